@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * Preset-dictionary trainer for the compressed output path
+ * (COMPRESS_DICT in ASTExporter.h). Small TU outputs compress poorly
+ * in isolation because each one repeats the same SDK header structures
+ * the corpus as a whole contains thousands of times; a dictionary of
+ * those shared byte sequences lets back-references reach out of the
+ * file from its first byte.
+ *
+ * Usage: ast_dict_train [-s max_bytes] <output.dict> <sample>...
+ *
+ * Samples are existing uncompressed captures (e.g. the ast_samples
+ * tree). Training counts fixed-size shingles across the corpus, keeps
+ * the recurring ones and packs them into the dictionary least-frequent
+ * first - zlib scores matches near the end of the window highest, so
+ * the most frequent sequences go last. The dictionary id (its
+ * Adler-32, the RFC 1950 DICTID a reader will see in the stream
+ * header) is printed on success; max_bytes defaults to 32768, the
+ * whole deflate window.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <zlib.h>
+
+namespace {
+
+// long enough to be a meaningful back-reference, short enough that SDK
+// structures repeated with small local edits still align on shingles
+const size_t shingleSize = 32;
+// counting every offset would mostly count self-overlaps of the same
+// run; a stride trades a little recall for corpus-sized memory
+const size_t shingleStride = 8;
+
+} // namespace
+
+int main(int argc, char **argv) {
+  size_t maxBytes = 32768;
+  int i = 1;
+  if (i + 1 < argc && strcmp(argv[i], "-s") == 0) {
+    maxBytes = strtoul(argv[i + 1], nullptr, 10);
+    i += 2;
+  }
+  if (argc - i < 2) {
+    std::cerr << "usage: " << argv[0]
+              << " [-s max_bytes] <output.dict> <sample>...\n";
+    return 1;
+  }
+  const std::string outputPath = argv[i++];
+
+  std::unordered_map<std::string, uint32_t> counts;
+  size_t corpusBytes = 0;
+  for (; i < argc; i++) {
+    std::ifstream in(argv[i], std::ios::binary);
+    if (!in) {
+      std::cerr << "[!] Cannot read sample " << argv[i] << "\n";
+      return 1;
+    }
+    std::ostringstream ss;
+    ss << in.rdbuf();
+    const std::string sample = ss.str();
+    corpusBytes += sample.size();
+    if (sample.size() < shingleSize) {
+      continue;
+    }
+    for (size_t off = 0; off + shingleSize <= sample.size();
+         off += shingleStride) {
+      counts[sample.substr(off, shingleSize)]++;
+    }
+  }
+
+  // recurring shingles only: a sequence seen once is file-local noise
+  std::vector<std::pair<uint32_t, const std::string *>> ranked;
+  for (const auto &entry : counts) {
+    if (entry.second >= 2) {
+      ranked.emplace_back(entry.second, &entry.first);
+    }
+  }
+  // most frequent last; ties broken by content for a deterministic dict
+  std::sort(ranked.begin(),
+            ranked.end(),
+            [](const std::pair<uint32_t, const std::string *> &a,
+               const std::pair<uint32_t, const std::string *> &b) {
+              return a.first != b.first ? a.first > b.first
+                                        : *a.second < *b.second;
+            });
+  if (ranked.size() * shingleSize > maxBytes) {
+    ranked.resize(maxBytes / shingleSize);
+  }
+  std::reverse(ranked.begin(), ranked.end());
+
+  std::string dictionary;
+  dictionary.reserve(maxBytes);
+  for (const auto &entry : ranked) {
+    // a shingle the dictionary already contains adds nothing new
+    if (dictionary.find(*entry.second) == std::string::npos) {
+      dictionary += *entry.second;
+    }
+  }
+
+  if (dictionary.empty()) {
+    std::cerr << "[!] No recurring sequences in the corpus; dictionary "
+                 "would be empty\n";
+    return 1;
+  }
+  std::ofstream out(outputPath, std::ios::binary | std::ios::trunc);
+  if (!out.write(dictionary.data(), dictionary.size())) {
+    std::cerr << "[!] Cannot write " << outputPath << "\n";
+    return 1;
+  }
+  uLong id = adler32(0L, Z_NULL, 0);
+  id = adler32(id, (const Bytef *)dictionary.data(), (uInt)dictionary.size());
+  printf("[+] %s: %zu bytes from a %zu-byte corpus, dictionary id %08lx\n",
+         outputPath.c_str(),
+         dictionary.size(),
+         corpusBytes,
+         (unsigned long)id);
+  return 0;
+}
@@ -31,3 +31,58 @@ static ASTLib::FrontendPluginRegistry::Add<ASTLib::YojsonExporterASTAction> Y(
 static ASTLib::FrontendPluginRegistry::Add<ASTLib::BiniouExporterASTAction> Z(
     "BiniouASTExporter",
     "Export the AST of source files into ATD-specified biniou data");
+
+static ASTLib::FrontendPluginRegistry::Add<
+    ASTLib::BiniouJsonTeeExporterASTAction>
+    ZT("BiniouJsonTeeASTExporter",
+       "Export the AST of source files into ATD-specified biniou data, "
+       "plus a JSON rendition of the same dump on a second stream");
+
+static ASTLib::FrontendPluginRegistry::Add<
+    ASTLib::BiniouSkeletonTeeExporterASTAction>
+    ZS("BiniouSkeletonTeeASTExporter",
+       "Export the AST of source files into ATD-specified biniou data, "
+       "plus a semantic fingerprint of the dump (pointers and source "
+       "ranges elided) on a second stream");
+
+static ASTLib::FrontendPluginRegistry::Add<
+    ASTLib::YojsonPipelineExporterASTAction>
+    YP("YojsonPipelineASTExporter",
+       "Export the AST of source files into ATD-specified Yojson data, "
+       "rendering the bytes on a second thread overlapped with the "
+       "traversal");
+
+static ASTLib::FrontendPluginRegistry::Add<
+    ASTLib::BiniouPipelineExporterASTAction>
+    ZP("BiniouPipelineASTExporter",
+       "Export the AST of source files into ATD-specified biniou data, "
+       "rendering the bytes on a second thread overlapped with the "
+       "traversal");
+
+static ASTLib::FrontendPluginRegistry::Add<ASTLib::FlatExporterASTAction> F(
+    "FlatASTExporter",
+    "Export the AST of source files into a flat, offset-based binary "
+    "format that consumers can mmap and navigate without deserializing");
+
+static ASTLib::FrontendPluginRegistry::Add<ASTLib::StatsExporterASTAction> S(
+    "ASTStatsExporter",
+    "Run the AST exporter traversal but emit only a histogram of node "
+    "counts and serialized-byte estimates per kind and per file");
+
+static ASTLib::FrontendPluginRegistry::Add<
+    ASTLib::JsonDeclOnlyExporterASTAction>
+    XD("JsonDeclsASTExporter",
+       "Export the AST of source files into ATD-specified Json data, "
+       "skipping function bodies");
+
+static ASTLib::FrontendPluginRegistry::Add<
+    ASTLib::YojsonDeclOnlyExporterASTAction>
+    YD("YojsonDeclsASTExporter",
+       "Export the AST of source files into ATD-specified Yojson data, "
+       "skipping function bodies");
+
+static ASTLib::FrontendPluginRegistry::Add<
+    ASTLib::BiniouDeclOnlyExporterASTAction>
+    ZD("BiniouDeclsASTExporter",
+       "Export the AST of source files into ATD-specified biniou data, "
+       "skipping function bodies");
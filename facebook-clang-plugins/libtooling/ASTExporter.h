@@ -28,7 +28,24 @@
  */
 
 #pragma once
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstring>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <set>
+#include <type_traits>
+#include <unordered_set>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <unistd.h>
 
 #include <clang/AST/ASTConsumer.h>
 #include <clang/AST/ASTContext.h>
@@ -50,13 +67,47 @@
 #include <clang/Frontend/FrontendDiagnostic.h>
 #include <clang/Frontend/FrontendPluginRegistry.h>
 
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/DenseSet.h>
+#include <llvm/ADT/FoldingSet.h>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/Twine.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Format.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/SHA1.h>
+#include <llvm/Support/StringSaver.h>
+#include <llvm/Support/ThreadPool.h>
+#include <llvm/Support/Threading.h>
+#include <llvm/Support/TimeProfiler.h>
 #include <llvm/Support/raw_ostream.h>
+#include <llvm/Support/thread.h>
 
+#include "AllocProfiler.h"
+#include "ArenaOStream.h"
+#include "AsyncOStream.h"
 #include "AttrParameterVectorStream.h"
+#include "CaptureProbes.h"
+#include "ChecksumOStream.h"
+#include "FrameOStream.h"
+#include "GzipOStream.h"
 #include "NamePrinter.h"
+#include "ParallelGzipOStream.h"
+#include "ShardedPtrTable.h"
 #include "SimplePluginASTAction.h"
+#include "SymbolBloom.h"
 #include "atdlib/ATDWriter.h"
 
+// Hash of the //@atd schema inlined in this file, stamped by the
+// Makefile (see ATD_SCHEMA_HASH there); emitted in the translation
+// unit header under SCHEMA_HASH=1 so readers can verify their
+// generated types match before taking a trusting parse path.
+#ifndef ATD_SCHEMA_HASH
+#define ATD_SCHEMA_HASH ""
+#endif
+
 //===----------------------------------------------------------------------===//
 // ASTExporter Visitor
 //===----------------------------------------------------------------------===//
@@ -66,10 +117,387 @@ namespace ASTLib {
 struct ASTExporterOptions : ASTPluginLib::PluginASTOptionsBase {
   bool withPointers = true;
   bool dumpComments = false;
+  // when non-empty, restricts dumpComments to decls of the listed kinds
+  // (variant names, e.g. "FunctionDecl,ObjCMethodDecl"); comments of
+  // other decls are never parsed, which is where the cost lies
+  std::unordered_set<std::string> commentKinds;
+  // With dumpComments: route comments to the <output>.comments sidecar
+  // instead of inlining full_comment fields into decl records, so the
+  // main stream stays dense for consumers that ignore comments. Rows
+  // pair the decl's pointer with its comment (see writeCommentSidecar);
+  // like the other sidecars this needs a plain-file output, so under a
+  // transport output the option is ignored and comments stay inline
+  bool commentSidecar = false;
+  // when non-empty, emit the lookup tables of exactly these decl
+  // contexts (qualified names, e.g. "std,myns::Widget") as a trailing
+  // value. Each component is resolved with a single targeted lookup and
+  // only the requested contexts have their tables walked, so asking for
+  // one namespace no longer completes the lazily-built lookup maps of
+  // the whole translation unit; external (PCH/module) decls are still
+  // never pulled in, which has_undeserialized_decls reports per context
+  std::set<std::string> lookupContexts;
   bool useMacroExpansionLocation = true;
+  // write the output file from a background thread, double-buffered
+  bool useAsyncOutput = false;
+  // gzip-compress the output stream in-process
+  bool compressOutput = false;
+  // compress on this many worker threads, as independent concatenated
+  // gzip members, so serialization of later decls overlaps compression
+  // of earlier chunks (any gzip reader still decompresses the result);
+  // 0 keeps the serial, single-member GzipOStream path
+  unsigned long compressThreads = 0;
+  // preset dictionary for the serial compressed path, trained from a
+  // corpus of existing captures by ast_dict_train; pays for the small
+  // TU outputs that repeat the corpus's SDK structures but are too
+  // short to rediscover them alone. Switches the output to the zlib
+  // wrapper, whose header carries the dictionary id (see GzipOStream.h)
+  std::string compressDictFile;
+  // buffer the whole output in memory and write it out once at the end
+  bool useArenaOutput = false;
+  // Predict the output size before serializing and pre-size the buffers
+  // that would otherwise grow by doubling (the arena's first chunk, the
+  // pinned whole-document biniou buffer, the flat regions): estimated
+  // bytes = AST-allocated KiB at the end of the parse times this factor.
+  // The ratio is stable per output configuration; measure it for a fleet
+  // with PHASE_STATS_FILE (output size over AST memory) or break it down
+  // with BINIOU_BYTE_STATS. 0 disables the prediction.
+  unsigned long outputBytesPerAstKb = 0;
+  // emit integer file ids in source locations and the id->path table
+  // as a trailing value, instead of repeating path strings
+  bool useFileTable = false;
+  // intern nested-name-specifier chains: qualified references emit an
+  // id into the chain table, which goes out as a trailing value, so a
+  // chain repeated across a namespace-heavy TU is emitted once
+  bool useSpecifierTable = false;
+  // reduce decl_ref records to kind and pointer: the inline name is
+  // dropped and each referenced decl's name goes out exactly once in
+  // the trailing ref-name table, keyed by decl_pointer, so a function
+  // called hundreds of times in a TU carries its qualified name once.
+  // Expression-heavy bodies are dominated by DeclRefExpr records, where
+  // the name is most of the bytes
+  bool refNameTable = false;
+  // reference a property's getter, setter and backing ivar by bare
+  // pointer instead of a full decl_ref: the synthesized accessor decls
+  // are dumped in the enclosing container anyway, so the property
+  // record does not need to re-serialize their names (UIKit-style
+  // interfaces carry hundreds of properties, two accessors each)
+  bool objcAccessorPointers = false;
+  // emit parameter lists as tables instead of per-parameter decl
+  // records: one row per parameter with fixed pointer/name/type/range
+  // columns, so biniou writes the field names once per function instead
+  // of once per parameter (TABLE_tag). A list containing a parameter
+  // that does not fit the columns (default argument, attributes, ...)
+  // keeps the detailed form
+  bool paramTable = false;
+  // memoize template specialization records: the first reference to a
+  // specialization dumps its argument list in full and registers it
+  // under an id, later references to the same specialization emit only
+  // the id. Template-heavy code re-serializes the same argument lists
+  // (and the types they pull in) many times per TU
+  bool dedupTemplateArgs = false;
+  // memoize base-class lists: the first class to show a given
+  // (bases, vbases, transitive vbases) combination dumps it in full and
+  // registers it under an id, later classes with the identical
+  // hierarchy emit only the id. CRTP chains repeat the same base lists
+  // across thousands of template specializations
+  bool dedupBaseLists = false;
+  // memoize ObjC protocol reference lists: the first interface,
+  // category, class extension or protocol to adopt a given list dumps
+  // it in full and registers it under an id, later holders of the
+  // identical list emit only the id. Heavily-categorized classes
+  // re-serialize the same protocol list once per category, each entry
+  // a full decl_ref
+  bool dedupProtocolLists = false;
+  // memoize availability attributes by value: the first occurrence of
+  // a (platform, introduced version) pair dumps the record and
+  // registers it under an id, later occurrences emit only the id.
+  // Apple SDK headers attach a near-identical availability attribute
+  // to almost every declaration
+  bool internAvailability = false;
+  // only mangle externally-visible declarations: internal-linkage
+  // functions, anonymous-namespace members and blocks never
+  // participate in cross-TU resolution, so their mangled names are
+  // computed, hashed and emitted for nothing. Their mangled_name
+  // fields are elided, and internal definitions stay out of the symbol
+  // bloom sidecar
+  bool mangleExternalOnly = false;
+  // give the begin and end slots of source ranges their own location
+  // delta streams, so endpoints shared with the enclosing node collapse
+  // to empty records; decoders must mirror the split-stream tracking
+  bool rangeDeltas = false;
+  // pack line and column into one field when the file is unchanged:
+  // packed = zigzag(line delta) * 4096 + column, with columns >= 4096
+  // escaping to the plain line/column fields. Location records dominate
+  // the stream, so dropping a field (and its hash, under biniou) from
+  // most of them compounds
+  bool packedLocDeltas = false;
+  // restrict the types table to types actually referenced by the dumped
+  // AST instead of every type uniqued in the ASTContext
+  bool onlyReferencedTypes = false;
+  // emit each qual_type as a single type_ptr with the three fast
+  // qualifier bits (const, volatile, restrict) folded into its low
+  // bits, instead of a record repeating them as flags next to the
+  // pointer; every type_ptr in the dump is folded, so readers recover
+  // the types-table key as type_ptr / 8 and the qualifiers from
+  // type_ptr mod 8
+  bool compactQualTypes = false;
+  // emit each pointer field as the signed difference from the
+  // previously emitted pointer id instead of the id itself. Ids are
+  // assigned in order of first appearance, so consecutive pointer
+  // fields are mostly ascending with small gaps and the delta fits one
+  // svint byte (biniou zigzags signed integers) where the absolute id
+  // takes three or four; pointer fields sit on virtually every record.
+  // Decoders must mirror the running id
+  bool pointerDeltas = false;
+  // only dump attributes whose kind is in the compile-time allowlist of
+  // kinds the reader consumes (isConsumedAttrKind); the long tail of
+  // SDK attribute kinds is dropped from attribute lists entirely
+  bool attrAllowlist = false;
+  // Emit an argument-less Null variant in null child positions (absent
+  // else branches, missing initializers) instead of dumping a sentinel
+  // NullStmt/EmptyDecl/Comment node through the full visitor; sentinels
+  // cost a complete serialized node apiece, millions of times per
+  // capture. Readers map Null to the placeholder they already build for
+  // the sentinel kinds
+  bool nullMarkers = false;
+  // emit integer literal values that fit in 64 bits as integers instead
+  // of decimal strings, skipping the APInt-to-string conversion
+  bool compactIntLiterals = false;
+  // Pack the boolean flag clusters of the biggest decl records
+  // (function_decl_info, var_decl_info) into a single ~flags bitmask
+  // field -- one field hash and a svint where each set flag otherwise
+  // costs a hashed field plus a tagged bool, on every decl record of
+  // the capture. Bit positions are schema (see FunctionDeclFlag and
+  // VarDeclFlag); readers see the format bit in the fingerprint
+  bool flagMasks = false;
+  // emit floating literals whose semantics convert to IEEE double
+  // without loss (i.e. all but long double and wider) as an ATD float
+  // -- a binary float64 in biniou, the shortest round-tripping decimal
+  // in the textual formats -- instead of the decimal string the
+  // annotation documents; readers see the format bit in the fingerprint
+  bool doubleLiterals = false;
+  // when clang can evaluate a global variable's initializer at compile
+  // time, emit the evaluated value plus a hash of the expression tree
+  // it replaces instead of the tree itself; config-table globals
+  // serialize as one value where thousands of nodes said the same thing
+  bool foldConstInits = false;
+  // attribute dump time to node kinds (cycle counters + node counts)
+  // and print a sorted profile to stderr when the TU is done
+  bool profileVisitors = false;
+  // hash mangled names and long template argument lists with XXH64
+  // (block hash, llvm::xxHash64) instead of byte-at-a-time fnv-1a;
+  // consumers must then recompute hashes with the matching xxh64_hash
+  // stub instead of fnv64_hash
+  bool useXXHash = false;
+  // continue statement dumping on a fresh thread (with its own stack)
+  // whenever the dumpStmt nesting exceeds this depth, so generated code
+  // with arbitrarily deep expressions cannot overflow the native stack.
+  // 0 disables the hand-off
+  unsigned long maxStmtRecursionDepth = 0;
+  // do not recurse into statements nested deeper than this: the subtree
+  // collapses into one SummarizedStmt node carrying its kind, child
+  // count and tree fingerprint (see dumpStmtSummary). Pathological
+  // generated expressions nest tens of thousands deep and downstream
+  // analyses give up on them anyway; the cap bounds worst-case capture
+  // time. Unlike maxStmtRecursionDepth this counts total nesting, not
+  // nesting per stack segment. 0 means no cap
+  unsigned long maxStmtDepth = 0;
+  // do not dump the children of initializer lists with more elements
+  // than this; the list is summarized by a count and a content hash
+  // instead (generated arrays routinely hold hundreds of thousands of
+  // literals). 0 means no cap
+  unsigned long maxInitListElems = 0;
+  // replace the per-constant decl records of enums with more constants
+  // than this by a columnar names/values table in enum_decl_info
+  // (generated thrift/protobuf enums carry tens of thousands of
+  // constants, and their shared location is the enum's own range).
+  // Enums with a constant wider than 64 bits keep the detailed form, so
+  // table values are always plain integers. 0 means no cap
+  unsigned long maxEnumConstants = 0;
+  // emit at most this many bytes of each string literal: longer
+  // literals keep their leading chunks only and are summarized by
+  // their full byte length and a content hash in expr_info (generated
+  // code embeds multi-megabyte base64 blobs whose tails no consumer
+  // reads). 0 means no cap; maxStringSize keeps chunking whatever is
+  // emitted
+  unsigned long maxLiteralBytes = 0;
+  // elide compiler-synthesized decls (default members, property
+  // accessors, ...) that no explicit code uses or references; decls
+  // referenced from dumped code are recovered through the dumpDeclRef
+  // queue where the decl list allows appending
+  bool skipUnusedImplicitDecls = false;
+  // for decl contexts backed by external storage (PCH, module files),
+  // dump only the decls that are already deserialized instead of
+  // forcing the whole context to load; the partial lists are flagged by
+  // has_external_lexical_storage in decl_context_info
+  bool noloadExternalDecls = false;
+  // dump only decls located in the main file, plus the transitive
+  // closure of decls they reference; everything else stays visible only
+  // through the inline decl_ref records at the reference sites (takes
+  // precedence over frameDecls for the decl list)
+  bool mainFileDeclsOnly = false;
+  // split the output into length-prefixed frames, one per top-level decl
+  // (plus a header and a trailer frame), so readers can parse
+  // incrementally; incompatible with the whole-document biniou modes
+  // (size backpatching, value/string sharing)
+  bool frameDecls = false;
+  // fingerprint each top-level decl (XXH64 of its frame payload) and
+  // append an index of (name, fingerprint, offset, length) rows as a
+  // trailing value, so incremental consumers can skip decls whose
+  // bytes did not change without re-reading them. Names are the hashed
+  // mangled name where the dump carries one, the qualified name
+  // otherwise. Only meaningful together with frameDecls
+  bool declIndex = false;
+  // emit full bodies only for top-level decls whose fingerprint differs
+  // from the previous capture of the same output path (read from the
+  // <output>.declidx sidecar the previous run left behind); the rest
+  // become reference stub frames carrying the fingerprint, with length
+  // 0 in the index. Decls are still serialized to compute their
+  // fingerprint, but unchanged bytes never reach the output or the
+  // downstream consumer. Implies declIndex; needs frameDecls
+  bool diffDecls = false;
+  // write a Bloom filter of the symbols this unit defines to the
+  // <output>.bloom sidecar (bodies only: function definitions and ObjC
+  // method implementations), keyed on the mangled_name strings the dump
+  // emits. Cross-unit symbol resolution probes the sidecars and skips
+  // the files that cannot define the name (see SymbolBloom.h)
+  bool symbolBloom = false;
+  // write one row per function definition and ObjC method
+  // implementation -- normalized file, begin line, end line, index name
+  // -- to the <output>.lines sidecar, sorted bytewise with zero-padded
+  // line numbers so byte order equals (file, line range) order. Mapping
+  // a changed line to the functions covering it is then a binary search
+  // over the rows, with no parsing of the dump on that path. Names
+  // follow declIndexName, so the rows join against decl records
+  bool lineIndex = false;
+  // emit the hash of the compiled-in //@atd schema (stamped by the
+  // Makefile from the same text extract_atd_from_cpp.py feeds the type
+  // generator) in the translation unit header. A reader generated from
+  // matching definitions can then skip its per-field presence checks,
+  // and a mismatched reader fails fast on the handshake instead of
+  // degrading every record parse. Builds outside the Makefile stamp ""
+  bool emitSchemaHash = false;
+  // reorder the translation unit's top-level decls into a canonical,
+  // content-derived order: grouped by originating file (headers sorted
+  // by path, the main file last), sorted by decl index name within a
+  // group. Source order interleaves headers, so a one-line edit shifts
+  // every later byte; canonical order keeps unchanged files
+  // byte-identical regions that delta compression and the header cache
+  // exploit. Only active on the materialized decl-list paths
+  // (frameDecls or parallelDecls); consumers must not rely on decl
+  // order
+  bool canonicalOrder = false;
+  // within each canonical-order file group, cluster decls by kind so
+  // the serializer works through runs of same-shaped nodes -- one
+  // dispatch target, warm branch predictors and instruction cache --
+  // instead of alternating between function, var and record layouts.
+  // The emitted->source position permutation of the top-level decls is
+  // published as a trailing table (see dumpDeclOrderTable) for
+  // consumers that need source order. Only meaningful with
+  // canonicalOrder
+  bool kindClusteredOrder = false;
+  // record which byte range of the framed output each originating file's
+  // decls landed in, one (file, offset, length) row per run of
+  // consecutive same-file decl frames, and leave the rows in the
+  // <output>.sections sidecar (pack.sections under pack: outputs, with
+  // unit-relative offsets). Partial loads then read only the sections of
+  // the files the analysis cares about instead of parsing the whole
+  // interleaved stream. Needs frameDecls; with canonicalOrder each file
+  // collapses to a single section. Only active on the inline framed
+  // path: the header cache emits reference stubs whose bytes live in
+  // external files, so no byte range of the output covers them
+  bool sectionIndex = false;
+  // Reserve a fixed 256-byte block at the very front of the output and
+  // patch it in place once the dump is complete with a section table:
+  // magic, then one (kind, offset, length) row for the decl stream and
+  // each trailing table, offsets relative to the first byte after the
+  // block (see LayoutSectionKind and buildLayoutHeader). Consumers can
+  // then mmap the block and madvise(WILLNEED) exactly the sections a
+  // partial load needs -- the index and one decl section -- instead of
+  // streaming the file; a zero magic marks a capture that died before
+  // the patch. Needs frameDecls for exact section boundaries, and the
+  // framed bytes must land in the file verbatim: compression, the
+  // validation footer and transport outputs disable it
+  bool layoutHeader = false;
+  // with frameDecls: every N closed top-level decl frames, push
+  // everything serialized so far towards the file and overwrite the
+  // <output>.ckpt marker in place with (completed decl frames, byte
+  // offset past the last complete frame) in a single pwrite, so the
+  // marker is never torn. Together with KEEP_PARTIAL, a capture killed
+  // mid-unit (OOM) leaves a salvageable prefix bounded by the last
+  // checkpoint instead of nothing. Only armed when no adapter between
+  // the framer and the file defers or transforms bytes (arena output,
+  // compression, async writing) and the output is a plain file. 0
+  // disables
+  unsigned long checkpointEvery = 0;
+  // append a fixed-size validation trailer (magic, byte count, crc32)
+  // to the output, so consumers detect truncated captures by reading 24
+  // bytes instead of re-parsing the whole file (see ChecksumOStream.h)
+  bool validationFooter = false;
+  // serialize each top-level decl the moment the parser finishes it
+  // (from HandleTopLevelDecl) instead of walking the whole unit at the
+  // end, overlapping the exporter's visitors with the parse; implicit
+  // decls the parser never hands over are swept up at the end of the
+  // unit, so the decl list holds the same entries in a different order
+  bool streamDecls = false;
+  // serialize the translation unit's top-level decls on this many worker
+  // threads once the parse is done, each into its own in-memory buffer,
+  // and splice the buffers into the decl list in the original order.
+  // 0 keeps serialization on the main thread
+  unsigned long parallelDecls = 0;
+  // directory where the decl blocks of included files are stored once per
+  // content digest; later TUs emit a reference frame instead of the block.
+  // Only active together with frameDecls, and one directory must not be
+  // shared between plugins emitting different formats
+  std::string headerCacheDir;
+  // directory of marker files recording which template specializations
+  // have already been exported, keyed by mangled name; later TUs drop
+  // them from their specialization lists instead of dumping the same
+  // bodies again
+  std::string specDedupDir;
+  // directory where the target configuration (triple and integer type
+  // widths) is published once per capture as <hash>.target; every
+  // translation_unit_decl then carries only the hash instead of
+  // re-serializing the identical record, and consumers parse the target
+  // info once
+  std::string targetManifestDir;
+  // where the JSON side of the tee exporter goes (see the
+  // BiniouJsonTee* actions); empty means next to the main output, with
+  // ".json" appended
+  std::string teeJsonFile;
+  // where the hash side of the skeleton tee exporter goes (see the
+  // BiniouSkeletonTee* action); empty means next to the main output,
+  // with ".skel" appended
+  std::string skeletonHashFile;
+  // append one JSON line per unit to this file, breaking wall time, CPU
+  // time and peak-RSS growth down into the parse, exporter-setup and
+  // dump phases, keyed by the (normalized) input path; meant for fleet
+  // aggregation without attaching a profiler. With STREAM_DECLS the
+  // parse phase necessarily includes the streamed serialization
+  std::string phaseStatsFile;
+  // append one tab-separated record per unit to this file -- normalized
+  // input path, hash of the main file contents, wall seconds, serialized
+  // bytes (before compression), peak RSS kb. The batch runner reads it
+  // back to start predicted-slow captures first (see ASTExporterBatch.cpp);
+  // the content hash lets readers discard records for edited files
+  std::string costDbFile;
+  // append one tab-separated row per unit to this ingestion manifest --
+  // output spec as given (pack: included), serialized bytes (before
+  // compression), decls dumped, hash of the main file contents,
+  // normalized input path -- so downstream consumers learn every
+  // produced output and its weight without a directory walk and a
+  // stat() per file. The batch runner appends suggested balanced shards
+  // to <manifest>.shards after the run (see ASTExporterBatch.cpp)
+  std::string manifestFile;
   ATDWriter::ATDWriterOptions atdWriterOptions = {
       .useYojson = false,
       .prettifyJson = true,
+      .biniouBackpatchSizes = false,
+      .biniouShareValues = false,
+      .biniouShareStrings = false,
+      .biniouByteStats = false,
+      .biniouNumVariants = false,
+      .expectedOutputBytes = 0,
   };
 
   void loadValuesFromEnvAndMap(
@@ -78,12 +506,339 @@ struct ASTExporterOptions : ASTPluginLib::PluginASTOptionsBase {
     loadBool(map, "AST_WITH_POINTERS", withPointers);
     loadBool(map, "USE_YOJSON", atdWriterOptions.useYojson);
     loadBool(map, "PRETTIFY_JSON", atdWriterOptions.prettifyJson);
+    loadBool(map,
+             "BINIOU_BACKPATCH_SIZES",
+             atdWriterOptions.biniouBackpatchSizes);
+    loadBool(map, "BINIOU_SHARE_VALUES", atdWriterOptions.biniouShareValues);
+    loadBool(map, "BINIOU_SHARE_STRINGS", atdWriterOptions.biniouShareStrings);
+    loadBool(map, "BINIOU_BYTE_STATS", atdWriterOptions.biniouByteStats);
+    loadBool(
+        map, "BINIOU_NUM_VARIANTS", atdWriterOptions.biniouNumVariants);
+    loadBool(map, "ASYNC_OUTPUT", useAsyncOutput);
+    loadBool(map, "FILE_TABLE", useFileTable);
+    loadBool(map, "RANGE_DELTAS", rangeDeltas);
+    loadBool(map, "PACKED_LOC_DELTAS", packedLocDeltas);
+    loadBool(map, "SPECIFIER_TABLE", useSpecifierTable);
+    loadBool(map, "REF_NAME_TABLE", refNameTable);
+    loadBool(map, "OBJC_ACCESSOR_POINTERS", objcAccessorPointers);
+    loadBool(map, "PARAM_TABLE", paramTable);
+    loadBool(map, "DEDUP_TEMPLATE_ARGS", dedupTemplateArgs);
+    loadBool(map, "DEDUP_BASE_LISTS", dedupBaseLists);
+    loadBool(map, "DEDUP_PROTOCOL_LISTS", dedupProtocolLists);
+    loadBool(map, "INTERN_AVAILABILITY", internAvailability);
+    loadBool(map, "MANGLE_EXTERNAL_ONLY", mangleExternalOnly);
+    loadBool(map, "ONLY_REFERENCED_TYPES", onlyReferencedTypes);
+    loadBool(map, "COMPACT_QUAL_TYPES", compactQualTypes);
+    loadBool(map, "POINTER_DELTAS", pointerDeltas);
+    loadBool(map, "ATTR_ALLOWLIST", attrAllowlist);
+    loadBool(map, "NULL_MARKERS", nullMarkers);
+    loadBool(map, "COMPACT_INT_LITERALS", compactIntLiterals);
+    loadBool(map, "DOUBLE_LITERALS", doubleLiterals);
+    loadBool(map, "FLAG_MASKS", flagMasks);
+    loadBool(map, "FOLD_CONST_INITS", foldConstInits);
+    loadBool(map, "USE_XXHASH", useXXHash);
+    loadBool(map, "PROFILE_VISITORS", profileVisitors);
+    loadUnsignedInt(map, "MAX_STMT_RECURSION_DEPTH", maxStmtRecursionDepth);
+    loadUnsignedInt(map, "MAX_STMT_DEPTH", maxStmtDepth);
+    loadUnsignedInt(map, "MAX_INIT_LIST_ELEMS", maxInitListElems);
+    loadUnsignedInt(map, "MAX_ENUM_CONSTANTS", maxEnumConstants);
+    loadUnsignedInt(map, "MAX_LITERAL_BYTES", maxLiteralBytes);
+    loadBool(map, "SKIP_UNUSED_IMPLICIT_DECLS", skipUnusedImplicitDecls);
+    loadBool(map, "NOLOAD_EXTERNAL_DECLS", noloadExternalDecls);
+    loadBool(map, "MAIN_FILE_DECLS_ONLY", mainFileDeclsOnly);
+    loadBool(map, "FRAME_DECLS", frameDecls);
+    loadBool(map, "DECL_INDEX", declIndex);
+    loadBool(map, "DIFF_DECLS", diffDecls);
+    if (diffDecls) {
+      // diffing needs the fingerprints and leaves an index for the next
+      // run to diff against
+      declIndex = true;
+    }
+    loadBool(map, "SYMBOL_BLOOM", symbolBloom);
+    loadBool(map, "LINE_INDEX", lineIndex);
+    loadBool(map, "SCHEMA_HASH", emitSchemaHash);
+    loadBool(map, "CANONICAL_ORDER", canonicalOrder);
+    loadBool(map, "KIND_CLUSTERED_ORDER", kindClusteredOrder);
+    loadBool(map, "SECTION_INDEX", sectionIndex);
+    loadBool(map, "LAYOUT_HEADER", layoutHeader);
+    loadUnsignedInt(map, "CHECKPOINT_EVERY", checkpointEvery);
+    loadBool(map, "VALIDATION_FOOTER", validationFooter);
+    loadBool(map, "STREAM_DECLS", streamDecls);
+    loadUnsignedInt(map, "PARALLEL_DECLS", parallelDecls);
+    loadString(map, "HEADER_CACHE_DIR", headerCacheDir);
+    loadString(map, "SPEC_DEDUP_DIR", specDedupDir);
+    loadString(map, "TARGET_MANIFEST_DIR", targetManifestDir);
+    loadString(map, "TEE_JSON_FILE", teeJsonFile);
+    loadString(map, "SKELETON_HASH_FILE", skeletonHashFile);
+    loadString(map, "PHASE_STATS_FILE", phaseStatsFile);
+    loadString(map, "COST_DB_FILE", costDbFile);
+    loadString(map, "MANIFEST_FILE", manifestFile);
+    loadBool(map, "COMPRESS_OUTPUT", compressOutput);
+    loadUnsignedInt(map, "COMPRESS_THREADS", compressThreads);
+    loadString(map, "COMPRESS_DICT", compressDictFile);
+    loadBool(map, "ARENA_OUTPUT", useArenaOutput);
+    loadUnsignedInt(map, "OUTPUT_BYTES_PER_AST_KB", outputBytesPerAstKb);
+    std::string lookupContextsArg;
+    if (loadString(map, "LOOKUP_CONTEXTS", lookupContextsArg)) {
+      // comma-separated list of qualified context names
+      size_t start = 0;
+      while (start <= lookupContextsArg.size()) {
+        size_t comma = lookupContextsArg.find(',', start);
+        if (comma == std::string::npos) {
+          comma = lookupContextsArg.size();
+        }
+        if (comma > start) {
+          lookupContexts.insert(lookupContextsArg.substr(start, comma - start));
+        }
+        start = comma + 1;
+      }
+    }
+    std::string commentKindsArg;
+    if (loadString(map, "COMMENT_KINDS", commentKindsArg)) {
+      // comma-separated list of decl variant names
+      size_t start = 0;
+      while (start <= commentKindsArg.size()) {
+        size_t comma = commentKindsArg.find(',', start);
+        if (comma == std::string::npos) {
+          comma = commentKindsArg.size();
+        }
+        if (comma > start) {
+          commentKinds.insert(commentKindsArg.substr(start, comma - start));
+        }
+        start = comma + 1;
+      }
+    }
+    loadBool(map, "COMMENT_SIDECAR", commentSidecar);
+  }
+
+  // Whether the configuration allows serializing top-level decls on
+  // worker threads. Every worker is an independent exporter over a
+  // read-only AST, so nothing may carry state across decls or mutate the
+  // context: the whole-document biniou modes, the trailing side tables,
+  // referenced-type tracking, lazy comment parsing and the mangling done
+  // for specialization dedup all do.
+  bool canParallelizeDecls() const {
+    return parallelDecls > 0 && !dumpComments && !useFileTable &&
+           !macroTable &&
+           !useSpecifierTable && !refNameTable && !dedupTemplateArgs &&
+           !dedupBaseLists && !dedupProtocolLists && !internAvailability &&
+           // evaluateValue memoizes into the (not thread-safe) ASTContext
+           !foldConstInits &&
+           !onlyReferencedTypes &&
+           // the running last-emitted id is cross-decl state
+           !pointerDeltas &&
+           headerCacheDir.empty() && specDedupDir.empty() &&
+           !atdWriterOptions.biniouBackpatchSizes &&
+           !atdWriterOptions.biniouShareValues &&
+           !atdWriterOptions.biniouShareStrings &&
+           !atdWriterOptions.biniouByteStats;
+  }
+
+  // Everything that changes the serialized form of a decl block. Mixed
+  // into the header-cache digest so captures made with incompatible
+  // settings never share a cache entry.
+  std::string formatFingerprint() const {
+    const bool bits[] = {withPointers,
+                         dumpComments,
+                         commentSidecar,
+                         useMacroExpansionLocation,
+                         macroTable,
+                         useFileTable,
+                         useSpecifierTable,
+                         refNameTable,
+                         objcAccessorPointers,
+                         paramTable,
+                         dedupTemplateArgs,
+                         dedupBaseLists,
+                         dedupProtocolLists,
+                         internAvailability,
+                         mangleExternalOnly,
+                         rangeDeltas,
+                         packedLocDeltas,
+                         compactIntLiterals,
+                         doubleLiterals,
+                         flagMasks,
+                         foldConstInits,
+                         onlyReferencedTypes,
+                         compactQualTypes,
+                         pointerDeltas,
+                         attrAllowlist,
+                         nullMarkers,
+                         noloadExternalDecls,
+                         mainFileDeclsOnly,
+                         atdWriterOptions.useYojson,
+                         atdWriterOptions.prettifyJson,
+                         atdWriterOptions.biniouNumVariants};
+    std::string fingerprint = "v1:";
+    for (bool b : bits) {
+      fingerprint += b ? '1' : '0';
+    }
+    return fingerprint;
   }
 };
 
 using namespace clang;
 using namespace clang::comments;
 
+// Precomputed biniou hashes for the hottest record field names, so that
+// BiniouEmitter does not hash the strings on every call (see ATDWriter::Tag).
+// Keep the spellings in sync with the ATD annotations below.
+namespace tags {
+// Variant names of the statement kinds that dominate dumped bodies, so
+// the biniou emitter does not hash the class-name string once per node
+// (see the fast paths in dumpStmt).
+constexpr ATDWriter::Tag DeclRefExprVariant("DeclRefExpr");
+constexpr ATDWriter::Tag ImplicitCastExprVariant("ImplicitCastExpr");
+constexpr ATDWriter::Tag IntegerLiteralVariant("IntegerLiteral");
+constexpr ATDWriter::Tag CallExprVariant("CallExpr");
+constexpr ATDWriter::Tag MemberExprVariant("MemberExpr");
+constexpr ATDWriter::Tag pointer("pointer");
+constexpr ATDWriter::Tag parent_pointer("parent_pointer");
+constexpr ATDWriter::Tag source_range("source_range");
+constexpr ATDWriter::Tag file("file");
+constexpr ATDWriter::Tag line("line");
+constexpr ATDWriter::Tag column("column");
+constexpr ATDWriter::Tag packed("packed");
+constexpr ATDWriter::Tag macro_file("macro_file");
+constexpr ATDWriter::Tag macro_line("macro_line");
+constexpr ATDWriter::Tag file_id("file_id");
+constexpr ATDWriter::Tag macro_file_id("macro_file_id");
+constexpr ATDWriter::Tag macro_id("macro_id");
+constexpr ATDWriter::Tag macro_offset("macro_offset");
+constexpr ATDWriter::Tag type_ptr("type_ptr");
+constexpr ATDWriter::Tag name("name");
+constexpr ATDWriter::Tag qual_name("qual_name");
+constexpr ATDWriter::Tag kind("kind");
+constexpr ATDWriter::Tag decl_pointer("decl_pointer");
+constexpr ATDWriter::Tag qual_type("qual_type");
+
+// Simple-variant spellings emitted once per node in hot visitors
+// (dumpAccessSpecifier, VisitVisibilityAttr). The unary/binary operator
+// opcode sets come out of OperationKinds.def and get function-local
+// pre-hashed tags at their switch cases instead of named constants here.
+// These sum types are closed, so the names carry their index in the ATD
+// declaration order and BINIOU_NUM_VARIANTS may encode them as one-byte
+// biniou num_variants; the indices are schema, keep them in sync with
+// the //@atd definitions (access_specifier, visibility_attr below).
+constexpr ATDWriter::NumTag PublicVariant("Public", 1);
+constexpr ATDWriter::NumTag ProtectedVariant("Protected", 2);
+constexpr ATDWriter::NumTag PrivateVariant("Private", 3);
+constexpr ATDWriter::NumTag NoneVariant("None", 0);
+constexpr ATDWriter::NumTag DefaultVisibilityVariant("DefaultVisibility", 0);
+constexpr ATDWriter::NumTag HiddenVisibilityVariant("HiddenVisibility", 1);
+constexpr ATDWriter::NumTag ProtectedVisibilityVariant("ProtectedVisibility",
+                                                       2);
+
+// Null-child marker shared by the decl, stmt and comment sums (see
+// nullMarkers); argument-less, so in biniou it is a bare name hash in
+// place of the whole sentinel node it replaces
+constexpr ATDWriter::Tag NullVariant("Null");
+
+// Stands in for a statement subtree capped by maxStmtDepth; carries the
+// subtree's kind, child count and fingerprint (see dumpStmtSummary)
+constexpr ATDWriter::Tag SummarizedStmtVariant("SummarizedStmt");
+
+// A hash collision between two names in one biniou scope would corrupt
+// the output silently. The registered constants above are checked
+// pairwise at compile time here (stronger than necessary - the hashes
+// only need to be unique per record - but free to check); the full
+// inlined ATD spec is checked by atdlib/check_biniou_hashes.py when
+// the OCaml bindings are generated from it.
+constexpr ATDWriter::Tag registeredTags[] = {
+    DeclRefExprVariant, ImplicitCastExprVariant, IntegerLiteralVariant,
+    CallExprVariant,    MemberExprVariant,       pointer,
+    parent_pointer,     source_range,            file,
+    line,               column,                  packed,
+    macro_file,         macro_line,              file_id,
+    macro_file_id,      macro_id,                macro_offset,
+    type_ptr,           name,                    qual_name,
+    kind,               decl_pointer,            qual_type,
+    PublicVariant,      ProtectedVariant,        PrivateVariant,
+    NoneVariant,        DefaultVisibilityVariant, HiddenVisibilityVariant,
+    ProtectedVisibilityVariant, NullVariant,
+    SummarizedStmtVariant,
+};
+
+constexpr bool registeredTagHashesAreDistinct() {
+  constexpr size_t numTags = sizeof(registeredTags) / sizeof(registeredTags[0]);
+  for (size_t i = 0; i < numTags; i++) {
+    for (size_t j = i + 1; j < numTags; j++) {
+      if (registeredTags[i].hash() == registeredTags[j].hash()) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+static_assert(registeredTagHashesAreDistinct(),
+              "biniou hash collision between registered tags");
+} // namespace tags
+
+// Section kinds of the layout header (see layoutHeader); the values are
+// wire format shared with the readers, so existing ones never change
+enum LayoutSectionKind : uint8_t {
+  LayoutDeclStream = 1,
+  LayoutFileTable = 2,
+  LayoutMacroTable = 3,
+  LayoutSpecifierTable = 4,
+  LayoutRefNameTable = 5,
+  LayoutDeclOrderTable = 6,
+  LayoutLookupTable = 7,
+  LayoutDeclIndexTable = 8,
+};
+
+// size of the zero placeholder reserved at the front of the output and
+// of the patched header block
+const size_t LayoutHeaderSize = 256;
+
+// Variant tag spellings for every attribute kind, indexed by attr::Kind
+// (the enum is generated from AttrList.inc in the same order). Having
+// them as compile-time tables turns the per-attribute tag switch, which
+// built a std::string each time, into a single array load.
+constexpr std::string_view attrTagTable[] = {
+#define ATTR(NAME) #NAME "Attr",
+#include <clang/Basic/AttrList.inc>
+};
+constexpr std::string_view attrKindTagTable[] = {
+#define ATTR(NAME) #NAME "AttrKind",
+#include <clang/Basic/AttrList.inc>
+};
+
+// Attribute kinds the downstream frontend actually consumes. Clang knows
+// several hundred kinds and SDK headers attach many of them to nearly
+// every declaration, but readers only ever look at this handful; under
+// ATTR_ALLOWLIST=1 attributes outside the set are skipped entirely --
+// no variant tag, no tuple -- with the enclosing lists counted to match.
+constexpr bool isConsumedAttrKind(attr::Kind kind) {
+  switch (kind) {
+  case attr::Annotate:
+  case attr::Availability:
+  case attr::CXX11NoReturn:
+  case attr::Deprecated:
+  case attr::NoReturn:
+  case attr::Sentinel:
+  case attr::Unavailable:
+  case attr::Visibility:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// the same predicate as a table indexed by attr::Kind, like the tag
+// tables above, so the per-attribute check is a single array load
+constexpr bool attrAllowlistTable[] = {
+#define ATTR(NAME) isConsumedAttrKind(attr::NAME),
+#include <clang/Basic/AttrList.inc>
+};
+
+// Tuple sizes are static information: the *TupleSize() call chains
+// resolve to per-kind constants, yet they used to be walked again for
+// every node dumped. Each dispatcher below computes a kind's size once
+// and serves repeat lookups from a table indexed by the kind value (0
+// marks a slot as not yet computed; every tuple has at least one
+// element). The kind enums are generated from the same .inc files as
+// the tables, so the kind value indexes straight into them.
 template <class Impl>
 struct TupleSizeBase {
   // Decls
@@ -95,7 +850,7 @@ struct TupleSizeBase {
 #define ABSTRACT_DECL(DECL) DECL
 #include <clang/AST/DeclNodes.inc>
 
-  int tupleSizeOfDeclKind(const Decl::Kind kind) {
+  int computeTupleSizeOfDeclKind(const Decl::Kind kind) {
     switch (kind) {
 #define DECL(DERIVED, BASE) \
   case Decl::DERIVED:       \
@@ -106,6 +861,22 @@ struct TupleSizeBase {
     llvm_unreachable("Decl that isn't part of DeclNodes.inc!");
   }
 
+  enum {
+    NumDeclKinds = 0
+#define DECL(DERIVED, BASE) +1
+#define ABSTRACT_DECL(DECL)
+#include <clang/AST/DeclNodes.inc>
+  };
+  int declTupleSizes[NumDeclKinds] = {};
+
+  int tupleSizeOfDeclKind(const Decl::Kind kind) {
+    int &size = declTupleSizes[kind];
+    if (size == 0) {
+      size = computeTupleSizeOfDeclKind(kind);
+    }
+    return size;
+  }
+
   // Stmts
 
 #define STMT(CLASS, PARENT)                                \
@@ -115,7 +886,7 @@ struct TupleSizeBase {
 #define ABSTRACT_STMT(STMT) STMT
 #include <clang/AST/StmtNodes.inc>
 
-  int tupleSizeOfStmtClass(const Stmt::StmtClass stmtClass) {
+  int computeTupleSizeOfStmtClass(const Stmt::StmtClass stmtClass) {
     switch (stmtClass) {
 #define STMT(CLASS, PARENT) \
   case Stmt::CLASS##Class:  \
@@ -128,6 +899,23 @@ struct TupleSizeBase {
     llvm_unreachable("Stmt that isn't part of StmtNodes.inc!");
   }
 
+  // stmt classes start at 1, after NoStmtClass
+  enum {
+    NumStmtClasses = 1
+#define STMT(CLASS, PARENT) +1
+#define ABSTRACT_STMT(STMT)
+#include <clang/AST/StmtNodes.inc>
+  };
+  int stmtTupleSizes[NumStmtClasses] = {};
+
+  int tupleSizeOfStmtClass(const Stmt::StmtClass stmtClass) {
+    int &size = stmtTupleSizes[stmtClass];
+    if (size == 0) {
+      size = computeTupleSizeOfStmtClass(stmtClass);
+    }
+    return size;
+  }
+
   // Comments
 
 #define COMMENT(CLASS, PARENT)                             \
@@ -137,7 +925,7 @@ struct TupleSizeBase {
 #define ABSTRACT_COMMENT(COMMENT) COMMENT
 #include <clang/AST/CommentNodes.inc>
 
-  int tupleSizeOfCommentKind(const Comment::CommentKind kind) {
+  int computeTupleSizeOfCommentKind(const Comment::CommentKind kind) {
     switch (kind) {
 #define COMMENT(CLASS, PARENT) \
   case Comment::CLASS##Kind:   \
@@ -150,6 +938,23 @@ struct TupleSizeBase {
     llvm_unreachable("Comment that isn't part of CommentNodes.inc!");
   }
 
+  // comment kinds start at 1, after NoCommentKind
+  enum {
+    NumCommentKinds = 1
+#define COMMENT(CLASS, PARENT) +1
+#define ABSTRACT_COMMENT(COMMENT)
+#include <clang/AST/CommentNodes.inc>
+  };
+  int commentTupleSizes[NumCommentKinds] = {};
+
+  int tupleSizeOfCommentKind(const Comment::CommentKind kind) {
+    int &size = commentTupleSizes[kind];
+    if (size == 0) {
+      size = computeTupleSizeOfCommentKind(kind);
+    }
+    return size;
+  }
+
   // Types
 
 #define TYPE(DERIVED, BASE)                              \
@@ -159,7 +964,7 @@ struct TupleSizeBase {
 #define ABSTRACT_TYPE(DERIVED, BASE) TYPE(DERIVED, BASE)
 #include <clang/AST/TypeNodes.inc>
 
-  int tupleSizeOfTypeClass(const Type::TypeClass typeClass) {
+  int computeTupleSizeOfTypeClass(const Type::TypeClass typeClass) {
     switch (typeClass) {
 #define TYPE(DERIVED, BASE) \
   case Type::DERIVED:       \
@@ -170,13 +975,29 @@ struct TupleSizeBase {
     llvm_unreachable("Type that isn't part of TypeNodes.def!");
   }
 
+  enum {
+    NumTypeClasses = 0
+#define TYPE(DERIVED, BASE) +1
+#define ABSTRACT_TYPE(DERIVED, BASE)
+#include <clang/AST/TypeNodes.inc>
+  };
+  int typeTupleSizes[NumTypeClasses] = {};
+
+  int tupleSizeOfTypeClass(const Type::TypeClass typeClass) {
+    int &size = typeTupleSizes[typeClass];
+    if (size == 0) {
+      size = computeTupleSizeOfTypeClass(typeClass);
+    }
+    return size;
+  }
+
   // Attributes
 
 #define ATTR(NAME) \
   int NAME##AttrTupleSize() { return 1; }
 #include <clang/Basic/AttrList.inc>
 
-  int tupleSizeOfAttrKind(const attr::Kind attrKind) {
+  int computeTupleSizeOfAttrKind(const attr::Kind attrKind) {
     switch (attrKind) {
 #define ATTR(NAME)       \
   case attr::Kind::NAME: \
@@ -185,10 +1006,570 @@ struct TupleSizeBase {
     }
     llvm_unreachable("Attr that isn't part of AttrList.inc!");
   }
+
+  enum {
+    NumAttrKinds = 0
+#define ATTR(NAME) +1
+#include <clang/Basic/AttrList.inc>
+  };
+  int attrTupleSizes[NumAttrKinds] = {};
+
+  int tupleSizeOfAttrKind(const attr::Kind attrKind) {
+    int &size = attrTupleSizes[attrKind];
+    if (size == 0) {
+      size = computeTupleSizeOfAttrKind(attrKind);
+    }
+    return size;
+  }
 };
 
 typedef ATDWriter::JsonWriter<raw_ostream> JsonWriter;
 
+// Writer fanning one traversal out to two streams: biniou on the main
+// output for the analyzer, prettified JSON on a second stream for
+// humans. Value sharing is decided by the caller once for both sides
+// (the JSON side always re-emits), so it is forced off on the biniou
+// side; string interning stays internal to BiniouEmitter and survives.
+class BiniouJsonTeeWriter
+    : public ATDWriter::TeeWriter<ATDWriter::BiniouEmitter<raw_ostream>,
+                                  ATDWriter::JsonEmitter<raw_ostream>> {
+  static ATDWriter::ATDWriterOptions biniouOptions(
+      ATDWriter::ATDWriterOptions opts) {
+    opts.biniouShareValues = false;
+    return opts;
+  }
+
+  // the JSON side is a debugging artifact: always plain prettified JSON
+  static ATDWriter::ATDWriterOptions jsonOptions(
+      ATDWriter::ATDWriterOptions opts) {
+    opts.useYojson = false;
+    opts.prettifyJson = true;
+    return opts;
+  }
+
+ public:
+  BiniouJsonTeeWriter(raw_ostream &os,
+                      raw_ostream &jsonOs,
+                      const ATDWriter::ATDWriterOptions opts)
+      : TeeWriter(ATDWriter::BiniouEmitter<raw_ostream>(os,
+                                                        biniouOptions(opts)),
+                  ATDWriter::JsonEmitter<raw_ostream>(jsonOs,
+                                                      jsonOptions(opts))) {}
+};
+
+// One traversal, dump plus fingerprint: biniou on the main output and
+// the skeleton hash - the dump with pointers and source ranges elided,
+// reduced to 64 bits - on a second stream (see SKELETON_HASH_FILE).
+// The hash side always re-emits shared values, so value sharing is
+// forced off on the biniou side to keep the tee in agreement.
+class BiniouSkeletonTeeWriter
+    : public ATDWriter::TeeWriter<
+          ATDWriter::BiniouEmitter<raw_ostream>,
+          ATDWriter::SkeletonHashEmitter<raw_ostream>> {
+  static ATDWriter::ATDWriterOptions biniouOptions(
+      ATDWriter::ATDWriterOptions opts) {
+    opts.biniouShareValues = false;
+    return opts;
+  }
+
+ public:
+  BiniouSkeletonTeeWriter(raw_ostream &os,
+                          raw_ostream &hashOs,
+                          const ATDWriter::ATDWriterOptions opts)
+      : TeeWriter(ATDWriter::BiniouEmitter<raw_ostream>(os,
+                                                        biniouOptions(opts)),
+                  ATDWriter::SkeletonHashEmitter<raw_ostream>(hashOs, opts)) {
+  }
+};
+
+// Pipelined renditions of the plain writers: the traversal thread only
+// tokenizes events, a render thread turns them into bytes (see
+// PipelineEmitter in atdlib/ATDWriter.h). Same output as the plain
+// writers, with rendering overlapped with the tree walk.
+class PipelinedJsonWriter
+    : public ATDWriter::PipelineWriter<ATDWriter::JsonEmitter<raw_ostream>> {
+ public:
+  PipelinedJsonWriter(raw_ostream &os, const ATDWriter::ATDWriterOptions opts)
+      : PipelineWriter(ATDWriter::JsonEmitter<raw_ostream>(os, opts)) {}
+};
+
+// The pipeline cannot answer enterSharedValue synchronously, so value
+// sharing is forced off; string interning stays internal to
+// BiniouEmitter and survives.
+class PipelinedBiniouWriter
+    : public ATDWriter::PipelineWriter<ATDWriter::BiniouEmitter<raw_ostream>> {
+  static ATDWriter::ATDWriterOptions biniouOptions(
+      ATDWriter::ATDWriterOptions opts) {
+    opts.biniouShareValues = false;
+    return opts;
+  }
+
+ public:
+  PipelinedBiniouWriter(raw_ostream &os, const ATDWriter::ATDWriterOptions opts)
+      : PipelineWriter(
+            ATDWriter::BiniouEmitter<raw_ostream>(os, biniouOptions(opts))) {}
+};
+
+// Emitter behind the ASTStatsExporter analysis tool: runs the regular
+// exporter traversal but writes no dump. Instead it accumulates, per
+// variant kind (FunctionDecl, CompoundStmt, BuiltinType, ...), per
+// originating file and for the whole unit, how many nodes were emitted
+// and how many bytes compact JSON would have spent on them, and writes
+// only that histogram -- itself JSON -- at EOF. Byte counts are
+// estimates (string escaping and float formatting are approximated) and
+// self-only: bytes of nested nodes are charged to the nested kind.
+// Nodes are attributed to the file current when their variant opens,
+// refined by the node's own source range, which the visitors emit
+// before any child. Meant to answer, per codebase, which pruning
+// options (comment elision, implicit decls, init-list caps, ...) would
+// actually pay, without eyeballing gigabytes of ast_samples.
+class StatsEmitter {
+  struct Stats {
+    uint64_t nodes = 0;
+    uint64_t selfBytes = 0;
+  };
+  struct Frame {
+    Stats *kind;
+    Stats *file;
+    uint64_t startBytes;
+    uint64_t childBytes = 0;
+    // a frame's file may only be refined until its first child opens
+    bool fileSettled = false;
+  };
+
+  raw_ostream &os_;
+  // sorted maps: node references are stable and the report comes out
+  // deterministic
+  std::map<std::string, Stats, std::less<>> kinds_;
+  std::map<std::string, Stats, std::less<>> files_;
+  std::vector<Frame> stack_;
+  // resolved lazily so the emitter stays safely copyable while idle
+  // (GenWriter takes it by value); all pointers into the maps are
+  // created only once emission has started
+  Stats *currentFile_ = nullptr;
+  uint64_t totalBytes_ = 0;
+  uint64_t totalNodes_ = 0;
+  bool nextStringIsFile_ = false;
+
+  Stats *fileStats(std::string_view name) {
+    auto it = files_.find(name);
+    if (it == files_.end()) {
+      it = files_.emplace(std::string(name), Stats()).first;
+    }
+    return &it->second;
+  }
+
+  // compact-JSON cost estimates, separator included
+  void addBytes(uint64_t n) { totalBytes_ += n; }
+
+  static uint64_t digits(int64_t val) {
+    uint64_t n = val < 0 ? 2 : 1;
+    for (uint64_t v = val < 0 ? -(uint64_t)val : (uint64_t)val; v >= 10;
+         v /= 10) {
+      n++;
+    }
+    return n;
+  }
+
+  void writeEscaped(std::string_view val) {
+    for (char c : val) {
+      if (c == '"' || c == '\\') {
+        os_ << '\\' << c;
+      } else if ((unsigned char)c < 0x20) {
+        os_ << llvm::format("\\u%04x", c);
+      } else {
+        os_ << c;
+      }
+    }
+  }
+
+  void writeSection(const char *name,
+                    const char *keyTag,
+                    const std::map<std::string, Stats, std::less<>> &stats) {
+    // largest self-byte footprint first
+    std::vector<const std::pair<const std::string, Stats> *> sorted;
+    for (const auto &entry : stats) {
+      if (entry.second.nodes > 0) {
+        sorted.push_back(&entry);
+      }
+    }
+    std::sort(sorted.begin(),
+              sorted.end(),
+              [](const auto *a, const auto *b) {
+                return a->second.selfBytes > b->second.selfBytes;
+              });
+    os_ << " \"" << name << "\": [\n";
+    bool first = true;
+    for (const auto *entry : sorted) {
+      os_ << (first ? "" : ",\n") << "  {\"" << keyTag << "\": \"";
+      writeEscaped(entry->first);
+      os_ << "\", \"nodes\": " << entry->second.nodes
+          << ", \"self_bytes\": " << entry->second.selfBytes << "}";
+      first = false;
+    }
+    os_ << "\n ]";
+  }
+
+ public:
+  // enum-like variants arrive as plain strings and are not counted as
+  // nodes
+  const bool shouldSimpleVariantsBeEmittedAsStrings = true;
+
+  StatsEmitter(raw_ostream &os, const ATDWriter::ATDWriterOptions opts)
+      : os_(os) {}
+
+  void emitEOF() {
+    os_ << "{\n \"total\": {\"nodes\": " << totalNodes_
+        << ", \"bytes\": " << totalBytes_ << "},\n";
+    writeSection("kinds", "kind", kinds_);
+    os_ << ",\n";
+    writeSection("files", "file", files_);
+    os_ << "\n}\n";
+  }
+  void flushOutput() {}
+  // sharing would hide exactly the repetition this tool measures
+  bool enterSharedValue(uint64_t key) { return true; }
+
+  void emitNull() {
+    nextStringIsFile_ = false;
+    addBytes(5);
+  }
+  void emitBoolean(bool val) {
+    nextStringIsFile_ = false;
+    addBytes(val ? 5 : 6);
+  }
+  void emitInteger(int64_t val) {
+    nextStringIsFile_ = false;
+    addBytes(digits(val) + 1);
+  }
+  void emitDouble(double val) {
+    nextStringIsFile_ = false;
+    addBytes(9);
+  }
+  void emitString(std::string_view val) {
+    if (nextStringIsFile_) {
+      nextStringIsFile_ = false;
+      currentFile_ = fileStats(val);
+      if (!stack_.empty() && !stack_.back().fileSettled) {
+        stack_.back().file = currentFile_;
+      }
+    }
+    addBytes(val.size() + 3);
+  }
+  void emitElementBytes(std::string_view val) {
+    nextStringIsFile_ = false;
+    addBytes(val.size() + 1);
+  }
+  // bulk arrays count like the equivalent per-element events
+  void emitIntegerArray(const int64_t *values, size_t numValues) {
+    enterArray((int)numValues);
+    for (size_t i = 0; i < numValues; i++) {
+      emitInteger(values[i]);
+    }
+    leaveArray();
+  }
+  void emitStringArray(const std::string_view *values, size_t numValues) {
+    enterArray((int)numValues);
+    for (size_t i = 0; i < numValues; i++) {
+      emitString(values[i]);
+    }
+    leaveArray();
+  }
+  void emitTag(std::string_view val) {
+    nextStringIsFile_ = (val == "file");
+    addBytes(val.size() + 4);
+  }
+  void emitTag(const ATDWriter::Tag &val) {
+    emitTag(std::string_view(val.str()));
+  }
+  void emitVariantTag(std::string_view val, bool hasArg) {
+    nextStringIsFile_ = false;
+    addBytes(val.size() + 3);
+    if (!stack_.empty()) {
+      stack_.back().fileSettled = true;
+    }
+    if (!currentFile_) {
+      // nodes seen before any location resolves, e.g. builtins
+      currentFile_ = fileStats("");
+    }
+    stack_.push_back(
+        {&kinds_[std::string(val)], currentFile_, totalBytes_});
+  }
+
+  void enterArray(int size) { addBytes(2); }
+  void enterArray() { addBytes(2); }
+  void leaveArray() {}
+  void enterObject(int size) { addBytes(2); }
+  void enterObject() { addBytes(2); }
+  void leaveObject() {}
+  void enterTable(int numRows) { addBytes(2); }
+  void leaveTable() {}
+  void enterTableRow(int size) { addBytes(2); }
+  void leaveTableRow() {}
+  void enterTuple(int size) { addBytes(2); }
+  void enterTuple() { addBytes(2); }
+  void leaveTuple() {}
+  void enterVariant() {}
+  void leaveVariant() {
+    Frame frame = stack_.back();
+    stack_.pop_back();
+    uint64_t total = totalBytes_ - frame.startBytes;
+    uint64_t self = total - frame.childBytes;
+    frame.kind->nodes++;
+    frame.kind->selfBytes += self;
+    frame.file->nodes++;
+    frame.file->selfBytes += self;
+    totalNodes_++;
+    if (!stack_.empty()) {
+      stack_.back().childBytes += total;
+    }
+  }
+};
+
+class StatsWriter : public ATDWriter::GenWriter<StatsEmitter> {
+ public:
+  StatsWriter(raw_ostream &os, const ATDWriter::ATDWriterOptions opts)
+      : GenWriter<StatsEmitter>(StatsEmitter(os, opts)) {}
+};
+
+// Per-kind visitor profile (PROFILE_VISITORS): every dumpDecl/dumpStmt/
+// dumpType/dumpComment dispatch is attributed to its node kind with a
+// cycle counter and a node count, cheap enough (timestamp read + array
+// increment) for production captures. Self time only: cycles spent in
+// nested dumps are charged to the nested kind, not the enclosing one.
+class VisitorProfiler {
+ public:
+  struct Entry {
+    const char *name = nullptr;
+    const char *category = nullptr;
+    uint64_t selfCycles = 0;
+    uint64_t count = 0;
+    // only written by the ALLOC_PROFILE build (see AllocProfiler.h);
+    // self-attributed like selfCycles, since entering a child frame
+    // redirects the slot
+    ASTPluginLib::AllocCounters allocs;
+  };
+
+ private:
+  struct Frame {
+    Entry *entry;
+    uint64_t start;
+    uint64_t childCycles = 0;
+    ASTPluginLib::AllocCounters *previousSlot = nullptr;
+  };
+  // indexed by the clang kind enums, which are small and dense
+  std::vector<Entry> declEntries;
+  std::vector<Entry> stmtEntries;
+  std::vector<Entry> typeEntries;
+  std::vector<Entry> commentEntries;
+  std::vector<Frame> stack_;
+
+  static uint64_t now() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    // cycle counter unavailable: fall back to nanoseconds
+    return (uint64_t)std::chrono::steady_clock::now()
+        .time_since_epoch()
+        .count();
+#endif
+  }
+
+  void enter(std::vector<Entry> &entries,
+             const char *category,
+             unsigned kind,
+             const char *name) {
+    if (entries.size() <= kind) {
+      entries.resize(kind + 1);
+    }
+    Entry &entry = entries[kind];
+    entry.name = name;
+    entry.category = category;
+    stack_.push_back({&entry, now()});
+    stack_.back().previousSlot =
+        ASTPluginLib::setAllocProfileSlot(&entry.allocs);
+  }
+
+  void leave() {
+    Frame frame = stack_.back();
+    stack_.pop_back();
+    ASTPluginLib::setAllocProfileSlot(frame.previousSlot);
+    uint64_t total = now() - frame.start;
+    frame.entry->selfCycles += total - frame.childCycles;
+    frame.entry->count++;
+    if (!stack_.empty()) {
+      stack_.back().childCycles += total;
+    }
+  }
+
+ public:
+  // RAII frame; a null profiler makes it a no-op, so call sites stay
+  // branch-cheap when profiling is off
+  class Scope {
+    VisitorProfiler *profiler_;
+
+   public:
+    Scope(VisitorProfiler *profiler,
+          std::vector<Entry> VisitorProfiler::*entries,
+          const char *category,
+          unsigned kind,
+          const char *name)
+        : profiler_(profiler) {
+      if (profiler_) {
+        profiler_->enter(profiler_->*entries, category, kind, name);
+      }
+    }
+    ~Scope() {
+      if (profiler_) {
+        profiler_->leave();
+      }
+    }
+  };
+
+  static constexpr std::vector<Entry> VisitorProfiler::*decls =
+      &VisitorProfiler::declEntries;
+  static constexpr std::vector<Entry> VisitorProfiler::*stmts =
+      &VisitorProfiler::stmtEntries;
+  static constexpr std::vector<Entry> VisitorProfiler::*types =
+      &VisitorProfiler::typeEntries;
+  static constexpr std::vector<Entry> VisitorProfiler::*comments =
+      &VisitorProfiler::commentEntries;
+
+  // sorted profile (self cycles, descending) to stderr
+  void report() const {
+    std::vector<const Entry *> sorted;
+    uint64_t totalCycles = 0;
+    uint64_t totalCount = 0;
+    uint64_t totalAllocBytes = 0;
+    for (const std::vector<Entry> *entries :
+         {&declEntries, &stmtEntries, &typeEntries, &commentEntries}) {
+      for (const Entry &entry : *entries) {
+        if (entry.count > 0) {
+          sorted.push_back(&entry);
+          totalCycles += entry.selfCycles;
+          totalCount += entry.count;
+          totalAllocBytes += entry.allocs.bytes;
+        }
+      }
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const Entry *a, const Entry *b) {
+      return a->selfCycles > b->selfCycles;
+    });
+    llvm::errs() << "=== visitor profile (" << totalCount << " nodes, "
+                 << totalCycles << " self cycles";
+    if (totalAllocBytes > 0) {
+      llvm::errs() << ", " << totalAllocBytes << " bytes allocated";
+    }
+    llvm::errs() << ") ===\n";
+    for (const Entry *entry : sorted) {
+      llvm::errs() << llvm::format("%5.1f%% %12" PRIu64 " cycles %9" PRIu64
+                                   " nodes %6" PRIu64 " cyc/node",
+                                   100.0 * entry->selfCycles / totalCycles,
+                                   entry->selfCycles,
+                                   entry->count,
+                                   entry->selfCycles / entry->count);
+      // allocation columns only exist in the ALLOC_PROFILE build, where
+      // operator new fills the counters (see AllocProfiler.h)
+      if (totalAllocBytes > 0) {
+        llvm::errs() << llvm::format(" %9" PRIu64 " allocs %12" PRIu64
+                                     " B %9" PRIu64 " frees",
+                                     entry->allocs.allocs,
+                                     entry->allocs.bytes,
+                                     entry->allocs.frees);
+      }
+      llvm::errs() << "  " << entry->name << entry->category << "\n";
+    }
+  }
+};
+
+// Everything dumpSourceLocation derives from a raw location, resolved
+// once and cached together: the expansion-, spelling- and
+// presumed-location queries each walk SourceManager tables, and the
+// locations of neighbouring AST nodes repeat (ranges share endpoints,
+// parents share locations with children), so macro-heavy code used to
+// pay the whole chain twice per node - once for the location itself
+// and once for its macro spelling.
+struct ResolvedLoc {
+  // presumed location of the (expansion) spelling: file/line/column
+  PresumedLoc PLoc;
+  // presumed location of the macro spelling: macro_file/macro_line;
+  // only resolved when isMacro, the sole case where it is dumped
+  PresumedLoc MLoc;
+  bool isMacro = false;
+};
+
+// The exporter heap that stays useful across translation units: the
+// arena slabs and the hash-table storage of the hot caches. The entries
+// themselves are Context-bound (keyed on decl, selector and location
+// identities of one TU), so a recycled block is cleared before reuse -
+// but clearing keeps the allocations, which is the point: a warm TU in
+// the daemon or the batch tool skips the allocator ramp-up a cold
+// exporter pays, while the Context-bound setup (mangler, null sentinel
+// nodes, name printer) is rebuilt per TU as it must be. Process-wide
+// and handed out under a lock, like PathNormalizationCache
+// (SimplePluginASTAction.h); concurrent exporters each hold their own
+// block, so the pool grows to the peak concurrency and stays there.
+class ExporterStatePool {
+ public:
+  struct State {
+    llvm::BumpPtrAllocator StringArena;
+    llvm::DenseMap<const void *, int> PointerMap;
+    llvm::DenseMap<uint64_t, ResolvedLoc> LocResolutionCache;
+    llvm::DenseMap<const NamedDecl *, llvm::StringRef> MangledNameCache;
+    llvm::DenseMap<const void *, llvm::StringRef> SelectorNameCache;
+    llvm::DenseMap<const Type *, const Type *> DesugarCache;
+
+    // drop the entries, keep the storage
+    void reset() {
+      PointerMap.clear();
+      LocResolutionCache.clear();
+      DesugarCache.clear();
+      // the string caches point into the arena, so they go together
+      MangledNameCache.clear();
+      SelectorNameCache.clear();
+      StringArena.Reset();
+    }
+  };
+
+  // RAII checkout: taken for the lifetime of one exporter, returned
+  // (cleared) to the pool when the exporter dies
+  class Lease {
+    std::unique_ptr<State> state_;
+
+   public:
+    Lease() : state_(acquire()) {}
+    ~Lease() { release(std::move(state_)); }
+    State *operator->() const { return state_.get(); }
+  };
+
+ private:
+  static std::unique_ptr<State> acquire() {
+    std::lock_guard<std::mutex> guard(poolMutex());
+    std::vector<std::unique_ptr<State>> &pool = freeStates();
+    if (!pool.empty()) {
+      std::unique_ptr<State> state = std::move(pool.back());
+      pool.pop_back();
+      return state;
+    }
+    return std::make_unique<State>();
+  }
+
+  static void release(std::unique_ptr<State> state) {
+    state->reset();
+    std::lock_guard<std::mutex> guard(poolMutex());
+    freeStates().push_back(std::move(state));
+  }
+
+  static std::mutex &poolMutex() {
+    static std::mutex mutex;
+    return mutex;
+  }
+  static std::vector<std::unique_ptr<State>> &freeStates() {
+    static std::vector<std::unique_ptr<State>> states;
+    return states;
+  }
+};
+
 template <class ATDWriter = JsonWriter>
 class ASTExporter : public ConstDeclVisitor<ASTExporter<ATDWriter>>,
                     public ConstStmtVisitor<ASTExporter<ATDWriter>>,
@@ -200,6 +1581,8 @@ class ASTExporter : public ConstDeclVisitor<ASTExporter<ATDWriter>>,
   typedef typename ATDWriter::ArrayScope ArrayScope;
   typedef typename ATDWriter::TupleScope TupleScope;
   typedef typename ATDWriter::VariantScope VariantScope;
+  typedef typename ATDWriter::TableScope TableScope;
+  typedef typename ATDWriter::TableRowScope TableRowScope;
   ATDWriter OF;
 
   ASTContext &Context;
@@ -220,21 +1603,263 @@ class ASTExporter : public ConstDeclVisitor<ASTExporter<ATDWriter>>,
   const Comment *const NullPtrComment;
 
   // Keep track of the last location we print out so that we can
-  // print out deltas from then on out.
-  const char *LastLocFilename;
-  unsigned LastLocLine;
-  unsigned LastLocColumn;
-
-  // Keep track of the last macro location we print out so that we can
-  // print out deltas from then on out.
-  const char *LastMacroLocFilename;
-  unsigned LastMacroLocLine;
+  // print out deltas from then on out. Under rangeDeltas the begin and
+  // end slots of source ranges each get their own delta stream (see
+  // dumpSourceRange), so the instances below evolve independently.
+  struct LocDeltaState {
+    const char *LastLocFilename = "";
+    unsigned LastLocLine = ~0U;
+    unsigned LastLocColumn = ~0U;
+    const char *LastMacroLocFilename = "";
+    unsigned LastMacroLocLine = ~0U;
+    // macroTable only: the last table reference emitted
+    int LastMacroId = -1;
+    int LastMacroOffset = -1;
+  };
+  LocDeltaState LocState;
+  LocDeltaState BeginLocState;
+  LocDeltaState EndLocState;
 
   // The \c FullComment parent of the comment being dumped.
   const FullComment *FC;
 
+  // Recycled heap shared with past and future exporters of this process
+  // (see ExporterStatePool); the members below alias into it so call
+  // sites read as before. The block comes back cleared, so per-TU
+  // determinism is untouched - only the storage is warm.
+  ExporterStatePool::Lease Recycled;
+
+  // Pointers are emitted as small dense ids, assigned in order of first
+  // appearance. Per-exporter state keeps the numbering deterministic for
+  // a given translation unit.
+  llvm::DenseMap<const void *, int> &PointerMap = Recycled->PointerMap;
+  int PointerCounter = 1;
+  // previously emitted pointer id (pointerDeltas only); ids follow
+  // first-appearance order, so the differences stay small
+  int LastEmittedPointerId = 0;
+
+  // Pointer ids shared by the worker exporters of a parallel decl dump:
+  // every worker must agree on the id of a node for cross-decl
+  // references to resolve. Insert-if-absent is lock-free (the hottest
+  // shared operation of the workers, see ShardedPtrTable.h); ids come
+  // from one shared counter, so they depend on scheduling but stay
+  // one-to-one.
+  struct PointerIdTable {
+    ASTPluginLib::ShardedPtrTable<int> map;
+    std::atomic<int> counter{1};
+    explicit PointerIdTable(size_t expectedEntries) : map(expectedEntries) {}
+  };
+  PointerIdTable *SharedPointerIds = nullptr;
+
+  // Serializes SourceManager queries from the worker exporters of a
+  // parallel decl dump: getPresumedLoc and friends memoize into
+  // non-atomic single-entry caches (LastLineNoFileIDQuery and company)
+  // and lazily build per-file line caches, so concurrent queries are a
+  // data race even though the AST itself is only read. Null outside
+  // parallel dumps; the per-exporter LocResolutionCache keeps lock
+  // traffic to one query per distinct location per worker.
+  std::mutex *SharedSourceManagerLock = nullptr;
+
+  // the lock above when set, otherwise an unlocked no-op
+  std::unique_lock<std::mutex> lockSourceManager() {
+    return SharedSourceManagerLock
+               ? std::unique_lock<std::mutex>(*SharedSourceManagerLock)
+               : std::unique_lock<std::mutex>();
+  }
+
+  // Under useFileTable, paths seen in source locations are numbered in
+  // order of first appearance; the table itself is emitted at the end.
+  // Keyed on the filename pointer like the normalization cache, since
+  // PresumedLoc filenames are stable for the lifetime of a TU.
+  llvm::DenseMap<const char *, int> FileIdMap;
+  std::vector<const std::string *> FileTable;
+
+  // Under Options.macroTable, macro definitions referenced by dumped
+  // locations are numbered in order of first appearance, keyed by their
+  // (normalized file, #define line); the id->definition table is
+  // emitted at the end like the file table. The definitions themselves
+  // come from the preprocessor (IncludeGraphHandler::MacroDefined),
+  // handed over by the consumer.
+  const ASTPluginLib::IncludeGraphData *PPData = nullptr;
+  std::map<std::pair<const std::string *, unsigned>, int> MacroIdMap;
+  struct MacroDefRow {
+    const std::string *name;
+    const std::string *file;
+    unsigned line;
+  };
+  std::vector<MacroDefRow> MacroDefTable;
+
+  // Under useSpecifierTable, qualifier chains are numbered in order of
+  // first appearance, keyed on the NestedNameSpecifier (uniqued in the
+  // ASTContext); the id->chain table is emitted at the end.
+  llvm::DenseMap<const NestedNameSpecifier *, int> SpecifierChainIdMap;
+  std::vector<NestedNameSpecifierLoc> SpecifierChainTable;
+
+  // Under refNameTable, decls whose reference records dropped the inline
+  // name, in first-reference order; their names are emitted once each by
+  // dumpRefNameTable at the end.
+  llvm::DenseSet<const NamedDecl *> RefNamedSet;
+  std::vector<const NamedDecl *> RefNamedDecls;
+
+  // Under dedupTemplateArgs, specialization argument lists are numbered
+  // in order of first appearance, keyed on the TemplateArgumentList
+  // address (clang shares one list across all redeclarations of a
+  // specialization); only the first record carries the arguments.
+  llvm::DenseMap<const TemplateArgumentList *, int> TemplateArgsIdMap;
+
+  // Under dedupBaseLists, base-class lists are numbered in order of
+  // first appearance, keyed by content (the base type pointers of the
+  // three sections, nullptr-separated) since clang does not share base
+  // specifiers between classes; only the first class carries the lists.
+  std::map<std::vector<const Type *>, int> BaseListIdMap;
+
+  // Under dedupProtocolLists, protocol reference lists are numbered in
+  // order of first appearance, keyed by content (every interface,
+  // category and protocol carries its own ObjCProtocolList copy, so
+  // there is no shared storage to key on); only the first holder dumps
+  // the list.
+  std::map<std::vector<const ObjCProtocolDecl *>, int> ProtocolListIdMap;
+
+  // Under internAvailability, (platform, introduced) availability pairs
+  // are numbered in order of first appearance; the platform identifier
+  // is uniqued in the ASTContext, so pointer identity keys its half.
+  // Only the first occurrence carries the record.
+  std::map<std::pair<const IdentifierInfo *, VersionTuple>, int>
+      AvailabilityIdMap;
+
+  // Under onlyReferencedTypes, every type referenced through
+  // dumpPointerToType is recorded here in first-reference order and only
+  // those types end up in the translation unit's types table.
+  llvm::DenseSet<const Type *> ReferencedTypeSet;
+  std::vector<const Type *> ReferencedTypes;
+
+  // Under mainFileDeclsOnly, decls referenced through dumpDeclRef are
+  // hoisted to their outermost ancestor below file scope and queued here
+  // in first-reference order; DumpedDecls guards against emitting a decl
+  // twice.
+  llvm::DenseSet<const Decl *> DumpedDecls;
+  llvm::DenseSet<const Decl *> ReferencedDeclSet;
+  std::vector<const Decl *> ReferencedDecls;
+
+  // Under commentSidecar, comments found while dumping decls are queued
+  // here instead of being inlined, and serialized into the sidecar
+  // document once the main dump is done (see writeCommentSidecar); the
+  // comment nodes live in the ASTContext, so the pointers stay valid.
+  std::vector<std::pair<const Decl *, const FullComment *>> SidecarComments;
+
+  // resolved-location cache of dumpSourceLocation (see ResolvedLoc)
+  llvm::DenseMap<uint64_t, ResolvedLoc> &LocResolutionCache =
+      Recycled->LocResolutionCache;
+
+  // Arena for strings that outlive their formatting: the cache values
+  // below are saved here once and referenced as StringRefs, so a cache
+  // rehash never moves the bytes and the per-entry std::string
+  // allocation disappears. Transient formatting elsewhere goes through
+  // stack SmallStrings instead, so neither path hits malloc per node.
+  // Reset wholesale when the exporter dies.
+  llvm::BumpPtrAllocator &StringArena = Recycled->StringArena;
+  llvm::StringSaver ArenaSaver{StringArena};
+
+  // Mangling runs the full Itanium mangler and is visibly hot on C++
+  // captures; redeclarations mangle to the same string, so memoize the
+  // emitted form per canonical decl.
+  llvm::DenseMap<const NamedDecl *, llvm::StringRef> &MangledNameCache =
+      Recycled->MangledNameCache;
+
+  // The same selectors recur tens of thousands of times in ObjC message
+  // sends, and Selector::getAsString allocates every time; stringify
+  // each selector once (keyed on its uniqued opaque pointer).
+  llvm::DenseMap<const void *, llvm::StringRef> &SelectorNameCache =
+      Recycled->SelectorNameCache;
+
+  // Memoized unqualified-desugar walks (see desugaredType): in
+  // typedef-heavy code every link of a desugar chain is itself a type in
+  // the table, so walking the chain per node is quadratic in its depth.
+  llvm::DenseMap<const Type *, const Type *> &DesugarCache =
+      Recycled->DesugarCache;
+
+  // set by the consumer under frameDecls; VisitDeclContext closes a frame
+  // after each top-level decl of the translation unit
+  ASTPluginLib::FrameOStream *FrameSink = nullptr;
+
+  // one row per top-level decl frame (declIndex only), dumped as a
+  // trailing value by dumpDeclIndexTable
+  struct DeclIndexEntry {
+    std::string name;
+    uint64_t fingerprint;
+    uint64_t offset;
+    uint64_t length;
+  };
+  std::vector<DeclIndexEntry> DeclIndex;
+
+  // one row per run of consecutive decl frames originating in the same
+  // file (sectionIndex only), dumped to the <output>.sections sidecar
+  struct SectionEntry {
+    std::string file;
+    uint64_t offset;
+    uint64_t length;
+  };
+  std::vector<SectionEntry> SectionIndex;
+
+  // one row per layout section (layoutHeader only): the decl stream,
+  // then each trailing table, tiling the framed stream in emission
+  // order (see closeLayoutSection)
+  struct LayoutEntry {
+    uint8_t kind;
+    uint64_t offset;
+    uint64_t length;
+  };
+  std::vector<LayoutEntry> LayoutSections;
+
+  // checkpoint state (checkpointEvery only): the marker fd stays open so
+  // a checkpoint is a flush plus one pwrite, and the streams between the
+  // frame sink and the file are flushed innermost first so the marked
+  // prefix is out of the process before the marker says so
+  int CheckpointFD = -1;
+  std::vector<llvm::raw_ostream *> CheckpointFlushChain;
+  uint64_t CompletedDeclFrames = 0;
+
+  // name -> fingerprint of the previous capture of this output path
+  // (diffDecls only); a name seen with two fingerprints is poisoned to
+  // 0 so it never matches
+  llvm::StringMap<uint64_t> PreviousDeclIndex;
+
+  // probe keys of the symbols this unit defines (symbolBloom only),
+  // collected where the dump emits their mangled names
+  llvm::DenseSet<uint64_t> DefinedSymbols;
+
+  // unsorted "file\tbegin\tend\tname" sidecar rows (lineIndex only),
+  // collected where the dump emits function bodies
+  std::vector<std::string> LineIndexRows;
+
+  // decls dumped by this exporter, nested ones included; a work-size
+  // proxy for the ingestion manifest (one increment per decl, so not
+  // worth gating on the option)
+  uint64_t DumpedDeclCount = 0;
+
+  // source index of each emitted top-level decl, recorded by
+  // canonicalizeDeclOrder under kindClusteredOrder and published as
+  // the decl_order_table trailing value
+  std::vector<int64_t> DeclOrderPermutation;
+
+  // Translation unit envelope held open between streaming calls, when
+  // the consumer feeds decls one at a time (streamDecls).
+  std::unique_ptr<VariantScope> StreamVariantScope;
+  std::unique_ptr<TupleScope> StreamTupleScope;
+  std::unique_ptr<ArrayScope> StreamArrayScope;
+
+  // dumpStmt nesting within the current stack segment (see
+  // maxStmtRecursionDepth)
+  unsigned StmtDepth = 0;
+  // dumpStmt nesting across stack segments (see maxStmtDepth); unlike
+  // StmtDepth this is not reset by the segment hand-off
+  unsigned TotalStmtDepth = 0;
+
   NamePrinter<ATDWriter> NamePrint;
 
+  // only consulted when Options.profileVisitors is set
+  VisitorProfiler Profiler;
+
  public:
   ASTExporter(raw_ostream &OS,
               ASTContext &Context,
@@ -249,13 +1874,424 @@ class ASTExporter : public ConstDeclVisitor<ASTExporter<ATDWriter>>,
             Context, Context.getTranslationUnitDecl(), SourceLocation())),
         NullPtrComment(new (Context) Comment(
             Comment::NoCommentKind, SourceLocation(), SourceLocation())),
-        LastLocFilename(""),
-        LastLocLine(~0U),
-        LastLocColumn(~0U),
-        LastMacroLocFilename(""),
-        LastMacroLocLine(~0U),
         FC(0),
-        NamePrint(Context.getSourceManager(), OF) {}
+        NamePrint(Context.getSourceManager(), OF, Opts.useXXHash) {}
+
+  // For writers that drive two streams at once (BiniouJsonTeeWriter);
+  // only instantiated for writer types with a matching constructor.
+  ASTExporter(raw_ostream &OS,
+              raw_ostream &SecondOS,
+              ASTContext &Context,
+              const ASTExporterOptions &Opts)
+      : OF(OS, SecondOS, Opts.atdWriterOptions),
+        Context(Context),
+        Options(Opts),
+        Mangler(
+            ItaniumMangleContext::create(Context, Context.getDiagnostics())),
+        NullPtrStmt(new (Context) NullStmt(SourceLocation())),
+        NullPtrDecl(EmptyDecl::Create(
+            Context, Context.getTranslationUnitDecl(), SourceLocation())),
+        NullPtrComment(new (Context) Comment(
+            Comment::NoCommentKind, SourceLocation(), SourceLocation())),
+        FC(0),
+        NamePrint(Context.getSourceManager(), OF, Opts.useXXHash) {}
+
+  ~ASTExporter() {
+    if (CheckpointFD >= 0) {
+      ::close(CheckpointFD);
+    }
+  }
+
+  void setFrameSink(ASTPluginLib::FrameOStream *sink) {
+    FrameSink = sink;
+    if (Options.declIndex) {
+      FrameSink->enableFrameDigests();
+    }
+  }
+
+  // how the decl index names D: the (hashed) mangled name the dump
+  // itself carries, so consumers can join the index against decl
+  // records; decls the mangler never saw fall back to their qualified
+  // name. Must run on the exporter whose visitors dumped D, since that
+  // is where the mangled-name cache filled up
+  std::string declIndexName(const Decl *D) const {
+    if (const auto *ND = dyn_cast<NamedDecl>(D)) {
+      llvm::StringRef mangled = MangledNameCache.lookup(
+          dyn_cast<NamedDecl>(ND->getCanonicalDecl()));
+      return mangled.empty() ? ND->getQualifiedNameAsString() : mangled.str();
+    }
+    return std::string();
+  }
+
+  // remember the frame just closed in the decl index
+  void recordDeclIndexEntry(std::string name) {
+    if (!Options.declIndex || !FrameSink) {
+      return;
+    }
+    DeclIndex.push_back({std::move(name),
+                         FrameSink->lastFrameDigest(),
+                         FrameSink->lastFrameOffset(),
+                         FrameSink->lastFrameLength()});
+  }
+
+  void recordDeclIndexEntry(const Decl *D) {
+    if (!Options.declIndex || !FrameSink) {
+      return;
+    }
+    recordDeclIndexEntry(declIndexName(D));
+  }
+
+  // close the frame holding one decl's bytes under diffDecls: a
+  // reference stub carrying the fingerprint when the bytes match the
+  // previous capture, a plain data frame otherwise
+  void closeDeclFrameDiffed(std::string name) {
+    if (!name.empty()) {
+      auto it = PreviousDeclIndex.find(name);
+      if (it != PreviousDeclIndex.end() && it->second != 0 &&
+          it->second == FrameSink->pendingFrameDigest()) {
+        SmallString<24> FingerprintBuf;
+        FrameSink->replacePendingFrame(
+            llvm::Twine(it->second).toStringRef(FingerprintBuf));
+        recordDeclIndexEntry(std::move(name));
+        return;
+      }
+    }
+    FrameSink->endFrame();
+    recordDeclIndexEntry(std::move(name));
+  }
+
+  // close the frame holding D's bytes, diffing against the previous
+  // capture when configured; teed blocks must stay complete for the
+  // header cache, so they are never stubbed out
+  void closeDeclFrame(const Decl *D) {
+    OF.flushOutput();
+    if (Options.diffDecls && !FrameSink->hasTee()) {
+      closeDeclFrameDiffed(declIndexName(D));
+    } else {
+      FrameSink->endFrame();
+      recordDeclIndexEntry(D);
+    }
+    ++CompletedDeclFrames;
+    if (CheckpointFD >= 0 &&
+        CompletedDeclFrames % Options.checkpointEvery == 0) {
+      writeCheckpoint();
+    }
+  }
+
+  // arm periodic checkpointing (checkpointEvery): markerPath is
+  // truncated now, so a marker from a previous capture of this output
+  // never outlives it, and flushChain holds the streams between the
+  // frame sink and the file, innermost first
+  void enableCheckpoints(const std::string &markerPath,
+                         std::vector<llvm::raw_ostream *> flushChain) {
+    CheckpointFD = ::open(
+        markerPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (CheckpointFD < 0) {
+      llvm::errs() << "[!] Failed to open checkpoint marker " << markerPath
+                   << "\n";
+      return;
+    }
+    CheckpointFlushChain = std::move(flushChain);
+  }
+
+  // push everything serialized so far to the operating system and
+  // overwrite the marker with what is now durable: the number of
+  // completed decl frames and the byte offset one past the last one.
+  // Both only grow, and the record is written in one pwrite at offset 0,
+  // so a reader never sees a torn or regressing marker
+  void writeCheckpoint() {
+    FrameSink->flush();
+    for (llvm::raw_ostream *S : CheckpointFlushChain) {
+      S->flush();
+    }
+    char marker[48];
+    int len = snprintf(marker,
+                       sizeof(marker),
+                       "%020llu\t%020llu\n",
+                       (unsigned long long)CompletedDeclFrames,
+                       (unsigned long long)(FrameSink->lastFrameOffset() +
+                                            FrameSink->lastFrameLength()));
+    if (len > 0 && ::pwrite(CheckpointFD, marker, (size_t)len, 0) < 0) {
+      // the capture itself is unaffected; the previous marker stands
+    }
+  }
+
+  // grow the section of D's originating file with the frame just closed,
+  // or start a new one when the file changes (sectionIndex only). Files
+  // are keyed the way canonicalizeDeclOrder groups decls, so under
+  // canonicalOrder every file ends up as exactly one section
+  void recordSectionEntry(const Decl *D) {
+    if (!Options.sectionIndex || !FrameSink) {
+      return;
+    }
+    const SourceManager &SM = Context.getSourceManager();
+    FileID FID = SM.getFileID(SM.getExpansionLoc(D->getLocation()));
+    const FileEntry *FE = SM.getFileEntryForID(FID);
+    // decls without a file (implicit, builtin) group under the empty path
+    std::string file =
+        FE ? Options.normalizeSourcePath(FE->getName()) : std::string();
+    uint64_t offset = FrameSink->lastFrameOffset();
+    uint64_t length = FrameSink->lastFrameLength();
+    if (!SectionIndex.empty() && SectionIndex.back().file == file) {
+      SectionIndex.back().length = offset + length - SectionIndex.back().offset;
+    } else {
+      SectionIndex.push_back({std::move(file), offset, length});
+    }
+  }
+
+  // pick up the (name, fingerprint) pairs the previous capture of this
+  // output left behind; silently absent on the first capture
+  void loadPreviousDeclIndex(const std::string &path) {
+    auto buffer = llvm::MemoryBuffer::getFile(path);
+    if (!buffer) {
+      return;
+    }
+    llvm::StringRef data = (*buffer)->getBuffer();
+    while (!data.empty()) {
+      std::pair<llvm::StringRef, llvm::StringRef> split = data.split('\n');
+      data = split.second;
+      llvm::SmallVector<llvm::StringRef, 4> fields;
+      split.first.split(fields, '\t');
+      uint64_t fingerprint;
+      if (fields.size() < 2 || fields[0].empty() ||
+          fields[1].getAsInteger(10, fingerprint)) {
+        continue;
+      }
+      auto res = PreviousDeclIndex.try_emplace(fields[0], fingerprint);
+      if (!res.second && res.first->second != fingerprint) {
+        res.first->second = 0;
+      }
+    }
+  }
+
+  // leave the index behind for the next capture of this output to diff
+  // against
+  void writeDeclIndexSidecar(const std::string &path) {
+    std::error_code EC;
+    llvm::raw_fd_ostream sidecar(path, EC);
+    if (EC) {
+      llvm::errs() << "[!] Failed to write decl index " << path << ": "
+                   << EC.message() << "\n";
+      return;
+    }
+    for (const DeclIndexEntry &entry : DeclIndex) {
+      sidecar << entry.name << '\t' << entry.fingerprint << '\t'
+              << entry.offset << '\t' << entry.length << '\n';
+    }
+  }
+
+  // refine this unit's pack index entry to decl granularity (pack:
+  // outputs, see PackOStream.h): one "source \t name \t offset \t
+  // length" line per decl frame, offsets relative to the unit's slice.
+  // Assembled into a single unbuffered O_APPEND write so concurrent
+  // captures interleave whole lines
+  void appendPackDeclIndex(const std::string &path,
+                           const std::string &source) {
+    std::string contents;
+    llvm::raw_string_ostream lines(contents);
+    for (const DeclIndexEntry &entry : DeclIndex) {
+      lines << source << '\t' << entry.name << '\t' << entry.offset << '\t'
+            << entry.length << '\n';
+    }
+    lines.flush();
+    std::error_code EC;
+    llvm::raw_fd_ostream index(path, EC, llvm::sys::fs::OF_Append);
+    if (EC) {
+      llvm::errs() << "[!] Failed to write pack decl index " << path << ": "
+                   << EC.message() << "\n";
+      return;
+    }
+    index.SetUnbuffered();
+    index.write(contents.data(), contents.size());
+  }
+
+  // Close the frame holding the layout section just emitted and record
+  // its row (layoutHeader only). Sections tile the framed stream: each
+  // row begins where the previous one ended, so the decl stream row --
+  // the first close, covering every decl frame plus the envelope
+  // remainder -- and the per-table rows need no bookkeeping beyond the
+  // framer's running position.
+  void closeLayoutSection(uint8_t kind) {
+    if (!Options.layoutHeader || !FrameSink) {
+      return;
+    }
+    uint64_t begin = LayoutSections.empty()
+                         ? 0
+                         : LayoutSections.back().offset +
+                               LayoutSections.back().length;
+    // push the emitter's buffered bytes into the framer first, so the
+    // boundary is exact
+    OF.flushOutput();
+    FrameSink->endFrame();
+    uint64_t end = FrameSink->framedBytes();
+    LayoutSections.push_back({kind, begin, end - begin});
+  }
+
+  // The patched content of the reserved front block (layoutHeader):
+  // the magic "ASTLAYT1", u32 header size, u32 section count, then
+  // 24-byte rows of u8 kind (7 bytes padding), u64 offset, u64 length,
+  // everything little-endian and offsets relative to the first byte
+  // after the block. The action patches it over the zero placeholder
+  // once the output has its final name (see ~SimplePluginASTActionBase)
+  std::string buildLayoutHeader() const {
+    std::string header(LayoutHeaderSize, '\0');
+    auto put32 = [&header](size_t at, uint32_t val) {
+      for (int i = 0; i < 4; i++) {
+        header[at + i] = (char)(val >> (8 * i));
+      }
+    };
+    auto put64 = [&header](size_t at, uint64_t val) {
+      for (int i = 0; i < 8; i++) {
+        header[at + i] = (char)(val >> (8 * i));
+      }
+    };
+    memcpy(&header[0], "ASTLAYT1", 8);
+    put32(8, (uint32_t)LayoutHeaderSize);
+    put32(12, (uint32_t)LayoutSections.size());
+    size_t at = 16;
+    for (const LayoutEntry &entry : LayoutSections) {
+      if (at + 24 > LayoutHeaderSize) {
+        break;
+      }
+      header[at] = (char)entry.kind;
+      put64(at + 8, entry.offset);
+      put64(at + 16, entry.length);
+      at += 24;
+    }
+    return header;
+  }
+
+  // leave the per-file section map behind (sectionIndex): one "file \t
+  // offset \t length" row per section, so partial loads seek straight to
+  // the byte ranges of the files they care about
+  void writeSectionIndexSidecar(const std::string &path) {
+    std::error_code EC;
+    llvm::raw_fd_ostream sidecar(path, EC);
+    if (EC) {
+      llvm::errs() << "[!] Failed to write section index " << path << ": "
+                   << EC.message() << "\n";
+      return;
+    }
+    for (const SectionEntry &entry : SectionIndex) {
+      sidecar << entry.file << '\t' << entry.offset << '\t' << entry.length
+              << '\n';
+    }
+  }
+
+  // refine this unit's pack index entry to section granularity (pack:
+  // outputs): one "source \t file \t offset \t length" line per section,
+  // offsets relative to the unit's slice, assembled into a single
+  // unbuffered O_APPEND write like appendPackDeclIndex
+  void appendPackSectionIndex(const std::string &path,
+                              const std::string &source) {
+    std::string contents;
+    llvm::raw_string_ostream lines(contents);
+    for (const SectionEntry &entry : SectionIndex) {
+      lines << source << '\t' << entry.file << '\t' << entry.offset << '\t'
+            << entry.length << '\n';
+    }
+    lines.flush();
+    std::error_code EC;
+    llvm::raw_fd_ostream index(path, EC, llvm::sys::fs::OF_Append);
+    if (EC) {
+      llvm::errs() << "[!] Failed to write pack section index " << path
+                   << ": " << EC.message() << "\n";
+      return;
+    }
+    index.SetUnbuffered();
+    index.write(contents.data(), contents.size());
+  }
+
+  // remember the line range of the body D just dumped (lineIndex only);
+  // name is what the dump called D, per declIndexName. Line numbers are
+  // zero-padded so the bytewise sort below matches numeric order
+  void recordLineIndexEntry(const Decl *D, llvm::StringRef name) {
+    SourceManager &SM = Context.getSourceManager();
+    SourceRange R = D->getSourceRange();
+    auto lock = lockSourceManager();
+    PresumedLoc Begin = SM.getPresumedLoc(SM.getExpansionLoc(R.getBegin()));
+    PresumedLoc End = SM.getPresumedLoc(SM.getExpansionLoc(R.getEnd()));
+    if (Begin.isInvalid() || End.isInvalid()) {
+      return;
+    }
+    std::string row;
+    llvm::raw_string_ostream OS(row);
+    OS << Options.normalizeSourcePath(Begin.getFilename()) << '\t'
+       << llvm::format("%08u", Begin.getLine()) << '\t'
+       << llvm::format("%08u", End.getLine()) << '\t' << name;
+    OS.flush();
+    LineIndexRows.push_back(std::move(row));
+  }
+
+  // leave the changed-lines index behind for the test determinator to
+  // binary-search (lineIndex only)
+  void writeLineIndexSidecar(const std::string &path) {
+    std::error_code EC;
+    llvm::raw_fd_ostream sidecar(path, EC);
+    if (EC) {
+      llvm::errs() << "[!] Failed to write line index " << path << ": "
+                   << EC.message() << "\n";
+      return;
+    }
+    std::sort(LineIndexRows.begin(), LineIndexRows.end());
+    for (const std::string &row : LineIndexRows) {
+      sidecar << row << '\n';
+    }
+  }
+
+  // The sidecar document of commentSidecar: an array of rows pairing a
+  // decl's pointer with its comment, in the same format and options as
+  // the main dump. A sub-exporter bound to the sidecar stream does the
+  // serialization; it shares this exporter's pointer ids the way
+  // dumpDeclsInParallel workers do, so row keys match the main stream's
+  // decl ids and comment-node ids extend the same id space. Runs after
+  // the main document is complete, so the ids handed out here need not
+  // be copied back. The comment_row type is declared with the comment
+  // sum at the end of the comment section.
+  void writeCommentSidecar(const std::string &path) {
+    std::error_code EC;
+    llvm::raw_fd_ostream sidecar(path, EC);
+    if (EC) {
+      llvm::errs() << "[!] Failed to write comment sidecar " << path << ": "
+                   << EC.message() << "\n";
+      return;
+    }
+    PointerIdTable pointerIds(PointerMap.size() + (1 << 16));
+    for (const auto &entry : PointerMap) {
+      pointerIds.map.getOrInsert(entry.first,
+                                 [&entry] { return entry.second; });
+    }
+    pointerIds.counter = PointerCounter;
+    ASTExporter<ATDWriter> sub(sidecar, Context, Options);
+    sub.SharedPointerIds = &pointerIds;
+    {
+      ArrayScope Scope(sub.OF, SidecarComments.size());
+      for (const auto &row : SidecarComments) {
+        ObjectScope oScope(sub.OF, 2);
+        sub.OF.emitTag(tags::decl_pointer);
+        sub.dumpPointer(row.first);
+        sub.OF.emitTag("comment");
+        sub.dumpFullComment(row.second);
+      }
+    }
+  }
+
+  // leave the filter of defined symbols behind for cross-unit
+  // resolution to probe (symbolBloom only)
+  void writeSymbolBloomSidecar(const std::string &path) {
+    std::error_code EC;
+    llvm::raw_fd_ostream sidecar(path, EC);
+    if (EC) {
+      llvm::errs() << "[!] Failed to write symbol filter " << path << ": "
+                   << EC.message() << "\n";
+      return;
+    }
+    SymbolBloom filter(DefinedSymbols.size());
+    for (uint64_t key : DefinedSymbols) {
+      filter.insert(key);
+    }
+    filter.write(sidecar);
+  }
 
   void dumpDecl(const Decl *D);
   void dumpStmt(const Stmt *S);
@@ -263,6 +2299,7 @@ class ASTExporter : public ConstDeclVisitor<ASTExporter<ATDWriter>>,
   void dumpType(const Type *T);
   void dumpPointerToType(const Type *T);
   void dumpQualTypeNoQuals(const QualType &qt);
+  const Type *desugaredType(const Type *T);
   void dumpClassLambdaCapture(const LambdaCapture *C);
   void dumpVersionTuple(const VersionTuple &VT);
 
@@ -270,20 +2307,51 @@ class ASTExporter : public ConstDeclVisitor<ASTExporter<ATDWriter>>,
   void dumpMacroLoc(bool is_macro,
                     bool is_different_macro_file,
                     bool is_different_macro_line,
-                    PresumedLoc MLoc);
+                    PresumedLoc MLoc,
+                    int macroId,
+                    int macroOffset);
+  std::pair<int, int> macroTableRef(const PresumedLoc &MLoc);
+  void dumpMacroDefinitionTable();
   void dumpPointer(const void *Ptr);
+  int pointerId(const void *Ptr);
+  void recordReferencedDecl(const Decl *D);
+  bool shouldSkipDecl(const Decl *D);
+  void dumpDeclsWithHeaderCache(const std::vector<const Decl *> &declsToDump);
+  void dumpDeclsInParallel(const std::vector<const Decl *> &declsToDump);
+  void canonicalizeDeclOrder(std::vector<const Decl *> &declsToDump);
+  void dumpDeclContextInfo(const DeclContext *DC);
+  void dumpTranslationUnitTrailer(const TranslationUnitDecl *D);
+  std::string writeTargetManifest();
+  void beginDeclStream(const TranslationUnitDecl *D);
+  void streamDecl(const Decl *D);
+  void endDeclStream(const TranslationUnitDecl *D);
+  bool specializationSeenElsewhere(const NamedDecl *spec);
+  bool shouldSummarizeInitList(const Stmt *S);
+  bool shouldTruncateStringLiteral(const Stmt *S);
+  void dumpStmtSummary(const Stmt *S);
+  bool shouldSummarizeEnum(const EnumDecl *D);
+  bool canTabulateParam(const VarDecl *D);
+  void dumpParamTableRow(const VarDecl *D);
+  const ResolvedLoc &resolveSourceLocation(SourceLocation Loc);
+  int fileId(const char *filename);
+  void dumpSourceFileTable();
+  void dumpDeclOrderTable();
   void dumpSourceRange(SourceRange R);
   void dumpSourceLocation(SourceLocation Loc);
+  void dumpSourceLocation(SourceLocation Loc, LocDeltaState &Last);
   void dumpQualType(const QualType &qt);
-  void dumpTypeOld(const Type *T);
   void dumpDeclRef(const Decl &Node);
   bool hasNodes(const DeclContext *DC);
   void dumpLookups(const DeclContext &DC);
+  void dumpLookupsTable();
+  const DeclContext *resolveLookupContext(const std::string &qualified);
   void dumpSelector(const Selector sel);
+  llvm::StringRef selectorName(const Selector sel);
   void dumpName(const NamedDecl &decl);
   void dumpInputKind(const InputKind kind);
   void dumpIntegerTypeWidths(const TargetInfo &info);
   void dumpVarDeclInfo(const VarDecl *D);
+  void dumpFoldedInit(const VarDecl *D, const APValue &Value);
 
   bool alwaysEmitParent(const Decl *D);
 
@@ -294,12 +2362,19 @@ class ASTExporter : public ConstDeclVisitor<ASTExporter<ATDWriter>>,
   void dumpCXXCtorInitializer(const CXXCtorInitializer &Init);
   void dumpDeclarationName(const DeclarationName &Name);
   void dumpNestedNameSpecifierLoc(NestedNameSpecifierLoc NNS);
+  int specifierChainId(NestedNameSpecifierLoc NNS);
+  void dumpSpecifierChainTable();
+  void dumpRefNameTable();
+  void dumpDeclIndexTable();
   void dumpTemplateArgument(const TemplateArgument &Arg);
   void dumpTemplateArguments(const TemplateArgumentList &Args);
   void dumpTemplateSpecialization(const TemplateDecl *D,
                                   const TemplateArgumentList &Args);
   void dumpCXXBaseSpecifier(const CXXBaseSpecifier &Base);
 
+  // sorted per-kind profile to stderr (PROFILE_VISITORS)
+  void dumpVisitorProfile() { Profiler.report(); }
+
 #define DECLARE_VISITOR(NAME) \
   int NAME##TupleSize();      \
   void Visit##NAME(const NAME *D);
@@ -482,6 +2557,10 @@ class ASTExporter : public ConstDeclVisitor<ASTExporter<ATDWriter>>,
 
   void dumpAttrKind(attr::Kind Kind);
   void dumpAttr(const Attr *A);
+  // callers size attribute lists with this before dumping each element
+  bool shouldDumpAttr(const Attr *A) {
+    return !Options.attrAllowlist || attrAllowlistTable[A->getKind()];
+  }
   DECLARE_VISITOR(Attr)
   DECLARE_VISITOR(AnnotateAttr)
   DECLARE_VISITOR(AvailabilityAttr)
@@ -491,6 +2570,16 @@ class ASTExporter : public ConstDeclVisitor<ASTExporter<ATDWriter>>,
   void dumpTypeAttr(AttributedType::Kind kind);
   void dumpObjCLifetimeQual(Qualifiers::ObjCLifetime qual);
 
+  /* Decision of planProtocolList (dedupProtocolLists): whether the
+     visitor dumps its inline protocols list, and the id to emit. */
+  struct ProtocolListPlan {
+    bool dumpList;
+    bool emitId;
+    int id;
+  };
+  ProtocolListPlan planProtocolList(const ObjCProtocolDecl *const *I,
+                                    const ObjCProtocolDecl *const *E);
+
   /* #define TYPE(CLASS, PARENT) DECLARE_VISITOR(CLASS##Type) */
   /* #define ABSTRACT_TYPE(CLASS, PARENT) */
   /* #include <clang/AST/TypeNodes.def> */
@@ -507,41 +2596,185 @@ bool hasMeaningfulTypeInfo(const Type *T) {
          T->isConstantSizeType();
 }
 
-std::unordered_map<const void *, int> pointerMap;
-int pointerCounter = 1;
-
 //@atd type pointer = int
+// (under POINTER_DELTAS each pointer field carries the signed
+// difference from the previously emitted pointer id; see
+// Options.pointerDeltas)
 template <class ATDWriter>
-void writePointer(ATDWriter &OF, bool withPointers, const void *Ptr) {
+int ASTExporter<ATDWriter>::pointerId(const void *Ptr) {
   if (!Ptr) {
-    OF.emitInteger(0);
-    return;
+    return 0;
   }
-  if (pointerMap.find(Ptr) == pointerMap.end()) {
-    pointerMap[Ptr] = pointerCounter++;
+  if (SharedPointerIds) {
+    return SharedPointerIds->map.getOrInsert(Ptr, [this] {
+      return SharedPointerIds->counter.fetch_add(1, std::memory_order_relaxed);
+    });
   }
-  OF.emitInteger(pointerMap[Ptr]);
+  auto res = PointerMap.try_emplace(Ptr, PointerCounter);
+  if (res.second) {
+    PointerCounter++;
+  }
+  return res.first->second;
 }
 
 template <class ATDWriter>
 void ASTExporter<ATDWriter>::dumpPointer(const void *Ptr) {
-  writePointer(OF, Options.withPointers, Ptr);
+  if (Options.pointerDeltas) {
+    // most deltas fit one svint byte where the absolute id takes three
+    // or four; null keeps its id 0, so its delta round-trips too
+    int id = pointerId(Ptr);
+    OF.emitInteger((int64_t)id - LastEmittedPointerId);
+    LastEmittedPointerId = id;
+    return;
+  }
+  OF.emitInteger(pointerId(Ptr));
+}
+
+template <class ATDWriter>
+const ResolvedLoc &ASTExporter<ATDWriter>::resolveSourceLocation(
+    SourceLocation Loc) {
+  auto res = LocResolutionCache.try_emplace(Loc.getRawEncoding());
+  ResolvedLoc &RL = res.first->second;
+  if (!res.second) {
+    return RL;
+  }
+  const SourceManager &SM = Context.getSourceManager();
+  auto lock = lockSourceManager();
+  SourceLocation ExpLoc =
+      Options.useMacroExpansionLocation ? SM.getExpansionLoc(Loc) : Loc;
+  RL.PLoc = SM.getPresumedLoc(SM.getSpellingLoc(ExpLoc));
+  SourceLocation MSourceLoc = SM.getSpellingLoc(Loc);
+  RL.isMacro = Loc.isMacroID() && !SM.isWrittenInBuiltinFile(MSourceLoc) &&
+               !SM.isWrittenInCommandLineFile(MSourceLoc) &&
+               !SM.isWrittenInScratchSpace(MSourceLoc);
+  if (RL.isMacro) {
+    RL.MLoc = SM.getPresumedLoc(MSourceLoc);
+  }
+  return RL;
+}
+
+template <class ATDWriter>
+int ASTExporter<ATDWriter>::fileId(const char *filename) {
+  auto res = FileIdMap.try_emplace(filename, (int)FileTable.size());
+  if (res.second) {
+    // normalizeSourcePath caches per filename pointer and hands back a
+    // reference that stays valid for the lifetime of the options
+    FileTable.push_back(&Options.normalizeSourcePath(filename));
+  }
+  return res.first->second;
+}
+
+//@atd type source_file_table = source_file list
+template <class ATDWriter>
+void ASTExporter<ATDWriter>::dumpSourceFileTable() {
+  // a pure leaf array, so the paths go out through the bulk primitive
+  SmallVector<std::string_view, 64> Paths;
+  Paths.reserve(FileTable.size());
+  for (const std::string *path : FileTable) {
+    Paths.push_back(*path);
+  }
+  OF.emitStringArray(Paths.data(), Paths.size());
+}
+
+// One row per top-level decl frame: the decl's name, the XXH64 of its
+// frame payload, and where the frame sits in the framed output stream.
+// Fingerprints are emitted as decimal strings like the hashed mangled
+// names they sit next to.
+//@atd type decl_index_entry = (string * string * int * int)
+//@atd type decl_index_table = decl_index_entry list
+template <class ATDWriter>
+void ASTExporter<ATDWriter>::dumpDeclIndexTable() {
+  ArrayScope Scope(OF, DeclIndex.size());
+  for (const DeclIndexEntry &entry : DeclIndex) {
+    TupleScope Scope(OF, 4);
+    OF.emitString(entry.name);
+    SmallString<24> FingerprintBuf;
+    OF.emitString(
+        llvm::Twine(entry.fingerprint).toStringRef(FingerprintBuf).str());
+    OF.emitInteger(entry.offset);
+    OF.emitInteger(entry.length);
+  }
+}
+
+// Resolve a macro spelling location to (table id, line offset into the
+// definition); {-1, 0} when the preprocessor never saw the definition
+// (precompiled headers, scratch buffers), in which case the caller
+// falls back to spelling file/line fields.
+template <class ATDWriter>
+std::pair<int, int> ASTExporter<ATDWriter>::macroTableRef(
+    const PresumedLoc &MLoc) {
+  if (!PPData) {
+    return {-1, 0};
+  }
+  const std::string &file = Options.normalizeSourcePath(MLoc.getFilename());
+  auto FI = PPData->macroDefinitions.find(&file);
+  if (FI == PPData->macroDefinitions.end() || FI->second.empty()) {
+    return {-1, 0};
+  }
+  // the definition whose #define line is closest above the spelling
+  // line; multi-line definitions spell their tokens below it
+  auto DI = FI->second.upper_bound(MLoc.getLine());
+  if (DI == FI->second.begin()) {
+    return {-1, 0};
+  }
+  --DI;
+  auto res = MacroIdMap.try_emplace(std::make_pair(&file, DI->first),
+                                    (int)MacroDefTable.size());
+  if (res.second) {
+    MacroDefTable.push_back({&DI->second, &file, DI->first});
+  }
+  return {res.first->second, (int)(MLoc.getLine() - DI->first)};
+}
+
+//@atd type macro_definition = (string * source_file * int)
+//@atd type macro_definition_table = macro_definition list
+template <class ATDWriter>
+void ASTExporter<ATDWriter>::dumpMacroDefinitionTable() {
+  ArrayScope Scope(OF, MacroDefTable.size());
+  for (const MacroDefRow &row : MacroDefTable) {
+    TupleScope RowScope(OF, 3);
+    OF.emitString(*row.name);
+    OF.emitString(*row.file);
+    OF.emitInteger(row.line);
+  }
 }
 
 template <class ATDWriter>
 void ASTExporter<ATDWriter>::dumpMacroLoc(bool is_macro,
                                           bool is_different_macro_file,
                                           bool is_different_macro_line,
-                                          PresumedLoc MLoc) {
+                                          PresumedLoc MLoc,
+                                          int macroId,
+                                          int macroOffset) {
   if (is_macro) {
     OF.emitFlag("is_macro", is_macro);
+    if (macroId >= 0) {
+      // table reference instead of spelling file/line: a changed id
+      // carries both fields, movement inside the definition only the
+      // offset, and a repeat nothing at all
+      if (is_different_macro_file) {
+        OF.emitTag(tags::macro_id);
+        OF.emitInteger(macroId);
+        OF.emitTag(tags::macro_offset);
+        OF.emitInteger(macroOffset);
+      } else if (is_different_macro_line) {
+        OF.emitTag(tags::macro_offset);
+        OF.emitInteger(macroOffset);
+      }
+      return;
+    }
     if (is_different_macro_file) {
-      OF.emitTag("macro_file");
-      OF.emitString(Options.normalizeSourcePath(MLoc.getFilename()));
-      OF.emitTag("macro_line");
+      if (Options.useFileTable) {
+        OF.emitTag(tags::macro_file_id);
+        OF.emitInteger(fileId(MLoc.getFilename()));
+      } else {
+        OF.emitTag(tags::macro_file);
+        OF.emitString(Options.normalizeSourcePath(MLoc.getFilename()));
+      }
+      OF.emitTag(tags::macro_line);
       OF.emitInteger(MLoc.getLine());
     } else if (is_different_macro_line) {
-      OF.emitTag("macro_line");
+      OF.emitTag(tags::macro_line);
       OF.emitInteger(MLoc.getLine());
     }
   }
@@ -552,22 +2785,28 @@ void ASTExporter<ATDWriter>::dumpMacroLoc(bool is_macro,
 //@atd   ?file <ocaml mutable> : source_file option;
 //@atd   ?line <ocaml mutable> : int option;
 //@atd   ?column <ocaml mutable> : int option;
+//@atd   ?packed <ocaml mutable> : int option;
 //@atd   ~is_macro: bool;
 //@atd   ?macro_file <ocaml mutable> : source_file option;
 //@atd   ?macro_line <ocaml mutable> : int option;
+//@atd   ?file_id <ocaml mutable> : int option;
+//@atd   ?macro_file_id <ocaml mutable> : int option;
+//@atd   ?macro_id <ocaml mutable> : int option;
+//@atd   ?macro_offset <ocaml mutable> : int option;
 //@atd } <ocaml field_prefix="sl_" validator="Clang_ast_visit.visit_source_loc">
 template <class ATDWriter>
 void ASTExporter<ATDWriter>::dumpSourceLocation(SourceLocation Loc) {
-  const SourceManager &SM = Context.getSourceManager();
-  SourceLocation ExpLoc =
-      Options.useMacroExpansionLocation ? SM.getExpansionLoc(Loc) : Loc;
-  SourceLocation SpellingLoc = SM.getSpellingLoc(ExpLoc);
+  dumpSourceLocation(Loc, LocState);
+}
 
+template <class ATDWriter>
+void ASTExporter<ATDWriter>::dumpSourceLocation(SourceLocation Loc,
+                                                LocDeltaState &Last) {
   // The general format we print out is filename:line:col, but we drop pieces
   // that haven't changed since the last loc printed.
-  PresumedLoc PLoc = SM.getPresumedLoc(SpellingLoc);
-  SourceLocation MSourceLoc = SM.getSpellingLoc(Loc);
-  PresumedLoc MLoc = SM.getPresumedLoc(MSourceLoc);
+  const ResolvedLoc &RL = resolveSourceLocation(Loc);
+  const PresumedLoc &PLoc = RL.PLoc;
+  const PresumedLoc &MLoc = RL.MLoc;
 
   if (PLoc.isInvalid()) {
     ObjectScope Scope(OF, 0);
@@ -575,64 +2814,139 @@ void ASTExporter<ATDWriter>::dumpSourceLocation(SourceLocation Loc) {
   }
   bool is_different_macro_file = false;
   bool is_different_macro_line = false;
-  bool is_macro = Loc.isMacroID() && !SM.isWrittenInBuiltinFile(MSourceLoc) &&
-                  !SM.isWrittenInCommandLineFile(MSourceLoc) &&
-                  !SM.isWrittenInScratchSpace(MSourceLoc);
+  bool is_macro = RL.isMacro;
+  int macroId = -1;
+  int macroOffset = 0;
   int macro_fields_count = is_macro;
   if (is_macro) {
-    if (strcmp(MLoc.getFilename(), LastMacroLocFilename) != 0) {
-      is_different_macro_file = true;
-      macro_fields_count += 2;
-    } else if (MLoc.getLine() != LastMacroLocLine) {
-      is_different_macro_line = true;
-      macro_fields_count += 1;
+    if (Options.macroTable) {
+      std::tie(macroId, macroOffset) = macroTableRef(MLoc);
+    }
+    if (macroId >= 0) {
+      // same delta discipline as the spelling fields below, against the
+      // table reference instead
+      if (macroId != Last.LastMacroId) {
+        is_different_macro_file = true;
+        macro_fields_count += 2;
+      } else if (macroOffset != Last.LastMacroOffset) {
+        is_different_macro_line = true;
+        macro_fields_count += 1;
+      }
+      Last.LastMacroId = macroId;
+      Last.LastMacroOffset = macroOffset;
+      // a later fallback site must not elide fields against state from
+      // before the table reference (and vice versa below): an empty
+      // record always means "same as the previous site of this kind"
+      Last.LastMacroLocFilename = "";
+      Last.LastMacroLocLine = ~0U;
+    } else {
+      if (strcmp(MLoc.getFilename(), Last.LastMacroLocFilename) != 0) {
+        is_different_macro_file = true;
+        macro_fields_count += 2;
+      } else if (MLoc.getLine() != Last.LastMacroLocLine) {
+        is_different_macro_line = true;
+        macro_fields_count += 1;
+      }
+      Last.LastMacroLocFilename = MLoc.getFilename();
+      Last.LastMacroLocLine = MLoc.getLine();
+      Last.LastMacroId = -1;
+      Last.LastMacroOffset = -1;
     }
-    LastMacroLocFilename = MLoc.getFilename();
-    LastMacroLocLine = MLoc.getLine();
   }
-  if (strcmp(PLoc.getFilename(), LastLocFilename) != 0) {
+  if (strcmp(PLoc.getFilename(), Last.LastLocFilename) != 0) {
     ObjectScope Scope(OF, 3 + macro_fields_count);
-    OF.emitTag("file");
-    // Normalizing filenames matters because the current directory may change
-    // during the compilation of large projects.
-    OF.emitString(Options.normalizeSourcePath(PLoc.getFilename()));
-    OF.emitTag("line");
+    if (Options.useFileTable) {
+      OF.emitTag(tags::file_id);
+      OF.emitInteger(fileId(PLoc.getFilename()));
+    } else {
+      OF.emitTag(tags::file);
+      // Normalizing filenames matters because the current directory may change
+      // during the compilation of large projects.
+      OF.emitString(Options.normalizeSourcePath(PLoc.getFilename()));
+    }
+    OF.emitTag(tags::line);
     OF.emitInteger(PLoc.getLine());
-    OF.emitTag("column");
+    OF.emitTag(tags::column);
     OF.emitInteger(PLoc.getColumn());
     dumpMacroLoc(
-        is_macro, is_different_macro_file, is_different_macro_line, MLoc);
-  } else if (PLoc.getLine() != LastLocLine) {
+        is_macro,
+        is_different_macro_file,
+        is_different_macro_line,
+        MLoc,
+        macroId,
+        macroOffset);
+  } else if (Options.packedLocDeltas && PLoc.getColumn() < 4096 &&
+             (PLoc.getLine() != Last.LastLocLine ||
+              PLoc.getColumn() != Last.LastLocColumn)) {
+    // one field for the common small movement within a file: the
+    // zigzag-folded line delta rides above the column's 12 bits, and
+    // columns that do not fit escape to the plain fields below
+    int64_t delta = (int64_t)PLoc.getLine() - (int64_t)Last.LastLocLine;
+    uint64_t folded = (uint64_t)((delta << 1) ^ (delta >> 63));
+    ObjectScope Scope(OF, 1 + macro_fields_count);
+    OF.emitTag(tags::packed);
+    OF.emitInteger((int64_t)(folded * 4096 + PLoc.getColumn()));
+    dumpMacroLoc(
+        is_macro,
+        is_different_macro_file,
+        is_different_macro_line,
+        MLoc,
+        macroId,
+        macroOffset);
+  } else if (PLoc.getLine() != Last.LastLocLine) {
     ObjectScope Scope(OF, 2 + macro_fields_count);
-    OF.emitTag("line");
+    OF.emitTag(tags::line);
     OF.emitInteger(PLoc.getLine());
-    OF.emitTag("column");
+    OF.emitTag(tags::column);
     OF.emitInteger(PLoc.getColumn());
     dumpMacroLoc(
-        is_macro, is_different_macro_file, is_different_macro_line, MLoc);
-  } else if (PLoc.getColumn() != LastLocColumn) {
+        is_macro,
+        is_different_macro_file,
+        is_different_macro_line,
+        MLoc,
+        macroId,
+        macroOffset);
+  } else if (PLoc.getColumn() != Last.LastLocColumn) {
     ObjectScope Scope(OF, 1 + macro_fields_count);
-    OF.emitTag("column");
+    OF.emitTag(tags::column);
     OF.emitInteger(PLoc.getColumn());
     dumpMacroLoc(
-        is_macro, is_different_macro_file, is_different_macro_line, MLoc);
+        is_macro,
+        is_different_macro_file,
+        is_different_macro_line,
+        MLoc,
+        macroId,
+        macroOffset);
   } else {
     ObjectScope Scope(OF, macro_fields_count);
     dumpMacroLoc(
-        is_macro, is_different_macro_file, is_different_macro_line, MLoc);
+        is_macro,
+        is_different_macro_file,
+        is_different_macro_line,
+        MLoc,
+        macroId,
+        macroOffset);
     return;
   }
-  LastLocFilename = PLoc.getFilename();
-  LastLocLine = PLoc.getLine();
-  LastLocColumn = PLoc.getColumn();
+  Last.LastLocFilename = PLoc.getFilename();
+  Last.LastLocLine = PLoc.getLine();
+  Last.LastLocColumn = PLoc.getColumn();
 }
 
 //@atd type source_range = (source_location * source_location)
 template <class ATDWriter>
 void ASTExporter<ATDWriter>::dumpSourceRange(SourceRange R) {
   TupleScope Scope(OF, 2);
-  dumpSourceLocation(R.getBegin());
-  dumpSourceLocation(R.getEnd());
+  if (Options.rangeDeltas) {
+    // nested nodes overwhelmingly share an endpoint with their parent or
+    // a sibling; a per-slot delta stream collapses the repeated begin or
+    // end location to an empty record
+    dumpSourceLocation(R.getBegin(), BeginLocState);
+    dumpSourceLocation(R.getEnd(), EndLocState);
+  } else {
+    dumpSourceLocation(R.getBegin());
+    dumpSourceLocation(R.getEnd());
+  }
 }
 
 //@atd type qual_type = {
@@ -641,6 +2955,8 @@ void ASTExporter<ATDWriter>::dumpSourceRange(SourceRange R) {
 //@atd   ~is_restrict : bool;
 //@atd   ~is_volatile : bool;
 //@atd } <ocaml field_prefix="qt_">
+// (under COMPACT_QUAL_TYPES the record above is replaced by a bare
+// folded type_ptr integer; see Options.compactQualTypes)
 template <class ATDWriter>
 void ASTExporter<ATDWriter>::dumpQualType(const QualType &qt) {
   clang::Qualifiers Quals =
@@ -648,8 +2964,27 @@ void ASTExporter<ATDWriter>::dumpQualType(const QualType &qt) {
   bool isConst = Quals.hasConst();
   bool isRestrict = Quals.hasRestrict();
   bool isVolatile = Quals.hasVolatile();
+  if (Options.compactQualTypes) {
+    // the whole reference is one integer: the qualifier flags ride in
+    // the low bits of the folded type_ptr (see dumpPointerToType), and
+    // no container wraps it. A bare svint is already smaller than a
+    // shared-value back pointer, so this path skips enterSharedValue
+    const Type *T = qt.getTypePtrOrNull();
+    if (Options.onlyReferencedTypes && T &&
+        ReferencedTypeSet.insert(T).second) {
+      ReferencedTypes.push_back(T);
+    }
+    OF.emitInteger(pointerId(T) * 8 + isConst * 4 + isVolatile * 2 +
+                   isRestrict);
+    return;
+  }
+  // the dump is a pure function of the opaque value, so repeated
+  // occurrences of common types can be shared when the writer supports it
+  if (!OF.enterSharedValue((uint64_t)(uintptr_t)qt.getAsOpaquePtr())) {
+    return;
+  }
   ObjectScope oScope(OF, 1 + isConst + isRestrict + isVolatile);
-  OF.emitTag("type_ptr");
+  OF.emitTag(tags::type_ptr);
   dumpQualTypeNoQuals(qt);
   OF.emitFlag("is_const", isConst);
   OF.emitFlag("is_restrict", isRestrict);
@@ -665,18 +3000,18 @@ void ASTExporter<ATDWriter>::dumpName(const NamedDecl &Decl) {
   // dump name
   ObjectScope oScope(OF, 2);
 
-  OF.emitTag("name");
+  OF.emitTag(tags::name);
 
   std::string name = Decl.getNameAsString();
   if (name.length() == 0) {
     const FieldDecl *FD = dyn_cast<FieldDecl>(&Decl);
     if (FD) {
-      name = "__anon_field_" + std::to_string(FD->getFieldIndex());
+      name = ("__anon_field_" + llvm::Twine(FD->getFieldIndex())).str();
     }
   }
   OF.emitString(name);
 
-  OF.emitTag("qual_name");
+  OF.emitTag(tags::qual_name);
   NamePrint.printDeclName(Decl);
 }
 
@@ -692,24 +3027,62 @@ void ASTExporter<ATDWriter>::dumpName(const NamedDecl &Decl) {
 #define ABSTRACT_DECL(DECL) DECL
 #include <clang/AST/DeclNodes.inc>
 //@atd ]
+template <class ATDWriter>
+void ASTExporter<ATDWriter>::recordReferencedDecl(const Decl *D) {
+  if (Options.mainFileDeclsOnly) {
+    // Hoist to the outermost enclosing decl below file scope: referenced
+    // members are exported together with their complete parent, while
+    // namespaces stay transparent so a single reference into a namespace
+    // does not pull the whole namespace in.
+    const DeclContext *DC = D->getDeclContext();
+    while (DC && !DC->isFileContext() && !isa<LinkageSpecDecl>(DC)) {
+      D = cast<Decl>(DC);
+      DC = D->getDeclContext();
+    }
+  }
+  if (ReferencedDeclSet.insert(D).second) {
+    ReferencedDecls.push_back(D);
+  }
+}
+
+template <class ATDWriter>
+bool ASTExporter<ATDWriter>::shouldSkipDecl(const Decl *D) {
+  // Compiler-synthesized decls that no explicit code uses: sema's used
+  // and referenced bits record exactly the references made from written
+  // code, so no separate pass over the AST is needed.
+  return Options.skipUnusedImplicitDecls && D->isImplicit() &&
+         !D->isUsed() && !D->isThisDeclarationReferenced();
+}
+
 template <class ATDWriter>
 void ASTExporter<ATDWriter>::dumpDeclRef(const Decl &D) {
+  if (Options.mainFileDeclsOnly || Options.skipUnusedImplicitDecls) {
+    recordReferencedDecl(&D);
+  }
   const NamedDecl *ND = dyn_cast<NamedDecl>(&D);
   const ValueDecl *VD = dyn_cast<ValueDecl>(&D);
   bool IsHidden = ND && !ND->isUnconditionallyVisible();
-  ObjectScope Scope(OF, 2 + (bool)ND + (bool)VD + IsHidden);
+  bool InlineName = ND && !Options.refNameTable;
+  ObjectScope Scope(OF, 2 + InlineName + (bool)VD + IsHidden);
 
-  OF.emitTag("kind");
+  OF.emitTag(tags::kind);
   OF.emitSimpleVariant(D.getDeclKindName());
-  OF.emitTag("decl_pointer");
+  OF.emitTag(tags::decl_pointer);
   dumpPointer(&D);
   if (ND) {
-    OF.emitTag("name");
-    dumpName(*ND);
+    if (Options.refNameTable) {
+      // the name goes out once, in the trailing table keyed by pointer
+      if (RefNamedSet.insert(ND).second) {
+        RefNamedDecls.push_back(ND);
+      }
+    } else {
+      OF.emitTag(tags::name);
+      dumpName(*ND);
+    }
     OF.emitFlag("is_hidden", IsHidden);
   }
   if (VD) {
-    OF.emitTag("qual_type");
+    OF.emitTag(tags::qual_type);
     dumpQualType(VD->getType());
   }
 }
@@ -730,34 +3103,390 @@ void ASTExporter<ATDWriter>::VisitDeclContext(const DeclContext *DC) {
     { ObjectScope Scope(OF, 0); }
     return;
   }
-  {
-    std::vector<Decl *> declsToDump;
-    for (auto I : DC->decls()) {
-      declsToDump.push_back(I);
+  // A context backed by a PCH or module file deserializes its whole
+  // lexical contents the moment decls() is iterated, defeating the point
+  // of the PCH. Under noloadExternalDecls only what is already loaded
+  // gets dumped; the has_external_lexical_storage flag emitted below
+  // marks the list as partial, pointing consumers back at the PCH.
+  bool noload = Options.noloadExternalDecls && DC->hasExternalLexicalStorage();
+  DeclContext::decl_range declsRange =
+      noload ? DC->noload_decls() : DC->decls();
+  if (Options.mainFileDeclsOnly && isa<TranslationUnitDecl>(DC)) {
+    ArrayScope Scope(OF);
+    const SourceManager &SM = Context.getSourceManager();
+    for (auto I : declsRange) {
+      if (shouldSkipDecl(I)) {
+        continue;
+      }
+      if (SM.isInMainFile(SM.getExpansionLoc(I->getLocation()))) {
+        dumpDecl(I);
+      }
+    }
+    if (Context.getObjCInstanceType().getTypePtrOrNull()) {
+      dumpDecl(Context.getObjCInstanceTypeDecl());
+    }
+    // Transitive closure of referenced header decls: dumping one can
+    // reference further decls, so the queue grows until a fixpoint.
+    // Anything never enqueued remains described only by the decl_refs at
+    // its reference sites.
+    for (size_t i = 0; i < ReferencedDecls.size(); i++) {
+      if (!DumpedDecls.count(ReferencedDecls[i])) {
+        dumpDecl(ReferencedDecls[i]);
+      }
+    }
+  } else if (Options.canParallelizeDecls() && isa<TranslationUnitDecl>(DC)) {
+    std::vector<const Decl *> declsToDump;
+    for (auto I : declsRange) {
+      if (!shouldSkipDecl(I)) {
+        declsToDump.push_back(I);
+      }
+    }
+    /* Some typedefs are not part of AST. 'instancetype' is one of them.
+    Export it nevertheless as part of TranslationUnitDecl context. */
+    if (Context.getObjCInstanceType().getTypePtrOrNull()) {
+      declsToDump.push_back(Context.getObjCInstanceTypeDecl());
+    }
+    if (Options.canonicalOrder) {
+      canonicalizeDeclOrder(declsToDump);
+    }
+    dumpDeclsInParallel(declsToDump);
+  } else if (FrameSink && isa<TranslationUnitDecl>(DC)) {
+    // Materialize the children to size the array up front: with an exact
+    // count the biniou emitter writes elements straight through instead of
+    // capturing the whole array, so the stream can be cut at decl
+    // boundaries.
+    std::vector<const Decl *> declsToDump;
+    for (auto I : declsRange) {
+      if (!shouldSkipDecl(I)) {
+        declsToDump.push_back(I);
+      }
     }
     /* Some typedefs are not part of AST. 'instancetype' is one of them.
     Export it nevertheless as part of TranslationUnitDecl context. */
     // getObjCInstanceType() should return null type when 'instancetype' is not
     // known yet - it doesn't work this way due to bug in clang, but keep
     // the check for when the bug is fixed.
-    if (isa<TranslationUnitDecl>(DC) &&
-        Context.getObjCInstanceType().getTypePtrOrNull()) {
+    if (Context.getObjCInstanceType().getTypePtrOrNull()) {
       declsToDump.push_back(Context.getObjCInstanceTypeDecl());
     }
-    ArrayScope Scope(OF, declsToDump.size());
-    for (auto I : declsToDump) {
+    if (Options.canonicalOrder) {
+      canonicalizeDeclOrder(declsToDump);
+    }
+    if (!Options.headerCacheDir.empty()) {
+      dumpDeclsWithHeaderCache(declsToDump);
+    } else {
+      ArrayScope Scope(OF, declsToDump.size());
+      // everything up to the start of the decl list is the header frame
+      OF.flushOutput();
+      FrameSink->endFrame();
+      for (const Decl *I : declsToDump) {
+        dumpDecl(I);
+        closeDeclFrame(I);
+        recordSectionEntry(I);
+      }
+    }
+  } else if (Options.maxEnumConstants > 0 && isa<EnumDecl>(DC) &&
+             shouldSummarizeEnum(cast<EnumDecl>(DC))) {
+    // children elided: the columnar constant table in enum_decl_info
+    // carries the same names and values in a fraction of the nodes
+    ArrayScope Scope(OF, 0);
+  } else {
+    // open-ended array: the emitters only write the element count once the
+    // array is closed, so no need to materialize the children just to count
+    // them beforehand
+    ArrayScope Scope(OF);
+    for (auto I : declsRange) {
+      if (shouldSkipDecl(I)) {
+        continue;
+      }
       dumpDecl(I);
     }
+    /* Some typedefs are not part of AST. 'instancetype' is one of them.
+    Export it nevertheless as part of TranslationUnitDecl context. */
+    // getObjCInstanceType() should return null type when 'instancetype' is not
+    // known yet - it doesn't work this way due to bug in clang, but keep
+    // the check for when the bug is fixed.
+    if (isa<TranslationUnitDecl>(DC) &&
+        Context.getObjCInstanceType().getTypePtrOrNull()) {
+      dumpDecl(Context.getObjCInstanceTypeDecl());
+    }
+    // Safety net for implicit decls referenced only from the AST being
+    // dumped (sema's used bit can lag): anything recorded by dumpDeclRef
+    // but skipped above is appended here, until a fixpoint.
+    if (Options.skipUnusedImplicitDecls && isa<TranslationUnitDecl>(DC)) {
+      for (size_t i = 0; i < ReferencedDecls.size(); i++) {
+        if (!DumpedDecls.count(ReferencedDecls[i])) {
+          dumpDecl(ReferencedDecls[i]);
+        }
+      }
+    }
   }
-  {
-    bool HasExternalLexicalStorage = DC->hasExternalLexicalStorage();
-    bool HasExternalVisibleStorage = DC->hasExternalVisibleStorage();
-    ObjectScope Scope(OF,
-                      0 + HasExternalLexicalStorage +
-                          HasExternalVisibleStorage); // not covered by tests
+  dumpDeclContextInfo(DC);
+}
+
+template <class ATDWriter>
+void ASTExporter<ATDWriter>::dumpDeclContextInfo(const DeclContext *DC) {
+  bool HasExternalLexicalStorage = DC->hasExternalLexicalStorage();
+  bool HasExternalVisibleStorage = DC->hasExternalVisibleStorage();
+  ObjectScope Scope(OF,
+                    0 + HasExternalLexicalStorage +
+                        HasExternalVisibleStorage); // not covered by tests
+
+  OF.emitFlag("has_external_lexical_storage", HasExternalLexicalStorage);
+  OF.emitFlag("has_external_visible_storage", HasExternalVisibleStorage);
+}
+
+// Reorder the translation unit's top-level decls into a canonical,
+// content-derived order (canonicalOrder): grouped by originating file
+// with headers sorted by normalized path and the main file last, sorted
+// by decl index name within a group, with source order breaking ties.
+// Unchanged files then reproduce byte-identical regions across captures
+// - and form exactly one block each for the header cache, instead of
+// one block per run of consecutive same-file decls.
+template <class ATDWriter>
+void ASTExporter<ATDWriter>::canonicalizeDeclOrder(
+    std::vector<const Decl *> &declsToDump) {
+  const SourceManager &SM = Context.getSourceManager();
+  FileID mainFID = SM.getMainFileID();
+  struct Key {
+    llvm::StringRef file;
+    bool isMain;
+    unsigned kind;
+    std::string name;
+    const Decl *decl;
+    size_t sourceIndex;
+  };
+  std::vector<Key> keys;
+  keys.reserve(declsToDump.size());
+  for (const Decl *D : declsToDump) {
+    FileID FID = SM.getFileID(SM.getExpansionLoc(D->getLocation()));
+    const FileEntry *FE = SM.getFileEntryForID(FID);
+    // decls without a file (implicit, builtin) group under the empty
+    // path, ahead of every header
+    llvm::StringRef file =
+        FE ? llvm::StringRef(Options.normalizeSourcePath(FE->getName()))
+           : llvm::StringRef();
+    keys.push_back(Key{file,
+                       FID == mainFID,
+                       (unsigned)D->getKind(),
+                       declIndexName(D),
+                       D,
+                       keys.size()});
+  }
+  const bool byKind = Options.kindClusteredOrder;
+  std::stable_sort(
+      keys.begin(), keys.end(), [byKind](const Key &a, const Key &b) {
+        if (a.isMain != b.isMain) {
+          return b.isMain;
+        }
+        if (a.file != b.file) {
+          return a.file < b.file;
+        }
+        if (byKind && a.kind != b.kind) {
+          return a.kind < b.kind;
+        }
+        return a.name < b.name;
+      });
+  if (byKind) {
+    DeclOrderPermutation.reserve(keys.size());
+  }
+  for (size_t i = 0; i < keys.size(); i++) {
+    declsToDump[i] = keys[i].decl;
+    if (byKind) {
+      DeclOrderPermutation.push_back((int64_t)keys[i].sourceIndex);
+    }
+  }
+}
+
+// The source position each emitted top-level decl came from: entry i is
+// the index the i-th emitted decl had before canonicalization and kind
+// clustering. One bulk integer array; consumers wanting source order
+// invert the permutation.
+//@atd type decl_order_table = int list
+template <class ATDWriter>
+void ASTExporter<ATDWriter>::dumpDeclOrderTable() {
+  OF.emitIntegerArray(DeclOrderPermutation.data(),
+                      DeclOrderPermutation.size());
+}
+
+// Emit the translation unit's decl list, storing the decl block of each
+// included file in Options.headerCacheDir the first time its content
+// digest is seen and emitting a reference frame on later sightings. Only
+// reached under frameDecls with a cache directory configured.
+template <class ATDWriter>
+void ASTExporter<ATDWriter>::dumpDeclsWithHeaderCache(
+    const std::vector<const Decl *> &declsToDump) {
+  const SourceManager &SM = Context.getSourceManager();
+  FileID mainFID = SM.getMainFileID();
+  // consecutive decls originating in the same file form one block
+  std::vector<std::pair<FileID, std::vector<const Decl *>>> blocks;
+  for (const Decl *D : declsToDump) {
+    FileID FID = SM.getFileID(SM.getExpansionLoc(D->getLocation()));
+    if (blocks.empty() || blocks.back().first != FID) {
+      blocks.emplace_back(FID, std::vector<const Decl *>());
+    }
+    blocks.back().second.push_back(D);
+  }
+  // resolve the blocks against the cache up front so the decl list can
+  // still be emitted with an exact element count
+  std::vector<std::string> cachePaths(blocks.size());
+  std::vector<bool> cacheHits(blocks.size(), false);
+  size_t numInline = 0;
+  for (size_t i = 0; i < blocks.size(); i++) {
+    FileID FID = blocks[i].first;
+    if (FID.isValid() && FID != mainFID && SM.getFileEntryForID(FID)) {
+      bool invalid = false;
+      llvm::StringRef content = SM.getBufferData(FID, &invalid);
+      if (!invalid) {
+        llvm::SHA1 Hash;
+        Hash.update(content);
+        Hash.update(Options.formatFingerprint());
+        cachePaths[i] = Options.headerCacheDir + "/" +
+                        llvm::toHex(Hash.final(), /*LowerCase=*/true);
+        cacheHits[i] = llvm::sys::fs::exists(cachePaths[i]);
+      }
+    }
+    if (!cacheHits[i]) {
+      numInline += blocks[i].second.size();
+    }
+  }
+  ArrayScope Scope(OF, numInline);
+  // everything up to the start of the decl list is the header frame
+  OF.flushOutput();
+  FrameSink->endFrame();
+  for (size_t i = 0; i < blocks.size(); i++) {
+    if (cacheHits[i]) {
+      FrameSink->emitReferenceFrame(llvm::sys::path::filename(cachePaths[i]));
+      continue;
+    }
+    // first sighting: tee the block's frames into a temporary file and
+    // publish it with a rename, so concurrent captures race benignly
+    std::unique_ptr<llvm::raw_fd_ostream> cacheOS;
+    llvm::SmallString<128> tmpPath;
+    if (!cachePaths[i].empty()) {
+      int tmpFD = -1;
+      if (!llvm::sys::fs::createUniqueFile(
+              cachePaths[i] + ".tmp%%%%%%", tmpFD, tmpPath)) {
+        cacheOS.reset(new llvm::raw_fd_ostream(tmpFD, /*shouldClose=*/true));
+        FrameSink->setTee(cacheOS.get());
+      }
+    }
+    for (const Decl *D : blocks[i].second) {
+      dumpDecl(D);
+      closeDeclFrame(D);
+    }
+    if (cacheOS) {
+      FrameSink->setTee(nullptr);
+      cacheOS.reset();
+      llvm::sys::fs::rename(tmpPath, cachePaths[i]);
+    }
+  }
+}
 
-    OF.emitFlag("has_external_lexical_storage", HasExternalLexicalStorage);
-    OF.emitFlag("has_external_visible_storage", HasExternalVisibleStorage);
+// Serialize the translation unit's top-level decls on a pool of worker
+// threads, each decl into its own in-memory buffer through its own
+// exporter, and splice the buffers into the decl list in the original
+// order. Only configurations where decls are independent serialization
+// units reach this (see canParallelizeDecls). Workers share the pointer
+// id table so cross-decl references resolve, and serialize their
+// SourceManager queries through one lock -- the AST is only read, but
+// SourceManager memoizes presumed-location queries in non-atomic caches
+// (see SharedSourceManagerLock); everything else (location deltas, name
+// and mangling caches) starts fresh per decl, so worker output is
+// self-contained and slightly larger than a sequential dump.
+template <class ATDWriter>
+void ASTExporter<ATDWriter>::dumpDeclsInParallel(
+    const std::vector<const Decl *> &declsToDump) {
+  size_t numDecls = declsToDump.size();
+  std::vector<std::string> buffers(numDecls);
+  std::vector<std::unique_ptr<llvm::raw_string_ostream>> streams;
+  std::vector<std::unique_ptr<ASTExporter<ATDWriter>>> workers;
+  streams.reserve(numDecls);
+  workers.reserve(numDecls);
+  // ids handed out so far (the envelope dumped the translation unit's
+  // own pointer already) seed the shared table, and the final state is
+  // copied back below for whatever follows the decl list; the capacity
+  // covers the largest TUs seen in capture statistics with headroom,
+  // and an overrun only costs the table its lock-freedom
+  PointerIdTable pointerIds(PointerMap.size() + (1 << 19));
+  for (const auto &entry : PointerMap) {
+    pointerIds.map.getOrInsert(entry.first, [&entry] { return entry.second; });
+  }
+  pointerIds.counter = PointerCounter;
+  std::mutex sourceManagerLock;
+  // the exporter constructor allocates its null sentinels in the
+  // ASTContext, which is not thread-safe, so workers are built here
+  for (size_t i = 0; i < numDecls; i++) {
+    streams.push_back(
+        std::make_unique<llvm::raw_string_ostream>(buffers[i]));
+    workers.push_back(
+        std::make_unique<ASTExporter<ATDWriter>>(*streams[i], Context, Options));
+    workers[i]->SharedPointerIds = &pointerIds;
+    workers[i]->SharedSourceManagerLock = &sourceManagerLock;
+    workers[i]->NamePrint.setSourceManagerLock(&sourceManagerLock);
+  }
+  {
+    llvm::ThreadPool pool(
+        llvm::hardware_concurrency((unsigned)Options.parallelDecls));
+    for (size_t i = 0; i < numDecls; i++) {
+      pool.async([this, &declsToDump, &workers, i] {
+        workers[i]->dumpDecl(declsToDump[i]);
+        workers[i]->OF.flushOutput();
+      });
+    }
+    pool.wait();
+  }
+  // drop anything the writer destructors append after the value (the
+  // textual formats close with a newline); the index names must be
+  // taken first, from the worker whose cache saw the decl
+  std::vector<std::string> indexNames(Options.declIndex && FrameSink
+                                          ? numDecls
+                                          : 0);
+  for (size_t i = 0; i < numDecls; i++) {
+    if (!indexNames.empty()) {
+      indexNames[i] = workers[i]->declIndexName(declsToDump[i]);
+    }
+    if (Options.symbolBloom) {
+      // symbols defined inside worker-dumped decls landed in the
+      // worker's set
+      DefinedSymbols.insert(workers[i]->DefinedSymbols.begin(),
+                            workers[i]->DefinedSymbols.end());
+    }
+    if (Options.lineIndex) {
+      // likewise for line-index rows; the sidecar writer sorts, so
+      // concatenation order does not matter
+      for (std::string &row : workers[i]->LineIndexRows) {
+        LineIndexRows.push_back(std::move(row));
+      }
+    }
+    DumpedDeclCount += workers[i]->DumpedDeclCount;
+    size_t size = buffers[i].size();
+    workers[i].reset();
+    buffers[i].resize(size);
+  }
+  PointerMap.clear();
+  pointerIds.map.forEach(
+      [this](const void *key, int id) { PointerMap.try_emplace(key, id); });
+  PointerCounter = pointerIds.counter.load();
+  ArrayScope Scope(OF, numDecls);
+  if (FrameSink) {
+    // everything up to the start of the decl list is the header frame
+    OF.flushOutput();
+    FrameSink->endFrame();
+  }
+  for (size_t i = 0; i < numDecls; i++) {
+    OF.emitElementBytes(buffers[i]);
+    if (FrameSink) {
+      OF.flushOutput();
+      if (Options.diffDecls) {
+        closeDeclFrameDiffed(std::move(indexNames[i]));
+      } else {
+        FrameSink->endFrame();
+        if (!indexNames.empty()) {
+          recordDeclIndexEntry(std::move(indexNames[i]));
+        }
+      }
+    }
   }
 }
 
@@ -787,15 +3516,24 @@ void ASTExporter<ATDWriter>::dumpLookups(const DeclContext &DC) {
   OF.emitTag("lookups");
   {
     ArrayScope Scope(OF);
+    // the lookup table iterates in pointer-keyed hash order; sort by name
+    // so that identical inputs produce byte-identical output across runs
+    std::vector<std::pair<std::string, DeclContextLookupResult>> lookups;
     DeclContext::all_lookups_iterator I = Primary->noload_lookups_begin(),
                                       E = Primary->noload_lookups_end();
     while (I != E) {
       DeclarationName Name = I.getLookupName();
-      DeclContextLookupResult R = *I++;
+      lookups.emplace_back(Name.getAsString(), *I++);
+    }
+    std::sort(lookups.begin(),
+              lookups.end(),
+              [](const auto &a, const auto &b) { return a.first < b.first; });
+    for (const auto &lookup : lookups) {
+      DeclContextLookupResult R = lookup.second;
 
       ObjectScope Scope(OF, 2); // not covered by tests
       OF.emitTag("decl_name");
-      OF.emitString(Name.getAsString());
+      OF.emitString(lookup.first);
 
       OF.emitTag("decl_refs");
       {
@@ -813,6 +3551,54 @@ void ASTExporter<ATDWriter>::dumpLookups(const DeclContext &DC) {
   OF.emitFlag("has_undeserialized_decls", HasUndeserializedLookups);
 }
 
+// Walk a qualified name down from the translation unit, one targeted
+// lookup per component: only the requested names are resolved, so the
+// lazily-built lookup maps of everything else stay unbuilt. Returns
+// null when a component does not name a context.
+template <class ATDWriter>
+const DeclContext *ASTExporter<ATDWriter>::resolveLookupContext(
+    const std::string &qualified) {
+  llvm::StringRef rest = qualified;
+  rest.consume_front("::");
+  const DeclContext *DC = Context.getTranslationUnitDecl();
+  while (DC && !rest.empty()) {
+    std::pair<llvm::StringRef, llvm::StringRef> split = rest.split("::");
+    rest = split.second;
+    DeclarationName name(&Context.Idents.get(split.first));
+    const DeclContext *next = nullptr;
+    for (const NamedDecl *ND : DC->getPrimaryContext()->lookup(name)) {
+      if (const auto *nextDC = dyn_cast<DeclContext>(ND)) {
+        next = nextDC->getPrimaryContext();
+        break;
+      }
+    }
+    DC = next;
+  }
+  return DC;
+}
+
+// Trailing value under lookupContexts: the lookup tables of exactly the
+// contexts the consumer named, in option order. Names that resolve to
+// nothing are reported on stderr and dropped, so a table is emitted for
+// every row that is present.
+//@atd type lookups_table = lookups list
+template <class ATDWriter>
+void ASTExporter<ATDWriter>::dumpLookupsTable() {
+  std::vector<const DeclContext *> contexts;
+  for (const std::string &qualified : Options.lookupContexts) {
+    const DeclContext *DC = resolveLookupContext(qualified);
+    if (DC) {
+      contexts.push_back(DC);
+    } else {
+      llvm::errs() << "[!] Lookup context not found: " << qualified << "\n";
+    }
+  }
+  ArrayScope Scope(OF, contexts.size());
+  for (const DeclContext *DC : contexts) {
+    dumpLookups(*DC);
+  }
+}
+
 //===----------------------------------------------------------------------===//
 //  C++ Utilities
 //===----------------------------------------------------------------------===//
@@ -822,16 +3608,16 @@ template <class ATDWriter>
 void ASTExporter<ATDWriter>::dumpAccessSpecifier(AccessSpecifier AS) {
   switch (AS) {
   case AS_public:
-    OF.emitSimpleVariant("Public");
+    OF.emitSimpleVariant(tags::PublicVariant);
     break;
   case AS_protected:
-    OF.emitSimpleVariant("Protected");
+    OF.emitSimpleVariant(tags::ProtectedVariant);
     break;
   case AS_private:
-    OF.emitSimpleVariant("Private");
+    OF.emitSimpleVariant(tags::PrivateVariant);
     break;
   case AS_none:
-    OF.emitSimpleVariant("None");
+    OF.emitSimpleVariant(tags::NoneVariant);
     break;
   }
 }
@@ -868,7 +3654,7 @@ void ASTExporter<ATDWriter>::dumpCXXCtorInitializer(
       OF.emitBoolean(Init.isBaseVirtual());
     }
   }
-  OF.emitTag("source_range");
+  OF.emitTag(tags::source_range);
   dumpSourceRange(Init.getSourceRange());
   if (E) {
     OF.emitTag("init_expr");
@@ -896,7 +3682,7 @@ void ASTExporter<ATDWriter>::dumpCXXCtorInitializer(
 template <class ATDWriter>
 void ASTExporter<ATDWriter>::dumpDeclarationName(const DeclarationName &Name) {
   ObjectScope Scope(OF, 2); // not covered by tests
-  OF.emitTag("kind");
+  OF.emitTag(tags::kind);
   switch (Name.getNameKind()) {
   case DeclarationName::Identifier:
     OF.emitSimpleVariant("Identifier");
@@ -932,8 +3718,11 @@ void ASTExporter<ATDWriter>::dumpDeclarationName(const DeclarationName &Name) {
     OF.emitSimpleVariant("CXXDeductionGuideName");
     break;
   }
-  OF.emitTag("name");
-  OF.emitString(Name.getAsString());
+  OF.emitTag(tags::name);
+  SmallString<64> NameBuf;
+  llvm::raw_svector_ostream NameOS(NameBuf);
+  NameOS << Name;
+  OF.emitString(NameOS.str());
 }
 //@atd type nested_name_specifier_loc = {
 //@atd   kind : specifier_kind;
@@ -962,7 +3751,7 @@ void ASTExporter<ATDWriter>::dumpNestedNameSpecifierLoc(
     NestedNameSpecifier::SpecifierKind Kind =
         NNS.getNestedNameSpecifier()->getKind();
     ObjectScope Scope(OF, 2);
-    OF.emitTag("kind");
+    OF.emitTag(tags::kind);
     switch (Kind) {
     case NestedNameSpecifier::Identifier:
       OF.emitSimpleVariant("Identifier");
@@ -993,6 +3782,50 @@ void ASTExporter<ATDWriter>::dumpNestedNameSpecifierLoc(
   }
 }
 
+// id of a qualifier chain in the chain table, registering it on first
+// sight. The emitted form of a chain depends only on the uniqued
+// NestedNameSpecifier, which therefore serves as the key.
+template <class ATDWriter>
+int ASTExporter<ATDWriter>::specifierChainId(NestedNameSpecifierLoc NNS) {
+  auto res = SpecifierChainIdMap.try_emplace(NNS.getNestedNameSpecifier(),
+                                             (int)SpecifierChainTable.size());
+  if (res.second) {
+    SpecifierChainTable.push_back(NNS);
+  }
+  return res.first->second;
+}
+
+//@atd type specifier_chain_table = (nested_name_specifier_loc list) list
+template <class ATDWriter>
+void ASTExporter<ATDWriter>::dumpSpecifierChainTable() {
+  ArrayScope Scope(OF, SpecifierChainTable.size());
+  for (size_t i = 0; i < SpecifierChainTable.size(); i++) {
+    dumpNestedNameSpecifierLoc(SpecifierChainTable[i]);
+  }
+}
+
+// One row per decl referenced without an inline name (refNameTable):
+// consumers join the table against decl_ref records by decl_pointer.
+// The table carries every referenced decl, including the ones whose own
+// record also holds the name, so resolution never depends on whether
+// the decl was dumped.
+//@atd type ref_name_entry = {
+//@atd   decl_pointer : pointer;
+//@atd   name : named_decl_info
+//@atd } <ocaml field_prefix="rne_">
+//@atd type ref_name_table = ref_name_entry list
+template <class ATDWriter>
+void ASTExporter<ATDWriter>::dumpRefNameTable() {
+  ArrayScope Scope(OF, RefNamedDecls.size());
+  for (const NamedDecl *ND : RefNamedDecls) {
+    ObjectScope Scope(OF, 2);
+    OF.emitTag(tags::decl_pointer);
+    dumpPointer(ND);
+    OF.emitTag(tags::name);
+    dumpName(*ND);
+  }
+}
+
 // template <class ATDWriter>
 // void ASTExporter<ATDWriter>::dumpTemplateParameters(const
 // TemplateParameterList *TPL) {
@@ -1039,9 +3872,36 @@ bool ASTExporter<ATDWriter>::alwaysEmitParent(const Decl *D) {
 template <class ATDWriter>
 void ASTExporter<ATDWriter>::dumpDecl(const Decl *D) {
   if (!D) {
+    if (Options.nullMarkers) {
+      OF.emitSimpleVariant(tags::NullVariant);
+      return;
+    }
     // We use a fixed EmptyDecl node to represent null pointers
     D = NullPtrDecl;
   }
+  DumpedDeclCount++;
+  if (DumpedDeclCount % 10000 == 0) {
+    // fleet-profiling heartbeat: the time between beats is dump
+    // throughput, readable from outside with no profiler attached
+    CAPTURE_PROBE1(decl_progress, DumpedDeclCount);
+  }
+  if (Options.mainFileDeclsOnly || Options.skipUnusedImplicitDecls ||
+      Options.streamDecls) {
+    DumpedDecls.insert(D);
+  }
+  VisitorProfiler::Scope ProfScope(Options.profileVisitors ? &Profiler
+                                                           : nullptr,
+                                   VisitorProfiler::decls,
+                                   "Decl",
+                                   (unsigned)D->getKind(),
+                                   D->getDeclKindName());
+  // Per-kind buckets in the -ftime-trace flamegraph: the profiler
+  // aggregates same-named events into Total entries, so each decl kind
+  // shows its cumulative serialization cost next to clang's own parse
+  // and instantiation buckets. The kind name is a static string, so an
+  // inactive profiler costs one pointer check; statements are too
+  // numerous to scope per node and are covered by their enclosing decl
+  llvm::TimeTraceScope TimeScope(D->getDeclKindName());
   VariantScope Scope(OF, std::string(D->getDeclKindName()) + "Decl");
   {
     TupleScope Scope(OF, ASTExporter::tupleSizeOfDeclKind(D->getKind()));
@@ -1086,10 +3946,22 @@ void ASTExporter<ATDWriter>::VisitDecl(const Decl *D) {
     bool IsDReferenced = D->isThisDeclarationReferenced();
     bool IsDInvalid = D->isInvalidDecl();
     bool HasAttributes = D->hasAttrs();
+    // the filter runs before clang's comment machinery, so decls of
+    // unlisted kinds never pay for comment lexing and parsing
+    bool WantComment =
+        Options.dumpComments &&
+        (Options.commentKinds.empty() ||
+         Options.commentKinds.count(std::string(D->getDeclKindName()) +
+                                    "Decl"));
     const FullComment *Comment =
-        Options.dumpComments
-            ? D->getASTContext().getLocalCommentForDeclUncached(D)
-            : nullptr;
+        WantComment ? D->getASTContext().getLocalCommentForDeclUncached(D)
+                    : nullptr;
+    if (Comment && Options.commentSidecar) {
+      // queued for the sidecar document; the decl record itself stays
+      // free of comment bytes
+      SidecarComments.emplace_back(D, Comment);
+      Comment = nullptr;
+    }
     AccessSpecifier Access = D->getAccess();
     bool HasAccess = Access != AccessSpecifier::AS_none;
     int size = 2 + ShouldEmitParentPointer + (bool)M + IsNDHidden +
@@ -1097,14 +3969,14 @@ void ASTExporter<ATDWriter>::VisitDecl(const Decl *D) {
                HasAttributes + (bool)Comment + HasAccess;
     ObjectScope Scope(OF, size);
 
-    OF.emitTag("pointer");
+    OF.emitTag(tags::pointer);
     dumpPointer(D);
     if (ShouldEmitParentPointer) {
-      OF.emitTag("parent_pointer");
+      OF.emitTag(tags::parent_pointer);
       dumpPointer(cast<Decl>(D->getDeclContext()));
     }
 
-    OF.emitTag("source_range");
+    OF.emitTag(tags::source_range);
     dumpSourceRange(D->getSourceRange());
     if (M) {
       OF.emitTag("owning_module");
@@ -1116,13 +3988,20 @@ void ASTExporter<ATDWriter>::VisitDecl(const Decl *D) {
     OF.emitFlag("is_this_declaration_referenced", IsDReferenced);
     OF.emitFlag("is_invalid_decl", IsDInvalid);
 
-    if (HasAttributes) {
-      OF.emitTag("attributes");
-      ArrayScope ArrayAttr(OF, D->getAttrs().size());
+    int NumAttrs = D->hasAttrs() ? (int)D->getAttrs().size() : 0;
+    if (Options.attrAllowlist && NumAttrs > 0) {
+      NumAttrs = 0;
       for (auto I : D->getAttrs()) {
-        dumpAttr(I);
+        NumAttrs += shouldDumpAttr(I);
       }
     }
+    OF.emitDefaultableArray("attributes", NumAttrs, [&] {
+      for (auto I : D->getAttrs()) {
+        if (shouldDumpAttr(I)) {
+          dumpAttr(I);
+        }
+      }
+    });
 
     if (Comment) {
       OF.emitTag("full_comment");
@@ -1343,7 +4222,9 @@ void ASTExporter<ATDWriter>::dumpIntegerTypeWidths(const TargetInfo &info) {
 //@atd type  translation_unit_decl_info = {
 //@atd   input_path : source_file;
 //@atd   input_kind : input_kind;
-//@atd   integer_type_widths : integer_type_widths;
+//@atd   ?integer_type_widths : integer_type_widths option;
+//@atd   ?target_hash : string option;
+//@atd   ?schema_hash : string option;
 //@atd   ~is_objc_arc_on : bool;
 //@atd   types : c_type list;
 //@atd } <ocaml field_prefix="tudi_">
@@ -1352,17 +4233,80 @@ void ASTExporter<ATDWriter>::VisitTranslationUnitDecl(
     const TranslationUnitDecl *D) {
   VisitDecl(D);
   VisitDeclContext(D);
+  dumpTranslationUnitTrailer(D);
+}
+
+// Capture-level target manifest (targetManifestDir): the record every
+// TU used to re-serialize inline goes out once as <dir>/<hash>.target,
+// and translation_unit_decl_info carries only the hash. The file is
+// published under its content hash with a rename, so concurrent
+// processes of a capture race benignly and identical configurations
+// converge on one file.
+template <class ATDWriter>
+std::string ASTExporter<ATDWriter>::writeTargetManifest() {
+  const TargetInfo &info = Context.getTargetInfo();
+  SmallString<256> Buf;
+  llvm::raw_svector_ostream recordOS(Buf);
+  recordOS << "{\"triple\":\"" << info.getTriple().str() << "\""
+           << ",\"char_type\":" << info.getCharWidth()
+           << ",\"short_type\":" << info.getShortWidth()
+           << ",\"int_type\":" << info.getIntWidth()
+           << ",\"long_type\":" << info.getLongWidth()
+           << ",\"longlong_type\":" << info.getLongLongWidth() << "}\n";
+  llvm::SHA1 Hash;
+  Hash.update(recordOS.str());
+  std::string hex = llvm::toHex(Hash.final(), /*LowerCase=*/true);
+  std::string manifestPath = Options.targetManifestDir + "/" + hex + ".target";
+  if (!llvm::sys::fs::exists(manifestPath)) {
+    int tmpFD = -1;
+    llvm::SmallString<128> tmpPath;
+    if (!llvm::sys::fs::createUniqueFile(
+            manifestPath + ".tmp%%%%%%", tmpFD, tmpPath)) {
+      {
+        llvm::raw_fd_ostream manifestOS(tmpFD, /*shouldClose=*/true);
+        manifestOS << recordOS.str();
+      }
+      llvm::sys::fs::rename(tmpPath, manifestPath);
+    }
+  }
+  return hex;
+}
+
+template <class ATDWriter>
+void ASTExporter<ATDWriter>::dumpTranslationUnitTrailer(
+    const TranslationUnitDecl *D) {
   bool IsObjCArcOn = D->getASTContext().getLangOpts().ObjCAutoRefCount;
-  ObjectScope Scope(OF, 4 + IsObjCArcOn);
+  ObjectScope Scope(OF, 4 + Options.emitSchemaHash + IsObjCArcOn);
   OF.emitTag("input_path");
   OF.emitString(
       Options.normalizeSourcePath(Options.inputFile.getFile().str().c_str()));
   OF.emitTag("input_kind");
   dumpInputKind(Options.inputFile.getKind());
-  OF.emitTag("integer_type_widths");
-  dumpIntegerTypeWidths(Context.getTargetInfo());
+  if (Options.targetManifestDir.empty()) {
+    OF.emitTag("integer_type_widths");
+    dumpIntegerTypeWidths(Context.getTargetInfo());
+  } else {
+    OF.emitTag("target_hash");
+    OF.emitString(writeTargetManifest());
+  }
+  if (Options.emitSchemaHash) {
+    OF.emitTag("schema_hash");
+    OF.emitString(ATD_SCHEMA_HASH);
+  }
   OF.emitFlag("is_objc_arc_on", IsObjCArcOn);
   OF.emitTag("types");
+  if (Options.onlyReferencedTypes) {
+    // VisitDeclContext above has recorded every type the dumped AST
+    // references; emitting a type can reference further types (desugared
+    // and component types), so the list may grow while it is flushed.
+    ArrayScope aScope(OF);
+    for (size_t i = 0; i < ReferencedTypes.size(); i++) {
+      dumpType(ReferencedTypes[i]);
+    }
+    // Just in case, add NoneType to dumped types
+    dumpType(nullptr);
+    return;
+  }
   const auto &types = Context.getTypes();
   ArrayScope aScope(OF, types.size() + 1); // + 1 for nullptr
   for (const Type *type : types) {
@@ -1372,6 +4316,86 @@ void ASTExporter<ATDWriter>::VisitTranslationUnitDecl(
   dumpType(nullptr);
 }
 
+// Streaming dump driven by HandleTopLevelDecl (streamDecls): the
+// translation unit envelope is opened when the first parsed decl
+// arrives, each decl is serialized while the parser works on the next
+// one, and the envelope is closed from HandleTranslationUnit. The
+// visitors' time thus hides behind the parse instead of adding to it.
+template <class ATDWriter>
+void ASTExporter<ATDWriter>::beginDeclStream(const TranslationUnitDecl *D) {
+  StreamVariantScope.reset(new VariantScope(OF, "TranslationUnitDecl"));
+  StreamTupleScope.reset(
+      new TupleScope(OF, ASTExporter::tupleSizeOfDeclKind(D->getKind())));
+  VisitDecl(D);
+  // Open-ended: the element count is only known once the parse is done.
+  // The textual emitters stream elements straight out; the biniou
+  // emitter captures them and splices the count in when the array is
+  // closed, so there only the visitor work overlaps the parse, not the
+  // byte writes (flushOutput is a no-op while the capture is open).
+  StreamArrayScope.reset(new ArrayScope(OF));
+  if (FrameSink) {
+    // everything up to the start of the decl list is the header frame
+    OF.flushOutput();
+    FrameSink->endFrame();
+  }
+}
+
+template <class ATDWriter>
+void ASTExporter<ATDWriter>::streamDecl(const Decl *D) {
+  if (shouldSkipDecl(D)) {
+    return;
+  }
+  if (Options.mainFileDeclsOnly) {
+    const SourceManager &SM = Context.getSourceManager();
+    if (!SM.isInMainFile(SM.getExpansionLoc(D->getLocation()))) {
+      return;
+    }
+  }
+  dumpDecl(D);
+  if (FrameSink) {
+    closeDeclFrame(D);
+  }
+}
+
+template <class ATDWriter>
+void ASTExporter<ATDWriter>::endDeclStream(const TranslationUnitDecl *D) {
+  // Sweep up what the parser never handed over: implicit builtin decls
+  // and decls sema only creates at the end of the unit. They follow the
+  // parsed decls instead of preceding them as in a whole-unit dump.
+  bool noload = Options.noloadExternalDecls && D->hasExternalLexicalStorage();
+  DeclContext::decl_range declsRange = noload ? D->noload_decls() : D->decls();
+  const SourceManager &SM = Context.getSourceManager();
+  for (auto I : declsRange) {
+    if (shouldSkipDecl(I) || DumpedDecls.count(I)) {
+      continue;
+    }
+    if (Options.mainFileDeclsOnly &&
+        !SM.isInMainFile(SM.getExpansionLoc(I->getLocation()))) {
+      continue;
+    }
+    dumpDecl(I);
+  }
+  /* Some typedefs are not part of AST. 'instancetype' is one of them.
+  Export it nevertheless as part of TranslationUnitDecl context. */
+  if (Context.getObjCInstanceType().getTypePtrOrNull() &&
+      !DumpedDecls.count(Context.getObjCInstanceTypeDecl())) {
+    dumpDecl(Context.getObjCInstanceTypeDecl());
+  }
+  // referenced-decl closure, as in VisitDeclContext
+  if (Options.mainFileDeclsOnly || Options.skipUnusedImplicitDecls) {
+    for (size_t i = 0; i < ReferencedDecls.size(); i++) {
+      if (!DumpedDecls.count(ReferencedDecls[i])) {
+        dumpDecl(ReferencedDecls[i]);
+      }
+    }
+  }
+  StreamArrayScope.reset();
+  dumpDeclContextInfo(D);
+  dumpTranslationUnitTrailer(D);
+  StreamTupleScope.reset();
+  StreamVariantScope.reset();
+}
+
 template <class ATDWriter>
 int ASTExporter<ATDWriter>::NamedDeclTupleSize() {
   return DeclTupleSize() + 1;
@@ -1408,16 +4432,44 @@ int ASTExporter<ATDWriter>::EnumDeclTupleSize() {
 //@atd #define enum_decl_tuple tag_decl_tuple * enum_decl_info
 //@atd type enum_decl_info = {
 //@atd   ?scope : enum_decl_scope option;
-//@atd   ~is_module_private : bool
+//@atd   ~is_module_private : bool;
+//@atd   ?constant_table : enum_constant_table option
 //@atd } <ocaml field_prefix="edi_">
 //@atd type enum_decl_scope = [Class | Struct]
+//@atd type enum_constant_table = {
+//@atd   names : string list;
+//@atd   values : int list;
+//@atd } <ocaml field_prefix="ect_">
+
+// Whether D's constants go out as the columnar table instead of
+// per-constant decl records (maxEnumConstants): only above the cap, and
+// only when every value fits a plain 64-bit integer, so the table's
+// values column never needs the wide decimal-string form.
+template <class ATDWriter>
+bool ASTExporter<ATDWriter>::shouldSummarizeEnum(const EnumDecl *D) {
+  if (Options.maxEnumConstants == 0) {
+    return false;
+  }
+  uint64_t count = 0;
+  for (const EnumConstantDecl *ECD : D->enumerators()) {
+    const llvm::APSInt &V = ECD->getInitVal();
+    if (V.isSigned() ? !V.isSignedIntN(64) : !V.isIntN(63)) {
+      return false;
+    }
+    count++;
+  }
+  return count > Options.maxEnumConstants;
+}
+
 template <class ATDWriter>
 void ASTExporter<ATDWriter>::VisitEnumDecl(const EnumDecl *D) {
   VisitTagDecl(D);
 
   bool IsScoped = D->isScoped();
   bool IsModulePrivate = D->isModulePrivate();
-  ObjectScope Scope(OF, 0 + IsScoped + IsModulePrivate); // not covered by tests
+  bool Summarize = shouldSummarizeEnum(D);
+  ObjectScope Scope(
+      OF, 0 + IsScoped + IsModulePrivate + Summarize); // not covered by tests
 
   if (IsScoped) {
     OF.emitTag("scope");
@@ -1427,6 +4479,37 @@ void ASTExporter<ATDWriter>::VisitEnumDecl(const EnumDecl *D) {
       OF.emitSimpleVariant("Struct");
   }
   OF.emitFlag("is_module_private", IsModulePrivate);
+  if (Summarize) {
+    // the constants elided from the decl list (generated enums carry
+    // tens of thousands), one name and one value per row; the shared
+    // location is the enum's own source range
+    OF.emitTag("constant_table");
+    int NumConstants =
+        (int)std::distance(D->enumerator_begin(), D->enumerator_end());
+    ObjectScope TableScope(OF, 2);
+    OF.emitTag("names");
+    {
+      // pure leaf arrays, so both columns go out through the bulk
+      // primitives instead of one emitter transition per constant
+      SmallVector<std::string_view, 64> Names;
+      Names.reserve(NumConstants);
+      for (const EnumConstantDecl *ECD : D->enumerators()) {
+        Names.push_back(ECD->getName());
+      }
+      OF.emitStringArray(Names.data(), Names.size());
+    }
+    OF.emitTag("values");
+    {
+      SmallVector<int64_t, 64> Values;
+      Values.reserve(NumConstants);
+      for (const EnumConstantDecl *ECD : D->enumerators()) {
+        const llvm::APSInt &V = ECD->getInitVal();
+        Values.push_back(V.isSigned() ? V.getSExtValue()
+                                      : (int64_t)V.getZExtValue());
+      }
+      OF.emitIntegerArray(Values.data(), Values.size());
+    }
+  }
 }
 
 template <class ATDWriter>
@@ -1494,13 +4577,57 @@ void ASTExporter<ATDWriter>::VisitIndirectFieldDecl(
   }
 }
 
+// Whether a parameter fits the fixed columns of parm_table_entry
+// (paramTable): rows of a table must all carry the same fields, so a
+// default argument, attributes, or a name dumpName would have to
+// qualify keeps the whole list in its detailed per-decl form.
+template <class ATDWriter>
+bool ASTExporter<ATDWriter>::canTabulateParam(const VarDecl *D) {
+  return !D->hasAttrs() && !D->hasInit() && !D->isModulePrivate() &&
+         (!D->getDeclName() || D->getDeclName().isIdentifier());
+}
+
+//@atd type parm_table_entry = {
+//@atd   pointer : pointer;
+//@atd   source_range : source_range;
+//@atd   name : string;
+//@atd   qual_type : qual_type;
+//@atd } <ocaml field_prefix="pte_">
+template <class ATDWriter>
+void ASTExporter<ATDWriter>::dumpParamTableRow(const VarDecl *D) {
+  TableRowScope Scope(OF, 4);
+  OF.emitTag(tags::pointer);
+  dumpPointer(D);
+  OF.emitTag(tags::source_range);
+  dumpSourceRange(D->getSourceRange());
+  OF.emitTag(tags::name);
+  OF.emitString(D->getNameAsString());
+  OF.emitTag(tags::qual_type);
+  dumpQualType(D->getType());
+}
+
 template <class ATDWriter>
 int ASTExporter<ATDWriter>::FunctionDeclTupleSize() {
   return ASTExporter::DeclaratorDeclTupleSize() + 1;
 }
+// Bit positions of function_decl_info.flags (flagMasks); the values are
+// wire format shared with readers, so existing ones never change
+enum FunctionDeclFlag : uint64_t {
+  FunctionFlagIsCpp = 1ull << 0,
+  FunctionFlagIsInline = 1ull << 1,
+  FunctionFlagIsModulePrivate = 1ull << 2,
+  FunctionFlagIsPure = 1ull << 3,
+  FunctionFlagIsDeleted = 1ull << 4,
+  FunctionFlagIsNoReturn = 1ull << 5,
+  FunctionFlagIsConstexpr = 1ull << 6,
+  FunctionFlagIsVariadic = 1ull << 7,
+  FunctionFlagIsStatic = 1ull << 8,
+};
+
 //@atd #define function_decl_tuple declarator_decl_tuple * function_decl_info
 //@atd type function_decl_info = {
 //@atd   ?mangled_name : string option;
+//@atd   ~flags : int;
 //@atd   ~is_cpp : bool;
 //@atd   ~is_inline : bool;
 //@atd   ~is_module_private : bool;
@@ -1511,6 +4638,7 @@ int ASTExporter<ATDWriter>::FunctionDeclTupleSize() {
 //@atd   ~is_variadic : bool;
 //@atd   ~is_static : bool;
 //@atd   ~parameters : decl list;
+//@atd   ~parameter_table : parm_table_entry list;
 //@atd   ?decl_ptr_with_body : pointer option;
 //@atd   ?body : stmt option;
 //@atd   ?template_specialization : template_specialization_info option;
@@ -1524,7 +4652,11 @@ void ASTExporter<ATDWriter>::VisitFunctionDecl(const FunctionDecl *D) {
   auto DNkind = D->getDeclName().getNameKind();
   bool ShouldMangleName = Mangler->shouldMangleDeclName(D) &&
                           DNkind != DeclarationName::CXXDeductionGuideName &&
-                          DNkind != DeclarationName::CXXUsingDirective;
+                          DNkind != DeclarationName::CXXUsingDirective &&
+                          // statics, anonymous-namespace members and local
+                          // functions resolve within this TU only
+                          (!Options.mangleExternalOnly ||
+                           D->isExternallyVisible());
   bool IsInlineSpecified = D->isInlineSpecified();
   bool IsModulePrivate = D->isModulePrivate();
   bool IsPure = D->isPure();
@@ -1538,6 +4670,15 @@ void ASTExporter<ATDWriter>::VisitFunctionDecl(const FunctionDecl *D) {
   auto IsNoReturn = D->isNoReturn();
   bool IsConstexpr = D->isConstexpr();
   bool HasParameters = !D->param_empty();
+  bool UseParamTable = Options.paramTable && HasParameters;
+  if (UseParamTable) {
+    for (const ParmVarDecl *P : D->parameters()) {
+      if (!canTabulateParam(P)) {
+        UseParamTable = false;
+        break;
+      }
+    }
+  }
   const FunctionDecl *DeclWithBody = D;
   // FunctionDecl::hasBody() will set DeclWithBody pointer to decl that
   // has body. If there is no body in all decls of that function,
@@ -1549,39 +4690,73 @@ void ASTExporter<ATDWriter>::VisitFunctionDecl(const FunctionDecl *D) {
   FunctionTemplateDecl *TemplateDecl = D->getPrimaryTemplate();
   SourceLocation PointOfInstantiation = D->getPointOfInstantiation();
   bool IsValidPointOfInstantiation = PointOfInstantiation.isValid();
-  int size = ShouldMangleName + IsCpp + IsInlineSpecified + IsModulePrivate +
-             IsPure + IsDeleted + IsNoReturn + IsConstexpr + IsVariadic +
-             IsStatic + HasParameters + (bool)DeclWithBody +
-             HasDeclarationBody + (bool)TemplateDecl +
+  // under flagMasks the nine booleans collapse into one ~flags field,
+  // present only when at least one is set
+  uint64_t FlagMask = 0;
+  if (Options.flagMasks) {
+    FlagMask = (IsCpp ? FunctionFlagIsCpp : 0) |
+               (IsInlineSpecified ? FunctionFlagIsInline : 0) |
+               (IsModulePrivate ? FunctionFlagIsModulePrivate : 0) |
+               (IsPure ? FunctionFlagIsPure : 0) |
+               (IsDeleted ? FunctionFlagIsDeleted : 0) |
+               (IsNoReturn ? FunctionFlagIsNoReturn : 0) |
+               (IsConstexpr ? FunctionFlagIsConstexpr : 0) |
+               (IsVariadic ? FunctionFlagIsVariadic : 0) |
+               (IsStatic ? FunctionFlagIsStatic : 0);
+  }
+  int numFlagFields = Options.flagMasks
+                          ? (FlagMask != 0)
+                          : IsCpp + IsInlineSpecified + IsModulePrivate +
+                                IsPure + IsDeleted + IsNoReturn + IsConstexpr +
+                                IsVariadic + IsStatic;
+  int size = ShouldMangleName + numFlagFields + HasParameters +
+             (bool)DeclWithBody + HasDeclarationBody + (bool)TemplateDecl +
              IsValidPointOfInstantiation;
   ObjectScope Scope(OF, size);
 
   if (ShouldMangleName) {
     OF.emitTag("mangled_name");
-    SmallString<64> Buf;
-    llvm::raw_svector_ostream StrOS(Buf);
-    GlobalDecl GD;
-    if (const auto *CD = dyn_cast<CXXConstructorDecl>(D)) {
-      GD = GlobalDecl(CD, Ctor_Base);
-    } else if (const auto *DD = dyn_cast<CXXDestructorDecl>(D)) {
-      GD = GlobalDecl(DD, Dtor_Base);
-    } else {
-      GD = GlobalDecl(D);
+    auto res = MangledNameCache.try_emplace(D->getCanonicalDecl());
+    if (res.second) {
+      SmallString<64> Buf;
+      llvm::raw_svector_ostream StrOS(Buf);
+      GlobalDecl GD;
+      if (const auto *CD = dyn_cast<CXXConstructorDecl>(D)) {
+        GD = GlobalDecl(CD, Ctor_Base);
+      } else if (const auto *DD = dyn_cast<CXXDestructorDecl>(D)) {
+        GD = GlobalDecl(DD, Dtor_Base);
+      } else {
+        GD = GlobalDecl(D);
+      }
+      Mangler->mangleName(GD, StrOS);
+      // mangled names can get ridiculously long, so hash them to a fixed
+      // size
+      res.first->second = ArenaSaver.save(llvm::Twine(
+          Options.useXXHash ? xxh64Hash(StrOS) : fnv64Hash(StrOS)));
     }
-    Mangler->mangleName(GD, StrOS);
-    // mangled names can get ridiculously long, so hash them to a fixed size
-    OF.emitString(std::to_string(fnv64Hash(StrOS)));
+    OF.emitString(res.first->second);
+    if (Options.symbolBloom && HasDeclarationBody) {
+      DefinedSymbols.insert(SymbolBloom::key(res.first->second));
+    }
+  }
+  if (Options.lineIndex && HasDeclarationBody) {
+    // unmangled (plain C) functions fall back to their qualified name
+    recordLineIndexEntry(D, declIndexName(D));
   }
 
-  OF.emitFlag("is_cpp", IsCpp);
-  OF.emitFlag("is_inline", IsInlineSpecified);
-  OF.emitFlag("is_module_private", IsModulePrivate);
-  OF.emitFlag("is_pure", IsPure);
-  OF.emitFlag("is_deleted", IsDeleted);
-  OF.emitFlag("is_no_return", IsNoReturn);
-  OF.emitFlag("is_constexpr", IsConstexpr);
-  OF.emitFlag("is_variadic", IsVariadic);
-  OF.emitFlag("is_static", IsStatic);
+  if (Options.flagMasks) {
+    OF.emitFlagMask("flags", FlagMask);
+  } else {
+    OF.emitFlag("is_cpp", IsCpp);
+    OF.emitFlag("is_inline", IsInlineSpecified);
+    OF.emitFlag("is_module_private", IsModulePrivate);
+    OF.emitFlag("is_pure", IsPure);
+    OF.emitFlag("is_deleted", IsDeleted);
+    OF.emitFlag("is_no_return", IsNoReturn);
+    OF.emitFlag("is_constexpr", IsConstexpr);
+    OF.emitFlag("is_variadic", IsVariadic);
+    OF.emitFlag("is_static", IsStatic);
+  }
 
   //  if (const FunctionProtoType *FPT =
   //  D->getType()->getAs<FunctionProtoType>()) {
@@ -1606,7 +4781,13 @@ void ASTExporter<ATDWriter>::VisitFunctionDecl(const FunctionDecl *D) {
   //    dumpTemplateArgumentList(*FTSI->TemplateArguments);
   //  }
 
-  if (HasParameters) {
+  if (UseParamTable) {
+    OF.emitTag("parameter_table");
+    TableScope Scope(OF, D->getNumParams());
+    for (const ParmVarDecl *P : D->parameters()) {
+      dumpParamTableRow(P);
+    }
+  } else if (HasParameters) {
     FunctionDecl::param_const_iterator I = D->param_begin(), E = D->param_end();
     if (I != E) {
       OF.emitTag("parameters");
@@ -1682,7 +4863,20 @@ int ASTExporter<ATDWriter>::VarDeclTupleSize() {
   return ASTExporter::DeclaratorDeclTupleSize() + 1;
 }
 
+// Bit positions of var_decl_info.flags (flagMasks); the values are wire
+// format shared with readers, so existing ones never change
+enum VarDeclFlag : uint64_t {
+  VarFlagIsGlobal = 1ull << 0,
+  VarFlagIsExtern = 1ull << 1,
+  VarFlagIsStatic = 1ull << 2,
+  VarFlagIsStaticLocal = 1ull << 3,
+  VarFlagIsStaticDataMember = 1ull << 4,
+  VarFlagIsConstexpr = 1ull << 5,
+  VarFlagIsInitIce = 1ull << 6,
+};
+
 //@atd type var_decl_info = {
+//@atd   ~flags : int;
 //@atd   ~is_global : bool;
 //@atd   ~is_extern : bool;
 //@atd   ~is_static : bool;
@@ -1692,6 +4886,7 @@ int ASTExporter<ATDWriter>::VarDeclTupleSize() {
 //@atd   ~is_init_ice : bool;
 //@atd   ?init_expr : stmt option;
 //@atd   ~is_init_expr_cxx11_constant: bool;
+//@atd   ?folded_init : folded_init_info option;
 //@atd   ?parm_index_in_function : int option;
 //@atd } <ocaml field_prefix="vdi_">
 template <class ATDWriter>
@@ -1713,22 +4908,56 @@ void ASTExporter<ATDWriter>::dumpVarDeclInfo(const VarDecl *D) {
   const ParmVarDecl *ParmDecl = dyn_cast<ParmVarDecl>(D);
   bool HasParmIndex = (bool)ParmDecl;
   bool isInitExprCXX11ConstantExpr = false;
+  // clang has often already evaluated a global initializer to a
+  // constant; under foldConstInits that one value stands in for the
+  // whole expression tree (evaluateValue memoizes in the ASTContext, so
+  // a folded initializer is never evaluated twice)
+  const APValue *FoldedInit = nullptr;
+  if (Options.foldConstInits && HasInit && IsGlobal &&
+      !initExpr->isValueDependent()) {
+    FoldedInit = D->evaluateValue();
+  }
+  // under flagMasks the seven leading booleans collapse into one ~flags
+  // field; is_init_expr_cxx11_constant stays separate as it belongs to
+  // the initializer
+  uint64_t FlagMask = 0;
+  if (Options.flagMasks) {
+    FlagMask = (IsGlobal ? VarFlagIsGlobal : 0) |
+               (IsExtern ? VarFlagIsExtern : 0) |
+               (IsStatic ? VarFlagIsStatic : 0) |
+               (IsStaticLocal ? VarFlagIsStaticLocal : 0) |
+               (IsStaticDataMember ? VarFlagIsStaticDataMember : 0) |
+               (IsConstexpr ? VarFlagIsConstexpr : 0) |
+               (IsInitICE ? VarFlagIsInitIce : 0);
+  }
+  int numFlagFields = Options.flagMasks
+                          ? (FlagMask != 0)
+                          : IsGlobal + IsExtern + IsStatic + IsStaticLocal +
+                                IsStaticDataMember + IsConstexpr + IsInitICE;
   ObjectScope Scope(OF,
-                    IsGlobal + IsExtern + IsStatic + IsStaticLocal +
-                        IsStaticDataMember + IsConstexpr + IsInitICE + HasInit +
-                        HasParmIndex + isInitExprCXX11ConstantExpr);
+                    numFlagFields + HasInit + HasParmIndex +
+                        isInitExprCXX11ConstantExpr);
 
-  OF.emitFlag("is_global", IsGlobal);
-  OF.emitFlag("is_extern", IsExtern);
-  OF.emitFlag("is_static", IsStatic);
-  OF.emitFlag("is_static_local", IsStaticLocal);
-  OF.emitFlag("is_static_data_member", IsStaticDataMember);
-  OF.emitFlag("is_constexpr", IsConstexpr);
-  OF.emitFlag("is_init_ice", IsInitICE);
+  if (Options.flagMasks) {
+    OF.emitFlagMask("flags", FlagMask);
+  } else {
+    OF.emitFlag("is_global", IsGlobal);
+    OF.emitFlag("is_extern", IsExtern);
+    OF.emitFlag("is_static", IsStatic);
+    OF.emitFlag("is_static_local", IsStaticLocal);
+    OF.emitFlag("is_static_data_member", IsStaticDataMember);
+    OF.emitFlag("is_constexpr", IsConstexpr);
+    OF.emitFlag("is_init_ice", IsInitICE);
+  }
   if (HasInit) {
-    OF.emitTag("init_expr");
-    dumpStmt(D->getInit());
-    OF.emitFlag("is_init_expr_cxx11_constant", isInitExprCXX11ConstantExpr);
+    if (FoldedInit) {
+      OF.emitTag("folded_init");
+      dumpFoldedInit(D, *FoldedInit);
+    } else {
+      OF.emitTag("init_expr");
+      dumpStmt(D->getInit());
+      OF.emitFlag("is_init_expr_cxx11_constant", isInitExprCXX11ConstantExpr);
+    }
   }
   if (HasParmIndex) {
     OF.emitTag("parm_index_in_function");
@@ -1736,6 +4965,29 @@ void ASTExporter<ATDWriter>::dumpVarDeclInfo(const VarDecl *D) {
   }
 }
 
+//@atd type folded_init_info = {
+//@atd   value : string;
+//@atd   tree_hash : string;
+//@atd } <ocaml field_prefix="fii_">
+template <class ATDWriter>
+void ASTExporter<ATDWriter>::dumpFoldedInit(const VarDecl *D,
+                                            const APValue &Value) {
+  ObjectScope Scope(OF, 2);
+  OF.emitTag("value");
+  std::string str;
+  llvm::raw_string_ostream valueStream(str);
+  Value.printPretty(valueStream, Context, D->getType());
+  OF.emitString(valueStream.str());
+  // the hash lets consumers tell two folded initializers apart (and
+  // spot identical ones) without the tree being serialized, like the
+  // init-list summary under maxInitListElems
+  llvm::FoldingSetNodeID ID;
+  D->getInit()->Profile(ID, Context, /*Canonical=*/false);
+  OF.emitTag("tree_hash");
+  SmallString<16> HashBuf;
+  OF.emitString(llvm::Twine(ID.ComputeHash()).toStringRef(HashBuf));
+}
+
 //@atd #define var_decl_tuple declarator_decl_tuple * var_decl_info
 template <class ATDWriter>
 void ASTExporter<ATDWriter>::VisitVarDecl(const VarDecl *D) {
@@ -1767,6 +5019,7 @@ int ASTExporter<ATDWriter>::UsingDirectiveDeclTupleSize() {
 //@atd   using_location : source_location;
 //@atd   namespace_key_location : source_location;
 //@atd   nested_name_specifier_locs : nested_name_specifier_loc list;
+//@atd   ?nested_name_specifier_id : int option;
 //@atd   ?nominated_namespace : decl_ref option;
 //@atd } <ocaml field_prefix="uddi_">
 template <class ATDWriter>
@@ -1775,14 +5028,21 @@ void ASTExporter<ATDWriter>::VisitUsingDirectiveDecl(
   VisitNamedDecl(D);
 
   bool HasNominatedNamespace = D->getNominatedNamespace();
-  ObjectScope Scope(OF, 3 + HasNominatedNamespace);
+  bool InternQualifier = Options.useSpecifierTable && D->getQualifierLoc();
+  ObjectScope Scope(OF, 3 + InternQualifier + HasNominatedNamespace);
 
   OF.emitTag("using_location");
   dumpSourceLocation(D->getUsingLoc());
   OF.emitTag("namespace_key_location");
   dumpSourceLocation(D->getNamespaceKeyLocation());
   OF.emitTag("nested_name_specifier_locs");
-  dumpNestedNameSpecifierLoc(D->getQualifierLoc());
+  if (InternQualifier) {
+    { ArrayScope aScope(OF, 0); }
+    OF.emitTag("nested_name_specifier_id");
+    OF.emitInteger(specifierChainId(D->getQualifierLoc()));
+  } else {
+    dumpNestedNameSpecifierLoc(D->getQualifierLoc());
+  }
   if (HasNominatedNamespace) {
     OF.emitTag("nominated_namespace");
     dumpDeclRef(*D->getNominatedNamespace());
@@ -1798,19 +5058,27 @@ int ASTExporter<ATDWriter>::NamespaceAliasDeclTupleSize() {
 //@atd   namespace_loc : source_location;
 //@atd   target_name_loc : source_location;
 //@atd   nested_name_specifier_locs : nested_name_specifier_loc list;
+//@atd   ?nested_name_specifier_id : int option;
 //@atd   namespace : decl_ref;
 //@atd } <ocaml field_prefix="nadi_">
 template <class ATDWriter>
 void ASTExporter<ATDWriter>::VisitNamespaceAliasDecl(
     const NamespaceAliasDecl *D) {
   VisitNamedDecl(D);
-  ObjectScope Scope(OF, 4);
+  bool InternQualifier = Options.useSpecifierTable && D->getQualifierLoc();
+  ObjectScope Scope(OF, 4 + InternQualifier);
   OF.emitTag("namespace_loc");
   dumpSourceLocation(D->getNamespaceLoc());
   OF.emitTag("target_name_loc");
   dumpSourceLocation(D->getTargetNameLoc());
   OF.emitTag("nested_name_specifier_locs");
-  dumpNestedNameSpecifierLoc(D->getQualifierLoc());
+  if (InternQualifier) {
+    { ArrayScope aScope(OF, 0); }
+    OF.emitTag("nested_name_specifier_id");
+    OF.emitInteger(specifierChainId(D->getQualifierLoc()));
+  } else {
+    dumpNestedNameSpecifierLoc(D->getQualifierLoc());
+  }
   OF.emitTag("namespace");
   dumpDeclRef(*D->getNamespace());
 }
@@ -1892,6 +5160,7 @@ int ASTExporter<ATDWriter>::CXXRecordDeclTupleSize() {
 //@atd   ~bases : type_ptr list;
 //@atd   ~vbases : type_ptr list;
 //@atd   ~transitive_vbases : type_ptr list;
+//@atd   ?base_list_id : int option;
 //@atd   ~is_pod : bool;
 //@atd   ~is_trivially_copyable : bool;
 //@atd   ?destructor : decl_ref option;
@@ -1931,32 +5200,64 @@ void ASTExporter<ATDWriter>::VisitCXXRecordDecl(const CXXRecordDecl *D) {
   const CXXDestructorDecl *DestructorDecl = D->getDestructor();
   const CXXMethodDecl *LambdaCallOperator = D->getLambdaCallOperator();
 
-  auto I = D->captures_begin(), E = D->captures_end();
-  ObjectScope Scope(OF,
-                    0 + HasNonVBases + HasVBases + HasTransitiveVBases + IsPOD +
-                        IsTriviallyCopyable + (bool)DestructorDecl +
-                        (bool)LambdaCallOperator + (I != E));
-
-  if (HasNonVBases) {
-    OF.emitTag("bases");
-    ArrayScope aScope(OF, nonVBases.size());
-    for (const auto base : nonVBases) {
-      dumpQualTypeNoQuals(base.getType());
+  // Identical hierarchies recur across template specializations; under
+  // dedupBaseLists only the first one dumps its lists, the rest carry
+  // the id it was registered under.
+  bool DedupBases = Options.dedupBaseLists &&
+                    (HasNonVBases || HasVBases || HasTransitiveVBases);
+  bool FirstBaseListRef = true;
+  int BaseListId = 0;
+  if (DedupBases) {
+    std::vector<const Type *> key;
+    key.reserve(nonVBases.size() + vBases.size() + numTransitiveVBases + 2);
+    for (const auto &base : nonVBases) {
+      key.push_back(base.getType().getTypePtrOrNull());
     }
-  }
-  if (HasVBases) {
-    OF.emitTag("vbases");
-    ArrayScope aScope(OF, vBases.size());
-    for (const auto base : vBases) {
-      dumpQualTypeNoQuals(base.getType());
+    key.push_back(nullptr);
+    for (const auto &base : vBases) {
+      key.push_back(base.getType().getTypePtrOrNull());
     }
-  }
-  if (HasTransitiveVBases) {
-    OF.emitTag("transitive_vbases");
-    ArrayScope aScope(OF, numTransitiveVBases);
-    for (const auto base : D->vbases()) {
-      dumpQualTypeNoQuals(base.getType());
+    key.push_back(nullptr);
+    for (const auto &base : D->vbases()) {
+      key.push_back(base.getType().getTypePtrOrNull());
     }
+    auto res =
+        BaseListIdMap.try_emplace(std::move(key), (int)BaseListIdMap.size());
+    FirstBaseListRef = res.second;
+    BaseListId = res.first->second;
+  }
+  bool DumpBaseLists = !DedupBases || FirstBaseListRef;
+
+  auto I = D->captures_begin(), E = D->captures_end();
+  ObjectScope Scope(
+      OF,
+      0 +
+          (DumpBaseLists
+               ? HasNonVBases + HasVBases + HasTransitiveVBases
+               : 0) +
+          DedupBases + IsPOD + IsTriviallyCopyable + (bool)DestructorDecl +
+          (bool)LambdaCallOperator + (I != E));
+
+  if (DumpBaseLists) {
+    OF.emitDefaultableArray("bases", nonVBases.size(), [&] {
+      for (const auto base : nonVBases) {
+        dumpQualTypeNoQuals(base.getType());
+      }
+    });
+    OF.emitDefaultableArray("vbases", vBases.size(), [&] {
+      for (const auto base : vBases) {
+        dumpQualTypeNoQuals(base.getType());
+      }
+    });
+    OF.emitDefaultableArray("transitive_vbases", numTransitiveVBases, [&] {
+      for (const auto base : D->vbases()) {
+        dumpQualTypeNoQuals(base.getType());
+      }
+    });
+  }
+  if (DedupBases) {
+    OF.emitTag("base_list_id");
+    OF.emitInteger(BaseListId);
   }
   OF.emitFlag("is_pod", IsPOD);
   OF.emitFlag("is_trivially_copyable", IsTriviallyCopyable);
@@ -2014,7 +5315,7 @@ void ASTExporter<ATDWriter>::dumpTemplateArgument(const TemplateArgument &Arg) {
     VariantScope Scope(OF, "Integral");
     llvm::SmallString<64> buf;
     Arg.getAsIntegral().toString(buf, 10);
-    OF.emitString(buf.str().str());
+    OF.emitString(buf.str());
     break;
   }
   case TemplateArgument::Template: {
@@ -2054,12 +5355,27 @@ void ASTExporter<ATDWriter>::dumpTemplateArguments(
 
 //@atd type template_specialization_info = {
 //@atd   template_decl : pointer;
+//@atd   ?spec_args_id : int option;
 //@atd   ~specialization_args : template_instantiation_arg_info list;
 //@atd } <ocaml field_prefix="tsi_">
 template <class ATDWriter>
 void ASTExporter<ATDWriter>::dumpTemplateSpecialization(
     const TemplateDecl *D, const TemplateArgumentList &Args) {
   bool HasTemplateArgs = Args.size() > 0;
+  if (Options.dedupTemplateArgs && HasTemplateArgs) {
+    auto res = TemplateArgsIdMap.try_emplace(&Args, TemplateArgsIdMap.size());
+    bool FirstReference = res.second;
+    ObjectScope oScope(OF, 2 + FirstReference);
+    OF.emitTag("template_decl");
+    dumpPointer(D);
+    OF.emitTag("spec_args_id");
+    OF.emitInteger(res.first->second);
+    if (FirstReference) {
+      OF.emitTag("specialization_args");
+      dumpTemplateArguments(Args);
+    }
+    return;
+  }
   ObjectScope oScope(OF, 1 + HasTemplateArgs);
   OF.emitTag("template_decl");
   dumpPointer(D);
@@ -2080,13 +5396,20 @@ void ASTExporter<ATDWriter>::VisitClassTemplateSpecializationDecl(
     const ClassTemplateSpecializationDecl *D) {
   VisitCXXRecordDecl(D);
   bool ShouldMangleName = Mangler->shouldMangleDeclName(D) &&
-                          (isa<FunctionDecl>(D) || isa<VarDecl>(D));
+                          (isa<FunctionDecl>(D) || isa<VarDecl>(D)) &&
+                          // e.g. specializations over internal-linkage
+                          // arguments resolve within this TU only
+                          (!Options.mangleExternalOnly ||
+                           D->isExternallyVisible());
   if (ShouldMangleName) {
     SmallString<64> Buf;
     llvm::raw_svector_ostream StrOS(Buf);
     Mangler->mangleName(D, StrOS);
     // mangled names can get ridiculously long, so hash them to a fixed size
-    OF.emitString(std::to_string(fnv64Hash(StrOS)));
+    SmallString<20> HashBuf;
+    OF.emitString(
+        llvm::Twine(Options.useXXHash ? xxh64Hash(StrOS) : fnv64Hash(StrOS))
+            .toStringRef(HashBuf));
   } else {
     OF.emitString("");
   }
@@ -2118,15 +5441,9 @@ void ASTExporter<ATDWriter>::VisitDecompositionDecl(
     const DecompositionDecl *D) {
   VisitVarDecl(D);
 
-  std::vector<const BindingDecl *> declsToDump;
-
+  ArrayScope Scope(OF);
   for (const auto *B : D->bindings()) {
-    declsToDump.push_back(B);
-  }
-
-  ArrayScope Scope(OF, declsToDump.size());
-  for (const auto *spec : declsToDump) {
-    dumpDecl(spec);
+    dumpDecl(B);
   }
 }
 
@@ -2188,20 +5505,19 @@ void ASTExporter<ATDWriter>::VisitCXXMethodDecl(const CXXMethodDecl *D) {
   OF.emitFlag("is_copy_assignment", isCopyAssignment);
   OF.emitFlag("is_copy_constructor", isCopyConstructor);
   OF.emitFlag("is_move_constructor", isMoveConstructor);
-  if (HasCtorInitializers) {
-    OF.emitTag("cxx_ctor_initializers");
-    ArrayScope Scope(OF, std::distance(C->init_begin(), C->init_end()));
-    for (auto I : C->inits()) {
-      dumpCXXCtorInitializer(*I);
-    }
-  }
-  if (OB != OE) {
-    OF.emitTag("overriden_methods");
-    ArrayScope Scope(OF, std::distance(OB, OE));
+  OF.emitDefaultableArray(
+      "cxx_ctor_initializers",
+      HasCtorInitializers ? std::distance(C->init_begin(), C->init_end()) : 0,
+      [&] {
+        for (auto I : C->inits()) {
+          dumpCXXCtorInitializer(*I);
+        }
+      });
+  OF.emitDefaultableArray("overriden_methods", std::distance(OB, OE), [&] {
     for (; OB != OE; ++OB) {
       dumpDeclRef(**OB);
     }
-  }
+  });
 }
 
 template <class ATDWriter>
@@ -2213,34 +5529,90 @@ int ASTExporter<ATDWriter>::ClassTemplateDeclTupleSize() {
 //@atd type template_decl_info = {
 //@atd   ~specializations : decl list;
 //@atd } <ocaml field_prefix="tdi_">
+// Cross-capture deduplication of implicit template specializations: the
+// same std:: instantiations get serialized by nearly every translation
+// unit of a project. The first capture to claim a specialization's
+// mangled name (a marker file in Options.specDedupDir) dumps it in
+// full; later captures drop it from their specialization lists, leaving
+// it visible through the decl_refs at its use sites.
+template <class ATDWriter>
+bool ASTExporter<ATDWriter>::specializationSeenElsewhere(
+    const NamedDecl *spec) {
+  if (Options.specDedupDir.empty()) {
+    return false;
+  }
+  SmallString<64> Buf;
+  llvm::raw_svector_ostream StrOS(Buf);
+  if (const FunctionDecl *FD = dyn_cast<FunctionDecl>(spec)) {
+    GlobalDecl GD;
+    if (const CXXConstructorDecl *CD = dyn_cast<CXXConstructorDecl>(FD)) {
+      GD = GlobalDecl(CD, Ctor_Base);
+    } else if (const CXXDestructorDecl *DD = dyn_cast<CXXDestructorDecl>(FD)) {
+      GD = GlobalDecl(DD, Dtor_Base);
+    } else {
+      GD = GlobalDecl(FD);
+    }
+    Mangler->mangleName(GD, StrOS);
+  } else if (const CXXRecordDecl *RD = dyn_cast<CXXRecordDecl>(spec)) {
+    Mangler->mangleTypeName(Context.getRecordType(RD), StrOS);
+  } else {
+    return false;
+  }
+  llvm::SHA1 Hash;
+  Hash.update(StrOS.str());
+  Hash.update(Options.formatFingerprint());
+  std::string markerPath = Options.specDedupDir + "/" +
+                           llvm::toHex(Hash.final(), /*LowerCase=*/true);
+  if (llvm::sys::fs::exists(markerPath)) {
+    return true;
+  }
+  // claim it: publish an empty marker with a rename so concurrent
+  // captures race benignly (both dump the body, neither fails)
+  int tmpFD = -1;
+  llvm::SmallString<128> tmpPath;
+  if (!llvm::sys::fs::createUniqueFile(
+          markerPath + ".tmp%%%%%%", tmpFD, tmpPath)) {
+    { llvm::raw_fd_ostream markerOS(tmpFD, /*shouldClose=*/true); }
+    llvm::sys::fs::rename(tmpPath, markerPath);
+  }
+  return false;
+}
+
 template <class ATDWriter>
 void ASTExporter<ATDWriter>::VisitClassTemplateDecl(
     const ClassTemplateDecl *D) {
   ASTExporter<ATDWriter>::VisitRedeclarableTemplateDecl(D);
-  std::vector<const ClassTemplateSpecializationDecl *> DeclsToDump;
+  auto shouldDumpSpec = [](const ClassTemplateSpecializationDecl *spec) {
+    switch (spec->getTemplateSpecializationKind()) {
+    case TSK_Undeclared:
+    case TSK_ImplicitInstantiation:
+      return true;
+    case TSK_ExplicitSpecialization:
+    case TSK_ExplicitInstantiationDeclaration:
+    case TSK_ExplicitInstantiationDefinition:
+      // these specializations will be dumped elsewhere
+      return false;
+    }
+    llvm_unreachable("invalid template specialization kind");
+  };
+  bool ShouldDumpSpecializations = false;
   if (D == D->getCanonicalDecl()) {
     // dump specializations once
     for (const auto *spec : D->specializations()) {
-      switch (spec->getTemplateSpecializationKind()) {
-      case TSK_Undeclared:
-      case TSK_ImplicitInstantiation:
-        DeclsToDump.push_back(spec);
-        break;
-      case TSK_ExplicitSpecialization:
-      case TSK_ExplicitInstantiationDeclaration:
-      case TSK_ExplicitInstantiationDefinition:
-        // these specializations will be dumped elsewhere
+      if (shouldDumpSpec(spec)) {
+        ShouldDumpSpecializations = true;
         break;
       }
     }
   }
-  bool ShouldDumpSpecializations = !DeclsToDump.empty();
   ObjectScope Scope(OF, 0 + ShouldDumpSpecializations);
   if (ShouldDumpSpecializations) {
     OF.emitTag("specializations");
-    ArrayScope aScope(OF, DeclsToDump.size());
-    for (const auto *spec : DeclsToDump) {
-      dumpDecl(spec);
+    ArrayScope aScope(OF);
+    for (const auto *spec : D->specializations()) {
+      if (shouldDumpSpec(spec) && !specializationSeenElsewhere(spec)) {
+        dumpDecl(spec);
+      }
     }
   }
 }
@@ -2254,30 +5626,37 @@ template <class ATDWriter>
 void ASTExporter<ATDWriter>::VisitFunctionTemplateDecl(
     const FunctionTemplateDecl *D) {
   ASTExporter<ATDWriter>::VisitRedeclarableTemplateDecl(D);
-  std::vector<const FunctionDecl *> DeclsToDump;
+  auto shouldDumpSpec = [](const FunctionDecl *spec) {
+    switch (spec->getTemplateSpecializationKind()) {
+    case TSK_Undeclared:
+    case TSK_ImplicitInstantiation:
+    case TSK_ExplicitInstantiationDefinition:
+    case TSK_ExplicitInstantiationDeclaration:
+      return true;
+    case TSK_ExplicitSpecialization:
+      // these specializations will be dumped when they are defined
+      return false;
+    }
+    llvm_unreachable("invalid template specialization kind");
+  };
+  bool ShouldDumpSpecializations = false;
   if (D == D->getCanonicalDecl()) {
     // dump specializations once
     for (const auto *spec : D->specializations()) {
-      switch (spec->getTemplateSpecializationKind()) {
-      case TSK_Undeclared:
-      case TSK_ImplicitInstantiation:
-      case TSK_ExplicitInstantiationDefinition:
-      case TSK_ExplicitInstantiationDeclaration:
-        DeclsToDump.push_back(spec);
-        break;
-      case TSK_ExplicitSpecialization:
-        // these specializations will be dumped when they are defined
+      if (shouldDumpSpec(spec)) {
+        ShouldDumpSpecializations = true;
         break;
       }
     }
   }
-  bool ShouldDumpSpecializations = !DeclsToDump.empty();
   ObjectScope Scope(OF, 0 + ShouldDumpSpecializations);
   if (ShouldDumpSpecializations) {
     OF.emitTag("specializations");
-    ArrayScope aScope(OF, DeclsToDump.size());
-    for (const auto *spec : DeclsToDump) {
-      dumpDecl(spec);
+    ArrayScope aScope(OF);
+    for (const auto *spec : D->specializations()) {
+      if (shouldDumpSpec(spec) && !specializationSeenElsewhere(spec)) {
+        dumpDecl(spec);
+      }
     }
   }
 }
@@ -2359,7 +5738,9 @@ int ASTExporter<ATDWriter>::ObjCMethodDeclTupleSize() {
 //@atd   ~is_property_accessor : bool;
 //@atd   ?property_decl : decl_ref option;
 //@atd   ~parameters : decl list;
+//@atd   ~parameter_table : parm_table_entry list;
 //@atd   ~implicit_parameters : decl list;
+//@atd   ~implicit_parameter_table : parm_table_entry list;
 //@atd   ~is_variadic : bool;
 //@atd   ~is_overriding : bool;
 //@atd   ~is_optional : bool;
@@ -2373,9 +5754,11 @@ void ASTExporter<ATDWriter>::VisitObjCMethodDecl(const ObjCMethodDecl *D) {
   bool IsInstanceMethod = D->isInstanceMethod();
   bool IsPropertyAccessor = D->isPropertyAccessor();
   const ObjCPropertyDecl *PropertyDecl = nullptr;
-  std::string selectorName = D->getSelector().getAsString();
+  // the arena bytes stay put even if dumping the body below grows the
+  // selector cache
+  llvm::StringRef SelName = selectorName(D->getSelector());
   // work around bug in clang
-  if (selectorName != ".cxx_construct" && selectorName != ".cxx_destruct") {
+  if (SelName != ".cxx_construct" && SelName != ".cxx_destruct") {
     PropertyDecl = D->findPropertyDecl();
   }
   ObjCMethodDecl::param_const_iterator I = D->param_begin(), E = D->param_end();
@@ -2388,18 +5771,42 @@ void ASTExporter<ATDWriter>::VisitObjCMethodDecl(const ObjCMethodDecl *D) {
     ImplicitParams.push_back(D->getCmdDecl());
   }
   bool HasImplicitParameters = !ImplicitParams.empty();
+  bool UseParamTable = Options.paramTable && HasParameters;
+  if (UseParamTable) {
+    for (const ParmVarDecl *P : D->parameters()) {
+      if (!canTabulateParam(P)) {
+        UseParamTable = false;
+        break;
+      }
+    }
+  }
+  // self and _cmd always fit the columns; explicit attributes or
+  // initializers cannot be written on them
+  bool UseImplicitParamTable = Options.paramTable && HasImplicitParameters;
   bool IsVariadic = D->isVariadic();
   bool IsOverriding = D->isOverriding();
   bool IsOptional = D->isOptional();
   const Stmt *Body = D->getBody();
 
-  SmallString<64> Buf;
-  llvm::raw_svector_ostream StrOS(Buf);
-  Mangler->mangleObjCMethodName(D,
-                                StrOS,
-                                /*includePrefixByte=*/false,
-                                /*includeCategoryNamespace=*/true);
-  std::string MangledName = StrOS.str().str();
+  auto res = MangledNameCache.try_emplace(D->getCanonicalDecl());
+  if (res.second) {
+    SmallString<64> Buf;
+    llvm::raw_svector_ostream StrOS(Buf);
+    Mangler->mangleObjCMethodName(D,
+                                  StrOS,
+                                  /*includePrefixByte=*/false,
+                                  /*includeCategoryNamespace=*/true);
+    res.first->second = ArenaSaver.save(StrOS.str());
+  }
+  // the arena bytes stay put even if dumping the body below grows the
+  // cache and moves the entry
+  llvm::StringRef MangledName = res.first->second;
+  if (Options.symbolBloom && Body) {
+    DefinedSymbols.insert(SymbolBloom::key(MangledName));
+  }
+  if (Options.lineIndex && Body) {
+    recordLineIndexEntry(D, MangledName);
+  }
 
   ObjectScope Scope(OF,
                     1 + IsInstanceMethod + IsPropertyAccessor +
@@ -2415,7 +5822,13 @@ void ASTExporter<ATDWriter>::VisitObjCMethodDecl(const ObjCMethodDecl *D) {
     OF.emitTag("property_decl");
     dumpDeclRef(*PropertyDecl);
   }
-  if (HasParameters) {
+  if (UseParamTable) {
+    OF.emitTag("parameter_table");
+    TableScope Scope(OF, std::distance(I, E));
+    for (; I != E; ++I) {
+      dumpParamTableRow(*I);
+    }
+  } else if (HasParameters) {
     OF.emitTag("parameters");
     ArrayScope Scope(OF, std::distance(I, E));
     for (; I != E; ++I) {
@@ -2423,7 +5836,13 @@ void ASTExporter<ATDWriter>::VisitObjCMethodDecl(const ObjCMethodDecl *D) {
     }
   }
 
-  if (HasImplicitParameters) {
+  if (UseImplicitParamTable) {
+    OF.emitTag("implicit_parameter_table");
+    TableScope Scope(OF, ImplicitParams.size());
+    for (const ImplicitParamDecl *P : ImplicitParams) {
+      dumpParamTableRow(P);
+    }
+  } else if (HasImplicitParameters) {
     OF.emitTag("implicit_parameters");
     ArrayScope Scope(OF, ImplicitParams.size());
     for (const ImplicitParamDecl *P : ImplicitParams) {
@@ -2445,6 +5864,25 @@ void ASTExporter<ATDWriter>::VisitObjCMethodDecl(const ObjCMethodDecl *D) {
   OF.emitString(MangledName);
 }
 
+// Interfaces, categories, class extensions and protocols each carry
+// their own copy of the protocols they adopt, and a heavily-categorized
+// class re-lists the same protocols once per category. Under
+// dedupProtocolLists the first holder of a given list dumps it in full
+// and registers it under an id, the rest emit only the id (the
+// base-list scheme of VisitCXXRecordDecl); empty lists stay elided.
+template <class ATDWriter>
+typename ASTExporter<ATDWriter>::ProtocolListPlan
+ASTExporter<ATDWriter>::planProtocolList(const ObjCProtocolDecl *const *I,
+                                         const ObjCProtocolDecl *const *E) {
+  if (!Options.dedupProtocolLists || I == E) {
+    return {true, false, 0};
+  }
+  std::vector<const ObjCProtocolDecl *> key(I, E);
+  auto res = ProtocolListIdMap.try_emplace(std::move(key),
+                                           (int)ProtocolListIdMap.size());
+  return {res.second, true, res.first->second};
+}
+
 template <class ATDWriter>
 int ASTExporter<ATDWriter>::ObjCCategoryDeclTupleSize() {
   return ObjCContainerDeclTupleSize() + 1;
@@ -2454,6 +5892,7 @@ int ASTExporter<ATDWriter>::ObjCCategoryDeclTupleSize() {
 //@atd   ?class_interface : decl_ref option;
 //@atd   ?implementation : decl_ref option;
 //@atd   ~protocols : decl_ref list;
+//@atd   ?protocol_list_id : int option;
 //@atd } <ocaml field_prefix="odi_">
 template <class ATDWriter>
 void ASTExporter<ATDWriter>::VisitObjCCategoryDecl(const ObjCCategoryDecl *D) {
@@ -2464,8 +5903,11 @@ void ASTExporter<ATDWriter>::VisitObjCCategoryDecl(const ObjCCategoryDecl *D) {
   ObjCCategoryDecl::protocol_iterator I = D->protocol_begin(),
                                       E = D->protocol_end();
   bool HasProtocols = I != E;
-  ObjectScope Scope(
-      OF, 0 + (bool)CI + (bool)Impl + HasProtocols); // not covered by tests
+  ProtocolListPlan Plan = planProtocolList(I, E);
+  ObjectScope Scope(OF,
+                    0 + (bool)CI + (bool)Impl +
+                        (Plan.dumpList && HasProtocols) +
+                        Plan.emitId); // not covered by tests
 
   if (CI) {
     OF.emitTag("class_interface");
@@ -2475,13 +5917,18 @@ void ASTExporter<ATDWriter>::VisitObjCCategoryDecl(const ObjCCategoryDecl *D) {
     OF.emitTag("implementation");
     dumpDeclRef(*Impl);
   }
-  if (HasProtocols) {
-    OF.emitTag("protocols");
-    ArrayScope Scope(OF, std::distance(I, E)); // not covered by tests
-    for (; I != E; ++I) {
-      assert(*I);
-      dumpDeclRef(**I);
-    }
+  if (Plan.dumpList) {
+    // not covered by tests
+    OF.emitDefaultableArray("protocols", std::distance(I, E), [&] {
+      for (; I != E; ++I) {
+        assert(*I);
+        dumpDeclRef(**I);
+      }
+    });
+  }
+  if (Plan.emitId) {
+    OF.emitTag("protocol_list_id");
+    OF.emitInteger(Plan.id);
   }
 }
 
@@ -2520,6 +5967,7 @@ int ASTExporter<ATDWriter>::ObjCProtocolDeclTupleSize() {
 //@atd #define obj_c_protocol_decl_tuple obj_c_container_decl_tuple * obj_c_protocol_decl_info
 //@atd type obj_c_protocol_decl_info = {
 //@atd   ~protocols : decl_ref list;
+//@atd   ?protocol_list_id : int option;
 //@atd } <ocaml field_prefix="opcdi_">
 template <class ATDWriter>
 void ASTExporter<ATDWriter>::VisitObjCProtocolDecl(const ObjCProtocolDecl *D) {
@@ -2528,15 +5976,23 @@ void ASTExporter<ATDWriter>::VisitObjCProtocolDecl(const ObjCProtocolDecl *D) {
   ObjCCategoryDecl::protocol_iterator I = D->protocol_begin(),
                                       E = D->protocol_end();
   bool HasProtocols = I != E;
-  ObjectScope Scope(OF, 0 + HasProtocols); // not covered by tests
+  ProtocolListPlan Plan = planProtocolList(I, E);
+  ObjectScope Scope(OF,
+                    0 + (Plan.dumpList && HasProtocols) +
+                        Plan.emitId); // not covered by tests
 
-  if (HasProtocols) {
-    OF.emitTag("protocols");
-    ArrayScope Scope(OF, std::distance(I, E)); // not covered by tests
-    for (; I != E; ++I) {
-      assert(*I);
-      dumpDeclRef(**I);
-    }
+  if (Plan.dumpList) {
+    // not covered by tests
+    OF.emitDefaultableArray("protocols", std::distance(I, E), [&] {
+      for (; I != E; ++I) {
+        assert(*I);
+        dumpDeclRef(**I);
+      }
+    });
+  }
+  if (Plan.emitId) {
+    OF.emitTag("protocol_list_id");
+    OF.emitInteger(Plan.id);
   }
 }
 
@@ -2549,6 +6005,7 @@ int ASTExporter<ATDWriter>::ObjCInterfaceDeclTupleSize() {
 //@atd   ?super : decl_ref option;
 //@atd   ?implementation : decl_ref option;
 //@atd   ~protocols : decl_ref list;
+//@atd   ?protocol_list_id : int option;
 //@atd   ~known_categories : decl_ref list;
 //@atd } <ocaml field_prefix="otdi_">
 template <class ATDWriter>
@@ -2566,8 +6023,11 @@ void ASTExporter<ATDWriter>::VisitObjCInterfaceDecl(
                                                EC = D->known_categories_end();
 
   bool HasKnownCategories = IC != EC;
-  ObjectScope Scope(
-      OF, 0 + (bool)SC + (bool)Impl + HasProtocols + HasKnownCategories);
+  ProtocolListPlan Plan = planProtocolList(IP, EP);
+  ObjectScope Scope(OF,
+                    0 + (bool)SC + (bool)Impl +
+                        (Plan.dumpList && HasProtocols) + Plan.emitId +
+                        HasKnownCategories);
 
   if (SC) {
     OF.emitTag("super");
@@ -2577,22 +6037,24 @@ void ASTExporter<ATDWriter>::VisitObjCInterfaceDecl(
     OF.emitTag("implementation");
     dumpDeclRef(*Impl);
   }
-  if (HasProtocols) {
-    OF.emitTag("protocols");
-    ArrayScope Scope(OF, std::distance(IP, EP));
-    for (; IP != EP; ++IP) {
-      assert(*IP);
-      dumpDeclRef(**IP);
-    }
+  if (Plan.dumpList) {
+    OF.emitDefaultableArray("protocols", std::distance(IP, EP), [&] {
+      for (; IP != EP; ++IP) {
+        assert(*IP);
+        dumpDeclRef(**IP);
+      }
+    });
+  }
+  if (Plan.emitId) {
+    OF.emitTag("protocol_list_id");
+    OF.emitInteger(Plan.id);
   }
-  if (HasKnownCategories) {
-    OF.emitTag("known_categories");
-    ArrayScope Scope(OF, std::distance(IC, EC));
+  OF.emitDefaultableArray("known_categories", std::distance(IC, EC), [&] {
     for (; IC != EC; ++IC) {
       assert(*IC);
       dumpDeclRef(**IC);
     }
-  }
+  });
 }
 
 template <class ATDWriter>
@@ -2625,14 +6087,13 @@ void ASTExporter<ATDWriter>::VisitObjCImplementationDecl(
     OF.emitTag("class_interface");
     dumpDeclRef(*CI);
   }
-  if (HasInitializers) {
-    OF.emitTag("ivar_initializers");
-    ArrayScope Scope(OF, std::distance(I, E)); // not covered by tests
+  // not covered by tests
+  OF.emitDefaultableArray("ivar_initializers", std::distance(I, E), [&] {
     for (; I != E; ++I) {
       assert(*I);
       dumpCXXCtorInitializer(**I);
     }
-  }
+  });
 }
 
 template <class ATDWriter>
@@ -2667,6 +6128,9 @@ int ASTExporter<ATDWriter>::ObjCPropertyDeclTupleSize() {
 //@atd   ?getter_method : decl_ref option;
 //@atd   ?setter_method : decl_ref option;
 //@atd   ?ivar_decl : decl_ref option;
+//@atd   ?getter_pointer : pointer option;
+//@atd   ?setter_pointer : pointer option;
+//@atd   ?ivar_pointer : pointer option;
 //@atd   ~property_control <ocaml default="`None"> : obj_c_property_control;
 //@atd   ~property_attributes : property_attribute list
 //@atd } <ocaml field_prefix="opdi_">
@@ -2702,20 +6166,50 @@ void ASTExporter<ATDWriter>::VisitObjCPropertyDecl(const ObjCPropertyDecl *D) {
                         HasPropertyControl +
                         HasPropertyAttributes); // not covered by tests
 
-  OF.emitTag("qual_type");
+  OF.emitTag(tags::qual_type);
   dumpQualType(D->getType());
 
-  if (Getter) {
-    OF.emitTag("getter_method");
-    dumpDeclRef(*Getter);
-  }
-  if (Setter) {
-    OF.emitTag("setter_method");
-    dumpDeclRef(*Setter);
-  }
-  if (Ivar) {
-    OF.emitTag("ivar_decl");
-    dumpDeclRef(*Ivar);
+  if (Options.objcAccessorPointers) {
+    // the accessor records themselves appear once, in the enclosing
+    // container; the property carries only their node ids. The recovery
+    // queue must still see the references so the ids resolve to dumped
+    // records under the partial-dump modes
+    if (Options.mainFileDeclsOnly || Options.skipUnusedImplicitDecls) {
+      if (Getter) {
+        recordReferencedDecl(Getter);
+      }
+      if (Setter) {
+        recordReferencedDecl(Setter);
+      }
+      if (Ivar) {
+        recordReferencedDecl(Ivar);
+      }
+    }
+    if (Getter) {
+      OF.emitTag("getter_pointer");
+      dumpPointer(Getter);
+    }
+    if (Setter) {
+      OF.emitTag("setter_pointer");
+      dumpPointer(Setter);
+    }
+    if (Ivar) {
+      OF.emitTag("ivar_pointer");
+      dumpPointer(Ivar);
+    }
+  } else {
+    if (Getter) {
+      OF.emitTag("getter_method");
+      dumpDeclRef(*Getter);
+    }
+    if (Setter) {
+      OF.emitTag("setter_method");
+      dumpDeclRef(*Setter);
+    }
+    if (Ivar) {
+      OF.emitTag("ivar_decl");
+      dumpDeclRef(*Ivar);
+    }
   }
 
   if (HasPropertyControl) {
@@ -2858,7 +6352,9 @@ void ASTExporter<ATDWriter>::VisitBlockDecl(const BlockDecl *D) {
   if (auto ND = dyn_cast<NamedDecl>(DC)) {
     if (!isa<FunctionDecl>(ND) && !isa<VarDecl>(ND) && ND->getIdentifier()) {
       MangledName = ND->getIdentifier()->getName().str();
-    } else if (!isa<CXXConstructorDecl>(DC) && !isa<CXXDestructorDecl>(DC)) {
+    } else if (!isa<CXXConstructorDecl>(DC) && !isa<CXXDestructorDecl>(DC) &&
+               // blocks have no linkage at all
+               !Options.mangleExternalOnly) {
       SmallString<64> Buf;
       llvm::raw_svector_ostream StrOS(Buf);
       Mangler->mangleBlock(DC, D, StrOS);
@@ -2915,14 +6411,12 @@ void ASTExporter<ATDWriter>::VisitBlockDecl(const BlockDecl *D) {
     dumpStmt(Body);
   }
 
-  if (!MangledName.empty()) {
-    OF.emitTag("mangled_name");
-    OF.emitString(MangledName);
-  }
+  OF.emitDefaultableString("mangled_name", MangledName);
 }
 
 // main variant for declarations
 //@atd type decl = [
+//@atd   | Null
 #define DECL(DERIVED, BASE) //@atd   | DERIVED@@Decl of (@DERIVED@_decl_tuple)
 #define ABSTRACT_DECL(DECL)
 #include <clang/AST/DeclNodes.inc>
@@ -2938,17 +6432,143 @@ void ASTExporter<ATDWriter>::VisitBlockDecl(const BlockDecl *D) {
 #define ABSTRACT_STMT(STMT) STMT
 #include <clang/AST/StmtNodes.inc>
 //
+// The cap of Options.maxInitListElems on initializer-list children,
+// the statement-tree analogue of maxStringSize for string literals.
+// Capped lists keep their stmt_info but lose their children; VisitExpr
+// emits a count plus content hash in expr_info in their place.
+template <class ATDWriter>
+bool ASTExporter<ATDWriter>::shouldSummarizeInitList(const Stmt *S) {
+  return Options.maxInitListElems > 0 && isa<InitListExpr>(S) &&
+         cast<InitListExpr>(S)->getNumInits() > Options.maxInitListElems;
+}
+
+// The cap of Options.maxLiteralBytes on string literal bytes: capped
+// literals keep their leading chunks only, and VisitExpr emits the full
+// length plus a content hash in expr_info in place of the tail.
+template <class ATDWriter>
+bool ASTExporter<ATDWriter>::shouldTruncateStringLiteral(const Stmt *S) {
+  return Options.maxLiteralBytes > 0 && isa<StringLiteral>(S) &&
+         cast<StringLiteral>(S)->getByteLength() > Options.maxLiteralBytes;
+}
+
 template <class ATDWriter>
 void ASTExporter<ATDWriter>::dumpStmt(const Stmt *S) {
   if (!S) {
+    if (Options.nullMarkers) {
+      OF.emitSimpleVariant(tags::NullVariant);
+      return;
+    }
     // We use a fixed NullStmt node to represent null pointers
     S = NullPtrStmt;
   }
-  VariantScope Scope(OF, S->getStmtClassName());
+  if (Options.maxStmtDepth > 0 && TotalStmtDepth >= Options.maxStmtDepth) {
+    dumpStmtSummary(S);
+    return;
+  }
+  if (Options.maxStmtRecursionDepth > 0 &&
+      StmtDepth >= Options.maxStmtRecursionDepth) {
+    // Hand the subtree over to a fresh thread with its own stack and
+    // wait for it. Emission stays strictly sequential -- only the native
+    // stack is swapped out -- so the writer and its open scopes carry
+    // over untouched, and the chain can extend to arbitrary depth one
+    // segment at a time.
+    const unsigned segmentStackSize = 8 << 20;
+    unsigned SavedDepth = StmtDepth;
+    StmtDepth = 0;
+    llvm::thread segment(llvm::Optional<unsigned>(segmentStackSize),
+                         [this, S] { dumpStmt(S); });
+    segment.join();
+    StmtDepth = SavedDepth;
+    return;
+  }
+  ++StmtDepth;
+  ++TotalStmtDepth;
   {
-    TupleScope Scope(OF, ASTExporter::tupleSizeOfStmtClass(S->getStmtClass()));
-    ConstStmtVisitor<ASTExporter<ATDWriter>>::Visit(S);
+    VisitorProfiler::Scope ProfScope(Options.profileVisitors ? &Profiler
+                                                             : nullptr,
+                                     VisitorProfiler::stmts,
+                                     "",
+                                     (unsigned)S->getStmtClass(),
+                                     S->getStmtClassName());
+    // Fast paths for the statement kinds that dominate dumped bodies
+    // (DeclRefExpr, ImplicitCastExpr, IntegerLiteral, CallExpr and
+    // MemberExpr together are ~70% of Stmt nodes): jump straight to the
+    // final visitor with a precomputed variant tag instead of walking
+    // the generic kind switch and hashing the class name per node. The
+    // visitors themselves are shared with the generic path, so the
+    // emitted bytes are identical by construction.
+    switch (S->getStmtClass()) {
+    case Stmt::DeclRefExprClass: {
+      VariantScope Scope(OF, tags::DeclRefExprVariant);
+      TupleScope TS(OF, ASTExporter::tupleSizeOfStmtClass(S->getStmtClass()));
+      VisitDeclRefExpr(static_cast<const DeclRefExpr *>(S));
+      break;
+    }
+    case Stmt::ImplicitCastExprClass: {
+      VariantScope Scope(OF, tags::ImplicitCastExprVariant);
+      TupleScope TS(OF, ASTExporter::tupleSizeOfStmtClass(S->getStmtClass()));
+      VisitImplicitCastExpr(static_cast<const ImplicitCastExpr *>(S));
+      break;
+    }
+    case Stmt::IntegerLiteralClass: {
+      VariantScope Scope(OF, tags::IntegerLiteralVariant);
+      TupleScope TS(OF, ASTExporter::tupleSizeOfStmtClass(S->getStmtClass()));
+      VisitIntegerLiteral(static_cast<const IntegerLiteral *>(S));
+      break;
+    }
+    case Stmt::CallExprClass: {
+      // CallExpr has no dedicated visitor; the generic dispatch lands on
+      // VisitExpr, so the fast path does too
+      VariantScope Scope(OF, tags::CallExprVariant);
+      TupleScope TS(OF, ASTExporter::tupleSizeOfStmtClass(S->getStmtClass()));
+      VisitExpr(static_cast<const CallExpr *>(S));
+      break;
+    }
+    case Stmt::MemberExprClass: {
+      VariantScope Scope(OF, tags::MemberExprVariant);
+      TupleScope TS(OF, ASTExporter::tupleSizeOfStmtClass(S->getStmtClass()));
+      VisitMemberExpr(static_cast<const MemberExpr *>(S));
+      break;
+    }
+    default: {
+      VariantScope Scope(OF, S->getStmtClassName());
+      TupleScope TS(OF,
+                    ASTExporter::tupleSizeOfStmtClass(S->getStmtClass()));
+      ConstStmtVisitor<ASTExporter<ATDWriter>>::Visit(S);
+      break;
+    }
+    }
   }
+  --StmtDepth;
+  --TotalStmtDepth;
+}
+
+// The stand-in for a subtree capped by maxStmtDepth: its root's kind
+// and range, how many children were cut, and a fingerprint of the whole
+// subtree so consumers can tell two capped subtrees apart (and spot
+// identical ones) without any of it being serialized, like the folded
+// initializers under foldConstInits.
+//@atd type summarized_stmt_info = {
+//@atd   kind : string;
+//@atd   num_children : int;
+//@atd   tree_hash : string;
+//@atd   source_range : source_range;
+//@atd } <ocaml field_prefix="ssi_">
+template <class ATDWriter>
+void ASTExporter<ATDWriter>::dumpStmtSummary(const Stmt *S) {
+  VariantScope Scope(OF, tags::SummarizedStmtVariant);
+  ObjectScope oScope(OF, 4);
+  OF.emitTag(tags::kind);
+  OF.emitString(S->getStmtClassName());
+  OF.emitTag("num_children");
+  OF.emitInteger(std::distance(S->child_begin(), S->child_end()));
+  llvm::FoldingSetNodeID ID;
+  S->Profile(ID, Context, /*Canonical=*/false);
+  OF.emitTag("tree_hash");
+  SmallString<16> HashBuf;
+  OF.emitString(llvm::Twine(ID.ComputeHash()).toStringRef(HashBuf));
+  OF.emitTag(tags::source_range);
+  dumpSourceRange(S->getSourceRange());
 }
 
 template <class ATDWriter>
@@ -2965,12 +6585,14 @@ void ASTExporter<ATDWriter>::VisitStmt(const Stmt *S) {
   {
     ObjectScope Scope(OF, 2);
 
-    OF.emitTag("pointer");
+    OF.emitTag(tags::pointer);
     dumpPointer(S);
-    OF.emitTag("source_range");
+    OF.emitTag(tags::source_range);
     dumpSourceRange(S->getSourceRange());
   }
-  {
+  if (shouldSummarizeInitList(S)) {
+    ArrayScope Scope(OF, 0);
+  } else {
     ArrayScope Scope(OF, std::distance(S->child_begin(), S->child_end()));
     for (const Stmt *CI : S->children()) {
       dumpStmt(CI);
@@ -3073,9 +6695,15 @@ int ASTExporter<ATDWriter>::AttributedStmtTupleSize() {
 template <class ATDWriter>
 void ASTExporter<ATDWriter>::VisitAttributedStmt(const AttributedStmt *Node) {
   VisitStmt(Node);
-  ArrayScope Scope(OF, Node->getAttrs().size()); // not covered by tests
+  int NumAttrs = 0; // not covered by tests
   for (auto A : Node->getAttrs()) {
-    dumpAttr(A);
+    NumAttrs += shouldDumpAttr(A);
+  }
+  ArrayScope Scope(OF, NumAttrs);
+  for (auto A : Node->getAttrs()) {
+    if (shouldDumpAttr(A)) {
+      dumpAttr(A);
+    }
   }
 }
 
@@ -3104,8 +6732,8 @@ void ASTExporter<ATDWriter>::VisitGotoStmt(const GotoStmt *Node) {
   VisitStmt(Node);
   ObjectScope Scope(OF, 2); // not covered by tests
   OF.emitTag("label");
-  OF.emitString(Node->getLabel()->getName().str());
-  OF.emitTag("pointer");
+  OF.emitString(Node->getLabel()->getName());
+  OF.emitTag(tags::pointer);
   dumpPointer(Node->getLabel());
 }
 
@@ -3198,10 +6826,20 @@ int ASTExporter<ATDWriter>::ExprTupleSize() {
 //@atd   qual_type : qual_type;
 //@atd   ~value_kind <ocaml default="`RValue"> : value_kind;
 //@atd   ~object_kind <ocaml default="`Ordinary"> : object_kind;
+//@atd   ?init_list_summary : init_list_summary option;
+//@atd   ?string_literal_summary : string_literal_summary option;
 //@atd } <ocaml field_prefix="ei_">
 //@atd type value_kind = [ RValue | LValue | XValue ]
 //@atd type object_kind = [ Ordinary | BitField | ObjCProperty | ObjCSubscript |
 //@atd VectorComponent ]
+//@atd type init_list_summary = {
+//@atd   num_elems : int;
+//@atd   hash : string;
+//@atd } <ocaml field_prefix="ils_">
+//@atd type string_literal_summary = {
+//@atd   num_bytes : int;
+//@atd   hash : string;
+//@atd } <ocaml field_prefix="sls_">
 template <class ATDWriter>
 void ASTExporter<ATDWriter>::VisitExpr(const Expr *Node) {
   VisitStmt(Node);
@@ -3210,9 +6848,13 @@ void ASTExporter<ATDWriter>::VisitExpr(const Expr *Node) {
   bool HasNonDefaultValueKind = VK != VK_PRValue;
   ExprObjectKind OK = Node->getObjectKind();
   bool HasNonDefaultObjectKind = OK != OK_Ordinary;
-  ObjectScope Scope(OF, 1 + HasNonDefaultValueKind + HasNonDefaultObjectKind);
+  bool SummarizeInitList = shouldSummarizeInitList(Node);
+  bool SummarizeStringLiteral = shouldTruncateStringLiteral(Node);
+  ObjectScope Scope(OF,
+                    1 + HasNonDefaultValueKind + HasNonDefaultObjectKind +
+                        SummarizeInitList + SummarizeStringLiteral);
 
-  OF.emitTag("qual_type");
+  OF.emitTag(tags::qual_type);
   dumpQualType(Node->getType());
 
   if (HasNonDefaultValueKind) {
@@ -3252,6 +6894,35 @@ void ASTExporter<ATDWriter>::VisitExpr(const Expr *Node) {
       break;
     }
   }
+  if (SummarizeInitList) {
+    const InitListExpr *ILE = cast<InitListExpr>(Node);
+    // the hash lets consumers tell two capped tables apart (and spot
+    // identical ones) without the elements being serialized
+    llvm::FoldingSetNodeID ID;
+    ILE->Profile(ID, Context, /*Canonical=*/false);
+    OF.emitTag("init_list_summary");
+    ObjectScope SummaryScope(OF, 2);
+    OF.emitTag("num_elems");
+    OF.emitInteger(ILE->getNumInits());
+    OF.emitTag("hash");
+    SmallString<16> HashBuf;
+    OF.emitString(llvm::Twine(ID.ComputeHash()).toStringRef(HashBuf));
+  }
+  if (SummarizeStringLiteral) {
+    // same idea as the init-list summary: the full length and a hash of
+    // the complete bytes stand in for the truncated tail, hashed
+    // straight off the AST's own buffer
+    llvm::StringRef Bytes = cast<StringLiteral>(Node)->getBytes();
+    uint64_t Hash = Options.useXXHash ? llvm::xxHash64(Bytes)
+                                      : fnv64Hash(Bytes.data(), Bytes.size());
+    OF.emitTag("string_literal_summary");
+    ObjectScope SummaryScope(OF, 2);
+    OF.emitTag("num_bytes");
+    OF.emitInteger(Bytes.size());
+    OF.emitTag("hash");
+    SmallString<24> HashBuf;
+    OF.emitString(llvm::Twine(Hash).toStringRef(HashBuf));
+  }
 }
 
 //@atd type cxx_base_specifier = {
@@ -3264,10 +6935,10 @@ void ASTExporter<ATDWriter>::dumpCXXBaseSpecifier(
   bool IsVirtual = Base.isVirtual();
   ObjectScope Scope(OF, 1 + IsVirtual);
 
-  OF.emitTag("name");
+  OF.emitTag(tags::name);
   const CXXRecordDecl *RD =
       cast<CXXRecordDecl>(Base.getType()->getAs<RecordType>()->getDecl());
-  OF.emitString(RD->getName().str());
+  OF.emitString(RD->getName());
   OF.emitFlag("virtual", IsVirtual);
 }
 
@@ -3401,16 +7072,14 @@ void ASTExporter<ATDWriter>::VisitOverloadExpr(const OverloadExpr *Node) {
   bool HasDecls = Node->getNumDecls() > 0;
   ObjectScope Scope(OF, 1 + HasDecls); // not covered by tests
 
-  if (HasDecls) {
-    OF.emitTag("decls");
-    ArrayScope Scope( // not covered by tests
-        OF,
-        std::distance(Node->decls_begin(), Node->decls_end()));
-    for (auto I : Node->decls()) {
-      dumpDeclRef(*I);
-    }
-  }
-  OF.emitTag("name");
+  // not covered by tests
+  OF.emitDefaultableArray(
+      "decls", std::distance(Node->decls_begin(), Node->decls_end()), [&] {
+        for (auto I : Node->decls()) {
+          dumpDeclRef(*I);
+        }
+      });
+  OF.emitTag(tags::name);
   dumpDeclarationName(Node->getName());
 }
 
@@ -3463,7 +7132,7 @@ void ASTExporter<ATDWriter>::VisitObjCIvarRefExpr(const ObjCIvarRefExpr *Node) {
 
   OF.emitTag("decl_ref");
   dumpDeclRef(*Node->getDecl());
-  OF.emitTag("pointer");
+  OF.emitTag(tags::pointer);
   dumpPointer(Node->getDecl());
   OF.emitFlag("is_free_ivar", IsFreeIvar);
 }
@@ -3529,15 +7198,26 @@ void ASTExporter<ATDWriter>::VisitCharacterLiteral(
 template <class ATDWriter>
 void ASTExporter<ATDWriter>::emitAPInt(bool isSigned,
                                        const llvm::APInt &value) {
+  // nearly every literal in real code fits in 64 bits; under
+  // compactIntLiterals those are emitted as a plain integer (an svint in
+  // biniou) and only genuinely wide values pay for the decimal string
+  bool fitsInt64 = Options.compactIntLiterals &&
+                   (isSigned ? value.isSignedIntN(64) : value.isIntN(63));
   ObjectScope Scope(OF, 2 + isSigned);
 
   OF.emitFlag("is_signed", isSigned);
   OF.emitTag("bitwidth");
   OF.emitInteger(value.getBitWidth());
-  OF.emitTag("value");
-  llvm::SmallString<64> buf;
-  value.toString(buf, 10, isSigned);
-  OF.emitString(buf.str().str());
+  if (fitsInt64) {
+    OF.emitTag("int_value");
+    OF.emitInteger(isSigned ? value.getSExtValue()
+                            : (int64_t)value.getZExtValue());
+  } else {
+    OF.emitTag("value");
+    llvm::SmallString<64> buf;
+    value.toString(buf, 10, isSigned);
+    OF.emitString(buf.str());
+  }
 }
 
 template <class ATDWriter>
@@ -3548,7 +7228,8 @@ int ASTExporter<ATDWriter>::IntegerLiteralTupleSize() {
 //@atd type integer_literal_info = {
 //@atd   ~is_signed : bool;
 //@atd   bitwidth : int;
-//@atd   value : string;
+//@atd   ~value : string;
+//@atd   ?int_value : int option;
 //@atd } <ocaml field_prefix="ili_">
 template <class ATDWriter>
 void ASTExporter<ATDWriter>::VisitIntegerLiteral(const IntegerLiteral *Node) {
@@ -3579,9 +7260,23 @@ int ASTExporter<ATDWriter>::FloatingLiteralTupleSize() {
 template <class ATDWriter>
 void ASTExporter<ATDWriter>::VisitFloatingLiteral(const FloatingLiteral *Node) {
   VisitExpr(Node);
+  if (Options.doubleLiterals) {
+    // nearly every literal carries float or double semantics, which
+    // convert to IEEE double exactly; only wider formats (x87 long
+    // double, float128) keep the decimal string
+    llvm::APFloat val = Node->getValue();
+    bool losesInfo = false;
+    val.convert(llvm::APFloat::IEEEdouble(),
+                llvm::APFloat::rmNearestTiesToEven,
+                &losesInfo);
+    if (!losesInfo) {
+      OF.emitDouble(val.convertToDouble());
+      return;
+    }
+  }
   llvm::SmallString<20> buf;
   Node->getValue().toString(buf);
-  OF.emitString(buf.str().str());
+  OF.emitString(buf.str());
 }
 
 template <class ATDWriter>
@@ -3592,17 +7287,22 @@ int ASTExporter<ATDWriter>::StringLiteralTupleSize() {
 template <class ATDWriter>
 void ASTExporter<ATDWriter>::VisitStringLiteral(const StringLiteral *Str) {
   VisitExpr(Str);
+  llvm::StringRef Bytes = Str->getBytes();
+  if (shouldTruncateStringLiteral(Str)) {
+    // the tail never leaves the AST's buffer; its length and content
+    // hash went out in expr_info above
+    Bytes = Bytes.take_front(Options.maxLiteralBytes);
+  }
   size_t n_chunks;
-  if (Str->getByteLength() == 0) {
+  if (Bytes.empty()) {
     n_chunks = 1;
   } else {
-    n_chunks = 1 + ((Str->getByteLength() - 1) / Options.maxStringSize);
+    n_chunks = 1 + ((Bytes.size() - 1) / Options.maxStringSize);
   }
   ArrayScope Scope(OF, n_chunks);
   for (size_t i = 0; i < n_chunks; ++i) {
-    OF.emitString(Str->getBytes()
-                      .substr(i * Options.maxStringSize, Options.maxStringSize)
-                      .str());
+    OF.emitString(
+        Bytes.substr(i * Options.maxStringSize, Options.maxStringSize));
   }
 }
 
@@ -3649,12 +7349,16 @@ void ASTExporter<ATDWriter>::VisitUnaryOperator(const UnaryOperator *Node) {
   bool IsPostfix = Node->isPostfix();
   ObjectScope Scope(OF, 1 + IsPostfix);
 
-  OF.emitTag("kind");
+  OF.emitTag(tags::kind);
   switch (Node->getOpcode()) {
-#define UNARY_OPERATION(NAME, SPELLING) \
-  case UO_##NAME:                       \
-    OF.emitSimpleVariant(#NAME);        \
-    break;
+    // one pre-hashed tag per opcode, computed at compile time (the
+    // qualified ::ATDWriter is the namespace, not the template parameter)
+#define UNARY_OPERATION(NAME, SPELLING)                     \
+  case UO_##NAME: {                                         \
+    static constexpr ::ATDWriter::Tag opcodeTag(#NAME);     \
+    OF.emitSimpleVariant(opcodeTag);                        \
+    break;                                                  \
+  }
 #include <clang/AST/OperationKinds.def>
   }
   OF.emitFlag("is_postfix", IsPostfix);
@@ -3684,7 +7388,7 @@ void ASTExporter<ATDWriter>::VisitUnaryExprOrTypeTraitExpr(
 
   ObjectScope Scope(OF, 2); // not covered by tests
 
-  OF.emitTag("kind");
+  OF.emitTag(tags::kind);
   switch (Node->getKind()) {
   case UETT_AlignOf:
     OF.emitSimpleVariant("AlignOf");
@@ -3710,7 +7414,7 @@ void ASTExporter<ATDWriter>::VisitUnaryExprOrTypeTraitExpr(
     break;
   }
 
-  OF.emitTag("qual_type");
+  OF.emitTag(tags::qual_type);
   dumpQualType(Node->getTypeOfArgument());
 }
 
@@ -3738,7 +7442,7 @@ void ASTExporter<ATDWriter>::VisitMemberExpr(const MemberExpr *Node) {
 
   OF.emitFlag("is_arrow", IsArrow);
   OF.emitFlag("performs_virtual_dispatch", PerformsVirtualDispatch);
-  OF.emitTag("name");
+  OF.emitTag(tags::name);
   ValueDecl *memberDecl = Node->getMemberDecl();
   dumpName(*memberDecl);
   OF.emitTag("decl_ref");
@@ -3773,12 +7477,14 @@ template <class ATDWriter>
 void ASTExporter<ATDWriter>::VisitBinaryOperator(const BinaryOperator *Node) {
   VisitExpr(Node);
   ObjectScope Scope(OF, 1);
-  OF.emitTag("kind");
+  OF.emitTag(tags::kind);
   switch (Node->getOpcode()) {
-#define BINARY_OPERATION(NAME, SPELLING) \
-  case BO_##NAME:                        \
-    OF.emitSimpleVariant(#NAME);         \
-    break;
+#define BINARY_OPERATION(NAME, SPELLING)                    \
+  case BO_##NAME: {                                         \
+    static constexpr ::ATDWriter::Tag opcodeTag(#NAME);     \
+    OF.emitSimpleVariant(opcodeTag);                        \
+    break;                                                  \
+  }
 #include <clang/AST/OperationKinds.def>
   }
 }
@@ -3820,7 +7526,7 @@ template <class ATDWriter>
 void ASTExporter<ATDWriter>::VisitAtomicExpr(const AtomicExpr *Node) {
   VisitExpr(Node);
   ObjectScope Scope(OF, 1);
-  OF.emitTag("kind");
+  OF.emitTag(tags::kind);
   switch (Node->getOp()) {
 #define BUILTIN(ID, TYPE, ATTRS)
 #define ATOMIC_BUILTIN(ID, TYPE, ATTRS) \
@@ -3879,8 +7585,8 @@ void ASTExporter<ATDWriter>::VisitAddrLabelExpr(const AddrLabelExpr *Node) {
   VisitExpr(Node);
   ObjectScope Scope(OF, 2); // not covered by tests
   OF.emitTag("label");
-  OF.emitString(Node->getLabel()->getName().str());
-  OF.emitTag("pointer");
+  OF.emitString(Node->getLabel()->getName());
+  OF.emitTag(tags::pointer);
   dumpPointer(Node->getLabel());
 }
 
@@ -4086,13 +7792,11 @@ void ASTExporter<ATDWriter>::VisitCXXNewExpr(const CXXNewExpr *Node) {
     OF.emitTag("initializer_expr");
     dumpPointer(Node->getInitializer());
   }
-  if (HasPlacementArgs) {
-    OF.emitTag("placement_args");
-    ArrayScope aScope(OF, PlacementArgs);
+  OF.emitDefaultableArray("placement_args", PlacementArgs, [&] {
     for (auto arg : Node->placement_arguments()) {
       dumpPointer(arg);
     }
-  }
+  });
 }
 
 template <class ATDWriter>
@@ -4262,11 +7966,11 @@ void ASTExporter<ATDWriter>::VisitObjCMessageExpr(const ObjCMessageExpr *Node) {
       OF, 1 + IsDefinitionFound + (bool)m_decl + HasNonDefaultReceiverKind);
 
   OF.emitTag("selector");
-  OF.emitString(selector.getAsString());
+  OF.emitString(selectorName(selector));
 
   if (m_decl) {
     OF.emitFlag("is_definition_found", IsDefinitionFound);
-    OF.emitTag("decl_pointer");
+    OF.emitTag(tags::decl_pointer);
     dumpPointer(m_decl);
   }
 
@@ -4290,10 +7994,22 @@ void ASTExporter<ATDWriter>::VisitObjCMessageExpr(const ObjCMessageExpr *Node) {
   }
 }
 
+template <class ATDWriter>
+llvm::StringRef ASTExporter<ATDWriter>::selectorName(const Selector sel) {
+  auto res = SelectorNameCache.try_emplace(sel.getAsOpaquePtr());
+  if (res.second) {
+    SmallString<64> Buf;
+    llvm::raw_svector_ostream StrOS(Buf);
+    sel.print(StrOS);
+    res.first->second = ArenaSaver.save(StrOS.str());
+  }
+  return res.first->second;
+}
+
 //@atd type selector = string
 template <class ATDWriter>
 void ASTExporter<ATDWriter>::dumpSelector(const Selector sel) {
-  OF.emitString(sel.getAsString());
+  OF.emitString(selectorName(sel));
 }
 
 template <class ATDWriter>
@@ -4348,7 +8064,7 @@ template <class ATDWriter>
 void ASTExporter<ATDWriter>::VisitObjCEncodeExpr(const ObjCEncodeExpr *Node) {
   VisitExpr(Node);
   ObjectScope Scope(OF, 2);
-  OF.emitTag("qual_type");
+  OF.emitTag(tags::qual_type);
   dumpQualType(Node->getEncodedType());
   OF.emitTag("raw");
   OF.emitString(Node->getEncodedType().getAsString());
@@ -4409,7 +8125,7 @@ void ASTExporter<ATDWriter>::VisitObjCPropertyRefExpr(
                     1 + IsSuperReceiver + IsMessagingGetter +
                         IsMessagingSetter); // not covered by tests
 
-  OF.emitTag("kind");
+  OF.emitTag(tags::kind);
   if (Node->isImplicitProperty()) {
     VariantScope Scope(OF, "MethodRef");
     {
@@ -4456,7 +8172,7 @@ void ASTExporter<ATDWriter>::VisitObjCSubscriptRefExpr(
   bool HasSetter = Node->setAtIndexMethodDecl();
   ObjectScope Scope(OF, 1 + HasGetter + HasSetter); // not covered by tests
 
-  OF.emitTag("kind");
+  OF.emitTag(tags::kind);
   if (Node->isArraySubscriptRefExpr()) {
     OF.emitSimpleVariant("ArraySubscript");
   } else {
@@ -4506,7 +8222,10 @@ void ASTExporter<ATDWriter>::VisitObjCAvailabilityCheckExpr(
 #pragma clang diagnostic ignored "-Wcast-qual"
     ObjCAvailabilityCheckExpr *E = (ObjCAvailabilityCheckExpr *)Expr;
 #pragma clang diagnostic pop
-    OF.emitString(E->getVersion().getAsString());
+    SmallString<32> VersionBuf;
+    llvm::raw_svector_ostream VersionOS(VersionBuf);
+    VersionOS << E->getVersion();
+    OF.emitString(VersionOS.str());
   }
 }
 
@@ -4554,6 +8273,8 @@ void ASTExporter<ATDWriter>::VisitObjCDictionaryLiteral(
 
 // Main variant for statements
 //@atd type stmt = [
+//@atd   | Null
+//@atd   | SummarizedStmt of (summarized_stmt_info)
 #define STMT(CLASS, PARENT) //@atd   | CLASS of (@CLASS@_tuple)
 #define ABSTRACT_STMT(STMT)
 #include <clang/AST/StmtNodes.inc>
@@ -4581,9 +8302,19 @@ void ASTExporter<ATDWriter>::dumpFullComment(const FullComment *C) {
 template <class ATDWriter>
 void ASTExporter<ATDWriter>::dumpComment(const Comment *C) {
   if (!C) {
+    if (Options.nullMarkers) {
+      OF.emitSimpleVariant(tags::NullVariant);
+      return;
+    }
     // We use a fixed NoComment node to represent null pointers
     C = NullPtrComment;
   }
+  VisitorProfiler::Scope ProfScope(Options.profileVisitors ? &Profiler
+                                                           : nullptr,
+                                   VisitorProfiler::comments,
+                                   "",
+                                   (unsigned)C->getCommentKind(),
+                                   C->getCommentKindName());
   VariantScope Scope(OF, std::string(C->getCommentKindName()));
   {
     TupleScope Scope(OF,
@@ -4605,9 +8336,9 @@ template <class ATDWriter>
 void ASTExporter<ATDWriter>::visitComment(const Comment *C) {
   {
     ObjectScope ObjComment(OF, 2); // not covered by tests
-    OF.emitTag("parent_pointer");
+    OF.emitTag(tags::parent_pointer);
     dumpPointer(C);
-    OF.emitTag("source_range");
+    OF.emitTag(tags::source_range);
     dumpSourceRange(C->getSourceRange());
   }
   {
@@ -4733,11 +8464,19 @@ void ASTExporter<ATDWriter>::visitComment(const Comment *C) {
 //}
 
 //@atd type comment = [
+//@atd   | Null
 #define COMMENT(CLASS, PARENT) //@atd   | CLASS of (@CLASS@_tuple)
 #define ABSTRACT_COMMENT(COMMENT)
 #include <clang/AST/CommentNodes.inc>
 //@atd ] <ocaml repr="classic">
 
+// One row of the <output>.comments sidecar (see writeCommentSidecar);
+// the sidecar document is a comment_row list in the main dump's format
+//@atd type comment_row = {
+//@atd   decl_pointer : pointer;
+//@atd   comment : comment;
+//@atd } <ocaml field_prefix="cr_">
+
 #define TYPE(DERIVED, BASE) //@atd #define @DERIVED@_type_tuple @BASE@_tuple
 #define ABSTRACT_TYPE(DERIVED, BASE) TYPE(DERIVED, BASE)
 TYPE(None, Type)
@@ -4749,6 +8488,12 @@ template <class ATDWriter>
 void ASTExporter<ATDWriter>::dumpType(const Type *T) {
 
   std::string typeClassName = T ? T->getTypeClassName() : "None";
+  VisitorProfiler::Scope ProfScope(Options.profileVisitors && T ? &Profiler
+                                                                : nullptr,
+                                   VisitorProfiler::types,
+                                   "Type",
+                                   T ? (unsigned)T->getTypeClass() : 0,
+                                   T ? T->getTypeClassName() : "None");
   VariantScope Scope(OF, typeClassName + "Type");
   {
     if (T) {
@@ -4766,6 +8511,17 @@ void ASTExporter<ATDWriter>::dumpType(const Type *T) {
 //@atd type type_ptr = int wrap <ocaml module="Clang_ast_types.TypePtr">
 template <class ATDWriter>
 void ASTExporter<ATDWriter>::dumpPointerToType(const Type *T) {
+  if (Options.onlyReferencedTypes && T && ReferencedTypeSet.insert(T).second) {
+    ReferencedTypes.push_back(T);
+  }
+  if (Options.compactQualTypes) {
+    // keep the type_ptr value space uniform under COMPACT_QUAL_TYPES:
+    // every reference is folded (id * 8 + cvr bits), and a bare type
+    // reference is unqualified. The types table itself stays keyed by
+    // the unfolded pointer field of type_info
+    OF.emitInteger(pointerId(T) * 8);
+    return;
+  }
   dumpPointer(T);
 }
 
@@ -4775,6 +8531,35 @@ void ASTExporter<ATDWriter>::dumpQualTypeNoQuals(const QualType &qt) {
   dumpPointerToType(T);
 }
 
+// T->getUnqualifiedDesugaredType() with memoization: the walk stops at
+// the first link already in DesugarCache and every link walked is then
+// cached, so a typedef-of-template-of-typedef chain costs its length
+// once per TU instead of once per link dumped. Byte-identical to the
+// uncached walk.
+template <class ATDWriter>
+const Type *ASTExporter<ATDWriter>::desugaredType(const Type *T) {
+  SmallVector<const Type *, 8> Path;
+  const Type *Cur = T;
+  while (true) {
+    auto It = DesugarCache.find(Cur);
+    if (It != DesugarCache.end()) {
+      Cur = It->second;
+      break;
+    }
+    const Type *Next =
+        Cur->getLocallyUnqualifiedSingleStepDesugaredType().getTypePtr();
+    if (Next == Cur) {
+      break;
+    }
+    Path.push_back(Cur);
+    Cur = Next;
+  }
+  for (const Type *Link : Path) {
+    DesugarCache.try_emplace(Link, Cur);
+  }
+  return Cur;
+}
+
 template <class ATDWriter>
 int ASTExporter<ATDWriter>::TypeTupleSize() {
   return 1;
@@ -4794,15 +8579,18 @@ template <class ATDWriter>
 void ASTExporter<ATDWriter>::VisitType(const Type *T) {
   // NOTE: T can (and will) be null here!!
 
-  bool HasDesugaredType = T && T->getUnqualifiedDesugaredType() != T;
+  // one memoized walk serves both the presence test and the emission;
+  // the naive getUnqualifiedDesugaredType walked the chain twice here
+  const Type *Desugared = T ? desugaredType(T) : nullptr;
+  bool HasDesugaredType = Desugared && Desugared != T;
   ObjectScope Scope(OF, 1 + HasDesugaredType);
 
-  OF.emitTag("pointer");
+  OF.emitTag(tags::pointer);
   dumpPointer(T);
 
   if (HasDesugaredType) {
     OF.emitTag("desugared_type");
-    dumpPointerToType(T->getUnqualifiedDesugaredType());
+    dumpPointerToType(Desugared);
   }
 }
 
@@ -4882,14 +8670,7 @@ void ASTExporter<ATDWriter>::VisitAtomicType(const AtomicType *T) {
 
 template <class ATDWriter>
 void ASTExporter<ATDWriter>::dumpAttrKind(attr::Kind Kind) {
-  switch (Kind) {
-#define ATTR(NAME)                          \
-  case AttributedType::Kind::NAME:          \
-    OF.emitSimpleVariant(#NAME "AttrKind"); \
-    return;
-#include <clang/Basic/AttrList.inc>
-  }
-  llvm_unreachable("Attribute kind that is not part of AttrList.inc!");
+  OF.emitSimpleVariant(attrKindTagTable[Kind]);
 }
 
 //@atd type objc_lifetime_attr = [
@@ -5070,13 +8851,11 @@ void ASTExporter<ATDWriter>::VisitFunctionProtoType(
   bool HasParamsType = T->getNumParams() > 0;
   ObjectScope Scope(OF, 0 + HasParamsType);
 
-  if (HasParamsType) {
-    OF.emitTag("params_type");
-    ArrayScope aScope(OF, T->getParamTypes().size());
+  OF.emitDefaultableArray("params_type", T->getParamTypes().size(), [&] {
     for (const auto &paramType : T->getParamTypes()) {
       dumpQualType(paramType);
     }
-  }
+  });
 }
 
 template <class ATDWriter>
@@ -5125,13 +8904,11 @@ void ASTExporter<ATDWriter>::VisitObjCObjectType(const ObjCObjectType *T) {
   OF.emitTag("base_type");
   dumpQualTypeNoQuals(T->getBaseType());
 
-  if (HasProtocols) {
-    OF.emitTag("protocol_decls_ptr");
-    ArrayScope aScope(OF, numProtocols);
+  OF.emitDefaultableArray("protocol_decls_ptr", numProtocols, [&] {
     for (int i = 0; i < numProtocols; i++) {
       dumpPointer(T->getProtocol(i));
     }
-  }
+  });
 
   if (isSpecialized) {
     OF.emitTag("type_args");
@@ -5227,15 +9004,7 @@ void ASTExporter<ATDWriter>::VisitTypedefType(const TypedefType *T) {
 
 template <class ATDWriter>
 void ASTExporter<ATDWriter>::dumpAttr(const Attr *A) {
-  std::string tag;
-  switch (A->getKind()) {
-#define ATTR(NAME)       \
-  case attr::Kind::NAME: \
-    tag = #NAME "Attr";  \
-    break;
-#include <clang/Basic/AttrList.inc>
-  }
-  VariantScope Scope(OF, tag);
+  VariantScope Scope(OF, attrTagTable[A->getKind()]);
   {
     TupleScope Scope(OF, ASTExporter::tupleSizeOfAttrKind(A->getKind()));
     ConstAttrVisitor<ASTExporter<ATDWriter>>::Visit(A);
@@ -5255,9 +9024,9 @@ int ASTExporter<ATDWriter>::AttrTupleSize() {
 template <class ATDWriter>
 void ASTExporter<ATDWriter>::VisitAttr(const Attr *A) {
   ObjectScope Scope(OF, 2);
-  OF.emitTag("pointer");
+  OF.emitTag(tags::pointer);
   dumpPointer(A);
-  OF.emitTag("source_range");
+  OF.emitTag(tags::source_range);
   dumpSourceRange(A->getRange());
 }
 
@@ -5303,23 +9072,49 @@ int ASTExporter<ATDWriter>::AnnotateAttrTupleSize() {
 template <class ATDWriter>
 void ASTExporter<ATDWriter>::VisitAnnotateAttr(const AnnotateAttr *A) {
   VisitAttr(A);
-  OF.emitString(A->getAnnotation().str());
+  OF.emitString(A->getAnnotation());
 }
 
 template <class ATDWriter>
 int ASTExporter<ATDWriter>::AvailabilityAttrTupleSize() {
   return AttrTupleSize() + 1;
 }
+// The introduced field is only ever absent under internAvailability,
+// when availability_id resolves the record: captures made without the
+// option keep their old shape.
 //@atd #define availability_attr_tuple attr_tuple * availability_attr_info
 //@atd type availability_attr_info = {
 //@atd   ?platform: string option;
-//@atd   introduced: version_tuple;
+//@atd   ?introduced: version_tuple option;
+//@atd   ?availability_id: int option;
 //@atd } <ocaml field_prefix="aai_">
 template <class ATDWriter>
 void ASTExporter<ATDWriter>::VisitAvailabilityAttr(const AvailabilityAttr *A) {
   VisitAttr(A);
   {
     IdentifierInfo *platform = A->getPlatform();
+    if (Options.internAvailability) {
+      // SDK headers attach the same (platform, introduced) pair to
+      // nearly every declaration; the first occurrence carries the
+      // record, the rest only the id it was registered under
+      auto res = AvailabilityIdMap.try_emplace(
+          std::make_pair(platform, A->getIntroduced()),
+          (int)AvailabilityIdMap.size());
+      bool FirstReference = res.second;
+      ObjectScope Scope(
+          OF, 1 + (FirstReference ? 1 + (bool)platform : 0));
+      if (FirstReference) {
+        if (platform != nullptr) {
+          OF.emitTag("platform");
+          OF.emitString(platform->getNameStart());
+        }
+        OF.emitTag("introduced");
+        dumpVersionTuple(A->getIntroduced());
+      }
+      OF.emitTag("availability_id");
+      OF.emitInteger(res.first->second);
+      return;
+    }
     ObjectScope Scope(OF, 2 + (bool)platform);
     if (platform != nullptr) {
       OF.emitTag("platform");
@@ -5364,13 +9159,13 @@ void ASTExporter<ATDWriter>::VisitVisibilityAttr(const VisibilityAttr *A) {
   VisitAttr(A);
   switch (A->getVisibility()) {
   case VisibilityAttr::Default:
-    OF.emitSimpleVariant("DefaultVisibility");
+    OF.emitSimpleVariant(tags::DefaultVisibilityVariant);
     break;
   case VisibilityAttr::Hidden:
-    OF.emitSimpleVariant("HiddenVisibility");
+    OF.emitSimpleVariant(tags::HiddenVisibilityVariant);
     break;
   case VisibilityAttr::Protected:
-    OF.emitSimpleVariant("ProtectedVisibility");
+    OF.emitSimpleVariant(tags::ProtectedVisibilityVariant);
     break;
   }
 }
@@ -5387,31 +9182,507 @@ TYPE(None, Type)
 #include <clang/AST/TypeNodes.inc>
 //@atd ] <ocaml repr="classic" validator="Clang_ast_visit.visit_type">
 
+// One reading of the process clocks -- wall time, CPU time (user plus
+// system) and peak RSS -- so consumer phases can be reported as deltas
+// (see PHASE_STATS_FILE).
+struct PhaseSample {
+  std::chrono::steady_clock::time_point wall;
+  double cpuSeconds = 0;
+  long peakRssKb = 0;
+
+  static PhaseSample now() {
+    PhaseSample s;
+    s.wall = std::chrono::steady_clock::now();
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+      s.cpuSeconds = usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+                     (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+#ifdef __APPLE__
+      // darwin reports bytes where linux reports kilobytes
+      s.peakRssKb = usage.ru_maxrss / 1024;
+#else
+      s.peakRssKb = usage.ru_maxrss;
+#endif
+    }
+    return s;
+  }
+};
+
 template <class ATDWriter = JsonWriter, bool ForceYojson = false>
 class ExporterASTConsumer : public ASTConsumer {
  private:
   std::shared_ptr<ASTExporterOptions> options;
+  // macro definitions recorded by the preprocessor handler (macroTable)
+  std::shared_ptr<ASTPluginLib::IncludeGraphData> sharedData;
   std::unique_ptr<raw_ostream> OS;
+  // secondary stream of the tee writer (BiniouJsonTeeWriter only)
+  std::unique_ptr<llvm::raw_fd_ostream> TeeOS;
+  // The output adapter chain and the exporter live as members so that a
+  // stream opened mid-parse (streamDecls) survives until the consumer is
+  // destroyed; member order makes destruction unwind the chain from the
+  // innermost adapter out towards the file.
+  std::unique_ptr<ASTPluginLib::ChecksumOStream> CKS;
+  std::unique_ptr<ASTPluginLib::AsyncOStream> AOS;
+  std::unique_ptr<ASTPluginLib::GzipOStream> GOS;
+  std::unique_ptr<ASTPluginLib::ParallelGzipOStream> PGOS;
+  std::unique_ptr<ASTPluginLib::ArenaOStream> BOS;
+  std::unique_ptr<ASTPluginLib::FrameOStream> FOS;
+  // the stream serialization writes to, i.e. the innermost adapter;
+  // its position counts serialized bytes before compression
+  raw_ostream *InnermostSink = nullptr;
+  std::unique_ptr<ASTExporter<ATDWriter>> Exporter;
+  // whether beginDeclStream has been issued (streamDecls only)
+  bool StreamOpen = false;
+  // taken when the consumer is created, i.e. before parsing starts
+  // (phaseStatsFile only)
+  PhaseSample ParseStart;
+
+  // append the one-line record for this unit to the shared stats file;
+  // O_APPEND keeps concurrent captures from interleaving partial lines
+  void appendPhaseStats(const PhaseSample &parseDone,
+                        const PhaseSample &setupDone,
+                        const PhaseSample &dumpDone) {
+    std::error_code EC;
+    llvm::raw_fd_ostream stats(
+        options->phaseStatsFile, EC, llvm::sys::fs::OF_Append);
+    if (EC) {
+      llvm::errs() << "[!] Failed to open phase stats file "
+                   << options->phaseStatsFile << ": " << EC.message() << "\n";
+      return;
+    }
+    stats << "{\"file\": \"";
+    for (char c : options->normalizeSourcePath(
+             options->inputFile.getFile().str().c_str())) {
+      if (c == '"' || c == '\\') {
+        stats << '\\';
+      }
+      stats << c;
+    }
+    stats << "\"";
+    auto phase = [&stats](const char *name,
+                          const PhaseSample &from,
+                          const PhaseSample &to) {
+      stats << llvm::format(
+          ", \"%s_wall_s\": %.3f, \"%s_cpu_s\": %.3f, \"%s_rss_kb\": %ld",
+          name,
+          std::chrono::duration<double>(to.wall - from.wall).count(),
+          name,
+          to.cpuSeconds - from.cpuSeconds,
+          name,
+          to.peakRssKb - from.peakRssKb);
+    };
+    phase("parse", ParseStart, parseDone);
+    phase("setup", parseDone, setupDone);
+    phase("dump", setupDone, dumpDone);
+    stats << "}\n";
+  }
+
+  // append the capture-cost record for this unit (see COST_DB_FILE);
+  // like the phase stats, one short O_APPEND write per unit, so records
+  // from concurrent captures interleave as whole lines
+  void appendCostRecord(ASTContext &Context, const PhaseSample &done) {
+    std::error_code EC;
+    llvm::raw_fd_ostream db(options->costDbFile, EC, llvm::sys::fs::OF_Append);
+    if (EC) {
+      llvm::errs() << "[!] Failed to open cost db " << options->costDbFile
+                   << ": " << EC.message() << "\n";
+      return;
+    }
+    const SourceManager &SM = Context.getSourceManager();
+    const uint64_t contentHash =
+        llvm::xxHash64(SM.getBufferData(SM.getMainFileID()));
+    db << options->normalizeSourcePath(
+              options->inputFile.getFile().str().c_str())
+       << "\t" << llvm::format_hex_no_prefix(contentHash, 16) << "\t"
+       << llvm::format(
+              "%.3f",
+              std::chrono::duration<double>(done.wall - ParseStart.wall)
+                  .count())
+       << "\t" << (InnermostSink ? InnermostSink->tell() : 0) << "\t"
+       << done.peakRssKb << "\n";
+  }
+
+  // append the ingestion-manifest row for this unit (see MANIFEST_FILE);
+  // one short O_APPEND write, whole-line interleaving as above
+  void appendManifestRecord(ASTContext &Context, uint64_t numDecls) {
+    std::error_code EC;
+    llvm::raw_fd_ostream manifest(
+        options->manifestFile, EC, llvm::sys::fs::OF_Append);
+    if (EC) {
+      llvm::errs() << "[!] Failed to open manifest " << options->manifestFile
+                   << ": " << EC.message() << "\n";
+      return;
+    }
+    const SourceManager &SM = Context.getSourceManager();
+    const uint64_t contentHash =
+        llvm::xxHash64(SM.getBufferData(SM.getMainFileID()));
+    manifest << options->outputFile << "\t"
+             << (InnermostSink ? InnermostSink->tell() : 0) << "\t"
+             << numDecls << "\t"
+             << llvm::format_hex_no_prefix(contentHash, 16) << "\t"
+             << options->normalizeSourcePath(
+                    options->inputFile.getFile().str().c_str())
+             << "\n";
+  }
+
+  // compose the configured adapters around the output file, innermost
+  // last, and return the stream serialization should write to
+  raw_ostream &wrapOutputStream() {
+    raw_ostream *sink = OS.get();
+    if (options->commentSidecar &&
+        ASTPluginLib::hasOutputTransport(options->outputFile)) {
+      // sidecars need a plain-file path to hang the suffix on
+      llvm::errs() << "[!] COMMENT_SIDECAR needs a plain-file output; "
+                      "comments stay inline\n";
+      options->commentSidecar = false;
+    }
+    // reserve the layout header slot at the very front, before any
+    // adapter; the zeros are patched in place once the section table is
+    // final, and a reader finding them instead of the magic knows the
+    // capture died before finishing
+    if (options->layoutHeader) {
+      if (options->frameDecls && !options->compressOutput &&
+          !options->validationFooter &&
+          !ASTPluginLib::hasOutputTransport(options->outputFile)) {
+        std::string placeholder(LayoutHeaderSize, '\0');
+        sink->write(placeholder.data(), placeholder.size());
+      } else {
+        llvm::errs() << "[!] LAYOUT_HEADER needs FRAME_DECLS and an "
+                        "uncompressed, unchecksummed plain-file output; "
+                        "ignored\n";
+        options->layoutHeader = false;
+      }
+    }
+    // outermost, so the trailer covers and follows the bytes exactly as
+    // they land in the file
+    if (options->validationFooter) {
+      CKS.reset(new ASTPluginLib::ChecksumOStream(*sink));
+      sink = CKS.get();
+    }
+    // serialize into a double buffer flushed by a background thread so
+    // traversal does not stall on slow output
+    if (options->useAsyncOutput) {
+      AOS.reset(new ASTPluginLib::AsyncOStream(*sink));
+      sink = AOS.get();
+    }
+    // gzip-compress in-process, streaming (composes with ASYNC_OUTPUT:
+    // compression runs here, the file write on the background thread);
+    // COMPRESS_THREADS moves compression to a worker pool emitting
+    // independent gzip members so traversal never waits on deflate
+    if (options->compressOutput) {
+      // a preset dictionary targets the small outputs where the
+      // parallel pipeline does not pay, so it selects the serial path
+      if (options->compressThreads > 0 && options->compressDictFile.empty()) {
+        PGOS.reset(new ASTPluginLib::ParallelGzipOStream(
+            *sink, (unsigned)options->compressThreads));
+        sink = PGOS.get();
+      } else {
+        std::string dictionary;
+        if (!options->compressDictFile.empty()) {
+          llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buffer =
+              llvm::MemoryBuffer::getFile(options->compressDictFile);
+          if (buffer) {
+            dictionary = (*buffer)->getBuffer().str();
+          } else {
+            llvm::errs() << "[!] Failed to read compression dictionary "
+                         << options->compressDictFile << "\n";
+          }
+        }
+        GOS.reset(new ASTPluginLib::GzipOStream(
+            *sink, /*level=*/Z_DEFAULT_COMPRESSION, dictionary));
+        sink = GOS.get();
+      }
+    }
+    // accumulate everything in memory and write out once at the end
+    if (options->useArenaOutput) {
+      BOS.reset(new ASTPluginLib::ArenaOStream(
+          *sink, options->atdWriterOptions.expectedOutputBytes));
+      sink = BOS.get();
+    }
+    // length-prefix a frame per top-level decl so readers can stream;
+    // innermost so compression and async writing see the framed bytes
+    if (options->frameDecls) {
+      FOS.reset(new ASTPluginLib::FrameOStream(*sink));
+      sink = FOS.get();
+    }
+    InnermostSink = sink;
+    return *sink;
+  }
+
+  ASTExporter<ATDWriter> &exporter(ASTContext &Context) {
+    if (!Exporter) {
+      if constexpr (std::is_same<ATDWriter, PipelinedJsonWriter>::value ||
+                    std::is_same<ATDWriter, PipelinedBiniouWriter>::value) {
+        // rendering trails the traversal on its own thread, so nothing
+        // may read stream offsets synchronously: decl frames (and the
+        // checkpoints and diffs built on them) are off the table, and
+        // parallel decls would only add a second copy of the same
+        // traversal/serialization overlap
+        if (options->frameDecls) {
+          llvm::errs() << "[!] FRAME_DECLS needs synchronous flushes and "
+                          "is ignored by the pipelined exporters\n";
+          options->frameDecls = false;
+        }
+        options->parallelDecls = 0;
+      }
+      if (options->outputBytesPerAstKb > 0) {
+        // the parse is over by the time the exporter is built, so the
+        // AST footprint is known; the prediction reaches the arena chunk
+        // below and the emitters' pinned buffers through writer options
+        options->atdWriterOptions.expectedOutputBytes =
+            Context.getASTAllocatedMemory() / 1024 *
+            (uint64_t)options->outputBytesPerAstKb;
+      }
+      raw_ostream &sink = wrapOutputStream();
+      if constexpr (std::is_same<ATDWriter, BiniouJsonTeeWriter>::value ||
+                    std::is_same<ATDWriter, BiniouSkeletonTeeWriter>::value) {
+        // the tee writers drive a second stream: a plain file next to
+        // the main output unless the option says otherwise (the
+        // adapter chain only wraps the main stream)
+        std::string path;
+        if constexpr (std::is_same<ATDWriter, BiniouSkeletonTeeWriter>::value) {
+          path = options->skeletonHashFile.empty()
+                     ? options->outputFile + ".skel"
+                     : options->skeletonHashFile;
+        } else {
+          path = options->teeJsonFile.empty() ? options->outputFile + ".json"
+                                              : options->teeJsonFile;
+        }
+        std::error_code EC;
+        TeeOS.reset(new llvm::raw_fd_ostream(path, EC));
+        if (EC) {
+          llvm::errs() << "[!] Failed to open tee output " << path << ": "
+                       << EC.message() << "\n";
+        }
+        // splicing pre-serialized buffers cannot be fanned out
+        options->parallelDecls = 0;
+        Exporter.reset(
+            new ASTExporter<ATDWriter>(sink, *TeeOS, Context, *options));
+      } else {
+        Exporter.reset(new ASTExporter<ATDWriter>(sink, Context, *options));
+      }
+      if (options->macroTable) {
+        // the definitions the preprocessor recorded, for macro location
+        // table references
+        Exporter->PPData = sharedData.get();
+      }
+      if (FOS) {
+        Exporter->setFrameSink(FOS.get());
+        if (options->checkpointEvery != 0 &&
+            !ASTPluginLib::hasOutputTransport(options->outputFile) &&
+            !options->useArenaOutput && !options->compressOutput &&
+            !options->useAsyncOutput) {
+          // checkpoints promise the marked prefix is on disk, which only
+          // holds when nothing between the framer and the file defers or
+          // transforms bytes: the arena buffers everything, gzip cannot
+          // finish mid-stream, async writes trail the traversal
+          std::vector<llvm::raw_ostream *> chain;
+          if (CKS) {
+            chain.push_back(CKS.get());
+          }
+          chain.push_back(OS.get());
+          Exporter->enableCheckpoints(options->outputFile + ".ckpt",
+                                      std::move(chain));
+        }
+        if (options->diffDecls &&
+            !ASTPluginLib::hasOutputTransport(options->outputFile)) {
+          // the previous capture of this output left its index behind;
+          // absent on the first capture, in which case everything dumps
+          // in full. Transport outputs have no sidecar to diff against
+          Exporter->loadPreviousDeclIndex(options->outputFile + ".declidx");
+        }
+      }
+    }
+    return *Exporter;
+  }
 
  public:
   using ASTConsumerOptions = ASTLib::ASTExporterOptions;
-  using PreprocessorHandler = ASTPluginLib::EmptyPreprocessorHandler;
-  using PreprocessorHandlerData = ASTPluginLib::EmptyPreprocessorHandlerData;
+  // the include-graph handler is inert unless INCLUDE_GRAPH_FILE is set
+  using PreprocessorHandler = ASTPluginLib::IncludeGraphHandler;
+  using PreprocessorHandlerData = ASTPluginLib::IncludeGraphData;
 
   ExporterASTConsumer(const CompilerInstance &CI,
                       std::shared_ptr<ASTConsumerOptions> options,
                       std::shared_ptr<PreprocessorHandlerData> sharedData,
                       std::unique_ptr<raw_ostream> &&OS)
-      : options(options), OS(std::move(OS)) {
+      : options(options), sharedData(sharedData), OS(std::move(OS)) {
     if (ForceYojson) {
       options->atdWriterOptions.useYojson = true;
     }
+    if (!options->phaseStatsFile.empty() || !options->costDbFile.empty()) {
+      ParseStart = PhaseSample::now();
+    }
+  }
+
+  // streamDecls: serialize each top-level decl as soon as the parser
+  // finishes it, pipelining the parse with the exporter's visitors. The
+  // translation unit envelope is opened on the first decl and closed in
+  // HandleTranslationUnit below.
+  bool HandleTopLevelDecl(DeclGroupRef DG) override {
+    if (!options->streamDecls || DG.isNull()) {
+      return true;
+    }
+    for (Decl *D : DG) {
+      ASTExporter<ATDWriter> &P = exporter(D->getASTContext());
+      if (!StreamOpen) {
+        P.beginDeclStream(D->getASTContext().getTranslationUnitDecl());
+        StreamOpen = true;
+      }
+      P.streamDecl(D);
+    }
+    return true;
   }
 
   virtual void HandleTranslationUnit(ASTContext &Context) {
-    TranslationUnitDecl *D = Context.getTranslationUnitDecl();
-    ASTExporter<ATDWriter> P(*OS, Context, *options);
-    P.dumpDecl(D);
+    CAPTURE_PROBE(translation_unit_begin);
+    // Under clang's -ftime-trace this lands in the same Chrome trace
+    // file as the parse and instantiation events, so one flamegraph
+    // covers the whole per-TU pipeline; without it the scope is a
+    // global-pointer check. The gap between ExportDecls below and this
+    // scope's end is the trailing tables and sidecars.
+    llvm::TimeTraceScope TimeScope("ExportTranslationUnit");
+    const bool phaseStats = !options->phaseStatsFile.empty();
+    PhaseSample ParseDone;
+    if (phaseStats) {
+      ParseDone = PhaseSample::now();
+    }
+    ASTExporter<ATDWriter> &P = exporter(Context);
+    // setup covers exporter construction (mangler, null nodes, writer);
+    // under streamDecls it happened during the parse and shows as ~0
+    PhaseSample SetupDone;
+    if (phaseStats) {
+      SetupDone = PhaseSample::now();
+    }
+    {
+      llvm::TimeTraceScope DeclsScope("ExportDecls");
+      if (options->streamDecls) {
+        // the parsed decls are already out; close the envelope around
+        // them (a unit without any parsed decl still gets its envelope
+        // here)
+        if (!StreamOpen) {
+          P.beginDeclStream(Context.getTranslationUnitDecl());
+          StreamOpen = true;
+        }
+        P.endDeclStream(Context.getTranslationUnitDecl());
+      } else {
+        P.dumpDecl(Context.getTranslationUnitDecl());
+      }
+    }
+    // under layoutHeader each closeLayoutSection seals the frame of the
+    // value(s) just emitted and records its byte range for the front
+    // block; without it the calls are no-ops
+    P.closeLayoutSection(LayoutDeclStream);
+    if (options->useFileTable) {
+      // trailing value: the id->path table referenced by source locations
+      P.dumpSourceFileTable();
+      P.closeLayoutSection(LayoutFileTable);
+    }
+    if (options->macroTable) {
+      // trailing value: the id->(name, file, line) definition table
+      // referenced by macro locations
+      P.dumpMacroDefinitionTable();
+      P.closeLayoutSection(LayoutMacroTable);
+    }
+    if (options->useSpecifierTable) {
+      // trailing value: the id->chain table for interned qualifier chains
+      P.dumpSpecifierChainTable();
+      P.closeLayoutSection(LayoutSpecifierTable);
+    }
+    if (options->refNameTable) {
+      // trailing value: the pointer->name table for nameless decl_refs
+      P.dumpRefNameTable();
+      P.closeLayoutSection(LayoutRefNameTable);
+    }
+    if (options->kindClusteredOrder) {
+      // trailing value: the emitted->source permutation of the
+      // top-level decls, for consumers that need source order back
+      P.dumpDeclOrderTable();
+      P.closeLayoutSection(LayoutDeclOrderTable);
+    }
+    if (!options->lookupContexts.empty()) {
+      // trailing value: lookup tables of the requested contexts only
+      P.dumpLookupsTable();
+      P.closeLayoutSection(LayoutLookupTable);
+    }
+    if (options->declIndex) {
+      // trailing value: (name, fingerprint, offset, length) per decl
+      // frame, landing in the trailer frame where readers can find it
+      // without parsing the document
+      P.dumpDeclIndexTable();
+      P.closeLayoutSection(LayoutDeclIndexTable);
+    }
+    if (options->layoutHeader) {
+      // the front block is patched after the output gets its final name
+      // (rename, linkat publication), which happens after this consumer
+      // is gone; leave the bytes with the action
+      options->pendingLayoutPatches.emplace_back(options->outputFile,
+                                                 P.buildLayoutHeader());
+    }
+    if (options->diffDecls &&
+        !ASTPluginLib::hasOutputTransport(options->outputFile)) {
+      P.writeDeclIndexSidecar(options->outputFile + ".declidx");
+    }
+    if (options->declIndex &&
+        options->outputFile.compare(0, 5, "pack:") == 0 &&
+        !options->compressOutput) {
+      // decl frame offsets only line up with the stored slice when the
+      // pack holds the uncompressed framed stream
+      P.appendPackDeclIndex(
+          options->outputFile.substr(5) + "/pack.declidx",
+          options->normalizeSourcePath(
+              options->inputFile.getFile().str().c_str()));
+    }
+    if (options->sectionIndex &&
+        !ASTPluginLib::hasOutputTransport(options->outputFile)) {
+      P.writeSectionIndexSidecar(options->outputFile + ".sections");
+    }
+    if (options->sectionIndex &&
+        options->outputFile.compare(0, 5, "pack:") == 0 &&
+        !options->compressOutput) {
+      // like the pack decl index, section offsets only line up with the
+      // stored slice when the pack holds the uncompressed framed stream
+      P.appendPackSectionIndex(
+          options->outputFile.substr(5) + "/pack.sections",
+          options->normalizeSourcePath(
+              options->inputFile.getFile().str().c_str()));
+    }
+    if (options->symbolBloom &&
+        !ASTPluginLib::hasOutputTransport(options->outputFile)) {
+      P.writeSymbolBloomSidecar(options->outputFile + ".bloom");
+    }
+    if (options->lineIndex &&
+        !ASTPluginLib::hasOutputTransport(options->outputFile)) {
+      P.writeLineIndexSidecar(options->outputFile + ".lines");
+    }
+    if (options->dumpComments && options->commentSidecar) {
+      // transports already cleared the flag in wrapOutputStream
+      P.writeCommentSidecar(options->outputFile + ".comments");
+    }
+    if (options->profileVisitors) {
+      // stderr only; the dump itself is unaffected
+      P.dumpVisitorProfile();
+    }
+    if (phaseStats) {
+      appendPhaseStats(ParseDone, SetupDone, PhaseSample::now());
+    }
+    if (!options->costDbFile.empty()) {
+      appendCostRecord(Context, PhaseSample::now());
+    }
+    if (!options->manifestFile.empty()) {
+      appendManifestRecord(Context, P.DumpedDeclCount);
+    }
+    CAPTURE_PROBE(translation_unit_end);
+  }
+
+  ~ExporterASTConsumer() override {
+    // the writer emits its EOF (and the pipelined writers drain) when
+    // the exporter dies; probe once the output bytes are complete
+    {
+      llvm::TimeTraceScope TimeScope("ExportFlush");
+      Exporter.reset();
+    }
+    CAPTURE_PROBE(emit_eof);
   }
 };
 
@@ -5425,5 +9696,71 @@ typedef ASTPluginLib::SimplePluginASTAction<
     ASTLib::ExporterASTConsumer<ATDWriter::BiniouWriter<llvm::raw_ostream>,
                                 true>>
     BiniouExporterASTAction;
+// one traversal, two artifacts: biniou on the main output plus a
+// prettified JSON rendition on a second stream (see TEE_JSON_FILE)
+typedef ASTPluginLib::SimplePluginASTAction<
+    ASTLib::ExporterASTConsumer<ASTLib::BiniouJsonTeeWriter, true>>
+    BiniouJsonTeeExporterASTAction;
+// biniou plus the semantic fingerprint that drives cache invalidation
+// (see SkeletonHashEmitter in atdlib/ATDWriter.h and SKELETON_HASH_FILE)
+typedef ASTPluginLib::SimplePluginASTAction<
+    ASTLib::ExporterASTConsumer<ASTLib::BiniouSkeletonTeeWriter, true>>
+    BiniouSkeletonTeeExporterASTAction;
+// statistics-only rendition of the same traversal (see StatsEmitter):
+// the output file receives a per-kind/per-file histogram, not a dump
+typedef ASTPluginLib::SimplePluginASTAction<
+    ASTLib::ExporterASTConsumer<ASTLib::StatsWriter, false>>
+    StatsExporterASTAction;
+// flat, offset-based binary output for mmap-ed consumption (see
+// FlatEmitter in atdlib/ATDWriter.h)
+typedef ASTPluginLib::SimplePluginASTAction<ASTLib::ExporterASTConsumer<
+    ATDWriter::FlatWriter<llvm::raw_ostream>,
+    false>>
+    FlatExporterASTAction;
+// same bytes as the plain yojson/biniou exporters, but rendered on a
+// second thread overlapped with the traversal (see PipelineEmitter in
+// atdlib/ATDWriter.h)
+typedef ASTPluginLib::SimplePluginASTAction<
+    ASTLib::ExporterASTConsumer<ASTLib::PipelinedJsonWriter, true>>
+    YojsonPipelineExporterASTAction;
+typedef ASTPluginLib::SimplePluginASTAction<
+    ASTLib::ExporterASTConsumer<ASTLib::PipelinedBiniouWriter, true>>
+    BiniouPipelineExporterASTAction;
+
+// The exporter template is instantiated once per writer in a dedicated
+// translation unit (ASTExporterJson.cpp and friends in the Makefile);
+// TUs including this header link against those instantiations instead
+// of each re-instantiating the traversal, so a rebuild of
+// ASTExporter.cpp stops recompiling the world once per writer and the
+// dylib carries one strong copy of each symbol rather than weak
+// duplicates bloating its relocation table (and process startup).
+extern template class ASTExporter<JsonWriter>;
+extern template class ASTExporter<ATDWriter::BiniouWriter<llvm::raw_ostream>>;
+extern template class ASTExporter<BiniouJsonTeeWriter>;
+extern template class ASTExporter<BiniouSkeletonTeeWriter>;
+extern template class ASTExporter<StatsWriter>;
+extern template class ASTExporter<ATDWriter::FlatWriter<llvm::raw_ostream>>;
+extern template class ASTExporter<PipelinedJsonWriter>;
+extern template class ASTExporter<PipelinedBiniouWriter>;
+
+// Declaration-only variant of an exporter action: function bodies are
+// neither parsed nor exported (clang's SkipFunctionBodies), which cuts
+// both parse and serialize time for dependency TUs whose bodies are
+// never analyzed. Body-less functions simply dump without a body field.
+template <class ExporterASTAction>
+class DeclOnlyExporterASTAction : public ExporterASTAction {
+ protected:
+  void ExecuteAction() override {
+    this->getCompilerInstance().getFrontendOpts().SkipFunctionBodies = true;
+    ExporterASTAction::ExecuteAction();
+  }
+};
+
+typedef DeclOnlyExporterASTAction<JsonExporterASTAction>
+    JsonDeclOnlyExporterASTAction;
+typedef DeclOnlyExporterASTAction<YojsonExporterASTAction>
+    YojsonDeclOnlyExporterASTAction;
+typedef DeclOnlyExporterASTAction<BiniouExporterASTAction>
+    BiniouDeclOnlyExporterASTAction;
 
 } // end of namespace ASTLib
@@ -0,0 +1,454 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * Multi-threaded batch capture: runs the AST exporter over every entry
+ * of a compile_commands.json inside one process, fanning the entries
+ * out to a pool of workers. Replaces one clang process spawn per file
+ * (process startup and plugin loading paid N times) with a single
+ * process whose capture throughput tracks the core count.
+ *
+ * Usage: ast_exporter_batch <compile_commands.json> [-j N] [KEY=VALUE...]
+ *
+ * KEY=VALUE arguments are plugin options, as with -plugin-arg on the
+ * command line; set at least OUTPUT_FILE, typically to a "%.bla"
+ * pattern so every entry derives its own output from its object file.
+ * The batch tool itself reads FORMAT=json|yojson|biniou (default
+ * yojson) to select the exporter, and COST_DB_FILE to load measured
+ * capture times for the longest-job-first schedule (the exporters
+ * append this run's measurements to the same file, so the second run
+ * schedules from history). NUMA_PIN=1 pins each worker to a NUMA node
+ * so its allocations stay node-local on multi-socket machines. With
+ * MANIFEST_FILE the exporters append one row per produced output and
+ * the tool leaves suggested balanced ingestion shards in
+ * <manifest>.shards after the run. -j defaults to the hardware
+ * concurrency.
+ *
+ * Each worker keeps its own FileManager for the entries it processes
+ * (FileManager is not thread-safe, so the stat caches are warm per
+ * worker rather than process-wide) and chdirs virtually into each
+ * entry's directory through an overlay file system, the same way
+ * ClangTool does.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#include <stdlib.h>
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include <clang/Basic/FileManager.h>
+#include <clang/Tooling/ArgumentsAdjusters.h>
+#include <clang/Tooling/CompilationDatabase.h>
+#include <clang/Tooling/JSONCompilationDatabase.h>
+#include <clang/Tooling/Tooling.h>
+
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/xxhash.h>
+#include <llvm/Support/ThreadPool.h>
+#include <llvm/Support/Threading.h>
+#include <llvm/Support/VirtualFileSystem.h>
+
+#include "ASTExporter.h"
+
+namespace {
+
+// One exporter action per invocation; the plugin options are handed to
+// it untouched, as with -plugin-arg on the command line.
+std::unique_ptr<clang::FrontendAction> makeAction(
+    const std::vector<std::string> &pluginArgs, const std::string &format) {
+  if (format == "json") {
+    return std::make_unique<ASTLib::JsonExporterASTAction>(pluginArgs);
+  }
+  if (format == "yojson") {
+    return std::make_unique<ASTLib::YojsonExporterASTAction>(pluginArgs);
+  }
+  if (format == "biniou") {
+    return std::make_unique<ASTLib::BiniouExporterASTAction>(pluginArgs);
+  }
+  return nullptr;
+}
+
+#ifdef __linux__
+// One cpu_set_t per NUMA node, parsed from
+// /sys/devices/system/node/node<N>/cpulist (e.g. "0-23,48-71"). Empty
+// on single-node machines or where sysfs is unavailable, in which case
+// placement is skipped.
+std::vector<cpu_set_t> numaNodeCpuSets() {
+  std::vector<cpu_set_t> nodes;
+  for (unsigned n = 0;; n++) {
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buffer =
+        llvm::MemoryBuffer::getFile("/sys/devices/system/node/node" +
+                                    std::to_string(n) + "/cpulist");
+    if (!buffer) {
+      break;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    llvm::StringRef rest = (*buffer)->getBuffer().trim();
+    while (!rest.empty()) {
+      llvm::StringRef range;
+      std::tie(range, rest) = rest.split(',');
+      llvm::StringRef lo = range, hi = range;
+      const size_t dash = range.find('-');
+      if (dash != llvm::StringRef::npos) {
+        lo = range.take_front(dash);
+        hi = range.drop_front(dash + 1);
+      }
+      unsigned first = 0, last = 0;
+      if (lo.trim().getAsInteger(10, first) ||
+          hi.trim().getAsInteger(10, last)) {
+        continue;
+      }
+      for (unsigned cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++) {
+        CPU_SET(cpu, &set);
+      }
+    }
+    if (CPU_COUNT(&set) > 0) {
+      nodes.push_back(set);
+    }
+  }
+  if (nodes.size() < 2) {
+    nodes.clear(); // one node: nothing to place
+  }
+  return nodes;
+}
+#endif
+
+std::string absoluteFilename(const clang::tooling::CompileCommand &cmd) {
+  llvm::SmallString<256> path(cmd.Filename);
+  if (llvm::sys::path::is_relative(path)) {
+    path = cmd.Directory;
+    llvm::sys::path::append(path, cmd.Filename);
+  }
+  return std::string(path);
+}
+
+// One prior capture of a file, from the cost database the exporter
+// appends to (COST_DB_FILE in ASTExporter.h). Only what the scheduler
+// needs is kept here.
+struct CostRecord {
+  uint64_t contentHash = 0;
+  double wallSeconds = 0;
+};
+
+// Load the cost database: tab-separated (path, content hash, wall
+// seconds, output bytes, peak rss) lines. Captures append concurrently
+// and recaptures append again, so the last record for a path wins; a
+// missing file is just an empty history.
+std::map<std::string, CostRecord> loadCostDb(const std::string &path) {
+  std::map<std::string, CostRecord> db;
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buffer =
+      llvm::MemoryBuffer::getFile(path);
+  if (!buffer) {
+    return db;
+  }
+  llvm::StringRef rest = (*buffer)->getBuffer();
+  while (!rest.empty()) {
+    llvm::StringRef line;
+    std::tie(line, rest) = rest.split('\n');
+    llvm::SmallVector<llvm::StringRef, 5> fields;
+    line.split(fields, '\t');
+    if (fields.size() < 3) {
+      continue; // tolerate lines truncated by a killed capture
+    }
+    CostRecord record;
+    if (fields[1].getAsInteger(16, record.contentHash) ||
+        fields[2].getAsDouble(record.wallSeconds)) {
+      continue;
+    }
+    db[fields[0].str()] = record;
+  }
+  return db;
+}
+
+// Predicted capture cost of every entry, in seconds where history
+// exists. A database record whose content hash still matches the file
+// gives a measured wall time; everything else falls back to the main
+// source file size -- far from proportional to parse time (headers
+// dominate), but enough to rank the monster files ahead of the trivial
+// ones. Size-based estimates are scaled by the throughput observed on
+// the measured entries so both kinds rank together.
+std::vector<double> predictedCosts(
+    const std::vector<clang::tooling::CompileCommand> &commands,
+    const std::map<std::string, CostRecord> &costDb) {
+  std::vector<double> costs(commands.size());
+  std::vector<char> measured(commands.size(), 0);
+  double measuredWall = 0;
+  uint64_t measuredBytes = 0;
+  for (size_t i = 0; i < commands.size(); i++) {
+    const std::string path = absoluteFilename(commands[i]);
+    uint64_t size = 0;
+    if (llvm::sys::fs::file_size(path, size)) {
+      size = 0; // unknown files sort last; the invocation will report them
+    }
+    // the exporter keys records by its normalized source path; with path
+    // normalization off that is the absolute path, otherwise the
+    // database entry as written is tried too
+    auto I = costDb.find(path);
+    if (I == costDb.end()) {
+      I = costDb.find(commands[i].Filename);
+    }
+    if (I != costDb.end()) {
+      llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buffer =
+          llvm::MemoryBuffer::getFile(path);
+      if (buffer &&
+          llvm::xxHash64((*buffer)->getBuffer()) == I->second.contentHash) {
+        costs[i] = I->second.wallSeconds;
+        measured[i] = 1;
+        measuredWall += I->second.wallSeconds;
+        measuredBytes += size;
+        continue;
+      }
+      // edited since it was measured: the record is stale, estimate
+    }
+    costs[i] = (double)size;
+  }
+  if (measuredWall > 0 && measuredBytes > 0) {
+    const double secondsPerByte = measuredWall / (double)measuredBytes;
+    for (size_t i = 0; i < commands.size(); i++) {
+      if (!measured[i]) {
+        costs[i] *= secondsPerByte;
+      }
+    }
+  }
+  return costs;
+}
+
+// Append-time manifest rows (MANIFEST_FILE in ASTExporter.h) turned
+// into suggested balanced ingestion shards in <manifest>.shards: one
+// line per shard, total bytes first, then the outputs assigned to it,
+// tab-separated. Greedy longest-first into the least-loaded shard over
+// the serialized sizes the exporters recorded, so downstream readers
+// spawn one ingest worker per line instead of re-balancing from a
+// stat() walk.
+void writeManifestShards(const std::string &manifestPath, unsigned numShards) {
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buffer =
+      llvm::MemoryBuffer::getFile(manifestPath);
+  if (!buffer || numShards == 0) {
+    return;
+  }
+  // recaptures append again, so the last row per output wins, as with
+  // the cost database
+  std::map<std::string, uint64_t> sizes;
+  llvm::StringRef rest = (*buffer)->getBuffer();
+  while (!rest.empty()) {
+    llvm::StringRef line;
+    std::tie(line, rest) = rest.split('\n');
+    llvm::SmallVector<llvm::StringRef, 5> fields;
+    line.split(fields, '\t');
+    uint64_t bytes = 0;
+    if (fields.size() < 2 || fields[1].getAsInteger(10, bytes)) {
+      continue; // tolerate lines truncated by a killed capture
+    }
+    sizes[fields[0].str()] = bytes;
+  }
+  std::vector<std::pair<uint64_t, const std::string *>> outputs;
+  outputs.reserve(sizes.size());
+  for (const auto &entry : sizes) {
+    outputs.push_back({entry.second, &entry.first});
+  }
+  std::stable_sort(
+      outputs.begin(), outputs.end(), [](const auto &a, const auto &b) {
+        return a.first > b.first;
+      });
+  struct Shard {
+    uint64_t bytes = 0;
+    std::vector<const std::string *> outputs;
+  };
+  std::vector<Shard> shards(numShards);
+  for (const auto &output : outputs) {
+    Shard *least = &shards[0];
+    for (Shard &shard : shards) {
+      if (shard.bytes < least->bytes) {
+        least = &shard;
+      }
+    }
+    least->bytes += output.first;
+    least->outputs.push_back(output.second);
+  }
+  std::error_code EC;
+  llvm::raw_fd_ostream out(manifestPath + ".shards", EC);
+  if (EC) {
+    llvm::errs() << "[!] Failed to write " << manifestPath
+                 << ".shards: " << EC.message() << "\n";
+    return;
+  }
+  for (const Shard &shard : shards) {
+    if (shard.outputs.empty()) {
+      continue;
+    }
+    out << shard.bytes;
+    for (const std::string *output : shard.outputs) {
+      out << '\t' << *output;
+    }
+    out << '\n';
+  }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::string dbPath;
+  std::vector<std::string> pluginArgs;
+  unsigned jobs = 0; // 0 = hardware concurrency
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "-j" && i + 1 < argc) {
+      jobs = (unsigned)strtoul(argv[++i], nullptr, 10);
+    } else if (arg.find('=') != std::string::npos) {
+      pluginArgs.push_back(arg);
+    } else if (dbPath.empty()) {
+      dbPath = arg;
+    } else {
+      llvm::errs() << "usage: " << argv[0]
+                   << " <compile_commands.json> [-j N] [KEY=VALUE...]\n";
+      return 1;
+    }
+  }
+  if (dbPath.empty()) {
+    llvm::errs() << "usage: " << argv[0]
+                 << " <compile_commands.json> [-j N] [KEY=VALUE...]\n";
+    return 1;
+  }
+
+  // consumed here, not by the plugin options
+  ASTPluginLib::PluginASTOptionsBase::registerToolOptionKey("FORMAT");
+  ASTPluginLib::PluginASTOptionsBase::registerToolOptionKey("NUMA_PIN");
+  std::string format = "yojson";
+  std::string costDbPath;
+  std::string manifestPath;
+  bool numaPin = false;
+  for (const std::string &arg : pluginArgs) {
+    if (arg.compare(0, 7, "FORMAT=") == 0) {
+      format = arg.substr(7);
+    } else if (arg.compare(0, 13, "COST_DB_FILE=") == 0) {
+      // also a plugin option: the exporters append this run's records to
+      // the same file the scheduler reads here
+      costDbPath = arg.substr(13);
+    } else if (arg.compare(0, 14, "MANIFEST_FILE=") == 0) {
+      // likewise: the exporters append the rows, the shard suggestion
+      // below reads them back
+      manifestPath = arg.substr(14);
+    } else if (arg.compare(0, 9, "NUMA_PIN=") == 0) {
+      numaPin = strtol(arg.c_str() + 9, nullptr, 10) != 0;
+    }
+  }
+  if (!makeAction(pluginArgs, format)) {
+    llvm::errs() << "[!] Unknown FORMAT " << format << "\n";
+    return 1;
+  }
+
+  std::string errorMessage;
+  std::unique_ptr<clang::tooling::JSONCompilationDatabase> db =
+      clang::tooling::JSONCompilationDatabase::loadFromFile(
+          dbPath,
+          errorMessage,
+          clang::tooling::JSONCommandLineSyntax::AutoDetect);
+  if (!db) {
+    llvm::errs() << "[!] Failed to load " << dbPath << ": " << errorMessage
+                 << "\n";
+    return 1;
+  }
+  const std::vector<clang::tooling::CompileCommand> commands =
+      db->getAllCompileCommands();
+
+  // the exporter only needs the AST, not code generation
+  clang::tooling::ArgumentsAdjuster adjuster =
+      clang::tooling::getClangSyntaxOnlyAdjuster();
+
+  // Longest job first: entries are ranked by predicted cost so the long
+  // poles start immediately instead of landing on a busy worker near the
+  // end of the run. Makespan then approaches total work over cores
+  // rather than being bounded by whenever the slowest TU happened to
+  // start. The stable sort keeps database order among equal costs.
+  std::vector<size_t> order(commands.size());
+  std::iota(order.begin(), order.end(), (size_t)0);
+  const std::vector<double> costs =
+      predictedCosts(commands,
+                     costDbPath.empty() ? std::map<std::string, CostRecord>()
+                                        : loadCostDb(costDbPath));
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return costs[a] > costs[b];
+  });
+
+  // Entries are pulled off a shared counter so that a handful of huge
+  // translation units cannot idle the other workers: every idle worker
+  // takes the longest remaining job, which is the schedule a
+  // work-stealing deque seeded in descending cost order would produce,
+  // with one atomic increment instead of per-worker deques.
+  std::atomic<size_t> nextCommand{0};
+  std::atomic<size_t> failures{0};
+#ifdef __linux__
+  // NUMA placement: workers are spread round-robin over the nodes and
+  // pinned to their node's cpu set. Everything a worker allocates -- its
+  // FileManager, clang's BumpPtrAllocator arenas, the exporter's output
+  // buffers -- is first touched on the worker's own node and stays
+  // local under the kernel's first-touch policy, so no per-allocation
+  // plumbing is needed beyond the pin.
+  const std::vector<cpu_set_t> numaNodes =
+      numaPin ? numaNodeCpuSets() : std::vector<cpu_set_t>();
+#endif
+  llvm::ThreadPool pool(llvm::hardware_concurrency(jobs));
+  for (unsigned i = 0; i < pool.getThreadCount(); i++) {
+    pool.async([&, i] {
+#ifdef __linux__
+      if (!numaNodes.empty()) {
+        const cpu_set_t &node = numaNodes[i % numaNodes.size()];
+        if (sched_setaffinity(0, sizeof(node), &node) != 0) {
+          llvm::errs() << "[!] Failed to pin worker " << i
+                       << " to its NUMA node\n";
+        }
+      }
+#endif
+      llvm::IntrusiveRefCntPtr<llvm::vfs::OverlayFileSystem> fs(
+          new llvm::vfs::OverlayFileSystem(llvm::vfs::getRealFileSystem()));
+      llvm::IntrusiveRefCntPtr<clang::FileManager> fileManager(
+          new clang::FileManager(clang::FileSystemOptions(), fs));
+      size_t c;
+      while ((c = nextCommand++) < commands.size()) {
+        const clang::tooling::CompileCommand &cmd = commands[order[c]];
+        if (fs->setCurrentWorkingDirectory(cmd.Directory)) {
+          llvm::errs() << "[!] Cannot enter " << cmd.Directory << "\n";
+          failures++;
+          continue;
+        }
+        clang::tooling::ToolInvocation invocation(
+            adjuster(cmd.CommandLine, cmd.Filename),
+            makeAction(pluginArgs, format),
+            fileManager.get());
+        if (!invocation.run()) {
+          llvm::errs() << "[!] Capture failed for " << cmd.Filename << "\n";
+          failures++;
+        }
+      }
+    });
+  }
+  pool.wait();
+
+  if (!manifestPath.empty()) {
+    // shard count defaults to this run's worker count; downstream can
+    // re-balance from the manifest rows if it wants a different fan-out
+    writeManifestShards(manifestPath, pool.getThreadCount());
+  }
+
+  if (failures > 0) {
+    llvm::errs() << "[!] " << failures.load() << " of " << commands.size()
+                 << " captures failed\n";
+    return 1;
+  }
+  return 0;
+}
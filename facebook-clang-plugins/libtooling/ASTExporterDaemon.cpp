@@ -0,0 +1,218 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * Long-lived capture server: accepts clang compile commands over a unix
+ * socket and runs the AST exporter on each of them inside this warm
+ * process, so that process startup, plugin loading and the FileManager
+ * stat caches are paid once per build instead of once per file.
+ *
+ * Usage: ast_exporter_daemon <socket-path> [stat-cache-file]
+ *
+ * When a stat-cache file is given, the symlink-resolution cache is
+ * loaded from it at startup (entries revalidated against lstat mtimes;
+ * see FileUtils::loadSymlinkCache) and saved back on a clean QUIT, so
+ * a restarted daemon skips the realpath storm over the symlink forest
+ * instead of re-resolving it across the first thousand requests.
+ *
+ * The daemon serves one request per connection, sequentially. A request
+ * is line-based:
+ *   - plugin option lines "KEY=VALUE" (at least OUTPUT_FILE=...; the
+ *     daemon itself reads FORMAT=json|yojson|biniou, default yojson,
+ *     CLEAR_STAT_CACHE=1 to drop the shared stat cache first, e.g.
+ *     when headers changed since the previous request, and
+ *     MEMORY_BUDGET_MB=N to trim the process-wide caches after the
+ *     request when they exceed N MB, so a days-long daemon holds a
+ *     fixed RSS without being restarted),
+ *   - a separator line "--",
+ *   - the compile command, one argument per line, starting with the
+ *     compiler path (used to locate the resource directory) and best
+ *     including -fsyntax-only,
+ *   - an empty line (or end of stream).
+ * The reply is a single line, "OK" once the output file is fully
+ * written or "KO" on any failure; diagnostics go to the daemon's
+ * stderr. A request consisting of the single line "QUIT" shuts the
+ * daemon down.
+ */
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <clang/Basic/FileManager.h>
+#include <clang/Tooling/Tooling.h>
+
+#include "ASTExporter.h"
+#include "FileUtils.h"
+
+namespace {
+
+// Run one exporter invocation against the shared file manager. The
+// plugin options select the output format; everything else is handed to
+// the action untouched, as with -plugin-arg on the command line.
+bool runExporter(const std::vector<std::string> &pluginArgs,
+                 std::vector<std::string> command,
+                 clang::FileManager &fileManager) {
+  std::string format = "yojson";
+  for (const std::string &arg : pluginArgs) {
+    if (arg.compare(0, 7, "FORMAT=") == 0) {
+      format = arg.substr(7);
+    } else if (arg == "CLEAR_STAT_CACHE=1") {
+      fileManager.clearStatCache();
+    }
+  }
+  std::unique_ptr<clang::FrontendAction> action;
+  if (format == "json") {
+    action.reset(new ASTLib::JsonExporterASTAction(pluginArgs));
+  } else if (format == "yojson") {
+    action.reset(new ASTLib::YojsonExporterASTAction(pluginArgs));
+  } else if (format == "biniou") {
+    action.reset(new ASTLib::BiniouExporterASTAction(pluginArgs));
+  } else {
+    llvm::errs() << "[!] Unknown FORMAT " << format << "\n";
+    return false;
+  }
+  clang::tooling::ToolInvocation invocation(
+      std::move(command), std::move(action), &fileManager);
+  return invocation.run();
+}
+
+// Serve requests forever (until a QUIT request); returns the process
+// exit code.
+int serve(const char *socketPath) {
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(socketPath) >= sizeof(addr.sun_path)) {
+    llvm::errs() << "[!] Socket path too long: " << socketPath << "\n";
+    return 1;
+  }
+  strncpy(addr.sun_path, socketPath, sizeof(addr.sun_path) - 1);
+  int server = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (server < 0) {
+    perror("socket");
+    return 1;
+  }
+  // a previous daemon instance may have left its socket behind
+  unlink(socketPath);
+  if (bind(server, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+      listen(server, 8) < 0) {
+    perror("bind/listen");
+    close(server);
+    return 1;
+  }
+
+  // The warm state the daemon exists for: one FileManager whose stat
+  // and directory caches survive across requests, so the system and
+  // project header trees are only stat'ed once per build.
+  llvm::IntrusiveRefCntPtr<clang::FileManager> fileManager(
+      new clang::FileManager(clang::FileSystemOptions()));
+
+  bool quit = false;
+  while (!quit) {
+    int client = accept(server, nullptr, nullptr);
+    if (client < 0) {
+      continue;
+    }
+    FILE *stream = fdopen(client, "r+");
+    if (!stream) {
+      close(client);
+      continue;
+    }
+    std::vector<std::string> pluginArgs;
+    std::vector<std::string> command;
+    bool separatorSeen = false;
+    char *line = nullptr;
+    size_t cap = 0;
+    ssize_t len;
+    while ((len = getline(&line, &cap, stream)) > 0) {
+      while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+        line[--len] = '\0';
+      }
+      if (len == 0) {
+        break;
+      }
+      std::string arg(line, len);
+      if (!separatorSeen && arg == "--") {
+        separatorSeen = true;
+      } else if (separatorSeen) {
+        command.push_back(arg);
+      } else {
+        pluginArgs.push_back(arg);
+      }
+    }
+    free(line);
+    bool ok;
+    if (!separatorSeen && pluginArgs.size() == 1 && pluginArgs[0] == "QUIT") {
+      ok = true;
+      quit = true;
+    } else {
+      ok = separatorSeen && !command.empty() &&
+           runExporter(pluginArgs, std::move(command), *fileManager);
+    }
+    fputs(ok ? "OK\n" : "KO\n", stream);
+    fclose(stream);
+    // Bounded-memory operation: between requests nothing holds
+    // references into the process-wide caches, so this is the one safe
+    // point to evict. Cold path-cache segments go first (segmented LRU,
+    // see PathNormalizationCache); the stat cache is unmeasured but
+    // grows with the same traffic, so it is dropped on the same
+    // cadence. Per-unit state (mangling caches, exporter arenas) dies
+    // with each invocation and needs no budget.
+    unsigned long budgetMb = 0;
+    for (const std::string &arg : pluginArgs) {
+      if (arg.compare(0, 17, "MEMORY_BUDGET_MB=") == 0) {
+        budgetMb = strtoul(arg.c_str() + 17, nullptr, 10);
+      }
+    }
+    if (budgetMb > 0) {
+      const size_t budget = (size_t)budgetMb << 20;
+      if (ASTPluginLib::PathNormalizationCache::trimAllToBudget(budget) >
+          budget) {
+        fileManager->clearStatCache();
+      }
+    }
+  }
+  close(server);
+  unlink(socketPath);
+  return 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  if (argc < 2 || argc > 3) {
+    llvm::errs() << "usage: " << argv[0]
+                 << " <socket-path> [stat-cache-file]\n";
+    return 1;
+  }
+  // consumed by the daemon, not by the plugin options
+  ASTPluginLib::PluginASTOptionsBase::registerToolOptionKey("FORMAT");
+  ASTPluginLib::PluginASTOptionsBase::registerToolOptionKey(
+      "CLEAR_STAT_CACHE");
+  ASTPluginLib::PluginASTOptionsBase::registerToolOptionKey(
+      "MEMORY_BUDGET_MB");
+  const char *statCacheFile = argc == 3 ? argv[2] : nullptr;
+  if (statCacheFile) {
+    FileUtils::loadSymlinkCache(statCacheFile);
+  }
+  int code = serve(argv[1]);
+  // only a clean shutdown persists the cache: a crash may leave it in
+  // an arbitrary state, and the stale file from the previous clean run
+  // is a better warm start than none
+  if (statCacheFile && code == 0) {
+    FileUtils::saveSymlinkCache(statCacheFile);
+  }
+  return code;
+}
@@ -0,0 +1,19 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * Explicit instantiation of the exporter for the flat offset-based
+ * writer. See the extern template block at the bottom of ASTExporter.h.
+ */
+
+#include "ASTExporter.h"
+
+namespace ASTLib {
+
+template class ASTExporter<ATDWriter::FlatWriter<llvm::raw_ostream>>;
+
+} // end of namespace ASTLib
@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * Standalone single-TU capture tool: the exporter linked statically
+ * into its own binary and driven by compile arguments. The plugin
+ * route pays a dlopen and relocation of the (large, three writer
+ * instantiations) dylib inside every clang process of a build; here
+ * the code is loaded once by the kernel at exec and shared from the
+ * page cache across the fleet's processes.
+ *
+ * Usage: ast_exporter [KEY=VALUE...] -- <compile command>
+ *
+ * KEY=VALUE arguments are plugin options, as with -plugin-arg on the
+ * command line; set at least OUTPUT_FILE. The tool itself reads
+ * FORMAT=json|yojson|biniou (default yojson) to select the exporter.
+ * The compile command starts with the compiler path (used to locate
+ * the resource directory) and best includes -fsyntax-only.
+ */
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <string.h>
+
+#include <clang/Basic/FileManager.h>
+#include <clang/Tooling/Tooling.h>
+
+#include "ASTExporter.h"
+
+namespace {
+
+void usage(const char *argv0) {
+  llvm::errs() << "usage: " << argv0
+               << " [KEY=VALUE...] -- <compile command>\n";
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::vector<std::string> pluginArgs;
+  std::vector<std::string> command;
+  int i = 1;
+  for (; i < argc && strcmp(argv[i], "--") != 0; i++) {
+    if (strchr(argv[i], '=') == nullptr) {
+      usage(argv[0]);
+      return 1;
+    }
+    pluginArgs.push_back(argv[i]);
+  }
+  for (i++; i < argc; i++) {
+    command.push_back(argv[i]);
+  }
+  if (command.empty()) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  std::string format = "yojson";
+  for (const std::string &arg : pluginArgs) {
+    if (arg.compare(0, 7, "FORMAT=") == 0) {
+      format = arg.substr(7);
+    }
+  }
+  std::unique_ptr<clang::FrontendAction> action;
+  if (format == "json") {
+    action.reset(new ASTLib::JsonExporterASTAction(pluginArgs));
+  } else if (format == "yojson") {
+    action.reset(new ASTLib::YojsonExporterASTAction(pluginArgs));
+  } else if (format == "biniou") {
+    action.reset(new ASTLib::BiniouExporterASTAction(pluginArgs));
+  } else {
+    llvm::errs() << "[!] Unknown FORMAT " << format << "\n";
+    return 1;
+  }
+
+  llvm::IntrusiveRefCntPtr<clang::FileManager> fileManager(
+      new clang::FileManager(clang::FileSystemOptions()));
+  clang::tooling::ToolInvocation invocation(
+      std::move(command), std::move(action), fileManager.get());
+  return invocation.run() ? 0 : 1;
+}
@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * Unity capture tool: folds the source files of one compile command
+ * into a single synthesized TU of #include lines and captures that in
+ * one invocation, so a set of small files sharing heavy headers (the
+ * C++ models build, where every file re-parses libc++) pays the header
+ * parse once. Builds on the multi-input handling in
+ * SimplePluginASTActionBase: the synthesized file becomes the
+ * invocation's only input, mapped virtually so nothing touches the
+ * source tree.
+ *
+ * Usage: ast_exporter_unity [KEY=VALUE...] -- <compile command with
+ * several source files>
+ *
+ * KEY=VALUE arguments are plugin options, as with -plugin-arg on the
+ * command line; set at least OUTPUT_FILE. The tool itself reads
+ * FORMAT=json|yojson|biniou (default yojson) to select the exporter.
+ * Per-source attribution survives in source locations (and in the file
+ * table under FILE_TABLE=1): each included file keeps its own path in
+ * the SourceManager. The usual unity-build caveats apply - file-scope
+ * statics and leaking macros of the folded files now share one TU.
+ */
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <string.h>
+
+#include <clang/Basic/FileManager.h>
+#include <clang/Tooling/Tooling.h>
+
+#include <llvm/Support/Path.h>
+
+#include "ASTExporter.h"
+
+namespace {
+
+void usage(const char *argv0) {
+  llvm::errs() << "usage: " << argv0
+               << " [KEY=VALUE...] -- <compile command>\n";
+}
+
+bool isSourceFile(const std::string &arg) {
+  llvm::StringRef a(arg);
+  return !a.startswith("-") &&
+         (a.endswith(".c") || a.endswith(".cc") || a.endswith(".cpp") ||
+          a.endswith(".cxx") || a.endswith(".m") || a.endswith(".mm"));
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::vector<std::string> pluginArgs;
+  std::vector<std::string> command;
+  int i = 1;
+  for (; i < argc && strcmp(argv[i], "--") != 0; i++) {
+    if (strchr(argv[i], '=') == nullptr) {
+      usage(argv[0]);
+      return 1;
+    }
+    pluginArgs.push_back(argv[i]);
+  }
+  for (i++; i < argc; i++) {
+    command.push_back(argv[i]);
+  }
+  if (command.empty()) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  std::string format = "yojson";
+  for (const std::string &arg : pluginArgs) {
+    if (arg.compare(0, 7, "FORMAT=") == 0) {
+      format = arg.substr(7);
+    }
+  }
+  std::unique_ptr<clang::FrontendAction> action;
+  if (format == "json") {
+    action.reset(new ASTLib::JsonExporterASTAction(pluginArgs));
+  } else if (format == "yojson") {
+    action.reset(new ASTLib::YojsonExporterASTAction(pluginArgs));
+  } else if (format == "biniou") {
+    action.reset(new ASTLib::BiniouExporterASTAction(pluginArgs));
+  } else {
+    llvm::errs() << "[!] Unknown FORMAT " << format << "\n";
+    return 1;
+  }
+
+  // Fold the command's source files into one synthesized TU: the first
+  // source argument is replaced by the virtual unity file (same
+  // directory and extension, so language detection and relative
+  // includes behave as before), the others are dropped from the
+  // command, and every folded file is included by absolute path.
+  std::vector<std::string> unityCommand;
+  std::string unityContents;
+  std::string unityPath;
+  for (const std::string &arg : command) {
+    if (!isSourceFile(arg)) {
+      unityCommand.push_back(arg);
+      continue;
+    }
+    llvm::SmallString<256> absPath(arg);
+    llvm::sys::fs::make_absolute(absPath);
+    if (unityPath.empty()) {
+      llvm::SmallString<256> path(absPath);
+      llvm::sys::path::remove_filename(path);
+      llvm::sys::path::append(
+          path,
+          std::string("unity_capture") +
+              std::string(llvm::sys::path::extension(absPath)));
+      unityPath = std::string(path);
+      unityCommand.push_back(unityPath);
+    }
+    unityContents += "#include \"";
+    unityContents += std::string(absPath);
+    unityContents += "\"\n";
+  }
+  if (unityPath.empty()) {
+    llvm::errs() << "[!] No source files in the compile command\n";
+    return 1;
+  }
+
+  llvm::IntrusiveRefCntPtr<clang::FileManager> fileManager(
+      new clang::FileManager(clang::FileSystemOptions()));
+  clang::tooling::ToolInvocation invocation(
+      std::move(unityCommand), std::move(action), fileManager.get());
+  invocation.mapVirtualFile(unityPath, unityContents);
+  return invocation.run() ? 0 : 1;
+}
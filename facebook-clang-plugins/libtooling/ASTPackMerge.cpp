@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * Post-capture dedup merge: reads N framed exporter outputs
+ * (FRAME_DECLS captures, uncompressed) and consolidates them into one
+ * pack directory (see PackOStream.h), deduplicating identical decl
+ * frames by payload fingerprint. Even with header caching, overlapping
+ * decls land in many outputs - the same system interface body can
+ * appear tens of thousands of times across a full capture.
+ *
+ * The first occurrence of a frame stays inline; every later occurrence
+ * is rewritten into a reference frame carrying the fingerprint in
+ * decimal, the same stub DIFF_DECLS and the header cache emit.
+ * <outdir>/pack.dedup maps each referenced fingerprint to the canonical
+ * payload's (segment, offset, length), so a reader resolves references
+ * with pread alone; units are looked up through <outdir>/pack.index
+ * under their input path (see PackReader.h).
+ *
+ * Usage: ast_pack_merge <outdir> <framed-output>...
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/DenseSet.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Support/xxhash.h>
+
+#include "FrameOStream.h"
+#include "PackOStream.h"
+#include "PackReader.h"
+
+namespace {
+
+/* where the first occurrence of a fingerprint landed: which unit's
+   rewritten stream, and the payload slice inside it */
+struct Canonical {
+  const std::string *unit;
+  uint64_t payloadOffset;
+  uint64_t length;
+};
+
+/* a reference stub is a ~20 byte decimal fingerprint; frames with
+   payloads at or below that size cost more referenced than inline */
+const size_t minDedupPayload = 24;
+
+bool mergeOne(const std::string &path,
+              const std::string &outDir,
+              llvm::DenseMap<uint64_t, Canonical> &seen,
+              llvm::DenseSet<uint64_t> &referenced,
+              uint64_t &frames,
+              uint64_t &deduped,
+              uint64_t &bytesSaved) {
+  auto buffer = llvm::MemoryBuffer::getFile(path);
+  if (!buffer) {
+    std::cerr << "[!] Failed to read " << path << "\n";
+    return false;
+  }
+  llvm::StringRef data = (*buffer)->getBuffer();
+  ASTPluginLib::PackOStream pack(outDir, path);
+  uint64_t outOffset = 0;
+  size_t pos = 0;
+  while (pos < data.size()) {
+    char kind = data[pos++];
+    uint64_t size = 0;
+    unsigned shift = 0;
+    while (pos < data.size() && (data[pos] & 0x80)) {
+      size |= (uint64_t)(data[pos++] & 0x7f) << shift;
+      shift += 7;
+    }
+    if (pos >= data.size() ||
+        (kind != ASTPluginLib::FrameOStream::DataFrame &&
+         kind != ASTPluginLib::FrameOStream::ReferenceFrame)) {
+      std::cerr << "[!] Malformed framed stream " << path << "\n";
+      return false;
+    }
+    size |= (uint64_t)data[pos++] << shift;
+    if (size > data.size() - pos) {
+      std::cerr << "[!] Truncated frame in " << path << "\n";
+      return false;
+    }
+    llvm::StringRef payload = data.substr(pos, size);
+    pos += size;
+    frames++;
+    if (kind == ASTPluginLib::FrameOStream::DataFrame &&
+        size >= minDedupPayload) {
+      uint64_t digest = llvm::xxHash64(payload);
+      auto res = seen.try_emplace(digest, Canonical());
+      if (!res.second) {
+        // rewrite the duplicate into the stub the exporter itself uses
+        // for an unchanged or cached decl block
+        std::string stub = std::to_string(digest);
+        outOffset += ASTPluginLib::FrameOStream::writeFrame(
+            pack,
+            ASTPluginLib::FrameOStream::ReferenceFrame,
+            stub.data(),
+            stub.size());
+        referenced.insert(digest);
+        deduped++;
+        bytesSaved += size - stub.size();
+        continue;
+      }
+      uint64_t written = ASTPluginLib::FrameOStream::writeFrame(
+          pack, kind, payload.data(), size);
+      res.first->second.unit = &path;
+      res.first->second.payloadOffset = outOffset + (written - size);
+      res.first->second.length = size;
+      outOffset += written;
+      continue;
+    }
+    // reference frames and tiny data frames pass through untouched
+    outOffset += ASTPluginLib::FrameOStream::writeFrame(
+        pack, kind, payload.data(), size);
+  }
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    std::cerr << "usage: " << argv[0] << " <outdir> <framed-output>...\n";
+    return 1;
+  }
+  const std::string outDir = argv[1];
+  std::vector<std::string> inputs(argv + 2, argv + argc);
+
+  llvm::DenseMap<uint64_t, Canonical> seen;
+  llvm::DenseSet<uint64_t> referenced;
+  uint64_t frames = 0, deduped = 0, bytesSaved = 0;
+  unsigned merged = 0;
+  for (const std::string &input : inputs) {
+    if (mergeOne(input, outDir, seen, referenced, frames, deduped,
+                 bytesSaved)) {
+      merged++;
+    }
+  }
+  // canonical offsets are relative to units' rewritten streams; now
+  // that every unit is published, pack.index says where those streams
+  // landed in the segments
+  ASTPluginLib::PackReader reader;
+  if (!reader.open(outDir)) {
+    std::cerr << "[!] Failed to read back " << outDir << "/pack.index\n";
+    return 1;
+  }
+  std::error_code EC;
+  llvm::raw_fd_ostream dedup(outDir + "/pack.dedup", EC);
+  if (EC) {
+    std::cerr << "[!] Failed to write " << outDir << "/pack.dedup: "
+              << EC.message() << "\n";
+    return 1;
+  }
+  for (uint64_t digest : referenced) {
+    const Canonical &canonical = seen.find(digest)->second;
+    ASTPluginLib::PackEntry unit;
+    if (!reader.lookup(*canonical.unit, unit)) {
+      continue;
+    }
+    dedup << digest << '\t' << unit.segment << '\t'
+          << unit.offset + canonical.payloadOffset << '\t'
+          << canonical.length << '\n';
+  }
+
+  llvm::outs() << "[+] merged " << merged << "/" << inputs.size()
+               << " units: " << frames << " frames, " << deduped
+               << " deduped, " << bytesSaved << " bytes saved\n";
+  return merged == inputs.size() ? 0 : 1;
+}
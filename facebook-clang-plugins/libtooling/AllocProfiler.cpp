@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * Global operator new/delete replacements for the allocation-profiling
+ * build (make ALLOC_PROFILE=1); see AllocProfiler.h. Interposition is
+ * process-wide once the plugin is loaded, which is the point: the
+ * counting path is two thread-local loads and two increments, so the
+ * numbers come without the timing distortion of an external heap
+ * profiler. Allocations outside a profiled visitor frame (the parse,
+ * clang's own bookkeeping) see a null slot and only pay the check.
+ */
+
+#ifdef ALLOC_PROFILE
+
+#include "AllocProfiler.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+namespace ASTPluginLib {
+thread_local AllocCounters *allocProfileSlot = nullptr;
+} // namespace ASTPluginLib
+
+namespace {
+
+void *countedAlloc(size_t size) noexcept {
+  void *p = malloc(size);
+  ASTPluginLib::AllocCounters *slot = ASTPluginLib::allocProfileSlot;
+  if (p != nullptr && slot != nullptr) {
+    slot->allocs++;
+    slot->bytes += size;
+  }
+  return p;
+}
+
+void countedFree(void *p) noexcept {
+  ASTPluginLib::AllocCounters *slot = ASTPluginLib::allocProfileSlot;
+  if (p != nullptr && slot != nullptr) {
+    slot->frees++;
+  }
+  free(p);
+}
+
+// the plugin is built -fno-exceptions, so the throwing forms abort
+// instead of raising bad_alloc, like llvm::report_bad_alloc_error
+void *countedAllocOrDie(size_t size) noexcept {
+  void *p = countedAlloc(size);
+  if (p == nullptr) {
+    fprintf(stderr, "[!] Allocation of %zu bytes failed\n", size);
+    abort();
+  }
+  return p;
+}
+
+} // namespace
+
+void *operator new(size_t size) { return countedAllocOrDie(size); }
+void *operator new[](size_t size) { return countedAllocOrDie(size); }
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+  return countedAlloc(size);
+}
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+  return countedAlloc(size);
+}
+
+void operator delete(void *p) noexcept { countedFree(p); }
+void operator delete[](void *p) noexcept { countedFree(p); }
+void operator delete(void *p, size_t) noexcept { countedFree(p); }
+void operator delete[](void *p, size_t) noexcept { countedFree(p); }
+void operator delete(void *p, const std::nothrow_t &) noexcept {
+  countedFree(p);
+}
+void operator delete[](void *p, const std::nothrow_t &) noexcept {
+  countedFree(p);
+}
+
+#endif // ALLOC_PROFILE
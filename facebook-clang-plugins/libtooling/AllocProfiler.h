@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+namespace ASTPluginLib {
+
+/**
+ * Heap-churn attribution for the visitor profile. Under the
+ * allocation-profiling build (make ALLOC_PROFILE=1), AllocProfiler.cpp
+ * replaces the global operator new/delete and charges every allocation
+ * to the thread's current counter slot; VisitorProfiler points the slot
+ * at the entry of the Visit* frame being timed, so the per-TU profile
+ * report gains allocations and bytes per visitor kind. Off that build
+ * the hooks below compile to nothing and no operators are replaced.
+ */
+struct AllocCounters {
+  uint64_t allocs = 0;
+  uint64_t bytes = 0;
+  uint64_t frees = 0;
+};
+
+#ifdef ALLOC_PROFILE
+/* where operator new charges its size; null (the steady state outside
+ * profiled visitor frames, e.g. during the parse) leaves the
+ * allocation unattributed */
+extern thread_local AllocCounters *allocProfileSlot;
+
+/* install a slot, returning the previous one so nested frames restore
+ * their parent's attribution on the way out */
+inline AllocCounters *setAllocProfileSlot(AllocCounters *slot) {
+  AllocCounters *previous = allocProfileSlot;
+  allocProfileSlot = slot;
+  return previous;
+}
+#else
+inline AllocCounters *setAllocProfileSlot(AllocCounters *) { return nullptr; }
+#endif
+
+} // namespace ASTPluginLib
@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "ArenaOStream.h"
+
+#include <cstring>
+
+#ifdef USE_HUGE_PAGES
+#include <sys/mman.h>
+#endif
+
+namespace ASTPluginLib {
+
+namespace {
+
+#ifdef USE_HUGE_PAGES
+
+const size_t hugePageSize = 2 << 20;
+
+/* 2MB-aligned anonymous mapping advised to huge pages; null when the
+   mapping itself fails. mmap gives no alignment guarantee, so the
+   region is over-mapped by one huge page and the misaligned edges are
+   trimmed; khugepaged only backs 2MB-aligned extents, so the alignment
+   is what makes the advice effective. A failed madvise (THP compiled
+   out or disabled) just leaves the region on normal pages. */
+char *mapChunk(size_t capacity) {
+  size_t padded = capacity + hugePageSize;
+  void *raw = ::mmap(nullptr,
+                     padded,
+                     PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS,
+                     -1,
+                     0);
+  if (raw == MAP_FAILED) {
+    return nullptr;
+  }
+  uintptr_t base = (uintptr_t)raw;
+  uintptr_t aligned = (base + hugePageSize - 1) & ~(uintptr_t)(hugePageSize - 1);
+  if (aligned > base) {
+    ::munmap(raw, aligned - base);
+  }
+  size_t tail = base + padded - (aligned + capacity);
+  if (tail > 0) {
+    ::munmap((void *)(aligned + capacity), tail);
+  }
+#ifdef MADV_HUGEPAGE
+  ::madvise((void *)aligned, capacity, MADV_HUGEPAGE);
+#endif
+  return (char *)aligned;
+}
+
+#endif
+
+} // namespace
+
+void ArenaOStream::addChunk(size_t capacity) {
+#ifdef USE_HUGE_PAGES
+  // round up so every chunk is a whole number of huge pages
+  capacity = (capacity + hugePageSize - 1) & ~(hugePageSize - 1);
+  if (char *data = mapChunk(capacity)) {
+    chunks_.push_back(Chunk{data, 0, capacity, /*mapped=*/true});
+    return;
+  }
+#endif
+  chunks_.push_back(Chunk{new char[capacity], 0, capacity, /*mapped=*/false});
+}
+
+ArenaOStream::ArenaOStream(llvm::raw_ostream &os, uint64_t expectedBytes)
+    : os_(os) {
+  addChunk(expectedBytes > chunkSize ? expectedBytes : chunkSize);
+}
+
+ArenaOStream::~ArenaOStream() {
+  // push whatever raw_ostream still buffers through write_impl
+  flush();
+  for (const Chunk &chunk : chunks_) {
+    os_.write(chunk.data, chunk.size);
+#ifdef USE_HUGE_PAGES
+    if (chunk.mapped) {
+      ::munmap(chunk.data, chunk.capacity);
+      continue;
+    }
+#endif
+    delete[] chunk.data;
+  }
+}
+
+void ArenaOStream::write_impl(const char *ptr, size_t size) {
+  pos_ += size;
+  while (size > 0) {
+    Chunk &chunk = chunks_.back();
+    // chunks fill to their capacity (the first one may exceed chunkSize
+    // when a size hint was given), so growth never reallocates
+    size_t room = chunk.capacity - chunk.size;
+    if (room == 0) {
+      addChunk(chunkSize);
+      continue;
+    }
+    size_t n = size < room ? size : room;
+    memcpy(chunk.data + chunk.size, ptr, n);
+    chunk.size += n;
+    ptr += n;
+    size -= n;
+  }
+}
+
+} // namespace ASTPluginLib
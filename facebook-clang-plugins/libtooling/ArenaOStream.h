@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <vector>
+
+#include <llvm/Support/raw_ostream.h>
+
+namespace ASTPluginLib {
+
+/**
+ * A raw_ostream adapter that accumulates the whole output in a chunked
+ * arena (chunks are never copied on growth) and writes it to the
+ * wrapped stream in one pass on destruction. This turns the tens of
+ * thousands of small interleaved writes produced while dumping a
+ * translation unit into a handful of large sequential ones.
+ *
+ * Built with HUGE_PAGES=1, chunks are carved from 2MB-aligned
+ * anonymous mappings advised MADV_HUGEPAGE (see mapChunk in the
+ * .cpp): multi-GB dumps on 4KB pages keep the TLB thrashing under the
+ * emitters' writes, and one huge page covers 512 times the buffer per
+ * TLB entry. Chunks fall back to plain heap memory where the mapping
+ * fails, and to plain pages where the kernel ignores the advice.
+ */
+class ArenaOStream : public llvm::raw_ostream {
+  llvm::raw_ostream &os_;
+
+  static const size_t chunkSize = 1 << 21;
+
+  /* capacity bytes of storage; filled to size_, never reallocated */
+  struct Chunk {
+    char *data;
+    size_t size;
+    size_t capacity;
+    /* huge-page mapping rather than heap memory (decides the release) */
+    bool mapped;
+  };
+  std::vector<Chunk> chunks_;
+  uint64_t pos_ = 0;
+
+  void addChunk(size_t capacity);
+
+  void write_impl(const char *ptr, size_t size) override;
+  uint64_t current_pos() const override { return pos_; }
+
+ public:
+  /* expectedBytes (0 = unknown) sizes the first chunk, so a predicted
+     dump lands in one contiguous block and one final write */
+  explicit ArenaOStream(llvm::raw_ostream &os, uint64_t expectedBytes = 0);
+  ~ArenaOStream() override;
+};
+
+} // namespace ASTPluginLib
@@ -0,0 +1,228 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "ArtifactStoreClient.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace ASTPluginLib {
+
+namespace {
+
+bool sendAll(int fd, const char *data, size_t size) {
+  while (size > 0) {
+    ssize_t sent = send(fd, data, size, 0);
+    if (sent < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data += sent;
+    size -= (size_t)sent;
+  }
+  return true;
+}
+
+bool recvAll(int fd, char *data, size_t size) {
+  while (size > 0) {
+    ssize_t received = recv(fd, data, size, 0);
+    if (received <= 0) {
+      if (received < 0 && errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data += received;
+    size -= (size_t)received;
+  }
+  return true;
+}
+
+/* read up to (and including) the newline ending the reply header */
+bool recvLine(int fd, std::string &line) {
+  line.clear();
+  char c;
+  while (recvAll(fd, &c, 1)) {
+    if (c == '\n') {
+      return true;
+    }
+    line.push_back(c);
+    if (line.size() > 256) {
+      return false;
+    }
+  }
+  return false;
+}
+
+} // namespace
+
+ArtifactStoreClient::ArtifactStoreClient(const std::string &uri) {
+  if (uri.compare(0, 4, "tcp:") != 0) {
+    return;
+  }
+  const size_t colon = uri.rfind(':');
+  if (colon <= 4 || colon + 1 >= uri.size()) {
+    return;
+  }
+  host_ = uri.substr(4, colon - 4);
+  port_ = uri.substr(colon + 1);
+}
+
+int ArtifactStoreClient::connectOnce() const {
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  struct addrinfo *result = nullptr;
+  if (getaddrinfo(host_.c_str(), port_.c_str(), &hints, &result) != 0) {
+    return -1;
+  }
+  int fd = -1;
+  for (struct addrinfo *entry = result; entry; entry = entry->ai_next) {
+    fd = socket(entry->ai_family, entry->ai_socktype, entry->ai_protocol);
+    if (fd < 0) {
+      continue;
+    }
+    if (connect(fd, entry->ai_addr, entry->ai_addrlen) == 0) {
+      break;
+    }
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(result);
+  return fd;
+}
+
+bool ArtifactStoreClient::get(const std::string &key,
+                              const std::string &outputFile) {
+  if (!isConfigured()) {
+    return false;
+  }
+  int fd = connectOnce();
+  if (fd < 0) {
+    return false;
+  }
+  const std::string request = "GET " + key + "\n";
+  std::string reply;
+  if (!sendAll(fd, request.data(), request.size()) || !recvLine(fd, reply) ||
+      reply.compare(0, 3, "OK ") != 0) {
+    close(fd);
+    return false;
+  }
+  uint64_t size = strtoull(reply.c_str() + 3, nullptr, 10);
+  // a failed transfer must not leave a torn output behind
+  const std::string tmp = outputFile + ".download";
+  int out = open(tmp.c_str(), O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC, 0644);
+  if (out < 0) {
+    close(fd);
+    return false;
+  }
+  bool ok = true;
+  char buffer[1 << 16];
+  while (ok && size > 0) {
+    size_t chunk = size < sizeof(buffer) ? (size_t)size : sizeof(buffer);
+    ok = recvAll(fd, buffer, chunk) &&
+         write(out, buffer, chunk) == (ssize_t)chunk;
+    size -= chunk;
+  }
+  close(fd);
+  close(out);
+  if (!ok || rename(tmp.c_str(), outputFile.c_str()) != 0) {
+    unlink(tmp.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool ArtifactStoreClient::sendRange(const std::string &header,
+                                    int fileFd,
+                                    uint64_t offset,
+                                    uint64_t length) const {
+  int fd = connectOnce();
+  if (fd < 0) {
+    return false;
+  }
+  bool ok = sendAll(fd, header.data(), header.size());
+  char buffer[1 << 16];
+  while (ok && length > 0) {
+    size_t chunk = length < sizeof(buffer) ? (size_t)length : sizeof(buffer);
+    ssize_t got = pread(fileFd, buffer, chunk, (off_t)offset);
+    ok = got == (ssize_t)chunk && sendAll(fd, buffer, chunk);
+    offset += chunk;
+    length -= chunk;
+  }
+  std::string reply;
+  ok = ok && recvLine(fd, reply) && reply == "OK";
+  close(fd);
+  return ok;
+}
+
+bool ArtifactStoreClient::put(const std::string &key,
+                              const std::string &outputFile) {
+  if (!isConfigured()) {
+    return false;
+  }
+  int fileFd = open(outputFile.c_str(), O_RDONLY | O_CLOEXEC);
+  struct stat st;
+  if (fileFd < 0 || fstat(fileFd, &st) != 0) {
+    if (fileFd >= 0) {
+      close(fileFd);
+    }
+    return false;
+  }
+  const uint64_t total = (uint64_t)st.st_size;
+  bool ok;
+  if (total < MultipartThreshold) {
+    ok = sendRange(
+        "PUT " + key + " " + std::to_string(total) + "\n", fileFd, 0, total);
+  } else {
+    // one range per connection: parallel streams fill the pipe to the
+    // store where one stream's congestion window cannot
+    const unsigned parts = MaxParts;
+    const uint64_t partSize = (total + parts - 1) / parts;
+    std::vector<char> results(parts, 0);
+    std::vector<std::thread> uploads;
+    for (unsigned i = 0; i < parts; i++) {
+      const uint64_t offset = (uint64_t)i * partSize;
+      const uint64_t length =
+          offset + partSize <= total ? partSize : total - offset;
+      uploads.emplace_back([&, i, offset, length] {
+        results[i] = sendRange("PART " + key + " " + std::to_string(offset) +
+                                   " " + std::to_string(length) + " " +
+                                   std::to_string(total) + "\n",
+                               fileFd,
+                               offset,
+                               length);
+      });
+    }
+    ok = true;
+    for (unsigned i = 0; i < parts; i++) {
+      uploads[i].join();
+      ok = ok && results[i];
+    }
+  }
+  close(fileFd);
+  if (!ok) {
+    std::cerr << "[!] Failed to publish artifact " << key << " to store\n";
+  }
+  return ok;
+}
+
+} // namespace ASTPluginLib
@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace ASTPluginLib {
+
+/**
+ * Client for a remote content-addressed artifact store
+ * (CAPTURE_STORE_URI), the fleet-wide sibling of the local capture
+ * store directory: capture and analysis run on different machines, and
+ * shipping artifacts through the store replaces rsyncing capture
+ * directories while deduplicating identical captures across every
+ * worker. Deliberately free of LLVM and clang dependencies, like
+ * PackReader, so consumer-side tooling can link it on its own.
+ *
+ * The URI is "tcp:host:port". The wire protocol serves one request per
+ * connection, a header line followed by raw bytes:
+ *   GET <key>\n                             -> OK <size>\n + bytes | KO\n
+ *   PUT <key> <size>\n + bytes              -> OK\n | KO\n
+ *   PART <key> <offset> <length> <total>\n
+ *     + bytes                               -> OK\n | KO\n
+ * Keys are hex digests (see captureStoreKey). Artifacts above
+ * MultipartThreshold are uploaded as PART requests on parallel
+ * connections, one range per thread, saturating fat pipes that a
+ * single TCP stream cannot; the store publishes the key once all
+ * <total> bytes have arrived, so a torn upload is never visible.
+ */
+class ArtifactStoreClient {
+ public:
+  explicit ArtifactStoreClient(const std::string &uri);
+
+  /* whether the URI parsed; requests on an unconfigured client fail */
+  bool isConfigured() const { return !host_.empty(); }
+
+  /* fetch the artifact stored under key into outputFile, through a
+     temporary file plus rename so a failed transfer leaves no partial
+     output; false on a miss or any error */
+  bool get(const std::string &key, const std::string &outputFile);
+
+  /* publish the bytes of outputFile under key; false on any error (the
+     capture itself is still good, only fleet reuse is lost) */
+  bool put(const std::string &key, const std::string &outputFile);
+
+  /* uploads at least this large go multipart */
+  static const uint64_t MultipartThreshold = 8 << 20;
+  /* upper bound on parallel upload connections */
+  static const unsigned MaxParts = 4;
+
+ private:
+  /* open one connection to the store; -1 on failure */
+  int connectOnce() const;
+  /* send one PUT or PART header plus a range of the given descriptor */
+  bool sendRange(const std::string &header,
+                 int fileFd,
+                 uint64_t offset,
+                 uint64_t length) const;
+
+  std::string host_;
+  std::string port_;
+};
+
+} // namespace ASTPluginLib
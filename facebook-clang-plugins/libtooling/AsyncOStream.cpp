@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "AsyncOStream.h"
+
+namespace ASTPluginLib {
+
+AsyncOStream::AsyncOStream(llvm::raw_ostream &os) : os_(os) {
+  front_.reserve(chunkSize);
+  back_.reserve(chunkSize);
+  writer_ = std::thread([this] { writerLoop(); });
+}
+
+AsyncOStream::~AsyncOStream() {
+  // push whatever raw_ostream still buffers through write_impl
+  flush();
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!front_.empty()) {
+      consumed_.wait(lock, [this] { return !pending_; });
+      std::swap(front_, back_);
+      pending_ = true;
+    }
+    done_ = true;
+  }
+  produced_.notify_one();
+  writer_.join();
+}
+
+void AsyncOStream::writerLoop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    produced_.wait(lock, [this] { return pending_ || done_; });
+    if (pending_) {
+      std::vector<char> chunk = std::move(back_);
+      back_ = std::vector<char>();
+      back_.reserve(chunkSize);
+      pending_ = false;
+      consumed_.notify_one();
+      lock.unlock();
+      os_.write(chunk.data(), chunk.size());
+      lock.lock();
+      // re-check: more data may already be pending
+      continue;
+    }
+    return;
+  }
+}
+
+void AsyncOStream::handOff() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  consumed_.wait(lock, [this] { return !pending_; });
+  std::swap(front_, back_);
+  pending_ = true;
+  lock.unlock();
+  produced_.notify_one();
+  front_.clear();
+}
+
+void AsyncOStream::write_impl(const char *ptr, size_t size) {
+  pos_ += size;
+  front_.insert(front_.end(), ptr, ptr + size);
+  if (front_.size() >= chunkSize) {
+    handOff();
+  }
+}
+
+} // namespace ASTPluginLib
@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <llvm/Support/raw_ostream.h>
+
+namespace ASTPluginLib {
+
+/**
+ * A raw_ostream adapter that performs the actual writes to the wrapped
+ * stream on a background thread, so that AST traversal and serialization
+ * do not stall on slow output (e.g. network filesystems).
+ *
+ * Double buffering: the producer fills one buffer while the writer thread
+ * flushes the other; the producer only blocks when it outruns the writer
+ * by a full buffer.
+ */
+class AsyncOStream : public llvm::raw_ostream {
+  llvm::raw_ostream &os_;
+
+  static const size_t chunkSize = 1 << 20;
+
+  // filled by write_impl on the producer side
+  std::vector<char> front_;
+  // being flushed by the writer thread
+  std::vector<char> back_;
+
+  std::mutex mutex_;
+  std::condition_variable produced_;
+  std::condition_variable consumed_;
+  bool pending_ = false;
+  bool done_ = false;
+  uint64_t pos_ = 0;
+
+  std::thread writer_;
+
+  void writerLoop();
+  void handOff();
+
+  void write_impl(const char *ptr, size_t size) override;
+  uint64_t current_pos() const override { return pos_; }
+
+ public:
+  explicit AsyncOStream(llvm::raw_ostream &os);
+  ~AsyncOStream() override;
+};
+
+} // namespace ASTPluginLib
@@ -12,25 +12,33 @@
 namespace ASTLib {
 
 AttrParameterVectorStream &AttrParameterVectorStream::operator<<(
-    const std::string &str) {
+    llvm::StringRef str) {
   // hack to get rid of spurious leading " "s
   if (str != " ") {
-    Content.push_back(str);
+    Content.emplace_back(str);
   }
   return *this;
 }
 
 AttrParameterVectorStream &AttrParameterVectorStream::operator<<(
     const unsigned int x) {
-  return operator<<(std::to_string(x));
+  // format the number in place in the new token
+  Content.emplace_back();
+  llvm::raw_svector_ostream OS(Content.back());
+  OS << x;
+  return *this;
 }
 
 AttrParameterVectorStream &AttrParameterVectorStream::operator<<(
     const llvm::VersionTuple &verTup) {
-  return operator<<(verTup.getAsString());
+  Content.emplace_back();
+  llvm::raw_svector_ostream OS(Content.back());
+  OS << verTup;
+  return *this;
 }
 
-const std::vector<std::string> &AttrParameterVectorStream::getContent() {
+const llvm::SmallVectorImpl<llvm::SmallString<16>>
+    &AttrParameterVectorStream::getContent() {
   return Content;
 }
 
@@ -7,25 +7,43 @@
 
 #pragma once
 
+#include <string_view>
+
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringRef.h>
 #include <llvm/Support/VersionTuple.h>
-#include <string>
-#include <vector>
 
 namespace ASTLib {
 
+/**
+ * Collects the parameters of an attribute as they are streamed in.
+ * Attribute-dense code (nullability and availability annotations in SDK
+ * headers) hits this constantly, so the tokens live in a
+ * SmallVector<SmallString> and numbers are formatted in place: nothing
+ * touches the heap for the typical short parameter list.
+ */
 class AttrParameterVectorStream {
 
  private:
-  std::vector<std::string> Content;
+  llvm::SmallVector<llvm::SmallString<16>, 8> Content;
 
  public:
   AttrParameterVectorStream() {}
 
-  AttrParameterVectorStream &operator<<(const std::string &str);
+  AttrParameterVectorStream &operator<<(llvm::StringRef str);
   AttrParameterVectorStream &operator<<(const unsigned int x);
   AttrParameterVectorStream &operator<<(const llvm::VersionTuple &verTup);
 
-  const std::vector<std::string> &getContent();
+  const llvm::SmallVectorImpl<llvm::SmallString<16>> &getContent();
+
+  /** emit the collected tokens as strings into the writer */
+  template <class ATDWriter>
+  void emitTo(ATDWriter &OF) {
+    for (const llvm::SmallString<16> &token : Content) {
+      OF.emitString(std::string_view(token.data(), token.size()));
+    }
+  }
 };
 
 } // end of namespace ASTLib
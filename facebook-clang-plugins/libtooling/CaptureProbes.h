@@ -0,0 +1,35 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+/**
+ * USDT static tracepoints at the capture lifecycle boundaries, for
+ * fleet machines where intrusive profilers cannot be attached: perf
+ * and bpftrace hook the probes of a running capture with no rebuild,
+ * and a probe nobody is watching is a single nop. Compiled in under
+ * USDT=1 (requires sys/sdt.h, from the systemtap-sdt headers); without
+ * it the macros expand to nothing.
+ *
+ * Provider "ast_exporter", probes:
+ *   execute_action          frontend action entered (per TU)
+ *   translation_unit_begin  HandleTranslationUnit entered (parse done)
+ *   translation_unit_end    dump plus trailing tables written
+ *   emit_eof                writer finished, output complete
+ *   decl_progress(count)    every 10000 dumped decls; the interval
+ *                           between beats is dump throughput
+ * e.g.: bpftrace -e 'usdt:*:ast_exporter:translation_unit_* { ... }'
+ */
+
+#if defined(USE_SDT) && __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define CAPTURE_PROBE(name) DTRACE_PROBE(ast_exporter, name)
+#define CAPTURE_PROBE1(name, arg1) DTRACE_PROBE1(ast_exporter, name, arg1)
+#else
+#define CAPTURE_PROBE(name)
+#define CAPTURE_PROBE1(name, arg1)
+#endif
@@ -0,0 +1,36 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "ChecksumOStream.h"
+
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/Support/CRC.h>
+
+namespace ASTPluginLib {
+
+ChecksumOStream::ChecksumOStream(llvm::raw_ostream &os) : os_(os) {}
+
+void ChecksumOStream::write_impl(const char *ptr, size_t size) {
+  crc_ = llvm::crc32(
+      crc_, llvm::ArrayRef<uint8_t>((const uint8_t *)ptr, size));
+  count_ += size;
+  os_.write(ptr, size);
+}
+
+ChecksumOStream::~ChecksumOStream() {
+  flush();
+  char trailer[TrailerSize] = {'A', 'S', 'T', 'C', 'K', 'S', 'M', '1'};
+  for (int i = 0; i < 8; i++) {
+    trailer[8 + i] = (char)(count_ >> (8 * i));
+  }
+  for (int i = 0; i < 4; i++) {
+    trailer[16 + i] = (char)(crc_ >> (8 * i));
+  }
+  os_.write(trailer, TrailerSize);
+}
+
+} // namespace ASTPluginLib
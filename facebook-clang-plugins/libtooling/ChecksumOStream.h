@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <llvm/Support/raw_ostream.h>
+
+namespace ASTPluginLib {
+
+/**
+ * A raw_ostream adapter that counts and checksums everything written
+ * through it and appends a fixed-size validation trailer on
+ * destruction (VALIDATION_FOOTER in ASTExporter.h):
+ *
+ *     "ASTCKSM1"  8 bytes magic
+ *     byte count  u64 little-endian, trailer excluded
+ *     crc32       u32 little-endian (zlib polynomial)
+ *     zero        u32 padding
+ *
+ * A consumer detects truncation - the common wound left by OOM-killed
+ * captures - by reading the last 24 bytes and comparing the count with
+ * the file size, instead of re-parsing gigabytes in a separate
+ * validation pass; the crc is there for a full check when corruption
+ * rather than truncation is suspected. Outermost in the adapter chain,
+ * so the trailer describes the bytes as they land in the file
+ * (compressed when COMPRESS_OUTPUT is on).
+ */
+class ChecksumOStream : public llvm::raw_ostream {
+  llvm::raw_ostream &os_;
+  uint64_t count_ = 0;
+  uint32_t crc_ = 0;
+
+  void write_impl(const char *ptr, size_t size) override;
+  uint64_t current_pos() const override { return count_; }
+
+ public:
+  static const size_t TrailerSize = 24;
+
+  explicit ChecksumOStream(llvm::raw_ostream &os);
+  /* appends the trailer */
+  ~ChecksumOStream() override;
+};
+
+} // namespace ASTPluginLib
@@ -5,10 +5,22 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <algorithm>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include <clang/AST/AST.h>
 #include <llvm/ADT/SmallVector.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
 #include <llvm/Support/Path.h>
-#include <vector>
+#include <llvm/Support/raw_ostream.h>
 
 #include "FileUtils.h"
 
@@ -20,32 +32,39 @@ namespace FileUtils {
  * currentWorkingDirectory unless currentWorkingDirectory == "".
  */
 std::string makeAbsolutePath(const std::string &currentWorkingDirectory,
-                             std::string path) {
-  llvm::SmallVector<char, 16> result;
-  std::vector<std::string> elements;
+                             const std::string &path) {
+  // single buffer holding the joined path; the component spans below
+  // index into it, so nothing is copied per component
+  llvm::SmallString<256> buffer;
+  llvm::SmallString<256> result;
+  llvm::SmallVector<llvm::StringRef, 16> components;
   int skip = 0;
 
   if (llvm::sys::path::is_relative(path)) {
     // Prepend currentWorkingDirectory to path (unless currentWorkingDirectory
     // is empty).
-    llvm::SmallVector<char, 16> vec(currentWorkingDirectory.begin(),
-                                    currentWorkingDirectory.end());
-    llvm::sys::path::append(vec, path);
-    path = std::string(vec.begin(), vec.end());
+    buffer = currentWorkingDirectory;
+    llvm::sys::path::append(buffer, path);
   } else {
-    // Else copy the separator to maintain an absolute path.
-    result.append(1, path.front());
+    buffer = path;
+    // Copy the separator to maintain an absolute path.
+    result.push_back(path.front());
   }
 
-  elements.push_back(llvm::sys::path::filename(path).str());
-
-  while (llvm::sys::path::has_parent_path(path)) {
-    path = llvm::sys::path::parent_path(path).str();
-    const std::string &element(llvm::sys::path::filename(path).str());
-    if (element == ".") {
+  // walk the components back to front, as the parent_path loop did
+  auto I = llvm::sys::path::rbegin(llvm::StringRef(buffer)),
+       E = llvm::sys::path::rend(llvm::StringRef(buffer));
+  if (I != E) {
+    // the last component is kept as written, even "." or ".."
+    components.push_back(*I);
+    ++I;
+  }
+  for (; I != E; ++I) {
+    llvm::StringRef component = *I;
+    if (component == ".") {
       continue;
     }
-    if (element == "..") {
+    if (component == "..") {
       skip++;
       continue;
     }
@@ -53,43 +72,275 @@ std::string makeAbsolutePath(const std::string &currentWorkingDirectory,
       skip--;
       continue;
     }
-    elements.push_back(element);
+    components.push_back(component);
   }
   while (skip > 0) {
-    elements.push_back("..");
+    components.push_back("..");
     skip--;
   }
 
-  for (auto I = elements.rbegin(), E = elements.rend(); I != E; I++) {
-    llvm::sys::path::append(result, *I);
+  for (auto CI = components.rbegin(), CE = components.rend(); CI != CE; CI++) {
+    llvm::sys::path::append(result, *CI);
   }
   return std::string(result.begin(), result.end());
 }
 
+PathRewriter::PathRewriter(const std::string &repoRoot,
+                           const std::string &sysRoot,
+                           bool keepExternalPaths,
+                           bool allowSiblingsToRoot)
+    : keepExternalPaths(keepExternalPaths) {
+  if (repoRoot != "") {
+    repoRootPrefix = repoRoot + "/";
+    if (allowSiblingsToRoot) {
+      siblingPrefix = llvm::sys::path::parent_path(repoRoot).str() + "/";
+    }
+  }
+  if (sysRoot != "") {
+    sysRootPrefix = sysRoot + "/";
+  }
+}
+
+std::string PathRewriter::rewrite(const std::string &path) const {
+  llvm::StringRef ref(path);
+  if (!repoRootPrefix.empty() && ref.startswith(repoRootPrefix)) {
+    return path.substr(repoRootPrefix.size());
+  }
+  if (!siblingPrefix.empty() && ref.startswith(siblingPrefix)) {
+    return "../" + path.substr(siblingPrefix.size());
+  }
+  if (!sysRootPrefix.empty() && ref.startswith(sysRootPrefix)) {
+    // Intentionally keep the heading "/" in this case.
+    return path.substr(sysRootPrefix.size() - 1);
+  }
+  if (keepExternalPaths) {
+    return path;
+  }
+  return "";
+}
+
 std::string makeRelativePath(const std::string &repoRoot,
                              const std::string &sysRoot,
                              bool keepExternalPaths,
                              bool allowSiblingsToRepoRoot,
                              const std::string &path) {
-  if (repoRoot != "") {
-    if (llvm::StringRef(path).startswith(repoRoot + "/")) {
-      return path.substr(repoRoot.size() + 1);
+  return PathRewriter(
+             repoRoot, sysRoot, keepExternalPaths, allowSiblingsToRepoRoot)
+      .rewrite(path);
+}
+
+namespace {
+
+/**
+ * Follow the symlinks of the last component of candidate, joining
+ * relative targets against the link's directory; bounded like realpath.
+ */
+std::string followLinks(std::string candidate) {
+  for (int depth = 0; depth < 32; depth++) {
+    char buf[2048];
+    int len = readlink(candidate.c_str(), buf, sizeof(buf) - 1);
+    if (len == -1) {
+      // not a symlink (or not readable): resolved
+      break;
     }
-    if (allowSiblingsToRepoRoot) {
-      std::string parentOfRoot = llvm::sys::path::parent_path(repoRoot).str();
-      if (llvm::StringRef(path).startswith(parentOfRoot + "/")) {
-        return "../" + path.substr(parentOfRoot.size() + 1);
+    buf[len] = '\0';
+    std::string dir = llvm::sys::path::parent_path(candidate).str();
+    // absolute targets replace the path, relative ones join against the
+    // link's directory; either way dot segments are simplified away
+    candidate = makeAbsolutePath(dir, buf);
+  }
+  return candidate;
+}
+
+/**
+ * Directory prefixes resolved so far, shared by the whole process. Only
+ * the cache lookups hold the lock; the readlink chains run outside it,
+ * and a racing duplicate resolution loses harmlessly.
+ */
+struct SymlinkResolver {
+  std::mutex mutex;
+  std::unordered_map<std::string, std::string> dirCache;
+
+  std::string resolveDir(const std::string &dir) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      auto I = dirCache.find(dir);
+      if (I != dirCache.end()) {
+        return I->second;
       }
     }
+    std::string resolved;
+    llvm::StringRef parent = llvm::sys::path::parent_path(dir);
+    if (parent.empty() || parent == dir) {
+      resolved = followLinks(dir);
+    } else {
+      // resolve the parent prefix first (memoized), then this component
+      resolved = followLinks(makeAbsolutePath(
+          resolveDir(parent.str()), llvm::sys::path::filename(dir).str()));
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    return dirCache.emplace(dir, std::move(resolved)).first->second;
   }
-  if (sysRoot != "" && llvm::StringRef(path).startswith(sysRoot + "/")) {
-    // Intentionally keep the heading "/" in this case.
-    return path.substr(sysRoot.size());
+};
+
+SymlinkResolver &symlinkResolver() {
+  // leaked on purpose: worker threads may outlive static destruction
+  static SymlinkResolver *resolver = new SymlinkResolver();
+  return *resolver;
+}
+
+} // namespace
+
+bool saveSymlinkCache(const std::string &path) {
+  SymlinkResolver &resolver = symlinkResolver();
+  std::lock_guard<std::mutex> lock(resolver.mutex);
+  std::error_code EC;
+  llvm::raw_fd_ostream out(path, EC, llvm::sys::fs::OF_None);
+  if (EC) {
+    return false;
   }
-  if (keepExternalPaths) {
-    return path;
+  for (const auto &entry : resolver.dirCache) {
+    struct stat st;
+    if (lstat(entry.first.c_str(), &st) != 0) {
+      continue;
+    }
+    // the lstat mtime of the cached path itself is the validation
+    // token: rewriting a symlink updates it, so a retargeted link
+    // fails the comparison on load
+    out << (long long)st.st_mtime << '\t' << entry.first << '\t'
+        << entry.second << '\n';
   }
-  return "";
+  return !out.has_error();
+}
+
+size_t loadSymlinkCache(const std::string &path) {
+  auto buffer = llvm::MemoryBuffer::getFile(path);
+  if (!buffer) {
+    return 0;
+  }
+  struct Entry {
+    long long mtime;
+    std::string dir;
+    std::string resolved;
+  };
+  std::vector<Entry> entries;
+  llvm::StringRef rest = (*buffer)->getBuffer();
+  while (!rest.empty()) {
+    llvm::StringRef line;
+    std::tie(line, rest) = rest.split('\n');
+    llvm::StringRef mtime, dir, resolved;
+    std::tie(mtime, line) = line.split('\t');
+    std::tie(dir, resolved) = line.split('\t');
+    long long parsed;
+    if (dir.empty() || mtime.getAsInteger(10, parsed)) {
+      continue;
+    }
+    entries.push_back({parsed, dir.str(), resolved.str()});
+  }
+  // parents before children, so that an entry resolved through a
+  // rejected ancestor (its own mtime is unchanged when an ancestor
+  // link retargets) can be rejected transitively below
+  std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {
+    return a.dir.size() < b.dir.size();
+  });
+  std::unordered_set<std::string> rejected;
+  SymlinkResolver &resolver = symlinkResolver();
+  std::lock_guard<std::mutex> lock(resolver.mutex);
+  size_t kept = 0;
+  for (const Entry &entry : entries) {
+    std::string parent = llvm::sys::path::parent_path(entry.dir).str();
+    struct stat st;
+    if (rejected.count(parent) || lstat(entry.dir.c_str(), &st) != 0 ||
+        (long long)st.st_mtime != entry.mtime) {
+      rejected.insert(entry.dir);
+      continue;
+    }
+    kept += resolver.dirCache.emplace(entry.dir, entry.resolved).second;
+  }
+  return kept;
+}
+
+void dropFromPageCache(const std::string &path) {
+#ifdef POSIX_FADV_DONTNEED
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return;
+  }
+#if defined(__linux__) && defined(SYNC_FILE_RANGE_WRITE)
+  // start writeback without waiting for it, so the advice below can
+  // take effect on more than the already-clean pages
+  sync_file_range(fd, 0, 0, SYNC_FILE_RANGE_WRITE);
+#endif
+  posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  close(fd);
+#else
+  (void)path;
+#endif
+}
+
+void prefetchIntoPageCache(const std::string &path) {
+#ifdef POSIX_FADV_WILLNEED
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return;
+  }
+  // queues the readahead and returns; the pages arrive while the
+  // caller does other work
+  posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+  close(fd);
+#else
+  (void)path;
+#endif
+}
+
+void startFileWriteback(const std::string &path) {
+#if defined(__linux__) && defined(SYNC_FILE_RANGE_WRITE)
+  int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return;
+  }
+  // queues the writeback and returns; the pages reach the disk while
+  // the caller moves on to the next unit
+  sync_file_range(fd, 0, 0, SYNC_FILE_RANGE_WRITE);
+  close(fd);
+#else
+  (void)path;
+#endif
+}
+
+void syncFileData(const std::string &path) {
+  int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+  if (fd < 0) {
+    llvm::errs() << "[!] Failed to open " << path << " to sync it\n";
+    return;
+  }
+  if (fdatasync(fd) != 0) {
+    llvm::errs() << "[!] Failed to sync " << path << "\n";
+  }
+  close(fd);
+}
+
+void patchFileHeader(const std::string &path, const std::string &bytes) {
+  int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+  if (fd < 0) {
+    llvm::errs() << "[!] Failed to open " << path << " to patch its header\n";
+    return;
+  }
+  ssize_t written = pwrite(fd, bytes.data(), bytes.size(), 0);
+  if (written != (ssize_t)bytes.size()) {
+    llvm::errs() << "[!] Failed to patch the header of " << path << "\n";
+  }
+  close(fd);
+}
+
+std::string resolvePathSymlinks(const std::string &path) {
+  llvm::StringRef parent = llvm::sys::path::parent_path(path);
+  if (parent.empty()) {
+    return followLinks(path);
+  }
+  return followLinks(makeAbsolutePath(
+      symlinkResolver().resolveDir(parent.str()),
+      llvm::sys::path::filename(path).str()));
 }
 
 } // namespace FileUtils
@@ -18,12 +18,43 @@ namespace FileUtils {
  * currentWorkingDirectory unless currentWorkingDirectory == "".
  */
 std::string makeAbsolutePath(const std::string &currentWorkingDirectory,
-                             std::string path);
+                             const std::string &path);
+
+/**
+ * The rewrite rules of makeRelativePath, compiled once: the prefixes to
+ * match ("repoRoot/", the parent of repoRoot, "sysRoot/") are
+ * concatenated at construction time instead of on every call, so a
+ * lookup is a few prefix comparisons with no intermediate allocations.
+ */
+class PathRewriter {
+ public:
+  PathRewriter() {}
+
+  PathRewriter(const std::string &repoRoot,
+               const std::string &sysRoot,
+               bool keepExternalPaths,
+               bool allowSiblingsToRoot);
+
+  /**
+   * Try to delete a prefix "repoRoot/" OR "sysRoot" from the given absolute
+   * path. If no rule applies AND keepExternalPaths is true, return the same
+   * path, otherwise return the empty string.
+   */
+  std::string rewrite(const std::string &path) const;
+
+ private:
+  /* "repoRoot/"; empty when there is no repo root */
+  std::string repoRootPrefix;
+  /* parent of the repo root plus "/"; empty unless siblings are allowed */
+  std::string siblingPrefix;
+  /* "sysRoot/"; empty when there is no system root */
+  std::string sysRootPrefix;
+  bool keepExternalPaths = false;
+};
 
 /**
- * Try to delete a prefix "repoRoot/" OR "sysRoot" from the given absolute path.
- * If no rule applies AND keepExternalPaths is true, return the same path,
- * otherwise return the empty string.
+ * One-shot convenience over PathRewriter; callers on a hot path should
+ * build the rewriter once instead.
  */
 std::string makeRelativePath(const std::string &repoRoot,
                              const std::string &sysRoot,
@@ -31,4 +62,72 @@ std::string makeRelativePath(const std::string &repoRoot,
                              bool allowSiblingsToRoot,
                              const std::string &path);
 
+/**
+ * Resolve symlinks in an absolute path, memoizing resolved directory
+ * prefixes in a process-wide cache: in symlink-forest layouts (bazel-style
+ * output trees) the links are the directories near the root, so each
+ * prefix costs its readlink chain once per process and every file below
+ * it reuses the result. Thread-safe.
+ */
+std::string resolvePathSymlinks(const std::string &path);
+
+/**
+ * Advise the kernel to drop the given file's pages from the page cache
+ * (DROP_OUTPUT_CACHE in SimplePluginASTAction.h). Writeback of
+ * still-dirty pages is started asynchronously first, so most of a
+ * freshly written file can actually be dropped; whatever is still dirty
+ * stays cached until the kernel writes it out on its own. A no-op on
+ * platforms without posix_fadvise.
+ */
+void dropFromPageCache(const std::string &path);
+
+/**
+ * Advise the kernel to read the whole file into the page cache ahead of
+ * use (posix_fadvise WILLNEED), without blocking on the I/O. A no-op on
+ * platforms without posix_fadvise and for unreadable paths.
+ */
+void prefetchIntoPageCache(const std::string &path);
+
+/**
+ * Overwrite the first bytes.size() bytes of the file at path in place
+ * with a single pwrite, leaving the rest untouched. Used to fill in a
+ * front block that was reserved with zeros while the file was streamed
+ * (LAYOUT_HEADER in ASTExporter.h). Failures are reported to stderr and
+ * otherwise ignored; the zeroed placeholder stays self-identifying.
+ */
+void patchFileHeader(const std::string &path, const std::string &bytes);
+
+/**
+ * Start asynchronous writeback of the whole file (the "flush"
+ * OUTPUT_DURABILITY policy, see SimplePluginASTAction.h): dirty pages
+ * head for the disk without the caller waiting on them, so they stop
+ * accumulating against whatever flushing the filesystem imposes later.
+ * A no-op on platforms without sync_file_range.
+ */
+void startFileWriteback(const std::string &path);
+
+/**
+ * fdatasync the file at path (the "fdatasync" OUTPUT_DURABILITY
+ * policy): returns once the data is on disk. Failures are reported to
+ * stderr and otherwise ignored.
+ */
+void syncFileData(const std::string &path);
+
+/**
+ * Serialize the process-wide symlink-resolution cache (see
+ * resolvePathSymlinks) to the given file, one "mtime\tdir\tresolved"
+ * line per entry, recording each cached path's lstat mtime as a
+ * validation token. Returns false when the file cannot be written.
+ */
+bool saveSymlinkCache(const std::string &path);
+
+/**
+ * Load entries saved by saveSymlinkCache into the symlink-resolution
+ * cache, keeping only those whose lstat mtime still matches; entries
+ * under a rejected ancestor are rejected transitively, since their
+ * resolutions went through it. Meant for process startup, before the
+ * cache sees traffic. Returns the number of entries kept.
+ */
+size_t loadSymlinkCache(const std::string &path);
+
 } // namespace FileUtils
@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "FrameOStream.h"
+
+#include <assert.h>
+
+#include <llvm/Support/xxhash.h>
+
+namespace ASTPluginLib {
+
+FrameOStream::FrameOStream(llvm::raw_ostream &os) : os_(os) {}
+
+FrameOStream::~FrameOStream() { endFrame(); }
+
+void FrameOStream::write_impl(const char *ptr, size_t size) {
+  pos_ += size;
+  frame_.insert(frame_.end(), ptr, ptr + size);
+}
+
+size_t FrameOStream::writeFrame(llvm::raw_ostream &os,
+                                char kind,
+                                const char *data,
+                                size_t size) {
+  size_t header = 2;
+  os << kind;
+  uint64_t n = size;
+  while (n >= 0x80) {
+    os << (char)(n | 0x80);
+    n >>= 7;
+    header++;
+  }
+  os << (char)n;
+  os.write(data, size);
+  return header + size;
+}
+
+void FrameOStream::endFrame() {
+  // push whatever raw_ostream still buffers through write_impl
+  flush();
+  lastOffset_ = outPos_;
+  lastLength_ = frame_.size();
+  if (computeDigests_) {
+    lastDigest_ =
+        llvm::xxHash64(llvm::StringRef(frame_.data(), frame_.size()));
+  }
+  outPos_ += writeFrame(os_, DataFrame, frame_.data(), frame_.size());
+  if (tee_) {
+    writeFrame(*tee_, DataFrame, frame_.data(), frame_.size());
+  }
+  frame_.clear();
+}
+
+uint64_t FrameOStream::pendingFrameDigest() {
+  flush();
+  return llvm::xxHash64(llvm::StringRef(frame_.data(), frame_.size()));
+}
+
+void FrameOStream::replacePendingFrame(llvm::StringRef payload) {
+  flush();
+  assert(!tee_ && "a teed block must stay complete");
+  lastOffset_ = outPos_;
+  lastLength_ = 0;
+  if (computeDigests_) {
+    lastDigest_ =
+        llvm::xxHash64(llvm::StringRef(frame_.data(), frame_.size()));
+  }
+  frame_.clear();
+  outPos_ += writeFrame(os_, ReferenceFrame, payload.data(), payload.size());
+}
+
+void FrameOStream::emitReferenceFrame(llvm::StringRef payload) {
+  flush();
+  assert(frame_.empty() && "reference frames only make sense between frames");
+  outPos_ += writeFrame(os_, ReferenceFrame, payload.data(), payload.size());
+}
+
+} // namespace ASTPluginLib
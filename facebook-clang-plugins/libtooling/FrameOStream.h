@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <vector>
+
+#include <llvm/Support/raw_ostream.h>
+
+namespace ASTPluginLib {
+
+/**
+ * A raw_ostream adapter that splits the output into frames, each written
+ * as a one-byte kind, the payload length as a base-128 varint (biniou
+ * uvint) and the payload bytes. Bytes accumulate in memory until
+ * endFrame() is called.
+ *
+ * Data frames carry document bytes: concatenating their payloads yields
+ * exactly the unframed document, so a reader may parse frames
+ * incrementally, skip them, or hand them to parallel workers. Reference
+ * frames carry the digest of a decl block stored out of band (see
+ * HEADER_CACHE_DIR in ASTExporter.h) and contribute no document bytes.
+ */
+class FrameOStream : public llvm::raw_ostream {
+  llvm::raw_ostream &os_;
+  /* when set, data frames are also copied here (used to capture a decl
+     block into the header cache while it is emitted) */
+  llvm::raw_ostream *tee_ = nullptr;
+
+  std::vector<char> frame_;
+  uint64_t pos_ = 0;
+
+  void write_impl(const char *ptr, size_t size) override;
+  uint64_t current_pos() const override { return pos_; }
+
+  /* fingerprint the payload of every data frame as it is closed */
+  bool computeDigests_ = false;
+  /* where the framed stream stands and what the last data frame was:
+     offset of its first byte in the framed output, payload length, and
+     (when enabled) the XXH64 of the payload */
+  uint64_t outPos_ = 0;
+  uint64_t lastOffset_ = 0;
+  uint64_t lastLength_ = 0;
+  uint64_t lastDigest_ = 0;
+
+ public:
+  static const char DataFrame = 'D';
+  static const char ReferenceFrame = 'R';
+
+  /* emit one complete frame onto os; returns the number of bytes
+     written, header included. Exposed for tools that rewrite framed
+     streams (see ASTPackMerge.cpp) */
+  static size_t writeFrame(llvm::raw_ostream &os,
+                           char kind,
+                           const char *data,
+                           size_t size);
+
+  explicit FrameOStream(llvm::raw_ostream &os);
+  /* closes the last frame */
+  ~FrameOStream() override;
+
+  /* length-prefix the bytes written since the previous frame boundary
+     and push them to the wrapped stream; empty frames are emitted too,
+     so the frame count is stable for a given input */
+  void endFrame();
+
+  /* emit a reference frame; only valid at a frame boundary */
+  void emitReferenceFrame(llvm::StringRef payload);
+
+  /* XXH64 of the bytes buffered for the frame currently open */
+  uint64_t pendingFrameDigest();
+
+  /* drop the buffered frame bytes and emit a reference frame carrying
+     payload in their place (see DIFF_DECLS in ASTExporter.h). The
+     last-frame accessors then describe the stub: the dropped payload's
+     digest, the reference frame's offset, and length 0 */
+  void replacePendingFrame(llvm::StringRef payload);
+
+  bool hasTee() const { return tee_ != nullptr; }
+
+  void setTee(llvm::raw_ostream *tee) { tee_ = tee; }
+
+  /* hash every data frame payload with XXH64 as it is closed (see
+     DECL_INDEX in ASTExporter.h); off by default since most captures
+     never read the digests */
+  void enableFrameDigests() { computeDigests_ = true; }
+
+  /* describe the last data frame closed by endFrame(): offset of its
+     kind byte in the framed output stream (i.e. before any compression
+     adapter further out), its payload length, and the payload's XXH64
+     (0 unless enableFrameDigests() was called) */
+  uint64_t lastFrameOffset() const { return lastOffset_; }
+  uint64_t lastFrameLength() const { return lastLength_; }
+  uint64_t lastFrameDigest() const { return lastDigest_; }
+
+  /* bytes of framed output pushed to the wrapped stream so far, frame
+     headers included; right after endFrame() this is an exact section
+     boundary (see LAYOUT_HEADER in ASTExporter.h) */
+  uint64_t framedBytes() const { return outPos_; }
+};
+
+} // namespace ASTPluginLib
@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "GzipOStream.h"
+
+#include <cstring>
+
+namespace ASTPluginLib {
+
+static const size_t outChunkSize = 256 * 1024;
+
+GzipOStream::GzipOStream(llvm::raw_ostream &os,
+                         int level,
+                         const std::string &dictionary)
+    : os_(os) {
+  outBuf_.resize(outChunkSize);
+  std::memset(&strm_, 0, sizeof(strm_));
+  // windowBits 15 + 16 selects the gzip wrapper, as produced by gzip(1)
+  // (and consumed by the existing sample-handling scripts); a preset
+  // dictionary forces the zlib wrapper, the only one with a dictionary
+  // field (its header then carries the dictionary's Adler-32 as id)
+  int windowBits = dictionary.empty() ? 15 + 16 : 15;
+  int ret = deflateInit2(
+      &strm_, level, Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY);
+  if (ret != Z_OK) {
+    llvm::errs() << "GzipOStream: deflateInit2 failed (" << ret << ")\n";
+  }
+  if (!dictionary.empty()) {
+    ret = deflateSetDictionary(&strm_,
+                               (const Bytef *)dictionary.data(),
+                               (uInt)dictionary.size());
+    if (ret != Z_OK) {
+      llvm::errs() << "GzipOStream: deflateSetDictionary failed (" << ret
+                   << ")\n";
+    }
+  }
+}
+
+GzipOStream::~GzipOStream() {
+  flush();
+  deflateChunk(nullptr, 0, Z_FINISH);
+  deflateEnd(&strm_);
+}
+
+void GzipOStream::deflateChunk(const char *ptr, size_t size, int flushMode) {
+  strm_.next_in = (Bytef *)const_cast<char *>(ptr);
+  strm_.avail_in = (uInt)size;
+  do {
+    strm_.next_out = (Bytef *)outBuf_.data();
+    strm_.avail_out = (uInt)outBuf_.size();
+    deflate(&strm_, flushMode);
+    size_t produced = outBuf_.size() - strm_.avail_out;
+    if (produced > 0) {
+      os_.write(outBuf_.data(), produced);
+    }
+  } while (strm_.avail_in > 0 || strm_.avail_out == 0);
+}
+
+void GzipOStream::write_impl(const char *ptr, size_t size) {
+  pos_ += size;
+  deflateChunk(ptr, size, Z_NO_FLUSH);
+}
+
+} // namespace ASTPluginLib
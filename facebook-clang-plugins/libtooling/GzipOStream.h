@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <llvm/Support/raw_ostream.h>
+#include <zlib.h>
+
+namespace ASTPluginLib {
+
+/**
+ * A raw_ostream adapter that gzip-compresses everything written to it,
+ * streaming, before forwarding the compressed bytes to the wrapped stream.
+ * AST dumps are highly compressible, so compressing in-process cuts both
+ * the bytes hitting the disk and the bytes the reader has to fetch.
+ *
+ * With a preset dictionary (COMPRESS_DICT, trained by ast_dict_train
+ * from a corpus of existing captures) the stream switches to the zlib
+ * wrapper - the gzip format has no dictionary field - and back-
+ * references can reach into the dictionary from the first byte, which
+ * is where small TU outputs win: they all repeat the same SDK header
+ * structures but are too short to rediscover them alone. The zlib
+ * header records the dictionary id (the Adler-32 of the dictionary,
+ * RFC 1950 DICTID); the reader matches it against its dictionaries
+ * before calling inflateSetDictionary.
+ */
+class GzipOStream : public llvm::raw_ostream {
+  llvm::raw_ostream &os_;
+  z_stream strm_;
+  std::vector<char> outBuf_;
+  uint64_t pos_ = 0;
+
+  void deflateChunk(const char *ptr, size_t size, int flushMode);
+
+  void write_impl(const char *ptr, size_t size) override;
+  uint64_t current_pos() const override { return pos_; }
+
+ public:
+  explicit GzipOStream(llvm::raw_ostream &os,
+                       int level = Z_DEFAULT_COMPRESSION,
+                       const std::string &dictionary = "");
+  ~GzipOStream() override;
+};
+
+} // namespace ASTPluginLib
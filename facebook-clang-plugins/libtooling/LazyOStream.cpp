@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "LazyOStream.h"
+
+#include <llvm/Support/FileSystem.h>
+
+namespace ASTPluginLib {
+
+LazyOStream::~LazyOStream() {
+  // push whatever raw_ostream still buffers through write_impl; this
+  // is what opens the file when the dump fits in the stream buffer
+  flush();
+  if (!out_ && !failed_) {
+    // nothing was emitted: leave no file behind, and make sure no stale
+    // output from an earlier run contradicts that (absence means empty)
+    llvm::sys::fs::remove(path_, /*IgnoreNonExisting=*/true);
+  }
+}
+
+void LazyOStream::write_impl(const char *ptr, size_t size) {
+  pos_ += size;
+  if (failed_) {
+    return;
+  }
+  if (!out_) {
+    std::error_code EC;
+    out_.reset(new llvm::raw_fd_ostream(path_, EC));
+    if (EC) {
+      llvm::errs() << "[!] Failed to create output file " << path_ << ": "
+                   << EC.message() << "\n";
+      out_.reset();
+      // swallow the rest of the dump; the capture is already lost
+      failed_ = true;
+      return;
+    }
+  }
+  out_->write(ptr, size);
+}
+
+} // namespace ASTPluginLib
@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include <llvm/Support/raw_ostream.h>
+
+namespace ASTPluginLib {
+
+/**
+ * A raw_ostream that defers creating its output file until the first
+ * byte reaches it (LAZY_OUTPUT in SimplePluginASTAction.h). Under
+ * MAIN_FILE_DECLS_ONLY and similar filters, many dependency TUs
+ * legitimately serialize nothing; the eager path still pays a create, a
+ * write of zero bytes and a rename for each of them, which a full build
+ * multiplies by every TU it touches.
+ *
+ * Empty-output protocol: a capture that emits no bytes creates no file
+ * and removes any stale output a previous run left at the path, so that
+ * absence can be trusted - after a successful lazy capture, a missing
+ * output file means "empty", not "never ran". Consumers must apply that
+ * reading; the eager modes keep producing empty files for tooling that
+ * cannot. Like KEEP_PARTIAL, lazily created files are written in place
+ * with no temporary-plus-rename step, so a capture killed mid-unit
+ * leaves a partial file - VALIDATION_FOOTER detects those.
+ */
+class LazyOStream : public llvm::raw_ostream {
+  std::string path_;
+  std::unique_ptr<llvm::raw_fd_ostream> out_;
+  uint64_t pos_ = 0;
+  bool failed_ = false;
+
+  void write_impl(const char *ptr, size_t size) override;
+  uint64_t current_pos() const override { return pos_; }
+
+ public:
+  explicit LazyOStream(const std::string &path) : path_(path) {}
+  /* removes a stale file when nothing was written */
+  ~LazyOStream() override;
+};
+
+} // namespace ASTPluginLib
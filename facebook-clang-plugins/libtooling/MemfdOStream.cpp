@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "MemfdOStream.h"
+
+#include <cstring>
+#include <iostream>
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace ASTPluginLib {
+
+namespace {
+
+int createSegment(const std::string &key) {
+  // the name is debugging aid only (/proc/pid/fd), not an address
+  int fd = ::memfd_create(key.c_str(), MFD_CLOEXEC);
+  if (fd < 0) {
+    std::cerr << "[!] could not create memfd segment for " << key << "\n";
+  }
+  return fd;
+}
+
+} // namespace
+
+MemfdOStream::MemfdOStream(const std::string &socketPath,
+                           const std::string &key,
+                           size_t reservation)
+    : MmapOStream(createSegment(key), reservation),
+      socketPath_(socketPath),
+      key_(key) {}
+
+MemfdOStream::~MemfdOStream() {
+  int segment = takeDescriptor();
+  if (segment < 0) {
+    return;
+  }
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (socketPath_.size() >= sizeof(addr.sun_path)) {
+    std::cerr << "[!] Output socket path too long: " << socketPath_ << "\n";
+    ::close(segment);
+    return;
+  }
+  strncpy(addr.sun_path, socketPath_.c_str(), sizeof(addr.sun_path) - 1);
+  int sock = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (sock < 0 ||
+      ::connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    std::cerr << "[!] Failed to connect to output socket " << socketPath_
+              << "\n";
+    if (sock >= 0) {
+      ::close(sock);
+    }
+    ::close(segment);
+    return;
+  }
+
+  struct iovec iov;
+  iov.iov_base = (void *)key_.data();
+  iov.iov_len = key_.size();
+  char control[CMSG_SPACE(sizeof(int))];
+  memset(control, 0, sizeof(control));
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+  memcpy(CMSG_DATA(cmsg), &segment, sizeof(int));
+  if (::sendmsg(sock, &msg, 0) < 0) {
+    std::cerr << "[!] Failed to publish memfd segment for " << key_ << "\n";
+  }
+  ::close(sock);
+  // the consumer holds its own reference now (or the dump is lost with
+  // the error above); ours is done either way
+  ::close(segment);
+}
+
+} // namespace ASTPluginLib
@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "MmapOStream.h"
+
+namespace ASTPluginLib {
+
+/**
+ * Shared-memory output segment (the memfd: transport). The dump is
+ * written into an anonymous memfd through a mapping, exactly as
+ * MmapOStream writes a file; when the dump is complete the descriptor
+ * itself is handed to the consumer over a unix socket (SCM_RIGHTS),
+ * who maps it read-only and parses in place. Against the unix:
+ * transport this removes the socket copy of the serialized bytes -
+ * the handoff of a multi-GB dump is one sendmsg, not a memcpy of
+ * every byte through the kernel.
+ *
+ * The handoff is a single message: the payload is the index key (the
+ * normalized main source path) naming the unit, the control data
+ * carries the memfd. The consumer learns the segment size from
+ * lseek(fd, 0, SEEK_END); the segment lives until the last descriptor
+ * to it is closed, no filesystem cleanup involved.
+ */
+class MemfdOStream : public MmapOStream {
+  std::string socketPath_;
+  std::string key_;
+
+ public:
+  MemfdOStream(const std::string &socketPath,
+               const std::string &key,
+               size_t reservation = DefaultReservation);
+  /* publishes the segment: sends (key, fd) to the socket */
+  ~MemfdOStream() override;
+};
+
+} // namespace ASTPluginLib
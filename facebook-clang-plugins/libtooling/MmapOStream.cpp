@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "MmapOStream.h"
+
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace ASTPluginLib {
+
+MmapOStream::MmapOStream(const std::string &path, size_t reservation) {
+  fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd_ < 0) {
+    std::cerr << "[!] could not create mmap output file " << path << "\n";
+    return;
+  }
+  if (!remap(reservation)) {
+    ::close(fd_);
+    fd_ = -1;
+    return;
+  }
+  // raw_ostream buffering would reintroduce the copy the mapping removes
+  SetUnbuffered();
+}
+
+MmapOStream::MmapOStream(int fd, size_t reservation) {
+  if (fd < 0) {
+    return;
+  }
+  fd_ = fd;
+  if (!remap(reservation)) {
+    // adopted descriptors are owned here, mapped or not
+    ::close(fd_);
+    fd_ = -1;
+    return;
+  }
+  SetUnbuffered();
+}
+
+int MmapOStream::takeDescriptor() {
+  if (map_ == nullptr) {
+    return -1;
+  }
+  ::munmap(map_, capacity_);
+  map_ = nullptr;
+  int fd = fd_;
+  fd_ = -1;
+  if (::ftruncate(fd, size_) != 0) {
+    std::cerr << "[!] could not truncate mmap output to final size\n";
+  }
+  return fd;
+}
+
+MmapOStream::~MmapOStream() {
+  if (map_ != nullptr) {
+    ::munmap(map_, capacity_);
+  }
+  if (fd_ >= 0) {
+    // the reservation was sparse; leave only the bytes actually written
+    if (::ftruncate(fd_, size_) != 0) {
+      std::cerr << "[!] could not truncate mmap output to final size\n";
+    }
+    ::close(fd_);
+  }
+}
+
+bool MmapOStream::remap(size_t capacity) {
+  if (map_ != nullptr) {
+    ::munmap(map_, capacity_);
+    map_ = nullptr;
+  }
+  if (::ftruncate(fd_, capacity) != 0) {
+    std::cerr << "[!] could not reserve mmap output file\n";
+    return false;
+  }
+  void *map =
+      ::mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if (map == MAP_FAILED) {
+    std::cerr << "[!] could not map output file\n";
+    return false;
+  }
+  map_ = (char *)map;
+  capacity_ = capacity;
+#if defined(USE_HUGE_PAGES) && defined(MADV_HUGEPAGE)
+  // best effort: file-backed THP needs kernel and filesystem support,
+  // and the kernel is free to ignore the advice
+  ::madvise(map_, capacity_, MADV_HUGEPAGE);
+#endif
+  return true;
+}
+
+void MmapOStream::write_impl(const char *ptr, size_t size) {
+  if (map_ == nullptr) {
+    return;
+  }
+  if (size_ + size > capacity_) {
+    size_t capacity = capacity_;
+    while (size_ + size > capacity) {
+      capacity *= 2;
+    }
+    if (!remap(capacity)) {
+      return;
+    }
+  }
+  memcpy(map_ + size_, ptr, size);
+  size_ += size;
+}
+
+} // namespace ASTPluginLib
@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <string>
+
+#include <llvm/Support/raw_ostream.h>
+
+namespace ASTPluginLib {
+
+/**
+ * A raw_ostream writing straight into a memory mapping of the output
+ * file (MMAP_OUTPUT in SimplePluginASTAction.h). The regular path
+ * copies every byte through userspace stream buffers and a write(2)
+ * into the page cache; here the stream is unbuffered and bytes land in
+ * the mapped pages directly, which multi-GB dumps notice.
+ *
+ * The file is created with a generous sparse reservation and the
+ * mapping grows by remapping when a dump outruns it; on destruction
+ * the mapping is synced and the file truncated to the bytes actually
+ * written. Unlike createOutputFile there is no temporary-plus-rename
+ * step, so a killed capture leaves a partial file rather than nothing -
+ * VALIDATION_FOOTER is the cheap way to detect those.
+ */
+class MmapOStream : public llvm::raw_ostream {
+  int fd_ = -1;
+  char *map_ = nullptr;
+  size_t capacity_ = 0;
+  size_t size_ = 0;
+
+  void write_impl(const char *ptr, size_t size) override;
+  uint64_t current_pos() const override { return size_; }
+
+  bool remap(size_t capacity);
+
+ public:
+  /* 1 GiB of address space and sparse file; pages materialize only as
+     they are written */
+  static const size_t DefaultReservation = (size_t)1 << 30;
+
+  explicit MmapOStream(const std::string &path,
+                       size_t reservation = DefaultReservation);
+  /* adopt an already-open descriptor (e.g. a memfd, see
+     MemfdOStream.h); the descriptor is truncated to the reservation
+     and closed with the stream unless taken back */
+  explicit MmapOStream(int fd, size_t reservation = DefaultReservation);
+  /* truncates to the written size */
+  ~MmapOStream() override;
+
+  /* false when the file could not be created or mapped; the caller
+     should fall back to the regular output path */
+  bool isOpen() const { return map_ != nullptr; }
+
+  /* Finish the stream early - unmap, truncate to the written size -
+     and hand the descriptor to the caller, who now owns it; the
+     destructor becomes a no-op. -1 when the stream never opened. */
+  int takeDescriptor();
+};
+
+} // namespace ASTPluginLib
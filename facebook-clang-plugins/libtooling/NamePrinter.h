@@ -6,9 +6,19 @@
  */
 
 #pragma once
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
 #include <clang/AST/DeclVisitor.h>
 #include <clang/Basic/SourceManager.h>
 
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Support/xxhash.h>
+
 #include "atdlib/ATDWriter.h"
 namespace ASTLib {
 
@@ -22,13 +32,51 @@ class NamePrinter : public ConstDeclVisitor<NamePrinter<ATDWriter>> {
 
   const SourceManager &SM;
   ATDWriter &OF;
+  // hash long template argument lists with XXH64 instead of fnv-1a
+  const bool useXXHash_;
+  // serializes getPresumedLoc when this printer runs on a worker of a
+  // parallel decl dump: the SourceManager memoizes queries in non-atomic
+  // caches (see ASTExporter::SharedSourceManagerLock). Null otherwise.
+  std::mutex *SMLock_ = nullptr;
+
+  // The visitors leave the printed form of one decl here; declComponent()
+  // memoizes it, and qualifierComponents() memoizes whole enclosing
+  // context chains, so a namespace hierarchy is printed once instead of
+  // once per decl dumped below it.
+  std::string component_;
+  llvm::DenseMap<const NamedDecl *, std::string> ComponentCache;
+  llvm::DenseMap<const DeclContext *, std::vector<std::string>>
+      QualifierCache;
+  const std::vector<std::string> emptyComponents_;
 
-  PrintingPolicy getPrintingPolicy();
+  // the printing policy never changes, so it is built once here instead
+  // of copying a LangOptions per printed name
+  const PrintingPolicy printingPolicy_;
+  // scratch buffer shared by the visitors below; each one formats a
+  // single decl, so reuse is safe and the storage stops being
+  // reallocated on every visited name
+  SmallString<256> scratch_;
+
+  // the lock above when set, otherwise an unlocked no-op
+  std::unique_lock<std::mutex> lockSourceManager() {
+    return SMLock_ ? std::unique_lock<std::mutex>(*SMLock_)
+                   : std::unique_lock<std::mutex>();
+  }
+
+  const std::string &declComponent(const NamedDecl *D);
+  const std::vector<std::string> &qualifierComponents(const DeclContext *Ctx);
+
+  static PrintingPolicy makePrintingPolicy();
+  const PrintingPolicy &getPrintingPolicy() const { return printingPolicy_; }
   void printTemplateArgList(llvm::raw_ostream &OS,
                             const ArrayRef<TemplateArgument> Args);
 
  public:
-  NamePrinter(const SourceManager &SM, ATDWriter &OF) : SM(SM), OF(OF) {}
+  NamePrinter(const SourceManager &SM, ATDWriter &OF, bool useXXHash = false)
+      : SM(SM), OF(OF), useXXHash_(useXXHash),
+        printingPolicy_(makePrintingPolicy()) {}
+
+  void setSourceManagerLock(std::mutex *lock) { SMLock_ = lock; }
 
   // implementation is inspired by NamedDecl::printQualifiedName
   // but with better handling for anonymous structs,unions and namespaces
@@ -53,31 +101,233 @@ uint64_t fnv64Hash(const char *s, int n) {
 }
 
 uint64_t fnv64Hash(llvm::raw_svector_ostream &OS) {
-  std::string s = OS.str().str();
+  llvm::StringRef s = OS.str();
   return fnv64Hash(s.data(), s.size());
 }
 
+// XXH64 with seed 0, as computed by llvm::xxHash64: a block hash that
+// consumes 32-byte stripes instead of fnv's byte-at-a-time multiply
+// chain. Selected by USE_XXHASH; the matching C implementation lives in
+// infer/src/c_stubs/fnv64_hash.c so hashes agree end-to-end.
+uint64_t xxh64Hash(llvm::raw_svector_ostream &OS) {
+  return llvm::xxHash64(OS.str());
+}
+
+// Streaming XXH64 state for hashes computed on the fly (seed 0, same
+// digest as llvm::xxHash64 over the concatenated input).
+class XXH64Stream {
+  static constexpr uint64_t P1 = 11400714785074694791ULL;
+  static constexpr uint64_t P2 = 14029467366897019727ULL;
+  static constexpr uint64_t P3 = 1609587929392839161ULL;
+  static constexpr uint64_t P4 = 9650029242287828579ULL;
+  static constexpr uint64_t P5 = 2870177450012600261ULL;
+
+  uint64_t v1_ = P1 + P2;
+  uint64_t v2_ = P2;
+  uint64_t v3_ = 0;
+  uint64_t v4_ = 0 - P1;
+  uint64_t total_ = 0;
+  unsigned char buf_[32];
+  size_t bufSize_ = 0;
+
+  static uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+  static uint64_t round(uint64_t acc, uint64_t input) {
+    acc += input * P2;
+    acc = rotl(acc, 31);
+    acc *= P1;
+    return acc;
+  }
+  static uint64_t mergeRound(uint64_t acc, uint64_t val) {
+    acc ^= round(0, val);
+    return acc * P1 + P4;
+  }
+  // little-endian reads, independently of the host
+  static uint64_t read64(const unsigned char *p) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--) {
+      v = (v << 8) | p[i];
+    }
+    return v;
+  }
+  static uint32_t read32(const unsigned char *p) {
+    uint32_t v = 0;
+    for (int i = 3; i >= 0; i--) {
+      v = (v << 8) | p[i];
+    }
+    return v;
+  }
+  void stripe(const unsigned char *p) {
+    v1_ = round(v1_, read64(p));
+    v2_ = round(v2_, read64(p + 8));
+    v3_ = round(v3_, read64(p + 16));
+    v4_ = round(v4_, read64(p + 24));
+  }
+
+ public:
+  void update(const char *data, size_t size) {
+    const unsigned char *ptr = (const unsigned char *)data;
+    total_ += size;
+    if (bufSize_ + size < sizeof(buf_)) {
+      memcpy(buf_ + bufSize_, ptr, size);
+      bufSize_ += size;
+      return;
+    }
+    if (bufSize_ > 0) {
+      size_t n = sizeof(buf_) - bufSize_;
+      memcpy(buf_ + bufSize_, ptr, n);
+      stripe(buf_);
+      ptr += n;
+      size -= n;
+      bufSize_ = 0;
+    }
+    while (size >= sizeof(buf_)) {
+      stripe(ptr);
+      ptr += sizeof(buf_);
+      size -= sizeof(buf_);
+    }
+    memcpy(buf_, ptr, size);
+    bufSize_ = size;
+  }
+
+  uint64_t digest() const {
+    uint64_t h;
+    if (total_ >= sizeof(buf_)) {
+      h = rotl(v1_, 1) + rotl(v2_, 7) + rotl(v3_, 12) + rotl(v4_, 18);
+      h = mergeRound(h, v1_);
+      h = mergeRound(h, v2_);
+      h = mergeRound(h, v3_);
+      h = mergeRound(h, v4_);
+    } else {
+      h = /* seed */ 0 + P5;
+    }
+    h += total_;
+    const unsigned char *p = buf_;
+    const unsigned char *end = buf_ + bufSize_;
+    while (p + 8 <= end) {
+      h ^= round(0, read64(p));
+      h = rotl(h, 27) * P1 + P4;
+      p += 8;
+    }
+    if (p + 4 <= end) {
+      h ^= (uint64_t)read32(p) * P1;
+      h = rotl(h, 23) * P2 + P3;
+      p += 4;
+    }
+    while (p < end) {
+      h ^= *p * P5;
+      h = rotl(h, 11) * P1;
+      p++;
+    }
+    h ^= h >> 33;
+    h *= P2;
+    h ^= h >> 29;
+    h *= P3;
+    h ^= h >> 32;
+    return h;
+  }
+};
+
 const int templateLengthThreshold = 40;
+
+// A raw_ostream that hashes what is written into it on the fly and keeps
+// only the first templateLengthThreshold + 1 bytes. Short renderings are
+// then emitted verbatim; anything longer is replaced by its hash without
+// the full string (megabytes for deeply nested templates) ever being
+// materialized.
+class HashingPrefixOStream : public llvm::raw_ostream {
+  uint64_t hash_ = FNV64_hash_start;
+  XXH64Stream xxh_;
+  const bool useXXHash_;
+  size_t size_ = 0;
+  char prefix_[templateLengthThreshold + 1];
+
+  void write_impl(const char *ptr, size_t size) override {
+    if (useXXHash_) {
+      xxh_.update(ptr, size);
+    } else {
+      for (size_t i = 0; i < size; i++) {
+        hash_ ^= ptr[i];
+        hash_ *= FNV64_prime;
+      }
+    }
+    if (size_ < sizeof(prefix_)) {
+      size_t n = std::min(size, sizeof(prefix_) - size_);
+      memcpy(prefix_ + size_, ptr, n);
+    }
+    size_ += size;
+  }
+  uint64_t current_pos() const override { return size_; }
+
+ public:
+  explicit HashingPrefixOStream(bool useXXHash = false)
+      : useXXHash_(useXXHash) {}
+
+  ~HashingPrefixOStream() override { flush(); }
+
+  // write the buffered bytes, or the hash when over the threshold
+  void emitTo(llvm::raw_ostream &OS) {
+    flush();
+    if (size_ > templateLengthThreshold) {
+      OS << "<";
+      OS.write_hex(useXXHash_ ? xxh_.digest() : hash_);
+      OS << ">";
+    } else {
+      OS.write(prefix_, size_);
+    }
+  }
+};
+
 template <class ATDWriter>
 void NamePrinter<ATDWriter>::printTemplateArgList(
     llvm::raw_ostream &OS, const ArrayRef<TemplateArgument> Args) {
-  SmallString<64> Buf;
-  llvm::raw_svector_ostream tmpOS(Buf);
+  HashingPrefixOStream tmpOS(useXXHash_);
   clang::printTemplateArgumentList(tmpOS, Args, getPrintingPolicy());
-  if (tmpOS.str().size() > templateLengthThreshold) {
-    OS << "<";
-    OS.write_hex(fnv64Hash(tmpOS));
-    OS << ">";
-  } else {
-    OS << tmpOS.str();
+  tmpOS.emitTo(OS);
+}
+
+// printed form of a single decl, memoized
+template <class ATDWriter>
+const std::string &NamePrinter<ATDWriter>::declComponent(const NamedDecl *D) {
+  auto it = ComponentCache.find(D);
+  if (it != ComponentCache.end()) {
+    return it->second;
+  }
+  component_.clear();
+  ConstDeclVisitor<NamePrinter<ATDWriter>>::Visit(D);
+  return ComponentCache.try_emplace(D, std::move(component_)).first->second;
+}
+
+// name components of Ctx and its enclosing named contexts, innermost
+// first, memoized per context so the chain is shared by all decls below
+template <class ATDWriter>
+const std::vector<std::string> &NamePrinter<ATDWriter>::qualifierComponents(
+    const DeclContext *Ctx) {
+  if (!Ctx || !isa<NamedDecl>(Ctx)) {
+    return emptyComponents_;
+  }
+  auto it = QualifierCache.find(Ctx);
+  if (it != QualifierCache.end()) {
+    return it->second;
   }
+  std::vector<std::string> components;
+  bool shouldPrintCtx = true;
+  // skip inline namespaces when printing qualified name
+  if (const NamespaceDecl *ND = dyn_cast<NamespaceDecl>(Ctx)) {
+    if (ND->isInline()) {
+      shouldPrintCtx = false;
+    }
+  }
+  if (shouldPrintCtx) {
+    components.push_back(declComponent(cast<NamedDecl>(Ctx)));
+  }
+  const std::vector<std::string> &parent = qualifierComponents(Ctx->getParent());
+  components.insert(components.end(), parent.begin(), parent.end());
+  return QualifierCache.try_emplace(Ctx, std::move(components)).first->second;
 }
 
 template <class ATDWriter>
 void NamePrinter<ATDWriter>::printDeclName(const NamedDecl &D) {
   const DeclContext *Ctx = D.getDeclContext();
-  SmallVector<const NamedDecl *, 8> Contexts;
-  Contexts.push_back(&D);
 
   // Don't dump full qualifier for variables declared
   // inside a function/method/block
@@ -86,41 +336,30 @@ void NamePrinter<ATDWriter>::printDeclName(const NamedDecl &D) {
     Ctx = nullptr;
   }
 
-  while (Ctx && isa<NamedDecl>(Ctx)) {
-    bool shouldPrintCtx = true;
-    // skip inline namespaces when printing qualified name
-    if (const NamespaceDecl *ND = dyn_cast<NamespaceDecl>(Ctx)) {
-      if (ND->isInline()) {
-        shouldPrintCtx = false;
-      }
-    }
-    if (shouldPrintCtx) {
-      Contexts.push_back(cast<NamedDecl>(Ctx));
-    }
-    Ctx = Ctx->getParent();
-  }
-
-  ArrayScope aScope(OF, Contexts.size());
-  // dump list in reverse
-  for (const Decl *Ctx : Contexts) {
-    ConstDeclVisitor<NamePrinter<ATDWriter>>::Visit(Ctx);
+  const std::vector<std::string> &qualifiers = qualifierComponents(Ctx);
+  ArrayScope aScope(OF, 1 + qualifiers.size());
+  // the decl itself first, then its contexts from the innermost out
+  OF.emitString(declComponent(&D));
+  for (const std::string &qualifier : qualifiers) {
+    OF.emitString(qualifier);
   }
 }
 
 template <class ATDWriter>
 void NamePrinter<ATDWriter>::VisitNamedDecl(const NamedDecl *D) {
-  OF.emitString(D->getNameAsString());
+  component_ = D->getNameAsString();
 }
 
 template <class ATDWriter>
 void NamePrinter<ATDWriter>::VisitNamespaceDecl(const NamespaceDecl *ND) {
   if (ND->isAnonymousNamespace()) {
+    auto lock = lockSourceManager();
     PresumedLoc PLoc = SM.getPresumedLoc(ND->getLocation());
     std::string file = "invalid_loc";
     if (PLoc.isValid()) {
       file = PLoc.getFilename();
     }
-    OF.emitString("anonymous_namespace_" + file);
+    component_ = "anonymous_namespace_" + file;
   } else {
     // for non-anonymous namespaces, fallback to normal behavior
     VisitNamedDecl(ND);
@@ -130,8 +369,8 @@ void NamePrinter<ATDWriter>::VisitNamespaceDecl(const NamespaceDecl *ND) {
 template <class ATDWriter>
 void NamePrinter<ATDWriter>::VisitTagDecl(const TagDecl *D) {
   // heavily inspired by clang's TypePrinter::printTag() function
-  SmallString<64> Buf;
-  llvm::raw_svector_ostream StrOS(Buf);
+  scratch_.clear();
+  llvm::raw_svector_ostream StrOS(scratch_);
   if (const IdentifierInfo *II = D->getIdentifier()) {
     StrOS << II->getName();
   } else if (TypedefNameDecl *Typedef = D->getTypedefNameForAnonDecl()) {
@@ -142,6 +381,7 @@ void NamePrinter<ATDWriter>::VisitTagDecl(const TagDecl *D) {
     } else {
       StrOS << "anonymous_" << D->getKindName();
     }
+    auto lock = lockSourceManager();
     PresumedLoc PLoc = SM.getPresumedLoc(D->getLocation());
     if (PLoc.isValid()) {
       StrOS << "_" << PLoc.getFilename() << ':' << PLoc.getLine() << ':'
@@ -155,7 +395,7 @@ void NamePrinter<ATDWriter>::VisitTagDecl(const TagDecl *D) {
     Args = TemplateArgs.asArray();
     printTemplateArgList(StrOS, Args);
   }
-  OF.emitString(StrOS.str().str());
+  component_ = StrOS.str().str();
 }
 
 template <class ATDWriter>
@@ -164,16 +404,16 @@ void NamePrinter<ATDWriter>::VisitFunctionDecl(const FunctionDecl *FD) {
   // add instantiated template arguments for readability
   if (const TemplateArgumentList *TemplateArgs =
           FD->getTemplateSpecializationArgs()) {
-    SmallString<64> Buf;
-    llvm::raw_svector_ostream StrOS(Buf);
+    scratch_.clear();
+    llvm::raw_svector_ostream StrOS(scratch_);
     printTemplateArgList(StrOS, TemplateArgs->asArray());
     template_str = StrOS.str().str();
   }
-  OF.emitString(FD->getNameAsString() + template_str);
+  component_ = FD->getNameAsString() + template_str;
 }
 
 template <class ATDWriter>
-PrintingPolicy NamePrinter<ATDWriter>::getPrintingPolicy() {
+PrintingPolicy NamePrinter<ATDWriter>::makePrintingPolicy() {
   // configure what to print
   LangOptions LO;
   PrintingPolicy Policy(LO);
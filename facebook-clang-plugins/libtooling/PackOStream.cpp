@@ -0,0 +1,282 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "PackOStream.h"
+
+#include <atomic>
+#include <errno.h>
+#include <fcntl.h>
+#include <iostream>
+#include <mutex>
+#include <stdio.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_set>
+
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/xxhash.h>
+
+namespace ASTPluginLib {
+
+// First page of an atomic-append segment, mapped shared by every
+// writer. reserved is the reservation cursor (next free byte),
+// committed retires reservations as their writes finish; the rest of
+// the page is zero padding up to HeaderSize.
+struct PackSegmentHeader {
+  std::atomic<uint64_t> magic;
+  std::atomic<uint64_t> reserved;
+  std::atomic<uint64_t> committed;
+};
+static_assert(sizeof(PackSegmentHeader) <= PackOStream::HeaderSize,
+              "segment header must fit its page");
+
+// "PACKSEG2", little-endian
+static const uint64_t PackSegmentMagic = 0x32474553'4b434150ULL;
+
+PackOStream::PackOStream(llvm::StringRef dir,
+                         llvm::StringRef key,
+                         bool dropCache,
+                         bool atomicAppend,
+                         bool flushAppend,
+                         bool durableAppend)
+    : dir_(dir.str()),
+      key_(key.str()),
+      dropCache_(dropCache),
+      atomicAppend_(atomicAppend),
+      flushAppend_(flushAppend),
+      durableAppend_(durableAppend) {
+  llvm::sys::fs::create_directories(dir_);
+}
+
+namespace {
+
+/* Segments appended to under the "fdatasync" durability policy, not
+ * yet synced; process-wide, so every TU of an invocation charges the
+ * same segment once. Leaked on purpose, like the symlink resolver:
+ * writers may live on worker threads that outlive static destruction. */
+struct DirtySegments {
+  std::mutex mutex;
+  std::unordered_set<std::string> paths;
+};
+
+DirtySegments &dirtySegments() {
+  static DirtySegments *dirty = new DirtySegments();
+  return *dirty;
+}
+
+} // namespace
+
+void PackOStream::syncAppendedSegments() {
+  DirtySegments &dirty = dirtySegments();
+  std::unordered_set<std::string> pending;
+  {
+    std::lock_guard<std::mutex> lock(dirty.mutex);
+    pending.swap(dirty.paths);
+  }
+  // the syncs themselves run outside the lock: concurrent appends keep
+  // registering (for the next drain) while this one waits on the disk
+  for (const std::string &path : pending) {
+    int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd < 0 || fdatasync(fd) != 0) {
+      std::cerr << "[!] Failed to sync pack segment " << path << "\n";
+    }
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+}
+
+void PackOStream::write_impl(const char *ptr, size_t size) {
+  pos_ += size;
+  buffer_.insert(buffer_.end(), ptr, ptr + size);
+}
+
+std::string PackOStream::segmentName(llvm::StringRef key) {
+  char name[32];
+  snprintf(name,
+           sizeof(name),
+           "segment-%02u.pack",
+           (unsigned)(llvm::xxHash64(key) % NumSegments));
+  return name;
+}
+
+static bool writeAll(int fd, const char *data, size_t size) {
+  while (size > 0) {
+    ssize_t written = write(fd, data, size);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data += written;
+    size -= (size_t)written;
+  }
+  return true;
+}
+
+static bool pwriteAll(int fd, const char *data, size_t size, off_t offset) {
+  while (size > 0) {
+    ssize_t written = pwrite(fd, data, size, offset);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data += written;
+    offset += written;
+    size -= (size_t)written;
+  }
+  return true;
+}
+
+bool PackOStream::appendLocked(int fd,
+                               const std::string &segmentPath,
+                               uint64_t &offset) {
+  // the lock keeps the slice contiguous under concurrent writers; it
+  // covers finding the offset and the append, nothing else
+  if (flock(fd, LOCK_EX) != 0) {
+    std::cerr << "[!] Failed to lock pack segment " << segmentPath << ": "
+              << strerror(errno) << "\n";
+    return false;
+  }
+  off_t end = lseek(fd, 0, SEEK_END);
+  bool ok = end >= 0 && writeAll(fd, buffer_.data(), buffer_.size());
+  flock(fd, LOCK_UN);
+  offset = (uint64_t)end;
+  return ok;
+}
+
+bool PackOStream::appendAtomic(int fd,
+                               const std::string &segmentPath,
+                               uint64_t &offset) {
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    std::cerr << "[!] Failed to stat pack segment " << segmentPath << ": "
+              << strerror(errno) << "\n";
+    return false;
+  }
+  if (st.st_size < (off_t)HeaderSize) {
+    // one-time initialization of a fresh segment is the only locked
+    // step: rechecked under the lock so exactly one writer extends the
+    // file to the header size, and a concurrent append past it can
+    // never be truncated away. Every append after this is lock-free.
+    bool ok = flock(fd, LOCK_EX) == 0 && fstat(fd, &st) == 0 &&
+              (st.st_size >= (off_t)HeaderSize ||
+               ftruncate(fd, (off_t)HeaderSize) == 0);
+    flock(fd, LOCK_UN);
+    if (!ok) {
+      std::cerr << "[!] Failed to initialize pack segment " << segmentPath
+                << ": " << strerror(errno) << "\n";
+      return false;
+    }
+  }
+  void *page =
+      mmap(nullptr, HeaderSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (page == MAP_FAILED) {
+    std::cerr << "[!] Failed to map pack segment header " << segmentPath
+              << ": " << strerror(errno) << "\n";
+    return false;
+  }
+  auto *header = static_cast<PackSegmentHeader *>(page);
+  // the first writer moves the reservation cursor past the header; the
+  // magic is stored by everyone, always with the same value
+  uint64_t expected = 0;
+  header->reserved.compare_exchange_strong(expected, HeaderSize);
+  header->magic.store(PackSegmentMagic, std::memory_order_relaxed);
+  // round the reservation to FrameAlign, so concurrent writers never
+  // touch the same cache line; the gap bytes stay zero and unindexed
+  const uint64_t aligned =
+      (buffer_.size() + FrameAlign - 1) & ~(FrameAlign - 1);
+  offset = header->reserved.fetch_add(aligned);
+  bool ok = pwriteAll(fd, buffer_.data(), buffer_.size(), (off_t)offset);
+  // retire the reservation whether or not the write stuck: committed ==
+  // reserved still means no writer is in flight below the cursor, and a
+  // failed frame is never indexed, so readers cannot reach its zeros
+  header->committed.fetch_add(aligned);
+  munmap(page, HeaderSize);
+  return ok;
+}
+
+PackOStream::~PackOStream() {
+  flush();
+  const std::string segment = segmentName(key_);
+  const std::string segmentPath = dir_ + "/" + segment;
+  // pwrite on an O_APPEND descriptor ignores its offset on Linux, so
+  // the atomic path must open without it
+  int flags = atomicAppend_ ? (O_CREAT | O_RDWR | O_CLOEXEC)
+                            : (O_CREAT | O_WRONLY | O_APPEND | O_CLOEXEC);
+  int fd = open(segmentPath.c_str(), flags, 0644);
+  if (fd < 0) {
+    std::cerr << "[!] Failed to open pack segment " << segmentPath << ": "
+              << strerror(errno) << "\n";
+    return;
+  }
+  uint64_t offset = 0;
+  bool ok = atomicAppend_ ? appendAtomic(fd, segmentPath, offset)
+                          : appendLocked(fd, segmentPath, offset);
+#if defined(__linux__) && defined(SYNC_FILE_RANGE_WRITE)
+  if (ok && flushAppend_ && !dropCache_) {
+    // the "flush" durability policy: start writeback of the slice
+    // without waiting on it (the dropCache branch below already does)
+    sync_file_range(
+        fd, (off_t)offset, (off_t)buffer_.size(), SYNC_FILE_RANGE_WRITE);
+  }
+#endif
+#ifdef POSIX_FADV_DONTNEED
+  if (ok && dropCache_) {
+    // exactly the slice this capture appended: start its writeback and
+    // drop it, keeping the page cache for the next TU's header reads
+#if defined(__linux__) && defined(SYNC_FILE_RANGE_WRITE)
+    sync_file_range(
+        fd, (off_t)offset, (off_t)buffer_.size(), SYNC_FILE_RANGE_WRITE);
+#endif
+    posix_fadvise(
+        fd, (off_t)offset, (off_t)buffer_.size(), POSIX_FADV_DONTNEED);
+  }
+#endif
+  if (ok && durableAppend_) {
+    // defer the fdatasync to the batched drain; registering is cheap,
+    // the set holds at most NumSegments paths per pack directory
+    DirtySegments &dirty = dirtySegments();
+    std::lock_guard<std::mutex> lock(dirty.mutex);
+    dirty.paths.insert(segmentPath);
+  }
+  close(fd);
+  if (!ok) {
+    std::cerr << "[!] Failed to append to pack segment " << segmentPath
+              << ": " << strerror(errno) << "\n";
+    return;
+  }
+
+  std::string line = key_ + "\t" + segment + "\t" + std::to_string(offset) +
+                     "\t" + std::to_string(buffer_.size()) + "\n";
+  const std::string indexPath = dir_ + "/pack.index";
+  int indexFd = open(indexPath.c_str(),
+                     O_CREAT | O_WRONLY | O_APPEND | O_CLOEXEC,
+                     0644);
+  if (indexFd < 0 || !writeAll(indexFd, line.data(), line.size())) {
+    std::cerr << "[!] Failed to index pack entry in " << indexPath << ": "
+              << strerror(errno) << "\n";
+  }
+  if (indexFd >= 0) {
+    close(indexFd);
+  }
+  if (durableAppend_) {
+    // a durable slice must also be findable: the index joins the same
+    // batched sync as the segments
+    DirtySegments &dirty = dirtySegments();
+    std::lock_guard<std::mutex> lock(dirty.mutex);
+    dirty.paths.insert(indexPath);
+  }
+}
+
+} // namespace ASTPluginLib
@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <llvm/Support/raw_ostream.h>
+
+namespace ASTPluginLib {
+
+/**
+ * A raw_ostream that publishes its bytes into a pack directory instead
+ * of a per-unit file (the pack: output transport, see
+ * SimplePluginASTAction.h). Per-unit outputs produce millions of small
+ * files on networked capture volumes, where open/close round trips
+ * dominate; a pack directory holds the same bytes in a bounded number
+ * of large segment files appended sequentially.
+ *
+ * The whole dump is buffered in memory and published on destruction:
+ * the segment is picked by hashing the unit key, appended to under an
+ * exclusive flock, and one line
+ *     key \t segment \t offset \t length
+ * is appended to <dir>/pack.index describing the slice. Index appends
+ * are single short write(2) calls on an O_APPEND descriptor, so
+ * concurrent captures interleave whole lines. Recaptures simply append
+ * again; readers let the last line for a key win (see PackReader.h).
+ *
+ * Under PACK_ATOMIC_APPEND the flock is replaced by a lock-free
+ * reservation protocol for many-writer fan-in (the parallel batch
+ * runner in particular): each segment starts with one mapped header
+ * page holding two atomic counters, and a writer claims its slice with
+ * a single fetch_add on the reservation counter, then pwrites at the
+ * claimed offset with no lock at all. Reservations are rounded up to
+ * FrameAlign so concurrent writers never share a cache line; the gaps
+ * are zero bytes no index line points at. The second counter retires
+ * reservations as their writes finish: committed == reserved is the
+ * published watermark, meaning every byte below reserved is final.
+ * Index lines stay the per-frame publication either way, so PackReader
+ * needs no changes (offsets in the index are absolute).
+ */
+class PackOStream : public llvm::raw_ostream {
+  std::string dir_;
+  /* index key for this unit: the normalized main source path */
+  std::string key_;
+  std::vector<char> buffer_;
+  uint64_t pos_ = 0;
+  /* evict the appended slice from the page cache after publishing it
+     (DROP_OUTPUT_CACHE): pack segments grow to gigabytes over a build
+     and nothing in this process reads them back */
+  bool dropCache_ = false;
+  /* reserve the slice offset with a fetch_add on the segment header
+     instead of taking the flock (PACK_ATOMIC_APPEND) */
+  bool atomicAppend_ = false;
+  /* start asynchronous writeback of the appended slice (the "flush"
+     OUTPUT_DURABILITY policy) */
+  bool flushAppend_ = false;
+  /* register the segment for the batched fdatasync of
+     syncAppendedSegments (the "fdatasync" OUTPUT_DURABILITY policy) */
+  bool durableAppend_ = false;
+
+  void write_impl(const char *ptr, size_t size) override;
+  uint64_t current_pos() const override { return pos_; }
+
+  /* the locked append path: flock, seek to the end, write */
+  bool appendLocked(int fd, const std::string &segmentPath, uint64_t &offset);
+  /* the lock-free path: map the header page, fetch_add a reservation,
+     pwrite at the claimed offset, retire the reservation */
+  bool appendAtomic(int fd, const std::string &segmentPath, uint64_t &offset);
+
+ public:
+  PackOStream(llvm::StringRef dir,
+              llvm::StringRef key,
+              bool dropCache = false,
+              bool atomicAppend = false,
+              bool flushAppend = false,
+              bool durableAppend = false);
+  /* appends the buffered bytes to the segment and indexes the slice */
+  ~PackOStream() override;
+
+  /* fdatasync every segment a durableAppend writer of this process has
+     appended to since the previous call, each exactly once -- syncing
+     per append would pay the sync tail on every TU for segments that
+     many TUs share. Called at action teardown under the "fdatasync"
+     OUTPUT_DURABILITY policy (see SimplePluginASTAction.h); cheap when
+     nothing is pending. */
+  static void syncAppendedSegments();
+
+  /* number of segment files a pack directory fans out over; hashing the
+     key over a handful of segments keeps writer lock contention low
+     while still producing few, large files */
+  static const unsigned NumSegments = 16;
+
+  /* atomic-append segments: size of the mapped header page at offset 0
+     and the alignment slice reservations are rounded to */
+  static const uint64_t HeaderSize = 4096;
+  static const uint64_t FrameAlign = 64;
+
+  /* segment file name the given key appends to */
+  static std::string segmentName(llvm::StringRef key);
+};
+
+} // namespace ASTPluginLib
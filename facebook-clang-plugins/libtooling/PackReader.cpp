@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "PackReader.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+#include <vector>
+
+namespace ASTPluginLib {
+
+static bool splitFields(const std::string &line,
+                        std::vector<std::string> &fields) {
+  fields.clear();
+  size_t start = 0;
+  while (true) {
+    size_t tab = line.find('\t', start);
+    if (tab == std::string::npos) {
+      fields.push_back(line.substr(start));
+      break;
+    }
+    fields.push_back(line.substr(start, tab - start));
+    start = tab + 1;
+  }
+  return fields.size() >= 4;
+}
+
+static bool parseUInt(const std::string &field, uint64_t &value) {
+  if (field.empty()) {
+    return false;
+  }
+  value = 0;
+  for (char c : field) {
+    if (c < '0' || c > '9') {
+      return false;
+    }
+    value = value * 10 + (uint64_t)(c - '0');
+  }
+  return true;
+}
+
+PackReader::~PackReader() {
+  for (const auto &entry : segmentFds_) {
+    close(entry.second);
+  }
+}
+
+bool PackReader::open(const std::string &dir) {
+  dir_ = dir;
+  std::ifstream index(dir + "/pack.index");
+  if (!index) {
+    return false;
+  }
+  std::string line;
+  std::vector<std::string> fields;
+  while (std::getline(index, line)) {
+    PackEntry entry;
+    // key \t segment \t offset \t length; malformed lines (a capture
+    // killed mid-append) are skipped, later lines overwrite earlier
+    if (!splitFields(line, fields) || !parseUInt(fields[2], entry.offset) ||
+        !parseUInt(fields[3], entry.length)) {
+      continue;
+    }
+    entry.segment = fields[1];
+    units_[fields[0]] = entry;
+  }
+
+  // optional, written when the capture ran with DECL_INDEX
+  std::ifstream declIndex(dir + "/pack.declidx");
+  if (declIndex) {
+    while (std::getline(declIndex, line)) {
+      uint64_t offset, length;
+      // source \t decl \t offset \t length, offsets unit-relative
+      if (!splitFields(line, fields) || !parseUInt(fields[2], offset) ||
+          !parseUInt(fields[3], length)) {
+        continue;
+      }
+      decls_[fields[0] + "\t" + fields[1]] = {offset, length};
+    }
+  }
+  return true;
+}
+
+bool PackReader::lookup(const std::string &source, PackEntry &entry) const {
+  auto it = units_.find(source);
+  if (it == units_.end()) {
+    return false;
+  }
+  entry = it->second;
+  return true;
+}
+
+bool PackReader::lookupDecl(const std::string &source,
+                            const std::string &decl,
+                            PackEntry &entry) const {
+  auto unit = units_.find(source);
+  if (unit == units_.end()) {
+    return false;
+  }
+  auto it = decls_.find(source + "\t" + decl);
+  if (it == decls_.end()) {
+    return false;
+  }
+  entry.segment = unit->second.segment;
+  entry.offset = unit->second.offset + it->second.first;
+  entry.length = it->second.second;
+  return true;
+}
+
+bool PackReader::read(const PackEntry &entry, std::string &bytes) {
+  int fd;
+  auto it = segmentFds_.find(entry.segment);
+  if (it != segmentFds_.end()) {
+    fd = it->second;
+  } else {
+    fd = ::open((dir_ + "/" + entry.segment).c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      return false;
+    }
+    segmentFds_[entry.segment] = fd;
+  }
+  bytes.resize(entry.length);
+  size_t done = 0;
+  while (done < entry.length) {
+    ssize_t got = pread(fd,
+                        &bytes[done],
+                        entry.length - done,
+                        (off_t)(entry.offset + done));
+    if (got < 0 && errno == EINTR) {
+      continue;
+    }
+    if (got <= 0) {
+      bytes.clear();
+      return false;
+    }
+    done += (size_t)got;
+  }
+  return true;
+}
+
+} // namespace ASTPluginLib
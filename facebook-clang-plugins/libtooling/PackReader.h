@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+namespace ASTPluginLib {
+
+/* a slice of a pack segment file */
+struct PackEntry {
+  std::string segment;
+  uint64_t offset;
+  uint64_t length;
+};
+
+/**
+ * Random-access reader for a pack directory written through the pack:
+ * output transport (see PackOStream.h). Deliberately free of LLVM and
+ * clang dependencies so consumer-side bindings (the OCaml capture
+ * reader in particular) can link it on its own.
+ *
+ * open() loads <dir>/pack.index, mapping each source path to the
+ * segment slice holding its dump; when a capture ran with DECL_INDEX it
+ * also loads <dir>/pack.declidx, refining that to per-decl slices.
+ * Later index lines win, so a recaptured unit resolves to its newest
+ * bytes. read() serves slices with pread(2) on descriptors kept open
+ * across calls - the point of packing is to pay the open once per
+ * segment, not once per unit.
+ */
+class PackReader {
+ public:
+  PackReader() {}
+  ~PackReader();
+  PackReader(const PackReader &) = delete;
+  PackReader &operator=(const PackReader &) = delete;
+
+  /* load the indexes; false when the pack index cannot be read */
+  bool open(const std::string &dir);
+
+  /* slice holding the full dump of a source path */
+  bool lookup(const std::string &source, PackEntry &entry) const;
+
+  /* slice holding one decl frame of a source path's dump; names are the
+     decl index join keys (hashed mangled name, or the qualified name
+     when no mangled name exists - see DECL_INDEX in ASTExporter.h) */
+  bool lookupDecl(const std::string &source,
+                  const std::string &decl,
+                  PackEntry &entry) const;
+
+  /* read a slice's bytes; false on any short or failed read */
+  bool read(const PackEntry &entry, std::string &bytes);
+
+ private:
+  std::string dir_;
+  std::unordered_map<std::string, PackEntry> units_;
+  /* keyed "source\tdecl"; offsets relative to the unit's slice */
+  std::unordered_map<std::string, std::pair<uint64_t, uint64_t>> decls_;
+  /* segment name -> descriptor, opened lazily, closed on destruction */
+  std::unordered_map<std::string, int> segmentFds_;
+};
+
+} // namespace ASTPluginLib
@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "ParallelGzipOStream.h"
+
+#include <cstring>
+
+#include <zlib.h>
+
+namespace ASTPluginLib {
+
+namespace {
+
+// compress one chunk into a complete, independent gzip member
+std::vector<char> compressMember(const std::vector<char> &chunk, int level) {
+  z_stream strm;
+  std::memset(&strm, 0, sizeof(strm));
+  // windowBits 15 + 16 selects the gzip wrapper, as in GzipOStream
+  int ret =
+      deflateInit2(&strm, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+  if (ret != Z_OK) {
+    llvm::errs() << "ParallelGzipOStream: deflateInit2 failed (" << ret
+                 << ")\n";
+    return {};
+  }
+  std::vector<char> member(deflateBound(&strm, (uLong)chunk.size()));
+  strm.next_in = (Bytef *)const_cast<char *>(chunk.data());
+  strm.avail_in = (uInt)chunk.size();
+  strm.next_out = (Bytef *)member.data();
+  strm.avail_out = (uInt)member.size();
+  deflate(&strm, Z_FINISH);
+  member.resize(member.size() - strm.avail_out);
+  deflateEnd(&strm);
+  return member;
+}
+
+} // namespace
+
+ParallelGzipOStream::ParallelGzipOStream(llvm::raw_ostream &os,
+                                         unsigned threads,
+                                         int level)
+    : os_(os), level_(level) {
+  front_.reserve(chunkSize);
+  if (threads == 0) {
+    threads = 1;
+  }
+  for (unsigned i = 0; i < threads; i++) {
+    workers_.emplace_back([this] { workerLoop(); });
+  }
+}
+
+ParallelGzipOStream::~ParallelGzipOStream() {
+  // push whatever raw_ostream still buffers through write_impl
+  flush();
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!front_.empty() || nextTicket_ == 0) {
+      // an empty dump still gets one (empty) member, so the output is a
+      // valid gzip stream like GzipOStream's
+      todo_.emplace_back(nextTicket_++, std::move(front_));
+    }
+    finished_ = true;
+  }
+  produced_.notify_all();
+  for (std::thread &worker : workers_) {
+    worker.join();
+  }
+  // workers only exit once todo_ is drained; members they could not
+  // forward while another was writing are flushed here, in order
+  for (auto &member : done_) {
+    os_.write(member.second.data(), member.second.size());
+  }
+}
+
+void ParallelGzipOStream::workerLoop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    produced_.wait(lock, [this] { return !todo_.empty() || finished_; });
+    if (todo_.empty()) {
+      return;
+    }
+    uint64_t ticket = todo_.front().first;
+    std::vector<char> chunk = std::move(todo_.front().second);
+    todo_.pop_front();
+    written_.notify_one();
+    lock.unlock();
+    std::vector<char> member = compressMember(chunk, level_);
+    lock.lock();
+    done_.emplace(ticket, std::move(member));
+    // forward whatever is ready, in input order; one worker at a time
+    while (!writing_ && done_.count(nextWrite_)) {
+      writing_ = true;
+      do {
+        std::vector<char> out = std::move(done_[nextWrite_]);
+        done_.erase(nextWrite_);
+        lock.unlock();
+        os_.write(out.data(), out.size());
+        lock.lock();
+        nextWrite_++;
+      } while (done_.count(nextWrite_));
+      writing_ = false;
+    }
+  }
+}
+
+void ParallelGzipOStream::handOff() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  // cap the work queued ahead of the sink, or a slow disk would let the
+  // producer park the whole dump in todo_
+  written_.wait(lock, [this] { return todo_.size() < maxInFlight; });
+  todo_.emplace_back(nextTicket_++, std::move(front_));
+  lock.unlock();
+  produced_.notify_one();
+  front_ = std::vector<char>();
+  front_.reserve(chunkSize);
+}
+
+void ParallelGzipOStream::write_impl(const char *ptr, size_t size) {
+  pos_ += size;
+  // carve large writes too, so a buffered producer handing over the
+  // dump in big slabs still yields chunk-sized members
+  while (size > 0) {
+    size_t take = size;
+    if (front_.size() + take > chunkSize) {
+      take = chunkSize - front_.size();
+    }
+    front_.insert(front_.end(), ptr, ptr + take);
+    ptr += take;
+    size -= take;
+    if (front_.size() >= chunkSize) {
+      handOff();
+    }
+  }
+}
+
+} // namespace ASTPluginLib
@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <llvm/Support/raw_ostream.h>
+
+namespace ASTPluginLib {
+
+/**
+ * A raw_ostream adapter compressing in parallel (COMPRESS_THREADS; the
+ * serial sibling is GzipOStream). Input is carved into fixed-size
+ * chunks, a pool of workers compresses each chunk into an independent
+ * gzip member, and the members are written to the wrapped stream in
+ * input order - concatenated members are a valid gzip stream (RFC
+ * 1952), so any gzip reader decompresses the output unchanged, while a
+ * reader that records member boundaries can decompress them in
+ * parallel too. Serialization of later decls proceeds while earlier
+ * chunks compress, which removes the compression tail from capture
+ * latency at a small ratio cost (each member restarts its dictionary).
+ */
+class ParallelGzipOStream : public llvm::raw_ostream {
+  llvm::raw_ostream &os_;
+  int level_;
+
+  static const size_t chunkSize = 1 << 20;
+  // jobs a producer may run ahead of the writer before blocking, so a
+  // slow sink cannot queue the whole dump in memory
+  static const size_t maxInFlight = 4;
+
+  std::vector<char> front_;
+
+  std::mutex mutex_;
+  std::condition_variable produced_;
+  std::condition_variable written_;
+  // chunks waiting for a worker, in input order
+  std::deque<std::pair<uint64_t, std::vector<char>>> todo_;
+  // compressed members waiting for their turn to be written
+  std::map<uint64_t, std::vector<char>> done_;
+  uint64_t nextTicket_ = 0;
+  uint64_t nextWrite_ = 0;
+  // one worker at a time forwards finished members to the sink
+  bool writing_ = false;
+  bool finished_ = false;
+  uint64_t pos_ = 0;
+
+  std::vector<std::thread> workers_;
+
+  void workerLoop();
+  void handOff();
+
+  void write_impl(const char *ptr, size_t size) override;
+  uint64_t current_pos() const override { return pos_; }
+
+ public:
+  ParallelGzipOStream(llvm::raw_ostream &os,
+                      unsigned threads,
+                      int level = -1 /* Z_DEFAULT_COMPRESSION */);
+  ~ParallelGzipOStream() override;
+};
+
+} // namespace ASTPluginLib
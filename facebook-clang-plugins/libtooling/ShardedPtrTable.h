@@ -0,0 +1,168 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace ASTPluginLib {
+
+/**
+ * Sharded open-addressing hash table from pointer keys to small
+ * trivially copyable values, built for concurrent insert-if-absent --
+ * the hottest operation of the parallel decl workers, where a
+ * mutex-guarded map serializes every pointer id lookup.
+ *
+ * Keys must be non-null (nullptr is the empty-slot sentinel) and
+ * Value() must never be a stored value (it marks a claimed slot whose
+ * value is still being published). Entries are never erased. Lookups
+ * and inserts are lock-free: a probe walks the shard's slot array,
+ * claims an empty slot with one compare-exchange, and publishes the
+ * value with a release store; a reader racing the claimant of its key
+ * spins for the one makeValue call it takes to publish.
+ *
+ * Capacity is fixed at construction, sized by the caller from expected
+ * entry counts; shards refuse new claims past 7/8 occupancy and spill
+ * to a small locked map instead, so an undersized table degrades but
+ * stays correct.
+ */
+template <typename Value>
+class ShardedPtrTable {
+ public:
+  explicit ShardedPtrTable(size_t expectedEntries) {
+    size_t perShard = 64;
+    while (perShard * numShards < expectedEntries * 2) {
+      perShard *= 2;
+    }
+    for (Shard &shard : shards_) {
+      shard.slots.reset(new Slot[perShard]);
+      shard.mask = perShard - 1;
+      shard.highWater = perShard - perShard / 8;
+    }
+  }
+
+  /* the value for key, inserting the result of makeValue() when absent;
+   * makeValue runs at most once per key (the slot is claimed first, the
+   * value computed after) */
+  template <typename MakeValue>
+  Value getOrInsert(const void *key, MakeValue &&makeValue) {
+    const uint64_t h = mix(key);
+    Shard &shard = shards_[h & (numShards - 1)];
+    size_t idx = (h >> shardBits) & shard.mask;
+    while (true) {
+      Slot &slot = shard.slots[idx];
+      const void *existing = slot.key.load(std::memory_order_acquire);
+      if (existing == nullptr) {
+        if (shard.used.load(std::memory_order_relaxed) >= shard.highWater) {
+          // refusing the claim keeps 1/8 of the slots empty, so probe
+          // chains for spilled keys still terminate quickly
+          break;
+        }
+        if (slot.key.compare_exchange_strong(
+                existing, key, std::memory_order_acq_rel)) {
+          shard.used.fetch_add(1, std::memory_order_relaxed);
+          Value value = makeValue();
+          slot.value.store(value, std::memory_order_release);
+          return value;
+        }
+        // lost the claim; existing now holds the winner's key
+      }
+      if (existing == key) {
+        Value value;
+        while ((value = slot.value.load(std::memory_order_acquire)) ==
+               Value()) {
+          // the claimant is between its compare-exchange and its store
+        }
+        return value;
+      }
+      idx = (idx + 1) & shard.mask;
+    }
+    std::lock_guard<std::mutex> lock(shard.overflowMutex);
+    auto it = shard.overflow.find(key);
+    if (it != shard.overflow.end()) {
+      return it->second;
+    }
+    Value value = makeValue();
+    shard.overflow.emplace(key, value);
+    return value;
+  }
+
+  /* visit every published entry; not synchronized against concurrent
+   * inserts, meant for the single-threaded steady state after a
+   * parallel phase */
+  template <typename Fn>
+  void forEach(Fn &&fn) const {
+    for (const Shard &shard : shards_) {
+      for (size_t i = 0; i <= shard.mask; i++) {
+        const void *key = shard.slots[i].key.load(std::memory_order_acquire);
+        if (key != nullptr) {
+          Value value = shard.slots[i].value.load(std::memory_order_acquire);
+          if (!(value == Value())) {
+            fn(key, value);
+          }
+        }
+      }
+      for (const auto &entry : shard.overflow) {
+        fn(entry.first, entry.second);
+      }
+    }
+  }
+
+  /* drop every entry; not synchronized against concurrent inserts,
+   * meant for cache eviction between units when no lookups are in
+   * flight */
+  void clear() {
+    for (Shard &shard : shards_) {
+      for (size_t i = 0; i <= shard.mask; i++) {
+        shard.slots[i].value.store(Value(), std::memory_order_relaxed);
+        shard.slots[i].key.store(nullptr, std::memory_order_relaxed);
+      }
+      shard.used.store(0, std::memory_order_relaxed);
+      std::lock_guard<std::mutex> lock(shard.overflowMutex);
+      shard.overflow.clear();
+    }
+  }
+
+ private:
+  static const size_t numShards = 64;
+  static const size_t shardBits = 6;
+
+  struct Slot {
+    std::atomic<const void *> key{nullptr};
+    std::atomic<Value> value{Value()};
+  };
+
+  struct Shard {
+    std::unique_ptr<Slot[]> slots;
+    size_t mask = 0;
+    size_t highWater = 0;
+    std::atomic<size_t> used{0};
+    /* spill for claims refused at high occupancy; a correctly sized
+     * table never touches it */
+    std::mutex overflowMutex;
+    std::unordered_map<const void *, Value> overflow;
+  };
+
+  /* murmur-style finalizer: raw pointer bits are too regular
+   * (alignment, arena locality) to index the table directly */
+  static uint64_t mix(const void *key) {
+    uint64_t h = (uint64_t)(uintptr_t)key;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+  }
+
+  Shard shards_[numShards];
+};
+
+} // namespace ASTPluginLib
@@ -8,23 +8,222 @@
 #include <functional>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <stdlib.h>
+#include <string.h>
 #include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
 #include <unistd.h>
 #include <unordered_map>
+#include <unordered_set>
 
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
 #include <llvm/Support/Path.h>
+#include <llvm/Support/SHA1.h>
+#include <llvm/Support/StringSaver.h>
 
 #include "FileUtils.h"
+#include "MemfdOStream.h"
+#include "PackOStream.h"
 #include "SimplePluginASTAction.h"
 
 namespace ASTPluginLib {
 
+bool hasOutputTransport(const std::string &outputFile) {
+  return outputFile.compare(0, 3, "fd:") == 0 ||
+         outputFile.compare(0, 5, "unix:") == 0 ||
+         outputFile.compare(0, 5, "pack:") == 0 ||
+         outputFile.compare(0, 6, "memfd:") == 0;
+}
+
+std::unique_ptr<llvm::raw_ostream> openOutputTransport(
+    const std::string &outputFile,
+    const std::string &indexKey,
+    bool dropCache,
+    bool atomicAppend,
+    bool flushAppend,
+    bool durableAppend) {
+  if (outputFile.compare(0, 3, "fd:") == 0) {
+    errno = 0;
+    char *end = nullptr;
+    long fd = strtol(outputFile.c_str() + 3, &end, 10);
+    if (errno || *end != '\0' || fd < 0) {
+      std::cerr << "[!] Bad output descriptor in " << outputFile << "\n";
+      return nullptr;
+    }
+    return std::unique_ptr<llvm::raw_ostream>(
+        new llvm::raw_fd_ostream((int)fd, /*shouldClose=*/true));
+  }
+  if (outputFile.compare(0, 5, "unix:") == 0) {
+    const std::string path = outputFile.substr(5);
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+      std::cerr << "[!] Output socket path too long: " << path << "\n";
+      return nullptr;
+    }
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 ||
+        connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+      std::cerr << "[!] Failed to connect to output socket " << path << "\n";
+      if (fd >= 0) {
+        close(fd);
+      }
+      return nullptr;
+    }
+    return std::unique_ptr<llvm::raw_ostream>(
+        new llvm::raw_fd_ostream(fd, /*shouldClose=*/true));
+  }
+  if (outputFile.compare(0, 6, "memfd:") == 0) {
+    const std::string path = outputFile.substr(6);
+    if (path.empty() || indexKey.empty()) {
+      std::cerr << "[!] Bad memfd output " << outputFile << "\n";
+      return nullptr;
+    }
+    auto OS = std::make_unique<MemfdOStream>(path, indexKey);
+    if (!OS->isOpen()) {
+      return nullptr;
+    }
+    return OS;
+  }
+  if (outputFile.compare(0, 5, "pack:") == 0) {
+    const std::string dir = outputFile.substr(5);
+    if (dir.empty() || indexKey.empty()) {
+      std::cerr << "[!] Bad pack output " << outputFile << "\n";
+      return nullptr;
+    }
+    return std::unique_ptr<llvm::raw_ostream>(new PackOStream(
+        dir, indexKey, dropCache, atomicAppend, flushAppend, durableAppend));
+  }
+  return nullptr;
+}
+
+std::string captureStoreEntry(const std::string &storeDir,
+                              clang::CompilerInstance &CI,
+                              const std::string &inputPath) {
+  std::string key = captureStoreKey(CI, inputPath);
+  return key.empty() ? "" : storeDir + "/" + key;
+}
+
+std::string captureStoreKey(clang::CompilerInstance &CI,
+                            const std::string &inputPath) {
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buffer =
+      llvm::MemoryBuffer::getFile(inputPath);
+  if (!buffer) {
+    return "";
+  }
+  llvm::SHA1 hash;
+  hash.update((*buffer)->getBuffer());
+  // The cc1 command line covers flags, macros, include paths and the
+  // plugin arguments: two captures agreeing on it and on the main file
+  // content produce the same output. Headers are deliberately not read
+  // here - hashing them would cost what the store is meant to save.
+  llvm::BumpPtrAllocator allocator;
+  llvm::StringSaver saver(allocator);
+  llvm::SmallVector<const char *, 64> cc1;
+  CI.getInvocation().generateCC1CommandLine(
+      cc1, [&saver](const llvm::Twine &arg) { return saver.save(arg).data(); });
+  for (const char *arg : cc1) {
+    hash.update(arg);
+    hash.update(llvm::StringRef("\0", 1));
+  }
+  return llvm::toHex(hash.final(), /*LowerCase=*/true);
+}
+
+bool copyFromCaptureStore(const std::string &entry,
+                          const std::string &outputFile) {
+  if (!llvm::sys::fs::exists(entry)) {
+    return false;
+  }
+  // hardlink when possible, fall back on a copy across filesystems
+  llvm::sys::fs::remove(outputFile);
+  if (!llvm::sys::fs::create_hard_link(entry, outputFile)) {
+    return true;
+  }
+  return !llvm::sys::fs::copy_file(entry, outputFile);
+}
+
+void insertIntoCaptureStore(const std::string &entry,
+                            const std::string &outputFile) {
+  if (!llvm::sys::fs::exists(outputFile) || llvm::sys::fs::exists(entry)) {
+    // failed capture, or another process published the entry first
+    return;
+  }
+  if (llvm::sys::fs::create_hard_link(outputFile, entry)) {
+    llvm::sys::fs::copy_file(outputFile, entry);
+  }
+}
+
+void prefetchIncludeGraph(const std::string &path) {
+  // everything -- including reading the graph itself, which may sit on
+  // the same slow filesystem as the headers -- happens off-thread;
+  // detached, since advice that arrives after the parse is merely
+  // useless. The thread owns its copy of the path.
+  std::thread([path] {
+    auto buffer = llvm::MemoryBuffer::getFile(path);
+    if (!buffer) {
+      // first run of this input: no graph recorded yet
+      return;
+    }
+    llvm::StringRef rest = (*buffer)->getBuffer();
+    std::unordered_set<std::string> seen;
+    while (!rest.empty()) {
+      llvm::StringRef line;
+      std::tie(line, rest) = rest.split('\n');
+      llvm::StringRef includee = line.split('\t').second;
+      if (!includee.empty() && seen.insert(includee.str()).second) {
+        FileUtils::prefetchIntoPageCache(includee.str());
+      }
+    }
+  }).detach();
+}
+
 /**
  * The actual prefix to prepend to environment variables (but not for the
  * command line).
  */
-const std::string PluginASTOptionsBase::envPrefix = "CLANG_FRONTEND_PLUGIN__";
+static const char kEnvPrefix[] = "CLANG_FRONTEND_PLUGIN__";
+
+const std::string PluginASTOptionsBase::envPrefix = kEnvPrefix;
+
+extern "C" char **environ;
+
+static PluginASTOptionsBase::argmap_t buildPrefixedEnvironment(
+    const std::string &prefix) {
+  PluginASTOptionsBase::argmap_t result;
+  for (char **entry = environ; *entry != nullptr; entry++) {
+    std::string_view line(*entry);
+    if (line.compare(0, prefix.size(), prefix) != 0) {
+      continue;
+    }
+    line.remove_prefix(prefix.size());
+    size_t pos = line.find('=');
+    if (pos != std::string_view::npos) {
+      result.emplace(line.substr(0, pos), line.substr(pos + 1));
+    }
+  }
+  return result;
+}
+
+/**
+ * The envPrefix slice of the environment, snapshotted once at process
+ * start (before main, so no lock and no initialization guard sits on
+ * the option-loading path) and keyed without the prefix. The old path
+ * ran getenv(envPrefix + key) per known key per parse - one string
+ * concatenation, one scan of the whole environment and one glibc
+ * environment lock each - which the daemon repeated per request.
+ * Immutable thereafter: setenv after startup is not seen, which the
+ * daemon protocol already requires of its clients.
+ */
+static const PluginASTOptionsBase::argmap_t prefixedEnvironment =
+    buildPrefixedEnvironment(kEnvPrefix);
 
 PluginASTOptionsBase::argmap_t PluginASTOptionsBase::makeMap(
     const std::vector<std::string> &args) {
@@ -40,17 +239,59 @@ PluginASTOptionsBase::argmap_t PluginASTOptionsBase::makeMap(
   return map;
 }
 
+/**
+ * Every key the load helpers ever probed, present in a map or not;
+ * the keys are string literals, so views are enough. Shared by the
+ * whole process (concurrent parses in the batch tool included, hence
+ * the lock) and stable after the first parse of each options class,
+ * so steady-state registration is a lookup, not an insert.
+ */
+static std::unordered_set<std::string_view> &knownOptionKeys() {
+  static std::unordered_set<std::string_view> keys;
+  return keys;
+}
+
+static std::mutex &knownOptionKeysMutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+
+static void registerOptionKey(const char *key) {
+  std::lock_guard<std::mutex> guard(knownOptionKeysMutex());
+  knownOptionKeys().insert(key);
+}
+
+void PluginASTOptionsBase::registerToolOptionKey(const char *key) {
+  registerOptionKey(key);
+}
+
+bool PluginASTOptionsBase::checkUnknownKeys(const argmap_t &map) {
+  bool ok = true;
+  std::lock_guard<std::mutex> guard(knownOptionKeysMutex());
+  const std::unordered_set<std::string_view> &known = knownOptionKeys();
+  for (const auto &entry : map) {
+    if (known.find(entry.first) == known.end()) {
+      std::cerr << "[!] Unknown plugin option " << entry.first << "\n";
+      ok = false;
+    }
+  }
+  return ok;
+}
+
 bool PluginASTOptionsBase::loadString(const argmap_t &map,
                                       const char *key,
                                       std::string &val) {
+  registerOptionKey(key);
+  // both lookups go through transparent comparators, so a parse
+  // allocates nothing per known option
   auto I = map.find(key);
   if (I != map.end()) {
     val = I->second;
     return true;
   }
-  const char *s = getenv((envPrefix + key).c_str());
-  if (s != nullptr) {
-    val = s;
+  auto E = prefixedEnvironment.find(key);
+  if (E != prefixedEnvironment.end()) {
+    val = E->second;
     return true;
   }
   return false;
@@ -105,9 +346,29 @@ void PluginASTOptionsBase::loadValuesFromEnvAndMap(const argmap_t map) {
   bool needBasePath = false;
 
   loadBool(map, "ALLOW_SIBLINGS_TO_REPO_ROOT", allowSiblingsToRepoRoot);
+  loadString(map, "CAPTURE_STORE_DIR", captureStoreDir);
+  loadString(map, "CAPTURE_STORE_URI", captureStoreUri);
+  loadString(map, "INCLUDE_GRAPH_FILE", includeGraphFile);
+  loadString(map, "INCLUDE_PREFETCH_FILE", includePrefetchFile);
+  loadBool(map, "MACRO_TABLE", macroTable);
   loadBool(map, "KEEP_EXTERNAL_PATHS", keepExternalPaths);
   loadString(map, "MAKE_RELATIVE_TO", repoRoot);
   loadUnsignedInt(map, "MAX_STRING_SIZE", maxStringSize);
+  loadBool(map, "MMAP_OUTPUT", mmapOutput);
+  loadUnsignedInt(map, "MMAP_RESERVE_MB", mmapReserveMb);
+  loadBool(map, "KEEP_PARTIAL", keepPartial);
+  loadBool(map, "LAZY_OUTPUT", lazyOutput);
+  loadBool(map, "URING_OUTPUT", uringOutput);
+  loadBool(map, "TMPFILE_PUBLISH", tmpfilePublish);
+  loadBool(map, "DROP_OUTPUT_CACHE", dropOutputCache);
+  loadBool(map, "PACK_ATOMIC_APPEND", packAtomicAppend);
+  loadString(map, "OUTPUT_DURABILITY", outputDurability);
+  if (outputDurability != "none" && outputDurability != "flush" &&
+      outputDurability != "fdatasync") {
+    std::cerr << "[!] Unknown OUTPUT_DURABILITY " << outputDurability
+              << "; using none\n";
+    outputDurability = "none";
+  }
 
   // Possibly override the first argument given on the command line.
   loadString(map, "OUTPUT_FILE", outputFile);
@@ -124,53 +385,163 @@ void PluginASTOptionsBase::loadValuesFromEnvAndMap(const argmap_t map) {
       basePath = CurrentDir.str().str();
     }
   }
+
+  // compile the relative-path rules now that they are all known
+  pathRewriter = FileUtils::PathRewriter(
+      repoRoot, iSysRoot, keepExternalPaths, allowSiblingsToRepoRoot);
 }
 
 void PluginASTOptionsBase::setObjectFile(const std::string &path) {
   objectFile = path;
-  if (path != "" && outputFile.size() > 0 && outputFile[0] == '%') {
-    outputFile = path + outputFile.substr(1);
+  // Remember the pattern rather than substituting destructively: when a
+  // single invocation carries several inputs, this runs once per input
+  // on the same options object and each input must re-derive its own
+  // output file.
+  if (outputPattern.empty() && outputFile.size() > 0 && outputFile[0] == '%') {
+    outputPattern = outputFile;
+  }
+  if (path != "" && !outputPattern.empty()) {
+    outputFile = path + outputPattern.substr(1);
   }
 }
 
-/**
- * Expects an immutable string on the heap as an argument
- * (e.g. a path extracted from a node in the AST)
- * Do not pass pointers to stack variables to this function.
- * (e.g. a .str() call on a StringRef)
- */
-const std::string &PluginASTOptionsBase::normalizeSourcePath(
+std::string PluginASTOptionsBase::computeNormalizedPath(
     const char *path) const {
-  auto I = normalizationCache->find(path);
-  if (I != normalizationCache->end()) {
-    return I->second;
-  }
-  std::string &result = (*normalizationCache)[path];
   if (basePath == "") {
-    result = path;
-    return result;
+    return path;
   }
   std::string absPath = FileUtils::makeAbsolutePath(basePath, path);
   if (resolveSymlinks) {
-    // if realPath is a symlink, resolve it
-    char buf[2048];
-    int len = readlink(absPath.c_str(), buf, sizeof(buf) - 1);
-    if (len != -1) {
-      buf[len] = '\0';
-      absPath = buf;
-    }
+    absPath = FileUtils::resolvePathSymlinks(absPath);
   }
   // By convention, relative paths are only activated when repoRoot != "".
   if (repoRoot != "") {
-    result = FileUtils::makeRelativePath(repoRoot,
-                                         iSysRoot,
-                                         keepExternalPaths,
-                                         allowSiblingsToRepoRoot,
-                                         absPath);
-  } else {
-    result = absPath;
+    return pathRewriter.rewrite(absPath);
   }
-  return result;
+  return absPath;
+}
+
+namespace {
+struct PathCacheRegistry {
+  std::mutex mutex;
+  std::unordered_map<std::string, PathNormalizationCache *> caches;
+};
+
+PathCacheRegistry &pathCacheRegistry() {
+  // leaked on purpose: normalized paths handed out by reference must
+  // outlive every thread, including past static destruction
+  static auto *registry = new PathCacheRegistry();
+  return *registry;
+}
+} // namespace
+
+PathNormalizationCache &PathNormalizationCache::forConfiguration(
+    const std::string &fingerprint) {
+  PathCacheRegistry &registry = pathCacheRegistry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  PathNormalizationCache *&cache = registry.caches[fingerprint];
+  if (cache == nullptr) {
+    cache = new PathNormalizationCache();
+  }
+  return *cache;
+}
+
+const std::string &PathNormalizationCache::normalize(
+    const PluginASTOptionsBase &options, const char *path) {
+  // hits resolve lock-free; the slow path below runs once per distinct
+  // pointer (and pointers are owned per SourceManager, so two threads
+  // first-seeing the same one at once essentially never happens)
+  return *byPointer.getOrInsert(path, [&]() -> const std::string * {
+    std::string key(path);
+    Shard &strShard = contentShard(key);
+    {
+      std::lock_guard<std::mutex> lock(strShard.mutex);
+      auto I = strShard.byContent.find(key);
+      if (I != strShard.byContent.end()) {
+        return &I->second;
+      }
+      auto C = strShard.coldByContent.find(key);
+      if (C != strShard.coldByContent.end()) {
+        // used again since its segment went cold: promote the node back
+        // to the hot segment (the handle keeps the strings in place)
+        const size_t bytes = entryBytes(C->first, C->second);
+        strShard.coldBytes -= bytes;
+        strShard.hotBytes += bytes;
+        return &strShard.byContent.insert(strShard.coldByContent.extract(C))
+                    .position->second;
+      }
+    }
+    // run the expensive pipeline outside the lock; a racing thread may
+    // compute the same path, in which case the first insertion wins
+    std::string normalized = options.computeNormalizedPath(path);
+    std::lock_guard<std::mutex> lock(strShard.mutex);
+    auto R = strShard.byContent.emplace(std::move(key), std::move(normalized));
+    if (R.second) {
+      strShard.hotBytes += entryBytes(R.first->first, R.first->second);
+    }
+    return &R.first->second;
+  });
+}
+
+size_t PathNormalizationCache::retainedBytes() {
+  size_t total = 0;
+  for (Shard &shard : shards) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    total += shard.hotBytes + shard.coldBytes;
+  }
+  return total;
+}
+
+void PathNormalizationCache::evictColdSegment() {
+  byPointer.clear();
+  for (Shard &shard : shards) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.coldByContent.clear();
+    shard.coldByContent.swap(shard.byContent);
+    shard.coldBytes = shard.hotBytes;
+    shard.hotBytes = 0;
+  }
+}
+
+size_t PathNormalizationCache::trimAllToBudget(size_t budgetBytes) {
+  PathCacheRegistry &registry = pathCacheRegistry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  size_t total = 0;
+  for (auto &entry : registry.caches) {
+    total += entry.second->retainedBytes();
+  }
+  // first round drops the cold segments, second what was hot before
+  // them; past that the caches are empty
+  size_t retained = total;
+  for (int round = 0; round < 2 && retained > budgetBytes; round++) {
+    retained = 0;
+    for (auto &entry : registry.caches) {
+      entry.second->evictColdSegment();
+      retained += entry.second->retainedBytes();
+    }
+  }
+  return total;
+}
+
+/**
+ * Expects an immutable string on the heap as an argument
+ * (e.g. a path extracted from a node in the AST)
+ * Do not pass pointers to stack variables to this function.
+ * (e.g. a .str() call on a StringRef)
+ */
+const std::string &PluginASTOptionsBase::normalizeSourcePath(
+    const char *path) const {
+  if (normalizationCache == nullptr) {
+    // the configuration is frozen by the time paths get normalized;
+    // options objects agreeing on it share one cache
+    std::string fingerprint = basePath + '\n' + repoRoot + '\n' + iSysRoot +
+                              '\n' +
+                              (char)('0' + (int)allowSiblingsToRepoRoot) +
+                              (char)('0' + (int)keepExternalPaths) +
+                              (char)('0' + (int)resolveSymlinks);
+    normalizationCache = &PathNormalizationCache::forConfiguration(fingerprint);
+  }
+  return normalizationCache->normalize(*this, path);
 }
 
 const std::string &PluginASTOptionsBase::normalizeSourcePath(
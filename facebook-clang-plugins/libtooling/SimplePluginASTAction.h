@@ -8,10 +8,15 @@
 #pragma once
 
 #include <functional>
+#include <iostream>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <stdlib.h>
 #include <string>
+#include <string_view>
 #include <unordered_map>
+#include <unordered_set>
 
 #include <clang/AST/ASTConsumer.h>
 #include <clang/Frontend/CompilerInstance.h>
@@ -20,15 +25,33 @@
 #include <clang/Lex/Preprocessor.h>
 #include <clang/Tooling/Tooling.h>
 
+#include <llvm/Support/raw_ostream.h>
+
+#include "ArtifactStoreClient.h"
+#include "CaptureProbes.h"
 #include "FileUtils.h"
+#include "LazyOStream.h"
+#include "MmapOStream.h"
+#include "PackOStream.h"
+#include "ShardedPtrTable.h"
+#include "TmpfileOStream.h"
+#include "UringOStream.h"
 
 namespace ASTPluginLib {
 
+class PathNormalizationCache;
+
 struct PluginASTOptionsBase {
   // source file being parsed
   clang::FrontendInputFile inputFile;
   // output file for the plugin
   std::string outputFile;
+  /* (path, bytes) of reserved front blocks waiting to be patched in
+   * place once the outputs have their final names; filled by the
+   * exporter under LAYOUT_HEADER (see ASTExporter.h) and drained by
+   * ~SimplePluginASTActionBase, which runs after every rename and
+   * publication */
+  std::vector<std::pair<std::string, std::string>> pendingLayoutPatches;
   // object file produced by the usual frontend (possibly empty)
   std::string objectFile;
 
@@ -55,21 +78,147 @@ struct PluginASTOptionsBase {
   bool keepExternalPaths = false;
   /* Resolve symlinks to their real path. */
   bool resolveSymlinks = false;
+  /* The relative-path rules above (repoRoot, iSysRoot,
+   * allowSiblingsToRepoRoot, keepExternalPaths) compiled once by
+   * loadValuesFromEnvAndMap, so that rewriting a path allocates
+   * nothing beyond its result. */
+  FileUtils::PathRewriter pathRewriter;
+  /* Directory of finished outputs keyed by a digest of the main file
+   * content and the cc1 command line: on a hit the prior output is
+   * hardlinked (or copied) to outputFile and the parse is skipped
+   * entirely. Headers are not part of the key, so stale entries must be
+   * invalidated externally (e.g. from the include graph) or the
+   * directory cleared. Empty disables the store. */
+  std::string captureStoreDir;
+  /* URI ("tcp:host:port") of a remote artifact store sharing the same
+   * content-addressed keys, for fleets where capture and analysis run
+   * on different machines: outputs are published to the store after
+   * capture and the early-skip check consults it on a local miss, so
+   * identical captures dedupe across every worker instead of being
+   * rsynced around (see ArtifactStoreClient.h for the protocol).
+   * Composes with captureStoreDir as a local tier. Empty disables the
+   * remote store. */
+  std::string captureStoreUri;
+  /* Path of the include-graph file recorded by IncludeGraphHandler; a
+   * leading '%' is replaced by the output file, so "%.inc" lands next
+   * to the AST output. Empty disables recording. */
+  std::string includeGraphFile;
+  /* Path of an include graph recorded by a previous run of this input
+   * (same format and '%' convention as includeGraphFile). At TU start
+   * the includee files are prefetched into the page cache off-thread
+   * (posix_fadvise WILLNEED; see FileUtils::prefetchIntoPageCache), so
+   * cold header reads overlap preprocessing instead of stalling it one
+   * miss at a time -- on network-backed trees each miss costs
+   * milliseconds. Include sets drift between runs, but a miss or a
+   * stale entry only loses the overlap. Empty disables prefetching. */
+  std::string includePrefetchFile;
+  /* Record macro definitions seen by the preprocessor and emit macro
+   * expansion locations as references into an id->definition table
+   * instead of repeating the spelling file/line at every site (logging
+   * macros expand tens of thousands of times per TU). Lives here rather
+   * than in the exporter options because the preprocessor handler needs
+   * it; the serialized form is the exporter's business (see
+   * dumpMacroLoc in ASTExporter.h). */
+  bool macroTable = false;
   /* do not emit string literals larger than this size */
   unsigned long maxStringSize = 65535;
-
-  typedef std::unordered_map<std::string, std::string> argmap_t;
+  /* Write plain-file outputs through a memory mapping of the file
+   * (MmapOStream.h) instead of createOutputFile, saving a copy through
+   * stream buffers on multi-GB dumps at the cost of the
+   * temporary-plus-rename step: a killed capture leaves a partial file.
+   * Ignored for fd:/unix:/pack: transports. */
+  bool mmapOutput = false;
+  /* initial reservation for the mapping, in MiB; sparse, so only pages
+   * actually written consume memory or disk */
+  unsigned long mmapReserveMb = 1024;
+  /* Write plain-file outputs in place, skipping the temporary-plus-rename
+   * step and the removal on fatal signals. A capture killed mid-unit
+   * (OOM) then leaves everything serialized so far on disk instead of
+   * nothing; with FRAME_DECLS the salvageable prefix is the complete
+   * frames, and CHECKPOINT_EVERY marks how far it reaches (see
+   * ASTExporter.h). The price is that a present output no longer implies
+   * a finished capture: readers must check the checkpoint marker or the
+   * validation trailer before trusting one. */
+  bool keepPartial = false;
+  /* Create plain-file outputs only when the first byte is emitted; a
+   * capture that serializes nothing then costs no filesystem operations
+   * at all, and a missing output after a successful run means "empty"
+   * (see LazyOStream.h for the protocol). Writes in place like
+   * KEEP_PARTIAL; takes precedence over MMAP_OUTPUT and is ignored for
+   * fd:/unix:/pack: transports. */
+  bool lazyOutput = false;
+  /* Write plain-file outputs through a process-wide io_uring: the
+   * serializing thread submits full chunks and keeps going while a
+   * single reaper collects completions for every output in the process
+   * (see UringOStream.h). Built for the batch tool's worker pool, where
+   * synchronous write() serializes dozens of workers on the kernel.
+   * Writes in place like KEEP_PARTIAL; LAZY_OUTPUT takes precedence,
+   * and kernels without io_uring fall back to synchronous writes. */
+  bool uringOutput = false;
+  /* Publish plain-file outputs as an anonymous O_TMPFILE inode linked
+   * under the final name on completion (see TmpfileOStream.h): the
+   * same atomic appearance as the default temporary-plus-rename, minus
+   * the temp name, the signal-handler bookkeeping and the rename --
+   * each a metadata operation costing a round trip on network
+   * filesystems. Honors the action's UseTemporary template parameter
+   * (in-place writers above take precedence) and falls back to the
+   * default path where O_TMPFILE is unsupported. Linux-only. */
+  bool tmpfilePublish = false;
+  /* After a capture finishes, start writeback of its output and advise
+   * the kernel to drop the written pages from the page cache
+   * (posix_fadvise DONTNEED; see FileUtils::dropFromPageCache).
+   * Gigabytes of dump otherwise evict the header pages clang's
+   * FileManager re-reads on the next TU's parse. Applies to plain-file
+   * outputs and to pack segments; the descriptor transports hand their
+   * bytes to another process and are unaffected. */
+  bool dropOutputCache = false;
+
+  /* Reserve pack segment slices with an atomic fetch_add on a mapped
+   * segment header instead of taking the per-append flock (see
+   * PackOStream.h). For many concurrent writers publishing into the
+   * same pack directory -- the parallel batch runner in particular --
+   * where the serializing lock becomes the bottleneck. Ignored for the
+   * other transports. */
+  bool packAtomicAppend = false;
+
+  /* Durability of finished outputs: "none" (the default) hands the
+   * bytes to the kernel and lets its writeback schedule them -- dumps
+   * are reproducible artifacts, and the close-time flushing some
+   * filesystems impose stalls workers for seconds of durability nobody
+   * asked for; "flush" starts asynchronous writeback of the finished
+   * output without waiting on it; "fdatasync" waits until the data is
+   * on disk before the capture counts as published. Plain files sync
+   * under their final name; pack segments batch the fsync, syncing
+   * each distinct segment appended to by the invocation once at action
+   * teardown instead of once per TU. The descriptor transports hand
+   * their bytes to another process and are unaffected. */
+  std::string outputDurability = "none";
+
+  /* transparent comparator, so the load helpers look keys up by their
+   * string literals without materializing a std::string per probe */
+  typedef std::map<std::string, std::string, std::less<>> argmap_t;
 
   static argmap_t makeMap(const std::vector<std::string> &args);
 
  private:
-  /* cache for normalizeSourcePath */
-  std::unique_ptr<std::unordered_map<const char *, std::string>>
-      normalizationCache;
+  /* process-wide cache for normalizeSourcePath, shared by every options
+   * object with the same normalization configuration and resolved
+   * lazily on first use (once loadValuesFromEnvAndMap has run) */
+  mutable PathNormalizationCache *normalizationCache = nullptr;
+
+  /* the "%.bla" output pattern as given, kept so that setObjectFile can
+   * re-derive outputFile once per input when a single invocation
+   * carries several source files */
+  std::string outputPattern;
 
  protected:
   static const std::string envPrefix;
 
+  /* The load helpers consult the map first and a process-wide snapshot
+   * of the envPrefix environment second (taken once, so per-request
+   * reloads in the daemon never re-scan or re-concatenate; environment
+   * changes after the first parse are not seen). Each registers its key
+   * - probed keys are known keys - for checkUnknownKeys below. */
   static bool loadString(const argmap_t &map,
                          const char *key,
                          std::string &val);
@@ -83,21 +232,187 @@ struct PluginASTOptionsBase {
                               unsigned long &val);
 
  public:
-  PluginASTOptionsBase() {
-    normalizationCache.reset(
-        new std::unordered_map<const char *, std::string>());
-  };
+  PluginASTOptionsBase() {}
 
   void loadValuesFromEnvAndMap(const argmap_t map);
 
+  /* Strict validation, to be run after loadValuesFromEnvAndMap: false
+   * (with one "[!]" line per offender) when the map carries a key that
+   * no load call probed - a typo that would otherwise silently fall
+   * back to its default. */
+  static bool checkUnknownKeys(const argmap_t &map);
+
+  /* Mark a key as consumed by a driving tool (FORMAT and friends, see
+   * the daemon and the batch runner) so checkUnknownKeys does not flag
+   * it; the tools hand their whole argument list to the plugin options
+   * untouched. Must be a string literal (the key is kept by reference). */
+  static void registerToolOptionKey(const char *key);
+
   // This should be called after outputFile has been set, so as to finalize
   // the output file in case a pattern "%.bla" was given.
   void setObjectFile(const std::string &path);
 
   const std::string &normalizeSourcePath(const char *path) const;
   const std::string &normalizeSourcePath(llvm::StringRef path) const;
+
+  /* the normalization pipeline (absolute path, symlinks, path relative
+   * to the repo root) with no caching; normalizeSourcePath is the
+   * cached entry point */
+  std::string computeNormalizedPath(const char *path) const;
+};
+
+/* Process-wide path normalization cache. The daemon and the batch tool
+ * run many compiler instances per process, concurrently for the latter;
+ * a per-options cache keyed by pointer identity starts cold with every
+ * instance and misses when equal paths arrive from different buffers.
+ * Lookups are two-level: a pointer fast path for the SourceManager-owned
+ * strings that repeat within a TU, falling back to the path content, so
+ * the makeAbsolutePath/realpath/makeRelativePath pipeline runs once per
+ * distinct path per process. The pointer level is a lock-free
+ * insert-if-absent table (see ShardedPtrTable.h) since it is hit for
+ * every dumped source location; the content level stays behind sharded
+ * locks, it only sees each distinct spelling once. Long-lived daemons
+ * can bound the retained memory with trimAllToBudget, which evicts at
+ * segment granularity between units (see MEMORY_BUDGET_MB in
+ * ASTExporterDaemon.cpp). */
+class PathNormalizationCache {
+ public:
+  /* the cache for a given normalization configuration, created on first
+   * use and alive for the rest of the process */
+  static PathNormalizationCache &forConfiguration(
+      const std::string &fingerprint);
+
+  const std::string &normalize(const PluginASTOptionsBase &options,
+                               const char *path);
+
+  /* bytes retained by the content entries of both segments; the pointer
+   * fast path is fixed-size and not counted */
+  size_t retainedBytes();
+
+  /* Trim every configuration's cache when the total exceeds
+   * budgetBytes, dropping cold segments first (entries no unit touched
+   * since the previous trim), then what was hot. Returns the bytes that
+   * were retained before trimming, so callers can tell whether an
+   * eviction happened. Only call between translation units: normalized
+   * strings are handed out by reference and must stay alive while a
+   * unit is being dumped. */
+  static size_t trimAllToBudget(size_t budgetBytes);
+
+ private:
+  PathNormalizationCache() {}
+
+  static const size_t numShards = 16;
+
+  /* accounting charge per content entry: the two string headers plus
+   * node and bucket overhead, on top of the character bytes */
+  static const size_t entryOverhead = 2 * sizeof(std::string) + 32;
+
+  static size_t entryBytes(const std::string &key, const std::string &value) {
+    return key.size() + value.size() + entryOverhead;
+  }
+
+  struct Shard {
+    std::mutex mutex;
+    /* normalized paths keyed by content, in two segments: byContent
+     * holds entries inserted or looked up since the last eviction,
+     * coldByContent what was hot before it. A hit in the cold segment
+     * moves the node handle back (element addresses survive the move),
+     * so an eviction drops exactly the entries no unit touched for a
+     * full trim cycle -- LRU at segment granularity. Between evictions
+     * entries are never erased, so references stay valid without
+     * holding the shard lock */
+    std::unordered_map<std::string, std::string> byContent;
+    std::unordered_map<std::string, std::string> coldByContent;
+    size_t hotBytes = 0;
+    size_t coldBytes = 0;
+  };
+  Shard shards[numShards];
+
+  /* drop the cold segment, demote the hot one and reset the pointer
+   * fast path (its entries alias strings of both segments, and its keys
+   * belong to SourceManagers of finished units anyway) */
+  void evictColdSegment();
+
+  /* fast path: pointers already seen, aliasing entries of byContent;
+   * sized for the distinct path spellings of the largest observed
+   * captures */
+  ShardedPtrTable<const std::string *> byPointer{1 << 16};
+
+  Shard &contentShard(const std::string &path) {
+    return shards[std::hash<std::string>()(path) % numShards];
+  }
 };
 
+/* Output transports. A plain outputFile is materialized through
+ * CI.createOutputFile (temporary file plus rename); two prefixes stream
+ * the dump straight to the consuming process instead, with no temporary
+ * file, no rename and no filesystem round trip:
+ *    fd:N       write to the already-open descriptor N, inherited from
+ *               the process that spawned the compiler
+ *    unix:/path connect to the unix socket listening at /path
+ * The descriptor is closed when the dump is complete, signalling EOF to
+ * the reader.
+ * A third prefix trades per-unit files for a shared pack directory:
+ *    pack:/dir  append the dump to a large segment file under /dir and
+ *               record (source path -> segment, offset, length) in
+ *               /dir/pack.index; random access goes through
+ *               PackReader.h, and DECL_INDEX refines the index to decl
+ *               granularity (see PackOStream.h)
+ * A fourth hands the consumer the memory itself instead of copying the
+ * bytes to it:
+ *    memfd:/path write into a shared-memory segment and pass its
+ *                descriptor (with the index key as payload) over the
+ *                unix socket at /path; the consumer maps the segment
+ *                in place (see MemfdOStream.h for the handoff message)
+ */
+bool hasOutputTransport(const std::string &outputFile);
+
+/* Open the stream for a transport-prefixed outputFile; null on failure
+ * (which should fail the capture rather than fall back to a file).
+ * indexKey names the unit in a pack index - the normalized main source
+ * path - and is ignored by the descriptor transports. dropCache applies
+ * the DROP_OUTPUT_CACHE policy to pack segment appends, atomicAppend
+ * the PACK_ATOMIC_APPEND reservation protocol, and flushAppend /
+ * durableAppend the "flush" and "fdatasync" OUTPUT_DURABILITY policies
+ * (the latter by registering the segment for the batched sync at
+ * action teardown). */
+std::unique_ptr<llvm::raw_ostream> openOutputTransport(
+    const std::string &outputFile,
+    const std::string &indexKey,
+    bool dropCache = false,
+    bool atomicAppend = false,
+    bool flushAppend = false,
+    bool durableAppend = false);
+
+/* Content-addressed capture store (CAPTURE_STORE_DIR). Finished outputs
+ * are published into the store directory under a digest of the main
+ * file content and the cc1 command line; a later capture with the same
+ * key reuses the stored bytes instead of parsing again. */
+std::string captureStoreEntry(const std::string &storeDir,
+                              clang::CompilerInstance &CI,
+                              const std::string &inputPath);
+
+/* The bare digest, as used for remote artifact store keys
+ * (CAPTURE_STORE_URI); captureStoreEntry is this joined to storeDir. */
+std::string captureStoreKey(clang::CompilerInstance &CI,
+                            const std::string &inputPath);
+
+/* Satisfy outputFile from the store entry; false when absent. */
+bool copyFromCaptureStore(const std::string &entry,
+                          const std::string &outputFile);
+
+/* Publish a finished output under its entry (no-op when the capture
+ * failed or another process published the entry first). */
+void insertIntoCaptureStore(const std::string &entry,
+                            const std::string &outputFile);
+
+/* Read the include graph at path (includer<TAB>includee lines, as
+ * written by IncludeGraphHandler) and advise the kernel to read each
+ * distinct includee ahead, all on a detached thread so the caller never
+ * waits on it; a missing or unreadable graph (the first run) is a
+ * silent no-op. */
+void prefetchIncludeGraph(const std::string &path);
+
 struct EmptyPreprocessorHandlerData {};
 
 struct EmptyPreprocessorHandler : public clang::PPCallbacks {
@@ -107,6 +422,110 @@ struct EmptyPreprocessorHandler : public clang::PPCallbacks {
       std::shared_ptr<EmptyPreprocessorHandlerData> sharedData) {}
 };
 
+/* The include graph seen by the preprocessor, recorded as (includer,
+ * includee) edges of normalized paths in first-seen order. Edges from
+ * every input of the invocation accumulate here; firstEdgeOfInput marks
+ * where the current input's edges begin. */
+struct IncludeGraphData {
+  std::vector<std::pair<std::string, std::string>> edges;
+  /* dedup of repeated inclusions within the current input */
+  std::unordered_set<std::string> seenEdges;
+  size_t firstEdgeOfInput = 0;
+  /* macro definitions seen by the preprocessor (macroTable only), per
+   * normalized definition file: line of the #define -> macro name. The
+   * file key is the stable string handed out by normalizeSourcePath,
+   * and node-based maps keep the names referencable while definitions
+   * accumulate. */
+  std::map<const std::string *, std::map<unsigned, std::string>>
+      macroDefinitions;
+};
+
+/* Records every InclusionDirective into the sharedData side-channel and
+ * writes the graph of the current input as one "includer<TAB>includee"
+ * line per edge when preprocessing ends (INCLUDE_GRAPH_FILE; inert when
+ * unset). Knowing which headers a TU depends on makes incremental
+ * capture invalidation a graph walk instead of a rehash of every header
+ * of every TU. */
+class IncludeGraphHandler : public clang::PPCallbacks {
+  clang::SourceManager &SM;
+  std::shared_ptr<PluginASTOptionsBase> options;
+  std::shared_ptr<IncludeGraphData> sharedData;
+
+ public:
+  IncludeGraphHandler(clang::SourceManager &SM,
+                      std::shared_ptr<PluginASTOptionsBase> options,
+                      std::shared_ptr<IncludeGraphData> sharedData)
+      : SM(SM), options(options), sharedData(sharedData) {}
+
+  void InclusionDirective(clang::SourceLocation HashLoc,
+                          const clang::Token &IncludeTok,
+                          llvm::StringRef FileName,
+                          bool IsAngled,
+                          clang::CharSourceRange FilenameRange,
+                          const clang::FileEntry *File,
+                          llvm::StringRef SearchPath,
+                          llvm::StringRef RelativePath,
+                          const clang::Module *Imported,
+                          clang::SrcMgr::CharacteristicKind FileType) override {
+    if (options->includeGraphFile.empty() || File == nullptr) {
+      return;
+    }
+    clang::PresumedLoc PLoc = SM.getPresumedLoc(HashLoc);
+    if (PLoc.isInvalid()) {
+      return;
+    }
+    // both names live as long as the SourceManager, as
+    // normalizeSourcePath requires
+    const std::string &includer =
+        options->normalizeSourcePath(PLoc.getFilename());
+    const std::string &includee = options->normalizeSourcePath(File->getName());
+    if (sharedData->seenEdges.insert(includer + '\t' + includee).second) {
+      sharedData->edges.emplace_back(includer, includee);
+    }
+  }
+
+  void MacroDefined(const clang::Token &MacroNameTok,
+                    const clang::MacroDirective *MD) override {
+    if (!options->macroTable || MD == nullptr ||
+        MacroNameTok.getIdentifierInfo() == nullptr) {
+      return;
+    }
+    clang::PresumedLoc PLoc = SM.getPresumedLoc(MD->getLocation());
+    if (PLoc.isInvalid()) {
+      return;
+    }
+    const std::string &file = options->normalizeSourcePath(PLoc.getFilename());
+    // redefinitions on the same line overwrite, which is also what the
+    // expansion sites see
+    sharedData->macroDefinitions[&file][PLoc.getLine()] =
+        MacroNameTok.getIdentifierInfo()->getName().str();
+  }
+
+  void EndOfMainFile() override {
+    if (options->includeGraphFile.empty()) {
+      return;
+    }
+    std::string path = options->includeGraphFile;
+    if (path[0] == '%') {
+      path = options->outputFile + path.substr(1);
+    }
+    std::error_code EC;
+    llvm::raw_fd_ostream OS(path, EC);
+    if (EC) {
+      std::cerr << "[!] Failed to open include graph file " << path << "\n";
+      return;
+    }
+    const auto &edges = sharedData->edges;
+    for (size_t i = sharedData->firstEdgeOfInput; i < edges.size(); i++) {
+      OS << edges[i].first << '\t' << edges[i].second << '\n';
+    }
+    // later inputs of a batch get their own graph, re-listing edges
+    // they share with this one
+    sharedData->firstEdgeOfInput = edges.size();
+    sharedData->seenEdges.clear();
+  }
+};
+
 template <class PluginASTOptions = PluginASTOptionsBase,
           class PreprocessorHandler = EmptyPreprocessorHandler,
           class PreprocessorHandlerData = EmptyPreprocessorHandlerData>
@@ -115,7 +534,42 @@ class SimplePluginASTActionBase : public clang::PluginASTAction {
   std::shared_ptr<PluginASTOptions> options;
   std::shared_ptr<PreprocessorHandlerData> sharedData;
 
+  /* capture store bookkeeping: whether the current input was satisfied
+   * from the store, and (entry, output) pairs to publish once the
+   * outputs have their final names */
+  bool captureStoreHit = false;
+  std::vector<std::pair<std::string, std::string>> pendingStoreInserts;
+
+  /* (key, output) pairs to publish to the remote artifact store
+   * (CAPTURE_STORE_URI) once the outputs have their final names */
+  std::vector<std::pair<std::string, std::string>> pendingRemotePuts;
+
+  /* outputs to evict from the page cache once they have their final
+   * names (DROP_OUTPUT_CACHE) */
+  std::vector<std::string> pendingCacheDrops;
+
+  /* plain-file outputs awaiting the OUTPUT_DURABILITY policy once they
+   * have their final names; pack appends register their segments with
+   * PackOStream instead */
+  std::vector<std::string> pendingDurabilitySyncs;
+
   void ExecuteAction() override {
+    CAPTURE_PROBE(execute_action);
+    if (captureStoreHit) {
+      // the output was reused from the capture store: skip the parse
+      captureStoreHit = false;
+      return;
+    }
+    if (!options->includePrefetchFile.empty()) {
+      std::string path = options->includePrefetchFile;
+      if (path[0] == '%') {
+        path = options->outputFile + path.substr(1);
+      }
+      // overlap cold header I/O with preprocessing: by the time the
+      // preprocessor discovers an include, its pages are often already
+      // in flight from the previous run's graph
+      prefetchIncludeGraph(path);
+    }
     auto &preprocessor = getCompilerInstance().getPreprocessor();
     preprocessor.addPPCallbacks(std::make_unique<PreprocessorHandler>(
         preprocessor.getSourceManager(), options, sharedData));
@@ -130,8 +584,10 @@ class SimplePluginASTActionBase : public clang::PluginASTAction {
       options->outputFile = args[0];
       args.erase(args.begin());
     }
-    options->loadValuesFromEnvAndMap(PluginASTOptions::makeMap(args));
-    return true;
+    auto map = PluginASTOptions::makeMap(args);
+    options->loadValuesFromEnvAndMap(map);
+    // reject typo'd keys instead of silently running with defaults
+    return PluginASTOptions::checkUnknownKeys(map);
   }
 
   SimplePluginASTActionBase() {
@@ -147,14 +603,69 @@ class SimplePluginASTActionBase : public clang::PluginASTAction {
   // expected to be use with SimpleFrontendActionFactory below.
   explicit SimplePluginASTActionBase(const std::vector<std::string> &args)
       : SimplePluginASTActionBase() {
-    options->loadValuesFromEnvAndMap(PluginASTOptions::makeMap(args));
+    auto map = PluginASTOptions::makeMap(args);
+    options->loadValuesFromEnvAndMap(map);
+    // a constructor cannot abort the action, so only warn here
+    PluginASTOptions::checkUnknownKeys(map);
+  }
+
+ public:
+  ~SimplePluginASTActionBase() override {
+    // The action outlives EndSourceFile, where the outputs get their
+    // final names; this is the earliest point where finished captures
+    // can be published into the store.
+    // Header patches come first, so store inserts and remote puts below
+    // pick up files whose front block is already filled in.
+    for (const auto &patch : options->pendingLayoutPatches) {
+      FileUtils::patchFileHeader(patch.first, patch.second);
+    }
+    // Durability before publication, so a store hardlink or remote put
+    // below never points at bytes the kernel still owes the disk.
+    for (const std::string &path : pendingDurabilitySyncs) {
+      if (options->outputDurability == "fdatasync") {
+        FileUtils::syncFileData(path);
+      } else {
+        FileUtils::startFileWriteback(path);
+      }
+    }
+    if (options->outputDurability == "fdatasync") {
+      // one fdatasync per distinct segment the invocation appended to,
+      // not one per TU
+      PackOStream::syncAppendedSegments();
+    }
+    for (const auto &insert : pendingStoreInserts) {
+      insertIntoCaptureStore(insert.first, insert.second);
+    }
+    if (!pendingRemotePuts.empty()) {
+      ArtifactStoreClient client(options->captureStoreUri);
+      for (const auto &put : pendingRemotePuts) {
+        client.put(put.first, put.second);
+      }
+    }
+    for (const std::string &path : pendingCacheDrops) {
+      FileUtils::dropFromPageCache(path);
+    }
   }
 
+ protected:
+
   bool SetFileOptions(clang::CompilerInstance &CI,
                       llvm::StringRef inputFilename) {
-    // When running clang tool on more than one source file, CreateASTConsumer
-    // will be ran for each of them separately. Hence, Inputs.size() = 1.
-    clang::FrontendInputFile inputFile = CI.getFrontendOpts().Inputs[0];
+    // A single invocation may carry several source files (unity-build
+    // style batching): ExecuteAction runs once per input against this
+    // same action, so the parsed options, the path normalization cache
+    // and sharedData all carry over, and only the per-input fields below
+    // are refreshed. Locate the input this run is for instead of
+    // assuming Inputs[0].
+    const std::vector<clang::FrontendInputFile> &inputs =
+        CI.getFrontendOpts().Inputs;
+    clang::FrontendInputFile inputFile = inputs[0];
+    for (const clang::FrontendInputFile &input : inputs) {
+      if (input.getFile() == inputFilename) {
+        inputFile = input;
+        break;
+      }
+    }
 
     switch (inputFile.getKind().getLanguage()) {
     case clang::Language::Unknown:
@@ -168,7 +679,14 @@ class SimplePluginASTActionBase : public clang::PluginASTAction {
       break;
     }
     options->inputFile = inputFile;
-    options->setObjectFile(CI.getFrontendOpts().OutputFile);
+    if (inputs.size() > 1) {
+      // the object file (if any) is shared by the whole batch; derive
+      // "%.bla" outputs from the input path instead, so that each input
+      // gets its own output file
+      options->setObjectFile(inputFilename.str());
+    } else {
+      options->setObjectFile(CI.getFrontendOpts().OutputFile);
+    }
     // success
     return true;
   }
@@ -215,12 +733,106 @@ class SimplePluginASTAction
     if (!Parent::SetFileOptions(CI, inputFilename)) {
       return nullptr;
     }
-    std::unique_ptr<llvm::raw_ostream> OS =
-        CI.createOutputFile(Parent::options->outputFile,
-                            Binary,
-                            RemoveFileOnSignal,
-                            UseTemporary,
-                            CreateMissingDirectories);
+    // store hits are only meaningful for plain file outputs; transports
+    // stream and cannot be hardlinked
+    if ((!Parent::options->captureStoreDir.empty() ||
+         !Parent::options->captureStoreUri.empty()) &&
+        !hasOutputTransport(Parent::options->outputFile)) {
+      std::string key = captureStoreKey(CI, inputFilename.str());
+      std::string entry =
+          key.empty() || Parent::options->captureStoreDir.empty()
+              ? ""
+              : Parent::options->captureStoreDir + "/" + key;
+      if (!key.empty()) {
+        // local tier first (a hardlink), then the fleet-wide store; a
+        // remote hit also queues local publication below, so the next
+        // capture of this key on this machine stays off the network
+        bool hit =
+            !entry.empty() &&
+            copyFromCaptureStore(entry, Parent::options->outputFile);
+        if (!hit && !Parent::options->captureStoreUri.empty()) {
+          if (ArtifactStoreClient(Parent::options->captureStoreUri)
+                  .get(key, Parent::options->outputFile)) {
+            hit = true;
+          } else {
+            Parent::pendingRemotePuts.emplace_back(
+                key, Parent::options->outputFile);
+          }
+        }
+        if (!entry.empty()) {
+          Parent::pendingStoreInserts.emplace_back(
+              entry, Parent::options->outputFile);
+        }
+        if (hit) {
+          // prior identical capture reused; a placeholder consumer keeps
+          // BeginSourceFile happy while ExecuteAction skips the parse
+          Parent::captureStoreHit = true;
+          return std::make_unique<clang::ASTConsumer>();
+        }
+      }
+    }
+    std::unique_ptr<llvm::raw_ostream> OS;
+    if (hasOutputTransport(Parent::options->outputFile)) {
+      OS = openOutputTransport(
+          Parent::options->outputFile,
+          Parent::options->normalizeSourcePath(inputFilename),
+          Parent::options->dropOutputCache,
+          Parent::options->packAtomicAppend,
+          Parent::options->outputDurability == "flush",
+          Parent::options->outputDurability == "fdatasync");
+    } else {
+      if (Parent::options->dropOutputCache) {
+        Parent::pendingCacheDrops.push_back(Parent::options->outputFile);
+      }
+      if (Parent::options->outputDurability != "none") {
+        Parent::pendingDurabilitySyncs.push_back(Parent::options->outputFile);
+      }
+      if (Parent::options->lazyOutput) {
+        // deferred creation: nothing touches the filesystem until the
+        // consumer emits its first byte, and an empty dump leaves (and
+        // cleans up to) no file at all
+        OS = std::make_unique<LazyOStream>(Parent::options->outputFile);
+      }
+      if (!OS && Parent::options->uringOutput) {
+        auto UOS =
+            std::make_unique<UringOStream>(Parent::options->outputFile);
+        if (UOS->isOpen()) {
+          OS = std::move(UOS);
+        }
+        // creation failure falls through to the regular path
+      }
+      if (!OS && Parent::options->mmapOutput) {
+        auto MOS = std::make_unique<MmapOStream>(
+            Parent::options->outputFile,
+            (size_t)Parent::options->mmapReserveMb << 20);
+        if (MOS->isOpen()) {
+          OS = std::move(MOS);
+        }
+        // on failure (e.g. a filesystem that cannot mmap writes), fall
+        // through to the regular path
+      }
+      if (!OS && Parent::options->tmpfilePublish && UseTemporary &&
+          !Parent::options->keepPartial) {
+        // same atomicity contract as the branch below, delivered by an
+        // unnamed inode instead of a named temp file plus rename
+        auto TOS =
+            std::make_unique<TmpfileOStream>(Parent::options->outputFile);
+        if (TOS->isOpen()) {
+          OS = std::move(TOS);
+        }
+        // no O_TMPFILE support falls through to the portable path
+      }
+      if (!OS) {
+        // keepPartial trades the atomicity of temporary-plus-rename for
+        // salvageable bytes when the process dies mid-unit
+        OS = CI.createOutputFile(
+            Parent::options->outputFile,
+            Binary,
+            RemoveFileOnSignal && !Parent::options->keepPartial,
+            UseTemporary && !Parent::options->keepPartial,
+            CreateMissingDirectories);
+      }
+    }
     if (!OS) {
       return nullptr;
     }
@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/MathExtras.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Support/xxhash.h>
+
+namespace ASTLib {
+
+/**
+ * Per-unit Bloom filter over the symbols a translation unit defines
+ * (SYMBOL_BLOOM in ASTExporter.h). Cross-unit symbol resolution scans
+ * captured outputs to find where a mangled name is defined; probing a
+ * few hundred bytes of sidecar per unit rules out the vast majority of
+ * files without parsing any dump.
+ *
+ * Keys are XXH64 of the mangled_name string exactly as the dump emits
+ * it (the hashed decimal form for functions, the raw mangled selector
+ * for ObjC methods), so a consumer derives the probe key from any
+ * dump it has already read. Sized at ~10 bits per key with 7 probes,
+ * under 1% of probes pass by accident.
+ *
+ * Sidecar layout, little-endian: the 8 bytes "ASTBLM01", the key
+ * count, the bit count and the probe count as u64, then the bitmap.
+ */
+class SymbolBloom {
+  uint64_t count_ = 0;
+  uint64_t probes_ = 7;
+  std::vector<uint8_t> bits_;
+
+  static void writeLE64(llvm::raw_ostream &os, uint64_t v) {
+    for (int i = 0; i < 8; i++) {
+      os << (char)(v >> (8 * i));
+    }
+  }
+  static uint64_t readLE64(const unsigned char *p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) {
+      v |= (uint64_t)p[i] << (8 * i);
+    }
+    return v;
+  }
+
+  /* second hash for double hashing (murmur3 finalizer, forced odd so
+     it is coprime with the power-of-two size). It must not be a linear
+     function of the key, or the probes collapse onto each other and
+     the false-positive rate degrades by orders of magnitude */
+  static uint64_t probeStep(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return key | 1;
+  }
+
+ public:
+  SymbolBloom() {}
+
+  /* the probe key for a mangled_name string as emitted in a dump */
+  static uint64_t key(llvm::StringRef name) { return llvm::xxHash64(name); }
+
+  /* size for an expected number of keys; power-of-two bits keep the
+     probe a mask instead of a division */
+  explicit SymbolBloom(uint64_t expected) {
+    uint64_t m = llvm::PowerOf2Ceil(std::max<uint64_t>(64, expected * 10));
+    bits_.assign(m / 8, 0);
+  }
+
+  void insert(uint64_t key) {
+    // double hashing: probe i flips bit key + i * step
+    uint64_t mask = bits_.size() * 8 - 1;
+    uint64_t step = probeStep(key);
+    for (uint64_t i = 0; i < probes_; i++) {
+      uint64_t bit = (key + i * step) & mask;
+      bits_[bit >> 3] |= (uint8_t)(1u << (bit & 7));
+    }
+    count_++;
+  }
+
+  bool mayContain(uint64_t key) const {
+    if (bits_.empty()) {
+      return false;
+    }
+    uint64_t mask = bits_.size() * 8 - 1;
+    uint64_t step = probeStep(key);
+    for (uint64_t i = 0; i < probes_; i++) {
+      uint64_t bit = (key + i * step) & mask;
+      if (!(bits_[bit >> 3] & (1u << (bit & 7)))) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  uint64_t size() const { return count_; }
+
+  void write(llvm::raw_ostream &os) const {
+    os << "ASTBLM01";
+    writeLE64(os, count_);
+    writeLE64(os, bits_.size() * 8);
+    writeLE64(os, probes_);
+    os.write((const char *)bits_.data(), bits_.size());
+  }
+
+  static bool read(llvm::StringRef data, SymbolBloom &out) {
+    if (data.size() < 32 || !data.startswith("ASTBLM01")) {
+      return false;
+    }
+    const unsigned char *p = (const unsigned char *)data.data() + 8;
+    out.count_ = readLE64(p);
+    uint64_t m = readLE64(p + 8);
+    out.probes_ = readLE64(p + 16);
+    if (m < 8 || !llvm::isPowerOf2_64(m) || out.probes_ == 0 ||
+        data.size() != 32 + m / 8) {
+      return false;
+    }
+    out.bits_.assign((const uint8_t *)data.data() + 32,
+                     (const uint8_t *)data.data() + 32 + m / 8);
+    return true;
+  }
+};
+
+} // namespace ASTLib
@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "TmpfileOStream.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <iostream>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace ASTPluginLib {
+
+TmpfileOStream::TmpfileOStream(const std::string &path) : path_(path) {
+#ifdef O_TMPFILE
+  // the inode must live on the filesystem that will hold the final
+  // name, so the anonymous file is opened in the output's directory
+  size_t slash = path.rfind('/');
+  std::string dir = slash == std::string::npos ? "." : path.substr(0, slash);
+  fd_ = ::open(dir.c_str(), O_TMPFILE | O_WRONLY | O_CLOEXEC, 0644);
+  // failure (old kernel, filesystem without O_TMPFILE support) is
+  // expected on some hosts; the caller falls back to temporary-plus-
+  // rename, so stay quiet
+#endif
+}
+
+TmpfileOStream::~TmpfileOStream() {
+  flush();
+  if (fd_ < 0) {
+    return;
+  }
+  // linkat refuses to replace; drop a stale output first. A crash here
+  // loses the stale file, never exposes a partial one.
+  ::unlink(path_.c_str());
+  char proc[64];
+  snprintf(proc, sizeof(proc), "/proc/self/fd/%d", fd_);
+  if (::linkat(AT_FDCWD, proc, AT_FDCWD, path_.c_str(), AT_SYMLINK_FOLLOW) !=
+      0) {
+    std::cerr << "[!] could not publish output file " << path_ << "\n";
+  }
+  ::close(fd_);
+}
+
+void TmpfileOStream::write_impl(const char *ptr, size_t size) {
+  pos_ += size;
+  if (fd_ < 0) {
+    return;
+  }
+  while (size > 0) {
+    ssize_t written = ::write(fd_, ptr, size);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      std::cerr << "[!] could not write output file " << path_ << "\n";
+      ::close(fd_);
+      fd_ = -1;
+      return;
+    }
+    ptr += written;
+    size -= written;
+  }
+}
+
+} // namespace ASTPluginLib
@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <string>
+
+#include <llvm/Support/raw_ostream.h>
+
+namespace ASTPluginLib {
+
+/**
+ * A raw_ostream writing an anonymous O_TMPFILE inode in the output
+ * file's directory and publishing it under its final name with linkat
+ * on destruction. The output appears atomically, like the
+ * temporary-plus-rename of CI.createOutputFile, but with no temporary
+ * name to invent, no signal-handler cleanup bookkeeping (an unpublished
+ * inode vanishes with the process, crash or not), and no rename -- one
+ * less metadata round trip per output on network filesystems.
+ *
+ * Linux-only: construction fails (isOpen() returns false) where
+ * O_TMPFILE is unsupported by the kernel or the filesystem, and callers
+ * fall back to the portable path. linkat cannot replace an existing
+ * name, so a stale output is unlinked just before publication; a crash
+ * in that window loses the stale file, never a partial one.
+ */
+class TmpfileOStream : public llvm::raw_ostream {
+  int fd_ = -1;
+  std::string path_;
+  uint64_t pos_ = 0;
+
+  void write_impl(const char *ptr, size_t size) override;
+  uint64_t current_pos() const override { return pos_; }
+
+ public:
+  explicit TmpfileOStream(const std::string &path);
+  ~TmpfileOStream() override;
+
+  bool isOpen() const { return fd_ >= 0; }
+};
+
+} // namespace ASTPluginLib
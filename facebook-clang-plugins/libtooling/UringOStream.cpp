@@ -0,0 +1,318 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "UringOStream.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#define AST_EXPORTER_HAVE_IO_URING 1
+#endif
+
+namespace ASTPluginLib {
+
+namespace {
+
+// submitted chunks stay well below the ring depth of a full capture
+// worker pool, and a chunk is large enough that submission overhead is
+// noise next to the write itself
+const size_t chunkSize = 1 << 20;
+
+struct StreamState;
+
+// one in-flight write; owns its bytes until the completion is reaped
+struct Pending {
+  StreamState *owner;
+  std::vector<char> buffer;
+  struct iovec iov;
+};
+
+// the per-stream side of completion accounting, kept apart from
+// UringOStream::Impl members the reaper must not touch
+struct StreamState {
+  std::mutex mutex;
+  std::condition_variable drained;
+  size_t inFlight = 0;
+  // set by the reaper, read by the serializing thread without the lock
+  std::atomic<bool> failed{false};
+
+  void completed(bool ok) {
+    std::lock_guard<std::mutex> guard(mutex);
+    if (!ok) {
+      failed = true;
+    }
+    if (--inFlight == 0) {
+      drained.notify_all();
+    }
+  }
+
+  void waitDrained() {
+    std::unique_lock<std::mutex> guard(mutex);
+    drained.wait(guard, [this] { return inFlight == 0; });
+  }
+};
+
+#ifdef AST_EXPORTER_HAVE_IO_URING
+
+/**
+ * The process-wide ring. All streams share one submission queue
+ * (submissions take a short lock) and one reaper thread; the kernel
+ * overlaps the writes across every output file of the worker pool.
+ * Set up lazily on the first stream; when the running kernel has no
+ * io_uring the instance stays null and streams write synchronously.
+ */
+class Ring {
+  static const unsigned entries = 256;
+
+  int fd_ = -1;
+  // submission side, guarded by mutex_
+  std::mutex mutex_;
+  unsigned *sqHead_ = nullptr;
+  unsigned *sqTail_ = nullptr;
+  unsigned sqMask_ = 0;
+  unsigned *sqArray_ = nullptr;
+  struct io_uring_sqe *sqes_ = nullptr;
+  // completion side, owned by the reaper thread
+  unsigned *cqHead_ = nullptr;
+  unsigned *cqTail_ = nullptr;
+  unsigned cqMask_ = 0;
+  struct io_uring_cqe *cqes_ = nullptr;
+
+  bool setup() {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    fd_ = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (fd_ < 0) {
+      return false;
+    }
+    size_t sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    void *sq = mmap(nullptr,
+                    sqSize,
+                    PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE,
+                    fd_,
+                    IORING_OFF_SQ_RING);
+    size_t cqSize =
+        params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    void *cq = mmap(nullptr,
+                    cqSize,
+                    PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE,
+                    fd_,
+                    IORING_OFF_CQ_RING);
+    void *sqes = mmap(nullptr,
+                      params.sq_entries * sizeof(struct io_uring_sqe),
+                      PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE,
+                      fd_,
+                      IORING_OFF_SQES);
+    if (sq == MAP_FAILED || cq == MAP_FAILED || sqes == MAP_FAILED) {
+      close(fd_);
+      fd_ = -1;
+      return false;
+    }
+    char *sqRing = (char *)sq;
+    sqHead_ = (unsigned *)(sqRing + params.sq_off.head);
+    sqTail_ = (unsigned *)(sqRing + params.sq_off.tail);
+    sqMask_ = *(unsigned *)(sqRing + params.sq_off.ring_mask);
+    sqArray_ = (unsigned *)(sqRing + params.sq_off.array);
+    sqes_ = (struct io_uring_sqe *)sqes;
+    char *cqRing = (char *)cq;
+    cqHead_ = (unsigned *)(cqRing + params.cq_off.head);
+    cqTail_ = (unsigned *)(cqRing + params.cq_off.tail);
+    cqMask_ = *(unsigned *)(cqRing + params.cq_off.ring_mask);
+    cqes_ = (struct io_uring_cqe *)(cqRing + params.cq_off.cqes);
+    // reap forever; the thread spends its life blocked in the kernel
+    std::thread([this] { reaperLoop(); }).detach();
+    return true;
+  }
+
+  void reaperLoop() {
+    for (;;) {
+      syscall(__NR_io_uring_enter, fd_, 0, 1, IORING_ENTER_GETEVENTS, nullptr);
+      unsigned head = __atomic_load_n(cqHead_, __ATOMIC_ACQUIRE);
+      unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+      while (head != tail) {
+        struct io_uring_cqe *cqe = &cqes_[head & cqMask_];
+        Pending *pending = (Pending *)(uintptr_t)cqe->user_data;
+        bool ok = cqe->res >= 0 && (size_t)cqe->res == pending->iov.iov_len;
+        if (!ok) {
+          std::cerr << "[!] io_uring write failed (res " << cqe->res << ")\n";
+        }
+        pending->owner->completed(ok);
+        delete pending;
+        head++;
+      }
+      __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+    }
+  }
+
+ public:
+  static Ring *instance() {
+    static Ring *ring = [] {
+      Ring *r = new Ring();
+      if (!r->setup()) {
+        delete r;
+        r = nullptr;
+      }
+      return r;
+    }();
+    return ring;
+  }
+
+  // queue one write; ownership of pending passes to the reaper. False
+  // means the ring had no room, and the caller should write
+  // synchronously instead of blocking the serializer.
+  bool submitWrite(int fd, Pending *pending, uint64_t offset) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    unsigned head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+    unsigned tail = *sqTail_;
+    if (tail - head >= entries) {
+      return false;
+    }
+    unsigned index = tail & sqMask_;
+    struct io_uring_sqe *sqe = &sqes_[index];
+    memset(sqe, 0, sizeof(*sqe));
+    // WRITEV rather than WRITE: supported by every io_uring kernel
+    sqe->opcode = IORING_OP_WRITEV;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)&pending->iov;
+    sqe->len = 1;
+    sqe->off = offset;
+    sqe->user_data = (uint64_t)(uintptr_t)pending;
+    sqArray_[index] = index;
+    __atomic_store_n(sqTail_, tail + 1, __ATOMIC_RELEASE);
+    // the sqe is queued at this point, so the write belongs to the
+    // kernel whatever enter returns; retry the transient errnos and
+    // report anything else once
+    while (syscall(__NR_io_uring_enter, fd_, 1, 0, 0, nullptr) < 0) {
+      if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+        std::cerr << "[!] io_uring_enter failed: " << strerror(errno) << "\n";
+        break;
+      }
+    }
+    return true;
+  }
+};
+
+#endif // AST_EXPORTER_HAVE_IO_URING
+
+} // namespace
+
+struct UringOStream::Impl {
+  int fd = -1;
+  // where the next chunk lands; completions may arrive out of order
+  uint64_t offset = 0;
+  std::vector<char> chunk;
+  StreamState state;
+  bool useRing = false;
+
+  void writeSync(const char *data, size_t size) {
+    while (size > 0) {
+      ssize_t written = ::write(fd, data, size);
+      if (written <= 0) {
+        std::cerr << "[!] Failed to write output: " << strerror(errno)
+                  << "\n";
+        state.failed = true;
+        return;
+      }
+      data += written;
+      size -= (size_t)written;
+    }
+  }
+
+  void submitChunk() {
+    if (chunk.empty()) {
+      return;
+    }
+#ifdef AST_EXPORTER_HAVE_IO_URING
+    if (useRing) {
+      Pending *pending = new Pending();
+      pending->owner = &state;
+      pending->buffer = std::move(chunk);
+      pending->iov.iov_base = pending->buffer.data();
+      pending->iov.iov_len = pending->buffer.size();
+      {
+        std::lock_guard<std::mutex> guard(state.mutex);
+        state.inFlight++;
+      }
+      if (Ring::instance()->submitWrite(fd, pending, offset)) {
+        offset += pending->iov.iov_len;
+        chunk.reserve(chunkSize);
+        return;
+      }
+      // ring full: back out and fall through to the synchronous path
+      chunk = std::move(pending->buffer);
+      delete pending;
+      {
+        std::lock_guard<std::mutex> guard(state.mutex);
+        state.inFlight--;
+      }
+    }
+#endif
+    writeSync(chunk.data(), chunk.size());
+    offset += chunk.size();
+    chunk.clear();
+  }
+};
+
+UringOStream::UringOStream(const std::string &path) : impl_(new Impl()) {
+  impl_->fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (impl_->fd < 0) {
+    std::cerr << "[!] Failed to create output file " << path << ": "
+              << strerror(errno) << "\n";
+    return;
+  }
+  impl_->chunk.reserve(chunkSize);
+#ifdef AST_EXPORTER_HAVE_IO_URING
+  impl_->useRing = Ring::instance() != nullptr;
+#endif
+}
+
+UringOStream::~UringOStream() {
+  flush();
+  if (impl_->fd >= 0) {
+    impl_->submitChunk();
+    impl_->state.waitDrained();
+    ::close(impl_->fd);
+  }
+}
+
+bool UringOStream::isOpen() const { return impl_->fd >= 0; }
+
+void UringOStream::write_impl(const char *ptr, size_t size) {
+  pos_ += size;
+  if (impl_->fd < 0 || impl_->state.failed) {
+    return;
+  }
+  while (size > 0) {
+    size_t room = chunkSize - impl_->chunk.size();
+    size_t take = size < room ? size : room;
+    impl_->chunk.insert(impl_->chunk.end(), ptr, ptr + take);
+    ptr += take;
+    size -= take;
+    if (impl_->chunk.size() == chunkSize) {
+      impl_->submitChunk();
+    }
+  }
+}
+
+} // namespace ASTPluginLib
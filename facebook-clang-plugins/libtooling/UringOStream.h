@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include <llvm/Support/raw_ostream.h>
+
+namespace ASTPluginLib {
+
+/**
+ * A raw_ostream that writes through a process-wide io_uring
+ * (URING_OUTPUT in SimplePluginASTAction.h). The serializing thread
+ * appends into a chunk; full chunks are submitted to the ring and the
+ * thread continues immediately, while a single reaper thread collects
+ * completions for every stream in the process. With the batch tool's
+ * worker pool this replaces dozens of threads serializing on
+ * synchronous write() with one submission queue the kernel drains at
+ * device speed.
+ *
+ * Writes land in place at their own file offsets (ordering between
+ * chunks does not matter), so like KEEP_PARTIAL there is no
+ * temporary-plus-rename step and a capture killed mid-unit leaves a
+ * partial file. On kernels without io_uring, or when the headers were
+ * not available at build time, chunks fall back to synchronous write()
+ * on the same code path; output is identical either way.
+ */
+class UringOStream : public llvm::raw_ostream {
+ public:
+  struct Impl;
+
+ private:
+  std::unique_ptr<Impl> impl_;
+  uint64_t pos_ = 0;
+
+  void write_impl(const char *ptr, size_t size) override;
+  uint64_t current_pos() const override { return pos_; }
+
+ public:
+  explicit UringOStream(const std::string &path);
+  /* submits the tail chunk and blocks until every in-flight write of
+   * this stream has completed */
+  ~UringOStream() override;
+
+  bool isOpen() const;
+};
+
+} // namespace ASTPluginLib
@@ -0,0 +1,586 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <assert.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Reader side of the biniou output of ATDWriter.h, for the C++
+// post-capture tools (merging, indexing, deduplication) and for
+// round-trip benchmarks of the emitters. A document is navigated
+// through value-sized cursors into the encoded bytes: nothing is
+// decoded until asked for and no tree is ever materialized, so walking
+// an mmapped multi-GB capture touches only the pages the walk visits.
+//
+// The reader trusts its input the way the rest of atdlib trusts its
+// callers: documents come from BiniouEmitter (or another conforming
+// biniou writer), and malformed bytes are a programming error caught by
+// assertions in DEBUG builds, not a recoverable condition. Tools
+// reading files of unknown provenance should checksum them first (the
+// capture pipeline provides a validation trailer for exactly that).
+namespace ATDReader {
+
+// the biniou value tags, as in ATDWriter.h
+const uint8_t bool_tag = 0;
+const uint8_t int8_tag = 1;
+const uint8_t int16_tag = 2;
+const uint8_t int32_tag = 3;
+const uint8_t int64_tag = 4;
+const uint8_t float64_tag = 12;
+const uint8_t uvint_tag = 16;
+const uint8_t svint_tag = 17;
+const uint8_t string_tag = 18;
+const uint8_t ARRAY_tag = 19;
+const uint8_t TUPLE_tag = 20;
+const uint8_t RECORD_tag = 21;
+const uint8_t NUM_VARIANT_tag = 22;
+const uint8_t VARIANT_tag = 23;
+const uint8_t unit_tag = 24;
+const uint8_t TABLE_tag = 25;
+const uint8_t SHARED_tag = 26;
+
+// string hash algorithm from the biniou spec (BiniouEmitter computes
+// the same for field and variant names); consumers hash the names they
+// look for once and match fields by hash
+inline uint32_t fieldHash(std::string_view str) {
+  uint32_t hash = 0;
+  for (const char &c : str) {
+    hash = 223 * hash + c;
+  }
+  hash %= 1 << 31;
+  return hash;
+}
+
+class BiniouArrayCursor;
+class BiniouTupleCursor;
+class BiniouRecordCursor;
+class BiniouTableCursor;
+
+// One biniou value inside an encoded document: the document bytes, the
+// value's tag and the position of its payload. Copying is three words;
+// every navigation method hands out more of these.
+class BiniouValue {
+  const uint8_t *doc_;
+  size_t docSize_;
+  uint8_t tag_;
+  // position of the payload (one past the tag byte for self-tagged
+  // values; array elements and table cells take their tag from the
+  // enclosing container and start straight at the payload)
+  size_t payload_;
+
+  friend class BiniouArrayCursor;
+  friend class BiniouTupleCursor;
+  friend class BiniouRecordCursor;
+  friend class BiniouTableCursor;
+  friend class BiniouRowCursor;
+
+  uint8_t byteAt(size_t pos) const {
+    assert(pos < docSize_);
+    return doc_[pos];
+  }
+
+  uint64_t readUvint(size_t &pos) const {
+    uint64_t result = 0;
+    int shift = 0;
+    uint8_t byte;
+    do {
+      byte = byteAt(pos++);
+      result |= (uint64_t)(byte & 127) << shift;
+      shift += 7;
+    } while (byte & 128);
+    return result;
+  }
+
+  // big-endian fixed-width integer, as write32 and friends produce
+  uint64_t readFixed(size_t pos, int numBytes) const {
+    uint64_t result = 0;
+    for (int i = 0; i < numBytes; i++) {
+      result = (result << 8) | byteAt(pos + i);
+    }
+    return result;
+  }
+
+  // position one past the payload of the given tag starting at pos;
+  // recursion depth is the nesting depth of the document, which the
+  // writer's own container stack already bounded
+  size_t skipPayload(uint8_t tag, size_t pos) const {
+    switch (tag) {
+    case bool_tag:
+    case int8_tag:
+    case unit_tag:
+      return pos + 1;
+    case int16_tag:
+      return pos + 2;
+    case int32_tag:
+      return pos + 4;
+    case int64_tag:
+    case float64_tag:
+      return pos + 8;
+    case uvint_tag:
+    case svint_tag:
+      readUvint(pos);
+      return pos;
+    case string_tag: {
+      uint64_t size = readUvint(pos);
+      return pos + size;
+    }
+    case ARRAY_tag: {
+      uint64_t count = readUvint(pos);
+      if (count > 0) {
+        uint8_t elemTag = byteAt(pos++);
+        for (uint64_t i = 0; i < count; i++) {
+          pos = skipPayload(elemTag, pos);
+        }
+      }
+      return pos;
+    }
+    case TUPLE_tag: {
+      uint64_t count = readUvint(pos);
+      for (uint64_t i = 0; i < count; i++) {
+        pos = skipValue(pos);
+      }
+      return pos;
+    }
+    case RECORD_tag: {
+      uint64_t count = readUvint(pos);
+      for (uint64_t i = 0; i < count; i++) {
+        pos = skipValue(pos + 4); // field hash word, then tagged value
+      }
+      return pos;
+    }
+    case NUM_VARIANT_tag: {
+      // the index in the low 7 bits of one byte, the top bit set when
+      // the variant has an argument (emitted under BINIOU_NUM_VARIANTS)
+      uint8_t byte = byteAt(pos++);
+      if (byte & 0x80) {
+        pos = skipValue(pos);
+      }
+      return pos;
+    }
+    case VARIANT_tag: {
+      uint32_t word = (uint32_t)readFixed(pos, 4);
+      pos += 4;
+      if (word & (1u << 31)) {
+        pos = skipValue(pos);
+      }
+      return pos;
+    }
+    case TABLE_tag: {
+      uint64_t numRows = readUvint(pos);
+      if (numRows > 0) {
+        uint64_t numColumns = readUvint(pos);
+        size_t headerPos = pos;
+        pos += numColumns * 5; // field hash word and value tag per column
+        for (uint64_t row = 0; row < numRows; row++) {
+          for (uint64_t col = 0; col < numColumns; col++) {
+            pos = skipPayload(byteAt(headerPos + col * 5 + 4), pos);
+          }
+        }
+      }
+      return pos;
+    }
+    case SHARED_tag: {
+      uint64_t offset = readUvint(pos);
+      if (offset == 0) {
+        // first occurrence: the shared value follows, tagged
+        pos = skipValue(pos);
+      }
+      // back reference: the offset varint was the whole payload
+      return pos;
+    }
+    default:
+      // the remaining spec tags are never produced by BiniouEmitter
+      assert(false && "unsupported biniou tag");
+      return docSize_;
+    }
+  }
+
+  // position one past the tagged value starting at pos
+  size_t skipValue(size_t pos) const {
+    uint8_t tag = byteAt(pos++);
+    return skipPayload(tag, pos);
+  }
+
+ public:
+  // an empty unit value, for out-parameters of the cursor next() calls
+  BiniouValue() : doc_(nullptr), docSize_(0), tag_(unit_tag), payload_(0) {}
+
+  BiniouValue(const uint8_t *doc, size_t docSize, uint8_t tag, size_t payload)
+      : doc_(doc), docSize_(docSize), tag_(tag), payload_(payload) {}
+
+  // the document root: one tagged value spanning the whole buffer
+  BiniouValue(const char *data, size_t size)
+      : doc_((const uint8_t *)data), docSize_(size), payload_(1) {
+    assert(size > 0);
+    tag_ = doc_[0];
+  }
+
+  uint8_t tag() const { return tag_; }
+
+  // position one past this value's bytes, i.e. where a sibling starts
+  size_t end() const { return skipPayload(tag_, payload_); }
+
+  bool booleanValue() const {
+    assert(tag_ == bool_tag);
+    return byteAt(payload_) != 0;
+  }
+
+  // any of the integer representations, sign-extended where signed
+  int64_t integerValue() const {
+    size_t pos = payload_;
+    switch (tag_) {
+    case int8_tag:
+      return (int8_t)byteAt(pos);
+    case int16_tag:
+      return (int16_t)readFixed(pos, 2);
+    case int32_tag:
+      return (int32_t)readFixed(pos, 4);
+    case int64_tag:
+      return (int64_t)readFixed(pos, 8);
+    case uvint_tag:
+      return (int64_t)readUvint(pos);
+    case svint_tag: {
+      // positive x encodes as 2x, negative as 2|x|-1 (see writeSvint)
+      uint64_t raw = readUvint(pos);
+      return (raw & 1) ? -(int64_t)((raw + 1) >> 1) : (int64_t)(raw >> 1);
+    }
+    default:
+      assert(false && "not an integer value");
+      return 0;
+    }
+  }
+
+  // a view of the string bytes in place; valid as long as the document
+  std::string_view stringValue() const {
+    assert(tag_ == string_tag);
+    size_t pos = payload_;
+    uint64_t size = readUvint(pos);
+    assert(pos + size <= docSize_);
+    return std::string_view((const char *)doc_ + pos, size);
+  }
+
+  // element count of an array, tuple or record; row count of a table
+  size_t childCount() const {
+    assert(tag_ == ARRAY_tag || tag_ == TUPLE_tag || tag_ == RECORD_tag ||
+           tag_ == TABLE_tag);
+    size_t pos = payload_;
+    return readUvint(pos);
+  }
+
+  // defined below the cursor classes
+  BiniouArrayCursor arrayElements() const;
+  BiniouTupleCursor tupleElements() const;
+  BiniouRecordCursor recordFields() const;
+  BiniouTableCursor tableRows() const;
+
+  // linear scan for the field hashing to name; false when absent
+  bool fieldByName(std::string_view name, BiniouValue &result) const;
+
+  uint32_t variantHash() const {
+    assert(tag_ == VARIANT_tag);
+    return (uint32_t)readFixed(payload_, 4) & ~(1u << 31);
+  }
+
+  // the variant index of a num_variant (BINIOU_NUM_VARIANTS captures
+  // carry indexes where plain captures carry name hashes)
+  uint8_t numVariantIndex() const {
+    assert(tag_ == NUM_VARIANT_tag);
+    return byteAt(payload_) & 0x7f;
+  }
+
+  bool variantHasArg() const {
+    if (tag_ == NUM_VARIANT_tag) {
+      return (byteAt(payload_) & 0x80) != 0;
+    }
+    assert(tag_ == VARIANT_tag);
+    return (readFixed(payload_, 4) & (1u << 31)) != 0;
+  }
+
+  BiniouValue variantArg() const {
+    assert(variantHasArg());
+    size_t pos = payload_ + (tag_ == NUM_VARIANT_tag ? 1 : 4);
+    uint8_t tag = byteAt(pos++);
+    return BiniouValue(doc_, docSize_, tag, pos);
+  }
+
+  // Follow a SHARED node to the value it denotes: a first occurrence
+  // carries the value inline, a back reference points at the first
+  // occurrence's offset varint (the distance between the two varint
+  // positions, as BiniouEmitter records it). Non-shared values resolve
+  // to themselves, so walkers can resolve unconditionally.
+  BiniouValue resolveShared() const {
+    if (tag_ != SHARED_tag) {
+      return *this;
+    }
+    size_t pos = payload_;
+    uint64_t offset = readUvint(pos);
+    if (offset != 0) {
+      pos = payload_ - offset;
+      uint64_t targetOffset = readUvint(pos);
+      assert(targetOffset == 0 && "back reference must point at a value");
+      (void)targetOffset;
+    }
+    uint8_t tag = byteAt(pos++);
+    return BiniouValue(doc_, docSize_, tag, pos).resolveShared();
+  }
+};
+
+// Array elements share the tag announced by the first element; the
+// cursor carries it and hands out untagged values.
+class BiniouArrayCursor {
+  BiniouValue current_;
+  size_t remaining_;
+
+  friend class BiniouValue;
+  BiniouArrayCursor(const BiniouValue &array) : current_(array), remaining_(0) {
+    assert(array.tag_ == ARRAY_tag);
+    size_t pos = array.payload_;
+    remaining_ = array.readUvint(pos);
+    current_.tag_ = remaining_ > 0 ? array.byteAt(pos++) : unit_tag;
+    current_.payload_ = pos;
+  }
+
+ public:
+  // false when exhausted; the yielded value stays valid after further
+  // next() calls (it only aliases the document)
+  bool next(BiniouValue &result) {
+    if (remaining_ == 0) {
+      return false;
+    }
+    remaining_--;
+    result = current_;
+    current_.payload_ = current_.skipPayload(current_.tag_, current_.payload_);
+    return true;
+  }
+};
+
+class BiniouTupleCursor {
+  BiniouValue current_;
+  size_t remaining_;
+
+  friend class BiniouValue;
+  BiniouTupleCursor(const BiniouValue &tuple) : current_(tuple), remaining_(0) {
+    assert(tuple.tag_ == TUPLE_tag);
+    size_t pos = tuple.payload_;
+    remaining_ = tuple.readUvint(pos);
+    current_.payload_ = pos;
+  }
+
+ public:
+  bool next(BiniouValue &result) {
+    if (remaining_ == 0) {
+      return false;
+    }
+    remaining_--;
+    size_t pos = current_.payload_;
+    current_.tag_ = current_.byteAt(pos++);
+    current_.payload_ = pos;
+    result = current_;
+    current_.payload_ = current_.skipPayload(current_.tag_, current_.payload_);
+    return true;
+  }
+};
+
+class BiniouRecordCursor {
+  BiniouValue current_;
+  size_t remaining_;
+
+  friend class BiniouValue;
+  BiniouRecordCursor(const BiniouValue &record)
+      : current_(record), remaining_(0) {
+    assert(record.tag_ == RECORD_tag);
+    size_t pos = record.payload_;
+    remaining_ = record.readUvint(pos);
+    current_.payload_ = pos;
+  }
+
+ public:
+  // yields the field-name hash (without the top marker bit) and value
+  bool next(uint32_t &hash, BiniouValue &result) {
+    if (remaining_ == 0) {
+      return false;
+    }
+    remaining_--;
+    size_t pos = current_.payload_;
+    hash = (uint32_t)current_.readFixed(pos, 4) & ~(1u << 31);
+    pos += 4;
+    current_.tag_ = current_.byteAt(pos++);
+    current_.payload_ = pos;
+    result = current_;
+    current_.payload_ = current_.skipPayload(current_.tag_, current_.payload_);
+    return true;
+  }
+};
+
+// Table rows are bare payloads in column order; the cursor indexes the
+// column header in place for the hash and tag of each cell.
+class BiniouRowCursor {
+  BiniouValue current_;
+  size_t headerPos_;
+  size_t column_;
+  size_t numColumns_;
+
+  friend class BiniouTableCursor;
+
+  BiniouRowCursor(const BiniouValue &doc,
+                  size_t headerPos,
+                  size_t numColumns,
+                  size_t rowPos)
+      : current_(doc),
+        headerPos_(headerPos),
+        column_(0),
+        numColumns_(numColumns) {
+    current_.payload_ = rowPos;
+  }
+
+ public:
+  // an exhausted cursor, for out-parameters of BiniouTableCursor::next
+  BiniouRowCursor() : headerPos_(0), column_(0), numColumns_(0) {}
+
+  bool next(uint32_t &hash, BiniouValue &result) {
+    if (column_ == numColumns_) {
+      return false;
+    }
+    size_t colPos = headerPos_ + column_ * 5;
+    hash = (uint32_t)current_.readFixed(colPos, 4) & ~(1u << 31);
+    current_.tag_ = current_.byteAt(colPos + 4);
+    column_++;
+    result = current_;
+    current_.payload_ = current_.skipPayload(current_.tag_, current_.payload_);
+    return true;
+  }
+
+  // where the next row starts: one past the last cell of this one
+  size_t end() {
+    uint32_t hash;
+    BiniouValue cell(current_);
+    while (next(hash, cell)) {
+    }
+    return current_.payload_;
+  }
+};
+
+class BiniouTableCursor {
+  BiniouValue doc_;
+  size_t headerPos_;
+  size_t numColumns_;
+  size_t rowPos_;
+  size_t remainingRows_;
+
+  friend class BiniouValue;
+  BiniouTableCursor(const BiniouValue &table)
+      : doc_(table),
+        headerPos_(0),
+        numColumns_(0),
+        rowPos_(0),
+        remainingRows_(0) {
+    assert(table.tag_ == TABLE_tag);
+    size_t pos = table.payload_;
+    remainingRows_ = table.readUvint(pos);
+    if (remainingRows_ > 0) {
+      numColumns_ = table.readUvint(pos);
+      headerPos_ = pos;
+      rowPos_ = pos + numColumns_ * 5;
+    }
+  }
+
+ public:
+  size_t numColumns() const { return numColumns_; }
+
+  bool next(BiniouRowCursor &row) {
+    if (remainingRows_ == 0) {
+      return false;
+    }
+    remainingRows_--;
+    row = BiniouRowCursor(doc_, headerPos_, numColumns_, rowPos_);
+    BiniouRowCursor skip(doc_, headerPos_, numColumns_, rowPos_);
+    rowPos_ = skip.end();
+    return true;
+  }
+};
+
+inline BiniouArrayCursor BiniouValue::arrayElements() const {
+  return BiniouArrayCursor(*this);
+}
+inline BiniouTupleCursor BiniouValue::tupleElements() const {
+  return BiniouTupleCursor(*this);
+}
+inline BiniouRecordCursor BiniouValue::recordFields() const {
+  return BiniouRecordCursor(*this);
+}
+inline BiniouTableCursor BiniouValue::tableRows() const {
+  return BiniouTableCursor(*this);
+}
+
+inline bool BiniouValue::fieldByName(std::string_view name,
+                                     BiniouValue &result) const {
+  uint32_t wanted = fieldHash(name);
+  BiniouRecordCursor fields = recordFields();
+  uint32_t hash;
+  while (fields.next(hash, result)) {
+    if (hash == wanted) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Read-only mapping of a capture file; the lifetime of every value and
+// string_view navigated out of it. Movable, not copyable.
+class MmapFile {
+  const char *data_ = nullptr;
+  size_t size_ = 0;
+
+ public:
+  MmapFile() {}
+  MmapFile(const MmapFile &) = delete;
+  MmapFile &operator=(const MmapFile &) = delete;
+  MmapFile(MmapFile &&other) : data_(other.data_), size_(other.size_) {
+    other.data_ = nullptr;
+    other.size_ = 0;
+  }
+
+  ~MmapFile() {
+    if (data_ != nullptr) {
+      ::munmap(const_cast<char *>(data_), size_);
+    }
+  }
+
+  bool open(const char *path) {
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+      return false;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || st.st_size == 0) {
+      ::close(fd);
+      return false;
+    }
+    void *mapping = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+      return false;
+    }
+    data_ = (const char *)mapping;
+    size_ = st.st_size;
+    return true;
+  }
+
+  bool isOpen() const { return data_ != nullptr; }
+  const char *data() const { return data_; }
+  size_t size() const { return size_; }
+
+  BiniouValue root() const { return BiniouValue(data_, size_); }
+};
+
+} // namespace ATDReader
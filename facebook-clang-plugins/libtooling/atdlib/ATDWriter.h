@@ -8,9 +8,20 @@
 #pragma once
 
 #include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <charconv>
+#include <condition_variable>
 #include <functional>
 #include <iostream>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 namespace ATDWriter {
@@ -18,6 +29,78 @@ namespace ATDWriter {
 struct ATDWriterOptions {
   bool useYojson;
   bool prettifyJson;
+  // Buffer the whole biniou output in memory and back-patch record sizes
+  // with the actual field count instead of padding with dummy fields.
+  bool biniouBackpatchSizes;
+  // Emit values passed to enterSharedValue once and reference later
+  // occurrences with biniou SHARED_tag back pointers. Buffers the whole
+  // output in memory so that back-pointer distances stay valid.
+  bool biniouShareValues;
+  // Intern repeated strings: emit the bytes of each distinct string once
+  // and reference later occurrences with SHARED_tag back pointers, like
+  // biniouShareValues does for whole values. Buffers the whole output.
+  bool biniouShareStrings;
+  // Attribute emitted bytes to the nearest enclosing record field or
+  // variant name and print a sorted histogram on stderr at EOF.
+  bool biniouByteStats;
+  // Encode variant names that carry a numeric index (NumTag) as biniou
+  // num_variants: the index in one byte instead of the hashed name in
+  // four. Indices follow declaration order in the closed ATD sum type
+  // defining the variant, so the reader must be generated from matching
+  // definitions.
+  bool biniouNumVariants;
+  // Expected size of the whole document, in bytes; 0 when unknown. A
+  // hint only - emitters that pin the full output in memory pre-size
+  // their buffers from it instead of climbing there by doubling, and
+  // nothing breaks when the document outgrows it.
+  uint64_t expectedOutputBytes;
+};
+
+// A record field name bundled with its biniou hash. The set of field names
+// written by an exporter is known at compile time, so the hash can be
+// precomputed once (typically in a 'static constexpr' constant) instead of
+// being recomputed from the string on every emitTag call.
+class Tag {
+  const char *name_;
+  uint32_t hash_;
+
+  // string hash algorithm from the biniou spec, constexpr version of
+  // BiniouEmitter::biniou_hash below
+  static constexpr uint32_t biniouHash(const char *s, size_t n) {
+    uint32_t hash = 0;
+    for (size_t i = 0; i < n; i++) {
+      hash = 223 * hash + s[i];
+    }
+    return hash % 0x80000000u;
+  }
+
+ public:
+  template <size_t N>
+  explicit constexpr Tag(const char (&name)[N])
+      : name_(name), hash_(biniouHash(name, N - 1)) {}
+
+  constexpr const char *str() const { return name_; }
+  constexpr uint32_t hash() const { return hash_; }
+};
+
+// A variant name additionally carrying its index in the ATD sum type
+// defining it (declaration order, the same order the reader derives
+// from the definitions). Only variants of closed sum types may register
+// one: under the biniouNumVariants option the index becomes part of the
+// wire format, so adding, removing or reordering variants of such a
+// type is a schema change. Biniou numeric variants hold the index in
+// the low 7 bits of a single byte, hence the 0-127 bound. Within one
+// biniou array every element must carry the same value tag, so a sum
+// type must register either all of its variants or none.
+class NumTag : public Tag {
+  uint8_t index_;
+
+ public:
+  template <size_t N>
+  explicit constexpr NumTag(const char (&name)[N], uint8_t index)
+      : Tag(name), index_((assert(index <= 127), index)) {}
+
+  constexpr uint8_t index() const { return index_; }
 };
 
 // Symbols to be stacked
@@ -30,18 +113,10 @@ enum ContainerSizeKind {
   CSKMAX // the container expects at most this number of items
 };
 
-// Main class for writing ATD-like data
-// - In NDEBUG mode this class is only a wrapper around an ATDEmitter
-// - In DEBUG mode it acts as a validator: asserts will fire if the events do
-// not correspond to a well-formed ATD/JSON value
-template <class ATDEmitter>
-class GenWriter {
-
- protected:
-  ATDEmitter emitter_;
-
- private:
-#ifdef DEBUG
+// Validation policies for GenWriter. The validating policy runs a small
+// automaton asserting that the stream of events corresponds to a
+// well-formed ATD/JSON value; the no-op policy compiles away entirely.
+class EventValidator {
   // State of the automaton
   std::vector<enum Symbol> stack_;
 
@@ -51,19 +126,24 @@ class GenWriter {
   // How many elements are expected in the current container
   std::vector<int> containerSize_;
   std::vector<enum ContainerSizeKind> containerSizeKind_;
-#endif
+
+ public:
+  EventValidator() { containerSizeKind_.push_back(CSKNONE); }
+
+  ~EventValidator() {
+    assert(stack_.empty());
+    assert(containerSizeKind_.size() == 1);
+    assert(containerSizeKind_.back() == CSKNONE);
+  }
 
   void enterValue() {
-#ifdef DEBUG
     if (stack_.empty()) {
       return;
     }
     assert(!needsTag(stack_.back()));
-#endif
   }
 
   void leaveValue() {
-#ifdef DEBUG
     switch (containerSizeKind_.back()) {
     case CSKEXACT:
     case CSKMAX:
@@ -79,7 +159,6 @@ class GenWriter {
       stack_.pop_back();
       assert(needsTag(stack_.back()));
     }
-#endif
   }
 
   void emitValue() {
@@ -87,10 +166,14 @@ class GenWriter {
     leaveValue();
   }
 
+  void emitTag() {
+    assert(needsTag(stack_.back()));
+    stack_.push_back(STAG);
+  }
+
   void enterContainer(enum Symbol s,
                       enum ContainerSizeKind csk = CSKNONE,
                       int numElems = 0) {
-#ifdef DEBUG
     enterValue();
     stack_.push_back(s);
     containerSizeKind_.push_back(csk);
@@ -102,11 +185,9 @@ class GenWriter {
     case CSKNONE:
       break;
     }
-#endif
   }
 
   void leaveContainer(enum Symbol s) {
-#ifdef DEBUG
     assert(stack_.back() == s);
     stack_.pop_back();
     switch (containerSizeKind_.back()) {
@@ -122,25 +203,58 @@ class GenWriter {
     }
     containerSizeKind_.pop_back();
     leaveValue();
-#endif
   }
+};
 
- public:
-  GenWriter(ATDEmitter emitter) : emitter_(emitter) {
-#ifdef DEBUG
-    containerSizeKind_.push_back(CSKNONE);
-#endif
-  }
+struct NoValidator {
+  void enterValue() {}
+  void leaveValue() {}
+  void emitValue() {}
+  void emitTag() {}
+  void enterContainer(enum Symbol s,
+                      enum ContainerSizeKind csk = CSKNONE,
+                      int numElems = 0) {}
+  void leaveContainer(enum Symbol s) {}
+};
 
-  ~GenWriter() {
 #ifdef DEBUG
-    assert(stack_.empty());
-    assert(containerSizeKind_.size() == 1);
-    assert(containerSizeKind_.back() == CSKNONE);
+typedef EventValidator DefaultValidator;
+#else
+typedef NoValidator DefaultValidator;
 #endif
-    emitter_.emitEOF();
+
+// Main class for writing ATD-like data
+// - With NoValidator (release default) this class is only a wrapper around
+// an ATDEmitter and the bookkeeping inlines away
+// - With EventValidator (DEBUG default, used by the test targets) asserts
+// will fire if the events do not correspond to a well-formed ATD/JSON value
+template <class ATDEmitter, class Validator = DefaultValidator>
+class GenWriter {
+
+ protected:
+  ATDEmitter emitter_;
+
+ private:
+  Validator validator_;
+
+  void emitValue() { validator_.emitValue(); }
+
+  void enterContainer(enum Symbol s,
+                      enum ContainerSizeKind csk = CSKNONE,
+                      int numElems = 0) {
+    validator_.enterContainer(s, csk, numElems);
   }
 
+  void leaveContainer(enum Symbol s) { validator_.leaveContainer(s); }
+
+ public:
+  GenWriter(ATDEmitter emitter) : emitter_(emitter) {}
+
+  ~GenWriter() { emitter_.emitEOF(); }
+
+  // best-effort flush of finished bytes to the underlying stream
+  void flushOutput() { emitter_.flushOutput(); }
+
   void emitNull() {
     emitValue();
     emitter_.emitNull();
@@ -153,22 +267,62 @@ class GenWriter {
     emitValue();
     emitter_.emitInteger(val);
   }
-  void emitFloat(float val) {
+  void emitDouble(double val) {
     emitValue();
-    emitter_.emitFloat(val);
+    emitter_.emitDouble(val);
   }
-  void emitString(const std::string &val) {
+  void emitString(std::string_view val) {
     emitValue();
     emitter_.emitString(val);
   }
-  void emitTag(const std::string &val) {
-#ifdef DEBUG
-    assert(needsTag(stack_.back()));
-    stack_.push_back(STAG);
-#endif
+  // Splice a value pre-serialized by a standalone writer of the same
+  // format and options as the next element of the enclosing container.
+  void emitElementBytes(std::string_view val) {
+    emitValue();
+    emitter_.emitElementBytes(val);
+  }
+  // Bulk leaf arrays: equivalent to a sized enterArray with one emit
+  // per element, but the emitters run tight loops over their sink
+  // instead of the per-element separator and tag bookkeeping, which is
+  // where leaf-heavy arrays spend their time.
+  void emitIntegerArray(const int64_t *values, size_t numValues) {
+    enterContainer(SARRAY, CSKEXACT, (int)numValues);
+    for (size_t i = 0; i < numValues; i++) {
+      emitValue();
+    }
+    leaveContainer(SARRAY);
+    emitter_.emitIntegerArray(values, numValues);
+  }
+  void emitStringArray(const std::string_view *values, size_t numValues) {
+    enterContainer(SARRAY, CSKEXACT, (int)numValues);
+    for (size_t i = 0; i < numValues; i++) {
+      emitValue();
+    }
+    leaveContainer(SARRAY);
+    emitter_.emitStringArray(values, numValues);
+  }
+  void emitTag(std::string_view val) {
+    validator_.emitTag();
+    emitter_.emitTag(val);
+  }
+  void emitTag(const Tag &val) {
+    validator_.emitTag();
     emitter_.emitTag(val);
   }
 
+  // Announce a value that may recur, identified by an opaque key. Returns
+  // true when the caller must emit the value as usual; returns false when
+  // the emitter wrote a reference to an earlier occurrence instead (only
+  // biniou with the biniouShareValues option does).
+  bool enterSharedValue(uint64_t key) {
+    if (emitter_.enterSharedValue(key)) {
+      return true;
+    }
+    // the back reference stands for the whole value
+    emitValue();
+    return false;
+  }
+
   void enterArray(int numElems) {
     enterContainer(SARRAY, CSKEXACT, numElems);
     emitter_.enterArray(numElems);
@@ -193,6 +347,27 @@ class GenWriter {
     leaveContainer(SOBJECT);
     emitter_.leaveObject();
   }
+  // Tables are arrays of identically-shaped records; biniou writes the
+  // field names once for the whole array, the textual formats fall back
+  // to a plain array of objects. Rows must all have the same fields, in
+  // the same order, so optional fields may not be skipped.
+  void enterTable(int numRows) {
+    enterContainer(SARRAY, CSKEXACT, numRows);
+    emitter_.enterTable(numRows);
+  }
+  void leaveTable() {
+    leaveContainer(SARRAY);
+    emitter_.leaveTable();
+  }
+  void enterTableRow(int numElems) {
+    enterContainer(SOBJECT, CSKMAX, numElems);
+    emitter_.enterTableRow(numElems);
+  }
+  void leaveTableRow() {
+    leaveContainer(SOBJECT);
+    emitter_.leaveTableRow();
+  }
+
   void enterTuple(int numElems) {
     enterContainer(STUPLE, CSKEXACT, numElems);
     emitter_.enterTuple(numElems);
@@ -206,18 +381,23 @@ class GenWriter {
     emitter_.leaveTuple();
   }
 
-  void enterVariant(const std::string &tag, bool hasArg = true) {
+  void enterVariant(std::string_view tag, bool hasArg = true) {
     // variants have at most one value, so we can safely use hasArg
     // as the number of arguments
     enterContainer(SVARIANT, CSKEXACT, hasArg);
     emitter_.enterVariant();
     emitter_.emitVariantTag(tag, hasArg);
   }
+  void enterVariant(const Tag &tag, bool hasArg = true) {
+    enterContainer(SVARIANT, CSKEXACT, hasArg);
+    emitter_.enterVariant();
+    emitter_.emitVariantTag(tag, hasArg);
+  }
   void leaveVariant() {
     leaveContainer(SVARIANT);
     emitter_.leaveVariant();
   }
-  void emitSimpleVariant(const std::string &tag) {
+  void emitSimpleVariant(std::string_view tag) {
     if (emitter_.shouldSimpleVariantsBeEmittedAsStrings) {
       emitString(tag);
     } else {
@@ -225,16 +405,79 @@ class GenWriter {
       leaveVariant();
     }
   }
+  // Pre-hashed fast path: the emitters that hash variant names (biniou)
+  // take the hash from the Tag instead of recomputing it per call.
+  void emitSimpleVariant(const Tag &tag) {
+    if (emitter_.shouldSimpleVariantsBeEmittedAsStrings) {
+      emitString(tag.str());
+    } else {
+      enterVariant(tag, false);
+      leaveVariant();
+    }
+  }
+  // Indexed fast path: under biniouNumVariants the biniou emitter
+  // encodes the NumTag's index as a num_variant; every other emitter
+  // sees the NumTag as a plain Tag through overload resolution.
+  void enterVariant(const NumTag &tag, bool hasArg = true) {
+    enterContainer(SVARIANT, CSKEXACT, hasArg);
+    emitter_.enterVariant();
+    emitter_.emitVariantTag(tag, hasArg);
+  }
+  void emitSimpleVariant(const NumTag &tag) {
+    if (emitter_.shouldSimpleVariantsBeEmittedAsStrings) {
+      emitString(tag.str());
+    } else {
+      enterVariant(tag, false);
+      leaveVariant();
+    }
+  }
 
   // convenient methods
 
-  void emitFlag(const std::string &tag, bool val) {
+  void emitFlag(std::string_view tag, bool val) {
     if (val) {
       emitTag(tag);
       emitBoolean(true);
     }
   }
 
+  // A cluster of up to 64 flags as one ~int bitmask field, elided like
+  // emitFlag when no flag is set (~int defaults to 0). In biniou each
+  // set flag otherwise costs a 4-byte field hash plus a tagged bool;
+  // here the whole cluster is one field hash and a svint. Bit positions
+  // are schema, documented next to the cluster's ATD record.
+  void emitFlagMask(std::string_view tag, uint64_t mask) {
+    if (mask != 0) {
+      emitTag(tag);
+      emitInteger((int64_t)mask);
+    }
+  }
+
+  // Default elision for the other ATD default kinds, in the spirit of
+  // emitFlag: a ~string field defaults to "" and a ~list field to [],
+  // and readers reconstruct absent fields from those defaults, so
+  // default-valued fields need not be written at all. Only valid for
+  // fields counted conditionally in the enclosing object's size.
+  void emitDefaultableString(std::string_view tag, std::string_view val) {
+    if (!val.empty()) {
+      emitTag(tag);
+      emitString(val);
+    }
+  }
+  // emitElems writes exactly numElems array elements; when numElems is
+  // 0 neither the tag nor the array is written and emitElems not called
+  template <class EmitElems>
+  void emitDefaultableArray(std::string_view tag,
+                            int numElems,
+                            EmitElems emitElems) {
+    if (numElems > 0) {
+      emitTag(tag);
+      enterArray(numElems);
+      emitElems();
+      leaveArray();
+    }
+  }
+
   // convenient classes for automatically closing containers using C++ scoping
 
   class ArrayScope {
@@ -264,11 +507,33 @@ class GenWriter {
     ~TupleScope() { f_.leaveTuple(); }
   };
 
+  class TableScope {
+    GenWriter &f_;
+
+   public:
+    TableScope(GenWriter &f, int numRows) : f_(f) { f_.enterTable(numRows); }
+    ~TableScope() { f_.leaveTable(); }
+  };
+
+  class TableRowScope {
+    GenWriter &f_;
+
+   public:
+    TableRowScope(GenWriter &f, int size) : f_(f) { f_.enterTableRow(size); }
+    ~TableRowScope() { f_.leaveTableRow(); }
+  };
+
   class VariantScope {
     GenWriter &f_;
 
    public:
-    VariantScope(GenWriter &f, const std::string &tag) : f_(f) {
+    VariantScope(GenWriter &f, std::string_view tag) : f_(f) {
+      f_.enterVariant(tag, true);
+    }
+    VariantScope(GenWriter &f, const Tag &tag) : f_(f) {
+      f_.enterVariant(tag, true);
+    }
+    VariantScope(GenWriter &f, const NumTag &tag) : f_(f) {
       f_.enterVariant(tag, true);
     }
     ~VariantScope() { f_.leaveVariant(); }
@@ -281,7 +546,6 @@ class JsonEmitter {
 
   const char *QUOTE = "\"";
   const char *COMMA = ",";
-  const char *TAB = "  ";
   const char *NEWLINE = "\n";
   const char *COLON = ":";
   const char *COLONWITHSPACES = " : ";
@@ -329,46 +593,75 @@ class JsonEmitter {
       os_ << COMMA;
     }
     if (nextElementNeedsNewLine_ && options_.prettifyJson) {
-      os_ << NEWLINE;
-      for (size_t i = 0; i < indentLevel_; i++) {
-        os_ << TAB;
-      }
+      writeNewLineAndIndent();
     }
   }
 
  private:
+  // Pretty mode pays a newline plus indentLevel_ two-space indents
+  // before every element; writing them one stream call per level made
+  // pretty dumps of big TUs many times slower than compact ones. Fuse
+  // them into a single bulk write from a static whitespace block
+  // instead; nesting
+  // deeper than the block (rare, but expression trees can do it)
+  // continues with all-space writes from the block's tail.
+  void writeNewLineAndIndent() {
+    static const char indentBlock[] =
+        "\n"
+        "                                                                "
+        "                                                                ";
+    const size_t maxLevels = (sizeof(indentBlock) - 2) / 2;
+    size_t level = indentLevel_;
+    os_.write(indentBlock, 1 + 2 * (level < maxLevels ? level : maxLevels));
+    for (level = level > maxLevels ? level - maxLevels : 0; level > 0;) {
+      const size_t chunk = level < maxLevels ? level : maxLevels;
+      os_.write(indentBlock + 1, 2 * chunk);
+      level -= chunk;
+    }
+  }
+
   // TODO: unicode and other control chars
-  void write_escaped(const std::string &val) {
-    for (std::string::const_iterator i = val.begin(), e = val.end(); i != e;
-         i++) {
-      char x = *i;
-      switch (x) {
-      case '\\':
-        os_ << "\\\\";
-        break;
-      case '"':
-        os_ << "\\\"";
-        break;
-      case '\n':
-        os_ << "\\n";
-        break;
-      case '\t':
-        os_ << "\\t";
-        break;
-      case '\b':
-        os_ << "\\b";
-        break;
-      case '\f':
-        os_ << "\\f";
-        break;
-      case '\r':
-        os_ << "\\r";
-        break;
-      default:
-        os_ << x;
-        break;
+  static const char *escapeOf(char x) {
+    switch (x) {
+    case '\\':
+      return "\\\\";
+    case '"':
+      return "\\\"";
+    case '\n':
+      return "\\n";
+    case '\t':
+      return "\\t";
+    case '\b':
+      return "\\b";
+    case '\f':
+      return "\\f";
+    case '\r':
+      return "\\r";
+    default:
+      return nullptr;
+    }
+  }
+
+  // Most strings need no escaping at all: scan for the next character that
+  // does and bulk-write the clean spans in between instead of going through
+  // the stream once per character.
+  void write_escaped(std::string_view val) {
+    const char *data = val.data();
+    const size_t size = val.size();
+    size_t spanStart = 0;
+    for (size_t i = 0; i < size; i++) {
+      const char *escaped = escapeOf(data[i]);
+      if (escaped) {
+        if (i > spanStart) {
+          os_.write(data + spanStart, i - spanStart);
+        }
+        os_ << escaped;
+        spanStart = i + 1;
       }
     }
+    if (size > spanStart) {
+      os_.write(data + spanStart, size - spanStart);
+    }
   }
 
   void enterContainer(char c) {
@@ -394,6 +687,12 @@ class JsonEmitter {
  public:
   void emitEOF() { os_ << NEWLINE; }
 
+  // push everything written so far to the underlying stream
+  void flushOutput() { os_.flush(); }
+
+  // sharing is a biniou-only concept; the textual formats always re-emit
+  bool enterSharedValue(uint64_t key) { return true; }
+
   void emitNull() {
     tab();
     os_ << NULLSTR;
@@ -408,14 +707,61 @@ class JsonEmitter {
     nextElementNeedsNewLine_ = true;
     previousElementIsVariantTag_ = false;
   }
+  // integers are the most common scalar in AST dumps; format into a stack
+  // buffer and write once rather than going through the stream's
+  // formatting machinery
+ private:
+  void writeInteger(int64_t val) {
+    char buf[20]; // up to -9223372036854775808
+    char *end = buf + sizeof(buf);
+    char *pos = end;
+    uint64_t x = val < 0 ? 0 - (uint64_t)val : (uint64_t)val;
+    do {
+      *--pos = '0' + (char)(x % 10);
+      x /= 10;
+    } while (x > 0);
+    if (val < 0) {
+      *--pos = '-';
+    }
+    os_.write(pos, end - pos);
+  }
+
+ public:
   void emitInteger(int64_t val) {
     tab();
-    os_ << val;
+    writeInteger(val);
+    previousElementNeedsComma_ = true;
+    nextElementNeedsNewLine_ = true;
+    previousElementIsVariantTag_ = false;
+  }
+
+ private:
+  // the shortest decimal form that parses back to the same double; when
+  // the library has no to_chars for doubles, a fixed 17-significant-digit
+  // form (always round-trippable, sometimes longer than needed). Note
+  // that non-finite values render as "inf"/"nan", which only lenient
+  // (yojson-style) readers accept
+  void writeDouble(double val) {
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+    char buf[32];
+    auto res = std::to_chars(buf, buf + sizeof(buf), val);
+    os_.write(buf, res.ptr - buf);
+#else
+    char buf[32];
+    int len = snprintf(buf, sizeof(buf), "%.17g", val);
+    os_.write(buf, len);
+#endif
+  }
+
+ public:
+  void emitDouble(double val) {
+    tab();
+    writeDouble(val);
     previousElementNeedsComma_ = true;
     nextElementNeedsNewLine_ = true;
     previousElementIsVariantTag_ = false;
   }
-  void emitString(const std::string &val) {
+  void emitString(std::string_view val) {
     tab();
     os_ << QUOTE;
     write_escaped(val);
@@ -424,7 +770,16 @@ class JsonEmitter {
     nextElementNeedsNewLine_ = true;
     previousElementIsVariantTag_ = false;
   }
-  void emitTag(const std::string &val) {
+  // Splice a pre-serialized value verbatim; under prettified output its
+  // inner indentation restarts from the margin.
+  void emitElementBytes(std::string_view val) {
+    tab();
+    os_.write(val.data(), val.size());
+    previousElementNeedsComma_ = true;
+    nextElementNeedsNewLine_ = true;
+    previousElementIsVariantTag_ = false;
+  }
+  void emitTag(std::string_view val) {
     tab();
     os_ << QUOTE;
     write_escaped(val);
@@ -438,7 +793,53 @@ class JsonEmitter {
     nextElementNeedsNewLine_ = false;
     previousElementIsVariantTag_ = false;
   }
-  void emitVariantTag(const std::string &val, bool hasArgs) {
+  void emitTag(const Tag &val) {
+    // field names never contain characters needing escapes
+    tab();
+    os_ << QUOTE << val.str() << QUOTE;
+    if (options_.prettifyJson) {
+      os_ << COLONWITHSPACES;
+    } else {
+      os_ << COLON;
+    }
+    previousElementNeedsComma_ = false;
+    nextElementNeedsNewLine_ = false;
+    previousElementIsVariantTag_ = false;
+  }
+  // Bulk leaf arrays: a whole array of scalars in one call, separators
+  // written in a tight loop instead of one tab() state transition per
+  // element. Byte-for-byte the output of a sized enterArray with one
+  // emit per element.
+  void emitIntegerArray(const int64_t *values, size_t numValues) {
+    enterContainer(LBRACKET);
+    for (size_t i = 0; i < numValues; i++) {
+      if (i) {
+        os_ << COMMA;
+      }
+      if (options_.prettifyJson) {
+        writeNewLineAndIndent();
+      }
+      writeInteger(values[i]);
+    }
+    leaveContainer(RBRACKET);
+  }
+  void emitStringArray(const std::string_view *values, size_t numValues) {
+    enterContainer(LBRACKET);
+    for (size_t i = 0; i < numValues; i++) {
+      if (i) {
+        os_ << COMMA;
+      }
+      if (options_.prettifyJson) {
+        writeNewLineAndIndent();
+      }
+      os_ << QUOTE;
+      write_escaped(values[i]);
+      os_ << QUOTE;
+    }
+    leaveContainer(RBRACKET);
+  }
+
+  void emitVariantTag(std::string_view val, bool hasArgs) {
     tab();
     os_ << QUOTE;
     write_escaped(val);
@@ -447,10 +848,18 @@ class JsonEmitter {
     nextElementNeedsNewLine_ = false;
     previousElementIsVariantTag_ = true;
   }
+  void emitVariantTag(const Tag &val, bool hasArgs) {
+    emitVariantTag(std::string_view(val.str()), hasArgs);
+  }
 
   void enterArray() { enterContainer(LBRACKET); }
   void enterArray(int size) { enterArray(); }
   void leaveArray() { leaveContainer(RBRACKET); }
+  // tables render as plain arrays of objects in the textual formats
+  void enterTable(int numRows) { enterArray(numRows); }
+  void leaveTable() { leaveArray(); }
+  void enterTableRow(int numElems) { enterObject(numElems); }
+  void leaveTableRow() { leaveObject(); }
   void enterObject() { enterContainer(LBRACE); }
   void enterObject(int size) { enterObject(); }
   void leaveObject() { leaveContainer(RBRACE); }
@@ -489,6 +898,7 @@ const uint8_t TABLE_tag = 25;
 const uint8_t SHARED_tag = 26;
 
 const int SIZE_NOT_NEEDED = -1;
+const int SIZE_UNKNOWN = -2;
 
 // Configure GenWriter for Biniou binary output
 template <class OStream = std::ostream>
@@ -497,22 +907,121 @@ class BiniouEmitter {
  private:
   OStream &os_;
 
+  // Pending bytes, flushed in bulk to avoid doing a (virtual) call into
+  // the underlying stream for every single byte of output.
+  static const size_t bufferCapacity_ = 64 * 1024;
+  std::vector<char> buffer_;
+
+  // When set, nothing is flushed before EOF so that record sizes can be
+  // rewritten in place once the actual field count is known, instead of
+  // padding records with dummy fields. Costs one output-sized buffer.
+  const bool backpatchSizes_ = false;
+
+  // When set, repeated values announced through enterSharedValue are
+  // emitted once and referenced afterwards with SHARED_tag back pointers.
+  // Implies buffering the whole output like backpatchSizes_, since a
+  // flush would invalidate the recorded positions.
+  const bool shareValues_ = false;
+
+  // When set, emitString interns its argument the same way: file paths,
+  // qualified names and selectors recur thousands of times per TU.
+  const bool shareStrings_ = false;
+
+  // When set, variant names carrying a numeric index (NumTag) are
+  // encoded as num_variants instead of hashed-name variants.
+  const bool numVariants_ = false;
+  // below this size a back reference is not reliably a win
+  static const size_t minSharedStringSize_ = 8;
+  // distinct interned strings, each mapped to a small dense id used as
+  // its sharing key
+  std::unordered_map<std::string, uint64_t> stringIds_;
+
+  // Sub-buffers holding the elements of open-ended arrays (one per open
+  // array, innermost last); the element count is only known when the array
+  // is closed, at which point the sub-buffer is spliced into its parent.
+  std::vector<std::vector<char>> captures_;
+
+  // Position of the offset varint of the first occurrence of a shared
+  // value, as an offset into the buffer it was written to. Buffers are
+  // identified by capture depth (0 = the main buffer); positions recorded
+  // inside a capture are rebased into the parent when the capture is
+  // spliced.
+  struct SharedPos {
+    size_t captureDepth;
+    size_t offset;
+  };
+  std::unordered_map<uint64_t, SharedPos> sharedPositions_;
+  // keys recorded at each capture depth, for rebasing at splice time
+  std::vector<std::vector<uint64_t>> sharedKeysAtDepth_;
+  // the payload following a SHARED_tag always carries its own value tag,
+  // even where an enclosing array would otherwise elide it
+  bool forceValueTag_ = false;
+
   // Opened container, writing in progress.
   struct ATDContainer {
     uint8_t tag;
     int size;
     int count;
-
-    ATDContainer(uint8_t tag, int size) : tag(tag), size(size), count(0) {}
+    // position of the size varint in its sink (backpatchSizes_ mode only)
+    size_t sizeOffset;
+    // depth of captures_ the container was opened in
+    size_t captureDepth;
+    // row of a TABLE_tag container: field and value tags belong to the
+    // column header instead of the row data
+    bool tableRow;
+
+    ATDContainer(uint8_t tag, int size, size_t captureDepth)
+        : tag(tag),
+          size(size),
+          count(0),
+          sizeOffset(0),
+          captureDepth(captureDepth),
+          tableRow(false) {}
   };
 
   // The full stack of opened containers
   std::vector<ATDContainer> atdContainers;
 
+  // Open tables (innermost last). The column layout is captured from the
+  // first row; later rows drop their field and value tags and write bare
+  // values in column order, as the table format prescribes.
+  struct TableState {
+    // (field-name hash, value tag) per column
+    std::vector<std::pair<uint32_t, uint8_t>> columns;
+    int rowIndex = 0;
+  };
+  std::vector<TableState> tables_;
+
+  // Byte accounting, attributing output bytes to the nearest enclosing
+  // record field or variant name. The current counter is bound lazily
+  // (the emitter is copied into GenWriter after construction, so a
+  // pointer into our own map must not be taken before that).
+  const bool statsEnabled_ = false;
+  std::unordered_map<std::string, uint64_t> statsBytes_;
+  uint64_t *statsCurrent_ = nullptr;
+  // attribution active when each open container was entered
+  std::vector<uint64_t *> statsStack_;
+
  public:
   const bool shouldSimpleVariantsBeEmittedAsStrings = false;
 
-  BiniouEmitter(OStream &os) : os_(os) {}
+  BiniouEmitter(OStream &os) : os_(os) { buffer_.reserve(bufferCapacity_); }
+
+  BiniouEmitter(OStream &os, const ATDWriterOptions opts)
+      : os_(os),
+        backpatchSizes_(opts.biniouBackpatchSizes),
+        shareValues_(opts.biniouShareValues),
+        shareStrings_(opts.biniouShareStrings),
+        numVariants_(opts.biniouNumVariants),
+        statsEnabled_(opts.biniouByteStats) {
+    size_t initialCapacity = bufferCapacity_;
+    if (!canFlush() && opts.expectedOutputBytes > initialCapacity) {
+      // a whole-document mode pins everything in buffer_ until EOF, so
+      // a size hint spares the reallocate-and-copy climb to get there
+      initialCapacity = opts.expectedOutputBytes;
+    }
+    buffer_.reserve(initialCapacity);
+  }
 
  private:
   bool isValueTagNeeded() {
@@ -529,22 +1038,58 @@ class BiniouEmitter {
     }
   }
 
+  bool inTableRow() {
+    return !atdContainers.empty() && atdContainers.back().tableRow;
+  }
+
+  // Decide whether the value about to be written carries its own tag.
+  // Inside a table row, value tags belong to the column header: the first
+  // row records them, later rows write bare values.
+  bool beginValue(uint8_t tag) {
+    // the payload of a SHARED_tag node is always tagged, even inside an
+    // array or a table row that would otherwise elide the tag
+    if (forceValueTag_) {
+      forceValueTag_ = false;
+      return true;
+    }
+    if (inTableRow()) {
+      TableState &table = tables_.back();
+      if (table.rowIndex == 0) {
+        table.columns.back().second = tag;
+      }
+      return false;
+    }
+    return isValueTagNeeded();
+  }
+
   void enterContainer(uint8_t tag, int size) {
-    bool needTag = isValueTagNeeded();
-    atdContainers.emplace_back(tag, size);
-    writeValueTag(os_, needTag, tag);
-    if (size != SIZE_NOT_NEEDED) {
-      writeUvint(os_, size);
+    bool needTag = beginValue(tag);
+    statsEnterContainer();
+    atdContainers.emplace_back(tag, size, captures_.size());
+    writeValueTag(needTag, tag);
+    if (size == SIZE_UNKNOWN) {
+      // buffer the elements until the count is known
+      captures_.emplace_back();
+    } else if (size != SIZE_NOT_NEEDED) {
+      atdContainers.back().sizeOffset = sink().size();
+      writeUvint(size);
     }
   }
 
   void leaveContainer() {
+    statsLeaveContainer();
     atdContainers.pop_back();
     markWrite();
   }
 
+  // deferred body of enterVariant, parameterized on the value tag the
+  // variant name encoding calls for
+  void enterVariantContainer(uint8_t tag) {
+    enterContainer(tag, SIZE_NOT_NEEDED);
+  }
+
   // string hash algorithm from the biniou spec
-  static uint32_t biniou_hash(const std::string &str) {
+  static uint32_t biniou_hash(std::string_view str) {
     uint32_t hash = 0;
     for (const char &c : str) {
       hash = 223 * hash + c;
@@ -553,108 +1098,440 @@ class BiniouEmitter {
     return hash;
   }
 
-  static void write8(OStream &os, uint8_t c) { os.write((const char *)&c, 1); }
+  // where bytes currently go: the innermost open-ended array, or the
+  // output buffer itself
+  std::vector<char> &sink() {
+    return captures_.empty() ? buffer_ : captures_.back();
+  }
 
-  static void write32(OStream &os, int32_t x) {
-    write8(os, x >> 24);
-    write8(os, x >> 16);
-    write8(os, x >> 8);
-    write8(os, x);
+  // only the main buffer may be flushed; capture sub-buffers must stay in
+  // memory until their array is closed
+  bool canFlush() {
+    return captures_.empty() && !backpatchSizes_ && !shareValues_ &&
+           !shareStrings_;
   }
 
-  static void writeUvint(OStream &os, uint64_t x) {
-    while (x > 127) {
-      write8(os, x | 128);
-      x >>= 7;
+  void flushBuffer() {
+    if (!buffer_.empty()) {
+      os_.write(buffer_.data(), buffer_.size());
+      buffer_.clear();
     }
+  }
 
-    write8(os, (uint8_t)x);
+  uint64_t *statsCounter() {
+    if (!statsCurrent_) {
+      statsCurrent_ = &statsBytes_["<toplevel>"];
+    }
+    return statsCurrent_;
   }
 
-  static void writeSvint(OStream &os, int64_t x) {
-    if (x >= 0) {
-      uint64_t t = x;
-      t = t * 2;
-      writeUvint(os, t);
-    } else {
-      uint64_t t = -x;
-      t = t * 2 - 1;
-      writeUvint(os, t);
+  void statsAdd(size_t n) {
+    if (statsEnabled_) {
+      *statsCounter() += n;
     }
   }
 
-  static void writeValueTag(OStream &os, bool needTag, uint8_t tag) {
-    if (needTag) {
-      write8(os, tag);
+  // switch byte attribution to the given field or variant name
+  void statsSetContext(std::string_view name) {
+    if (statsEnabled_) {
+      statsCurrent_ = &statsBytes_[std::string(name)];
     }
   }
 
-  void emitDummyRecordField() {
-    emitTag("!!DUMMY!!");
-    markWrite();
-    // unit is the smallest value (2 bytes)
-    write8(os_, unit_tag);
-    write8(os_, 0);
+  void statsEnterContainer() {
+    if (statsEnabled_) {
+      statsStack_.push_back(statsCounter());
+    }
   }
 
- public:
-  void emitEOF() {}
+  void statsLeaveContainer() {
+    if (statsEnabled_) {
+      statsCurrent_ = statsStack_.back();
+      statsStack_.pop_back();
+    }
+  }
 
-  void emitBoolean(bool val) {
-    bool needTag = isValueTagNeeded();
-    markWrite();
-    writeValueTag(os_, needTag, bool_tag);
-    write8(os_, val);
+  void write8(uint8_t c) {
+    statsAdd(1);
+    if (canFlush() && buffer_.size() >= bufferCapacity_) {
+      flushBuffer();
+    }
+    sink().push_back(c);
   }
 
-  void emitInteger(int64_t val) {
-    bool needTag = isValueTagNeeded();
-    markWrite();
-    writeValueTag(os_, needTag, svint_tag);
-    writeSvint(os_, val);
+  void writeBytes(const char *data, size_t size) {
+    statsAdd(size);
+    spliceBytes(data, size);
   }
 
-  void emitString(const std::string &val) {
-    bool needTag = isValueTagNeeded();
-    markWrite();
-    writeValueTag(os_, needTag, string_tag);
-    writeUvint(os_, val.length());
-    for (const char &c : val) {
-      write8(os_, c);
+  // append without byte accounting: capture contents were already counted
+  // when they were first written
+  void spliceBytes(const char *data, size_t size) {
+    if (canFlush() && buffer_.size() + size > bufferCapacity_) {
+      flushBuffer();
+      // bypass the buffer entirely for oversized payloads
+      if (size > bufferCapacity_) {
+        os_.write(data, size);
+        return;
+      }
     }
+    sink().insert(sink().end(), data, data + size);
   }
 
-  void emitTag(const std::string &val) {
-    int32_t hash = biniou_hash(val);
-    // set first bit of hash
-    hash |= 1 << 31;
-    markWrite();
-    write32(os_, hash);
+  static int uvintLength(uint64_t x) {
+    int len = 1;
+    while (x > 127) {
+      len++;
+      x >>= 7;
+    }
+    return len;
   }
 
-  void emitVariantTag(const std::string &val, bool hasArg) {
-    int32_t hash = biniou_hash(val);
-    // set first bit of hash if the variant has an argument
-    if (hasArg) {
-      hash |= 1 << 31;
+  // rewrite the size varint of a record still sitting in a buffer; only
+  // valid when the new value has the same encoded length as the old one
+  static void patchUvintAt(std::vector<char> &buf, size_t offset, uint64_t x) {
+    while (x > 127) {
+      buf[offset++] = (char)(uint8_t)(x | 128);
+      x >>= 7;
     }
-    markWrite();
-    write32(os_, hash);
+    buf[offset] = (char)(uint8_t)x;
   }
 
-  void enterArray(int size) { enterContainer(ARRAY_tag, size); }
-  // unsupported:
-  // void enterArray() { enterContainer(ARRAY_tag); }
-  void leaveArray() { leaveContainer(); }
-  void enterObject(int size) { enterContainer(RECORD_tag, size); }
+  std::vector<char> &bufferAtDepth(size_t captureDepth) {
+    return captureDepth == 0 ? buffer_ : captures_[captureDepth - 1];
+  }
+
+  void write32(int32_t x) {
+    write8(x >> 24);
+    write8(x >> 16);
+    write8(x >> 8);
+    write8(x);
+  }
+
+  void writeUvint(uint64_t x) {
+    // encode all 7-bit groups into a stack buffer and append them with a
+    // single bulk write instead of one write8 (and its flush check) each
+    char buf[10]; // 64 bits / 7 bits per byte, rounded up
+    size_t len = 0;
+    while (x > 127) {
+      buf[len++] = (char)(uint8_t)(x | 128);
+      x >>= 7;
+    }
+    buf[len++] = (char)(uint8_t)x;
+    writeBytes(buf, len);
+  }
+
+  void writeSvint(int64_t x) {
+    if (x >= 0) {
+      uint64_t t = x;
+      t = t * 2;
+      writeUvint(t);
+    } else {
+      uint64_t t = -x;
+      t = t * 2 - 1;
+      writeUvint(t);
+    }
+  }
+
+  void writeValueTag(bool needTag, uint8_t tag) {
+    if (needTag) {
+      write8(tag);
+    }
+  }
+
+  // Record field names are 4-byte hashes with the top bit set. Inside a
+  // table row, the first row collects them for the column header and
+  // later rows omit them entirely.
+  void writeFieldTag(uint32_t hash) {
+    markWrite();
+    if (inTableRow()) {
+      TableState &table = tables_.back();
+      if (table.rowIndex == 0) {
+        table.columns.emplace_back(hash, 0);
+      } else {
+        // rows of a table must repeat the columns in the same order
+        assert(
+            table.columns[(atdContainers.back().count - 1) / 2].first == hash);
+      }
+      return;
+    }
+    write32((int32_t)(hash | (1u << 31)));
+  }
+
+  // Rebase shared-value positions recorded inside a removed capture (at
+  // the given depth) into the current sink, which is about to receive the
+  // capture's bytes starting at its current end.
+  void rebaseSharedCapture(size_t depth) {
+    if (depth < sharedKeysAtDepth_.size()) {
+      size_t base = sink().size();
+      for (uint64_t key : sharedKeysAtDepth_[depth]) {
+        SharedPos &pos = sharedPositions_[key];
+        if (pos.captureDepth == depth) {
+          pos.captureDepth = depth - 1;
+          pos.offset += base;
+          sharedKeysAtDepth_[depth - 1].push_back(key);
+        }
+      }
+      sharedKeysAtDepth_[depth].clear();
+    }
+  }
+
+  void emitDummyRecordField() {
+    emitTag("!!DUMMY!!");
+    markWrite();
+    // unit is the smallest value (2 bytes)
+    write8(unit_tag);
+    write8(0);
+  }
+
+  // sorted histogram of byte attribution, for finding what dominates the
+  // output of a given translation unit
+  void dumpByteStats() {
+    uint64_t total = 0;
+    std::vector<std::pair<uint64_t, const std::string *>> rows;
+    for (const auto &entry : statsBytes_) {
+      total += entry.second;
+      rows.emplace_back(entry.second, &entry.first);
+    }
+    std::sort(rows.begin(), rows.end(), [](const auto &a, const auto &b) {
+      return a.first > b.first;
+    });
+    std::cerr << "biniou byte stats: " << total << " bytes total\n";
+    for (const auto &row : rows) {
+      uint64_t tenths = total ? (row.first * 1000 + total / 2) / total : 0;
+      std::cerr << "  " << tenths / 10 << "." << tenths % 10 << "%\t"
+                << row.first << "\t" << *row.second << "\n";
+    }
+  }
+
+ public:
+  void emitEOF() {
+    flushBuffer();
+    if (statsEnabled_) {
+      dumpByteStats();
+    }
+  }
+
+  // push everything written so far to the underlying stream; a no-op
+  // while captures are open or a whole-document mode (size backpatching,
+  // value/string sharing) pins the bytes in memory
+  void flushOutput() {
+    if (canFlush()) {
+      flushBuffer();
+    }
+    os_.flush();
+  }
+
+  // Returns true when the caller must emit the value identified by key;
+  // returns false when a SHARED_tag back reference to the first
+  // occurrence was written instead.
+  bool enterSharedValue(uint64_t key) {
+    if (!shareValues_) {
+      return true;
+    }
+    // caller keys and interned-string ids live in disjoint key spaces
+    return shareByKey(key << 1);
+  }
+
+ private:
+  bool shareByKey(uint64_t key) {
+    bool needTag = beginValue(SHARED_tag);
+    size_t depth = captures_.size();
+    // position of the offset varint, one byte past the tag when present
+    size_t offsetPos = sink().size() + (needTag ? 1 : 0);
+    auto it = sharedPositions_.find(key);
+    if (it != sharedPositions_.end() && it->second.captureDepth == depth) {
+      // first occurrence in the same buffer: the bytes in between are
+      // final, so the back-pointer distance is exact
+      markWrite();
+      writeValueTag(needTag, SHARED_tag);
+      writeUvint(offsetPos - it->second.offset);
+      return false;
+    }
+    // unseen, or first seen in an enclosing buffer at a distance that is
+    // only known once the open captures in between are spliced: emit the
+    // value (again) and point later references at this occurrence
+    if (depth >= sharedKeysAtDepth_.size()) {
+      sharedKeysAtDepth_.resize(depth + 1);
+    }
+    sharedPositions_[key] = {depth, offsetPos};
+    sharedKeysAtDepth_[depth].push_back(key);
+    writeValueTag(needTag, SHARED_tag);
+    writeUvint(0);
+    forceValueTag_ = true;
+    return true;
+  }
+
+ public:
+  void emitBoolean(bool val) {
+    bool needTag = beginValue(bool_tag);
+    markWrite();
+    writeValueTag(needTag, bool_tag);
+    write8(val);
+  }
+
+  void emitInteger(int64_t val) {
+    bool needTag = beginValue(svint_tag);
+    markWrite();
+    writeValueTag(needTag, svint_tag);
+    writeSvint(val);
+  }
+
+  void emitDouble(double val) {
+    bool needTag = beginValue(float64_tag);
+    markWrite();
+    writeValueTag(needTag, float64_tag);
+    // the IEEE 754 bits, most significant byte first like the fixed-size
+    // ints; no decimal conversion in either direction
+    uint64_t bits;
+    static_assert(sizeof(bits) == sizeof(val), "double must be 64-bit");
+    memcpy(&bits, &val, sizeof(bits));
+    char bytes[8];
+    for (int i = 0; i < 8; i++) {
+      bytes[i] = (char)(bits >> (8 * (7 - i)));
+    }
+    writeBytes(bytes, sizeof(bytes));
+  }
+
+  void emitString(std::string_view val) {
+    if (shareStrings_ && val.size() >= minSharedStringSize_) {
+      uint64_t id =
+          stringIds_.emplace(std::string(val), stringIds_.size()).first->second;
+      if (!shareByKey((id << 1) | 1)) {
+        // back reference written in place of the string
+        return;
+      }
+    }
+    bool needTag = beginValue(string_tag);
+    markWrite();
+    writeValueTag(needTag, string_tag);
+    writeUvint(val.length());
+    writeBytes(val.data(), val.length());
+  }
+
+  // Bulk leaf arrays: one beginValue decision for the whole array (only
+  // the first element of a biniou array carries a value tag), elements
+  // encoded in a tight loop. Byte-for-byte the output of a sized
+  // enterArray with one emit per element.
+  void emitIntegerArray(const int64_t *values, size_t numValues) {
+    enterArray((int)numValues);
+    for (size_t i = 0; i < numValues; i++) {
+      markWrite();
+      writeValueTag(i == 0, svint_tag);
+      writeSvint(values[i]);
+    }
+    leaveArray();
+  }
+  void emitStringArray(const std::string_view *values, size_t numValues) {
+    enterArray((int)numValues);
+    if (shareStrings_) {
+      // interning decides per string between bytes and a back
+      // reference, so the elements take the full emitString path
+      for (size_t i = 0; i < numValues; i++) {
+        emitString(values[i]);
+      }
+    } else {
+      for (size_t i = 0; i < numValues; i++) {
+        markWrite();
+        writeValueTag(i == 0, string_tag);
+        writeUvint(values[i].length());
+        writeBytes(values[i].data(), values[i].length());
+      }
+    }
+    leaveArray();
+  }
+
+  // Splice a pre-serialized value. A standalone biniou value starts with
+  // its own tag byte, which is exactly the encoding of a first array
+  // element; later elements drop the byte, since the first occurrence
+  // announced the tag for the whole array.
+  void emitElementBytes(std::string_view val) {
+    if (val.empty()) {
+      return;
+    }
+    bool needTag = beginValue((uint8_t)val[0]);
+    markWrite();
+    if (needTag) {
+      writeBytes(val.data(), val.length());
+    } else {
+      writeBytes(val.data() + 1, val.length() - 1);
+    }
+  }
+
+  void emitTag(std::string_view val) {
+    statsSetContext(val);
+    writeFieldTag(biniou_hash(val));
+  }
+
+  void emitTag(const Tag &val) {
+    statsSetContext(val.str());
+    writeFieldTag(val.hash());
+  }
+
+  void emitVariantTag(std::string_view val, bool hasArg) {
+    enterVariantContainer(VARIANT_tag);
+    statsSetContext(val);
+    int32_t hash = biniou_hash(val);
+    // set first bit of hash if the variant has an argument
+    if (hasArg) {
+      hash |= 1 << 31;
+    }
+    markWrite();
+    write32(hash);
+  }
+  void emitVariantTag(const Tag &val, bool hasArg) {
+    enterVariantContainer(VARIANT_tag);
+    statsSetContext(val.str());
+    int32_t hash = (int32_t)val.hash();
+    if (hasArg) {
+      hash |= 1 << 31;
+    }
+    markWrite();
+    write32(hash);
+  }
+  void emitVariantTag(const NumTag &val, bool hasArg) {
+    if (!numVariants_) {
+      emitVariantTag(static_cast<const Tag &>(val), hasArg);
+      return;
+    }
+    enterVariantContainer(NUM_VARIANT_tag);
+    statsSetContext(val.str());
+    markWrite();
+    // num_variant payload: the index in the low 7 bits of one byte, the
+    // top bit set when the variant has an argument
+    write8((uint8_t)(val.index() | (hasArg ? 0x80 : 0)));
+  }
+
+  void enterArray(int size) { enterContainer(ARRAY_tag, size); }
+  void enterArray() { enterContainer(ARRAY_tag, SIZE_UNKNOWN); }
+  void leaveArray() {
+    if (atdContainers.back().size == SIZE_UNKNOWN) {
+      // splice the buffered elements into the parent sink, now that the
+      // element count is known
+      int count = atdContainers.back().count;
+      std::vector<char> elements = std::move(captures_.back());
+      captures_.pop_back();
+      writeUvint(count);
+      rebaseSharedCapture(captures_.size() + 1);
+      spliceBytes(elements.data(), elements.size());
+    }
+    leaveContainer();
+  }
+  void enterObject(int size) { enterContainer(RECORD_tag, size); }
   // unsupported:
   // void enterObject() { enterContainer(RECORD_tag); }
   void leaveObject() {
     const ATDContainer &obj = atdContainers.back();
-    // Container's size was already written -> must fill in for missing
-    // records.
-    for (int i = obj.count / 2; i < obj.size; i++) {
-      emitDummyRecordField();
+    int actualSize = obj.count / 2;
+    if (backpatchSizes_ && actualSize != obj.size &&
+        uvintLength(actualSize) == uvintLength(obj.size)) {
+      patchUvintAt(bufferAtDepth(obj.captureDepth), obj.sizeOffset, actualSize);
+    } else {
+      // Container's size was already written -> must fill in for missing
+      // records.
+      for (int i = actualSize; i < obj.size; i++) {
+        emitDummyRecordField();
+      }
     }
     leaveContainer();
   }
@@ -662,10 +1539,1139 @@ class BiniouEmitter {
   // unsupported:
   // void enterTuple() { enterContainer(TUPLE_tag); }
   void leaveTuple() { leaveContainer(); }
-  void enterVariant() { enterContainer(VARIANT_tag, SIZE_NOT_NEEDED); }
+
+  // Tables: arrays of identically-shaped records where the field hashes
+  // and value tags are written once, in a column header taken from the
+  // first row, instead of once per element.
+  void enterTable(int numRows) {
+    bool needTag = beginValue(TABLE_tag);
+    statsEnterContainer();
+    atdContainers.emplace_back(TABLE_tag, numRows, captures_.size());
+    writeValueTag(needTag, TABLE_tag);
+    writeUvint(numRows);
+    tables_.emplace_back();
+  }
+  void leaveTable() {
+    tables_.pop_back();
+    leaveContainer();
+  }
+  void enterTableRow(int numElems) {
+    statsEnterContainer();
+    atdContainers.emplace_back(RECORD_tag, numElems, captures_.size());
+    atdContainers.back().tableRow = true;
+    if (tables_.back().rowIndex == 0) {
+      // buffer the first row until its column layout is known
+      captures_.emplace_back();
+    }
+  }
+  void leaveTableRow() {
+    TableState &table = tables_.back();
+    if (table.rowIndex == 0) {
+      // the header precedes all row data: column count, then field hash
+      // and value tag per column, then the captured first-row values
+      std::vector<char> row = std::move(captures_.back());
+      captures_.pop_back();
+      writeUvint(table.columns.size());
+      for (const auto &col : table.columns) {
+        write32((int32_t)(col.first | (1u << 31)));
+        write8(col.second);
+      }
+      rebaseSharedCapture(captures_.size() + 1);
+      spliceBytes(row.data(), row.size());
+    }
+    table.rowIndex++;
+    leaveContainer();
+  }
+  // The value tag depends on the name about to be written (VARIANT_tag
+  // for hashed names, NUM_VARIANT_tag for indexed ones under
+  // numVariants_), so the container is opened by emitVariantTag, which
+  // always follows immediately with no bytes written in between.
+  void enterVariant() {}
+  void leaveVariant() { leaveContainer(); }
+};
+
+// Configure GenWriter for the flat, offset-based binary output: records
+// are fixed-layout structs in a contiguous buffer and strings are
+// slices of a separate blob, so a consumer can mmap a capture and
+// navigate it through offsets without deserializing anything.
+//
+// Layout: a 32-byte header - the 8 bytes "ASTFLAT1", then records
+// offset, records size, blob offset, blob size, root count and the
+// offset of the root-offset array, all u32 little-endian - followed by
+// the records region and the string blob. Record offsets are relative
+// to the records region, whose first 8 bytes are zero so that offset 0
+// means "none". Records start 8-byte aligned, with a one-byte kind:
+//   'n' null                      (8 bytes)
+//   'b' bool: value in byte 1     (8 bytes)
+//   'i' int: i64 at byte 8        (16 bytes)
+//   'f' float: f64 at byte 8      (16 bytes)
+//   's' string: u32 blob offset and u32 length at byte 4
+//   'x' bytes: a verbatim splice, same slots as 's'
+//   'A' array / 'T' tuple / 't' table: u32 count at byte 4, then count
+//       u32 child record offsets
+//   'O' object / 'r' table row: u32 count at byte 4, then count pairs
+//       of u32 (field name string record, value record) offsets
+//   'V' variant: u32 name string record offset at byte 4, u32 argument
+//       record offset at byte 8 (0 when the variant has none)
+// Identical strings (field names included) intern to one record. The
+// whole output is buffered and written at EOF, when the offsets are
+// final.
+template <class OStream = std::ostream>
+class FlatEmitter {
+  OStream &os_;
+
+  std::vector<uint8_t> records_;
+  std::vector<uint8_t> blob_;
+  // string contents -> string record offset
+  std::map<std::string, uint32_t, std::less<>> internedStrings_;
+  // one open container per nesting level; objects and table rows
+  // alternate name and value offsets in items
+  struct Pending {
+    uint8_t kind;
+    std::vector<uint32_t> items;
+  };
+  std::vector<Pending> open_;
+  std::vector<uint32_t> roots_;
+
+  static void appendLE32(std::vector<uint8_t> &buf, uint32_t v) {
+    for (int i = 0; i < 4; i++) {
+      buf.push_back((uint8_t)(v >> (8 * i)));
+    }
+  }
+  static void appendLE64(std::vector<uint8_t> &buf, uint64_t v) {
+    for (int i = 0; i < 8; i++) {
+      buf.push_back((uint8_t)(v >> (8 * i)));
+    }
+  }
+
+  // 8-align and place the kind byte; returns the record's offset
+  uint32_t beginRecord(uint8_t kind) {
+    while (records_.size() % 8 != 0) {
+      records_.push_back(0);
+    }
+    uint32_t off = (uint32_t)records_.size();
+    records_.push_back(kind);
+    return off;
+  }
+  void padRecordTo(uint32_t off, size_t size) {
+    while (records_.size() < off + size) {
+      records_.push_back(0);
+    }
+  }
+
+  uint32_t internString(std::string_view val) {
+    auto it = internedStrings_.find(val);
+    if (it != internedStrings_.end()) {
+      return it->second;
+    }
+    uint32_t blobOff = (uint32_t)blob_.size();
+    blob_.insert(blob_.end(), val.begin(), val.end());
+    uint32_t off = beginRecord('s');
+    padRecordTo(off, 4);
+    appendLE32(records_, blobOff);
+    appendLE32(records_, (uint32_t)val.size());
+    internedStrings_.emplace(std::string(val), off);
+    return off;
+  }
+
+  // attach a finished record to the enclosing container, or make it a
+  // root when there is none (the document, then trailing values)
+  void addValue(uint32_t off) {
+    if (open_.empty()) {
+      roots_.push_back(off);
+    } else {
+      open_.back().items.push_back(off);
+    }
+  }
+
+  void enterContainer(uint8_t kind) { open_.push_back(Pending{kind, {}}); }
+
+  void leaveContainer() {
+    Pending top = std::move(open_.back());
+    open_.pop_back();
+    uint32_t off = beginRecord(top.kind);
+    padRecordTo(off, 4);
+    if (top.kind == 'V') {
+      appendLE32(records_, top.items.empty() ? 0 : top.items[0]);
+      appendLE32(records_, top.items.size() > 1 ? top.items[1] : 0);
+    } else if (top.kind == 'O' || top.kind == 'r') {
+      appendLE32(records_, (uint32_t)(top.items.size() / 2));
+      for (uint32_t item : top.items) {
+        appendLE32(records_, item);
+      }
+    } else {
+      appendLE32(records_, (uint32_t)top.items.size());
+      for (uint32_t item : top.items) {
+        appendLE32(records_, item);
+      }
+    }
+    addValue(off);
+  }
+
+ public:
+  bool shouldSimpleVariantsBeEmittedAsStrings;
+
+  FlatEmitter(OStream &os, const ATDWriterOptions opts)
+      : os_(os), shouldSimpleVariantsBeEmittedAsStrings(true) {
+    if (opts.expectedOutputBytes > 0) {
+      // both regions grow until EOF; records dominate the output of the
+      // exporter, so split the size hint accordingly
+      records_.reserve(opts.expectedOutputBytes / 4 * 3);
+      blob_.reserve(opts.expectedOutputBytes / 4);
+    }
+    // offset 0 stands for "none", never for a record
+    appendLE64(records_, 0);
+  }
+
+  void emitEOF() {
+    // the root-offset array lives at the end of the records region
+    while (records_.size() % 4 != 0) {
+      records_.push_back(0);
+    }
+    uint32_t rootsOff = (uint32_t)records_.size();
+    for (uint32_t root : roots_) {
+      appendLE32(records_, root);
+    }
+    std::vector<uint8_t> header;
+    header.insert(header.end(),
+                  (const uint8_t *)"ASTFLAT1",
+                  (const uint8_t *)"ASTFLAT1" + 8);
+    const uint32_t recordsOff = 32;
+    appendLE32(header, recordsOff);
+    appendLE32(header, (uint32_t)records_.size());
+    appendLE32(header, recordsOff + (uint32_t)records_.size());
+    appendLE32(header, (uint32_t)blob_.size());
+    appendLE32(header, (uint32_t)roots_.size());
+    appendLE32(header, rootsOff);
+    os_.write((const char *)header.data(), header.size());
+    os_.write((const char *)records_.data(), records_.size());
+    os_.write((const char *)blob_.data(), blob_.size());
+    os_.flush();
+  }
+
+  // everything is buffered until the offsets are final at EOF
+  void flushOutput() {}
+
+  // sharing comes for free: interning already collapses strings, and a
+  // reader follows offsets, so no back-pointer scheme is needed
+  bool enterSharedValue(uint64_t key) { return true; }
+
+  void emitNull() { addValue(beginRecord('n')); }
+  void emitBoolean(bool val) {
+    uint32_t off = beginRecord('b');
+    records_.push_back(val ? 1 : 0);
+    addValue(off);
+  }
+  void emitInteger(int64_t val) {
+    uint32_t off = beginRecord('i');
+    padRecordTo(off, 8);
+    appendLE64(records_, (uint64_t)val);
+    addValue(off);
+  }
+  void emitDouble(double val) {
+    uint32_t off = beginRecord('f');
+    padRecordTo(off, 8);
+    uint64_t bits;
+    static_assert(sizeof(bits) == sizeof(val), "double must be 64-bit");
+    memcpy(&bits, &val, sizeof(bits));
+    appendLE64(records_, bits);
+    addValue(off);
+  }
+  void emitString(std::string_view val) { addValue(internString(val)); }
+  // flat records carry no per-element separator state, so bulk arrays
+  // are just the per-element calls
+  void emitIntegerArray(const int64_t *values, size_t numValues) {
+    enterArray((int)numValues);
+    for (size_t i = 0; i < numValues; i++) {
+      emitInteger(values[i]);
+    }
+    leaveArray();
+  }
+  void emitStringArray(const std::string_view *values, size_t numValues) {
+    enterArray((int)numValues);
+    for (size_t i = 0; i < numValues; i++) {
+      emitString(values[i]);
+    }
+    leaveArray();
+  }
+  // a pre-serialized buffer cannot be spliced into a flat capture - its
+  // offsets are relative to the buffer that produced it - so the bytes
+  // are kept verbatim as an opaque record (PARALLEL_DECLS and flat
+  // output do not compose)
+  void emitElementBytes(std::string_view val) {
+    uint32_t blobOff = (uint32_t)blob_.size();
+    blob_.insert(blob_.end(), val.begin(), val.end());
+    uint32_t off = beginRecord('x');
+    padRecordTo(off, 4);
+    appendLE32(records_, blobOff);
+    appendLE32(records_, (uint32_t)val.size());
+    addValue(off);
+  }
+  void emitTag(std::string_view val) {
+    open_.back().items.push_back(internString(val));
+  }
+  void emitTag(const Tag &val) { emitTag(std::string_view(val.str())); }
+  void emitVariantTag(std::string_view val, bool hasArgs) {
+    open_.back().items.push_back(internString(val));
+  }
+  void emitVariantTag(const Tag &val, bool hasArgs) {
+    emitVariantTag(std::string_view(val.str()), hasArgs);
+  }
+
+  void enterArray() { enterContainer('A'); }
+  void enterArray(int size) { enterArray(); }
+  void leaveArray() { leaveContainer(); }
+  void enterTable(int numRows) { enterContainer('t'); }
+  void leaveTable() { leaveContainer(); }
+  void enterTableRow(int numElems) { enterContainer('r'); }
+  void leaveTableRow() { leaveContainer(); }
+  void enterObject() { enterContainer('O'); }
+  void enterObject(int size) { enterObject(); }
+  void leaveObject() { leaveContainer(); }
+  void enterTuple() { enterContainer('T'); }
+  void enterTuple(int size) { enterTuple(); }
+  void leaveTuple() { leaveContainer(); }
+  void enterVariant() { enterContainer('V'); }
   void leaveVariant() { leaveContainer(); }
 };
 
+// Semantic-fingerprint sink: consumes the same event stream as a real
+// emitter - typically teed with one - but writes no document, only a
+// rolling 64-bit hash (FNV-1a over typed events), printed as one hex
+// line at EOF. Fields whose tag names a volatile set ("pointer",
+// "source_range") are elided together with their whole value subtree,
+// because pointers and absolute locations shift between otherwise
+// identical runs; hashing the raw output would therefore never match,
+// while this skeleton hash answers "did the TU's AST meaningfully
+// change" and can drive cache invalidation without a second traversal
+// or a byte-level diff.
+//
+// Shared values are always re-emitted into the hash (enterSharedValue
+// returns true), so when teed the partner emitter must not dedup
+// either (value sharing off, as BiniouJsonTeeWriter already forces);
+// and spliced pre-serialized buffers are hashed verbatim - the
+// elision cannot see inside them, so PARALLEL_DECLS weakens the
+// invariance to whatever the buffers contain.
+template <class OStream = std::ostream>
+class SkeletonHashEmitter {
+  OStream &os_;
+
+  uint64_t hash_ = 0xcbf29ce484222325ULL; // FNV-1a offset basis
+  // the next value is a volatile field's and must be skipped
+  bool skipPending_ = false;
+  // containers still open inside the subtree being skipped
+  unsigned skipNesting_ = 0;
+
+  void mix(const char *data, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+      hash_ ^= (unsigned char)data[i];
+      hash_ *= 0x100000001b3ULL; // FNV-1a prime
+    }
+  }
+  void mixEvent(char kind, std::string_view val = {}) {
+    mix(&kind, 1);
+    mix(val.data(), val.size());
+  }
+
+  static bool isVolatileTag(std::string_view val) {
+    return val == "pointer" || val == "source_range";
+  }
+
+  bool skipping() const { return skipNesting_ > 0; }
+  // true when the current scalar value was consumed by a pending or
+  // active skip
+  bool skipScalar() {
+    if (skipping()) {
+      return true;
+    }
+    if (skipPending_) {
+      skipPending_ = false;
+      return true;
+    }
+    return false;
+  }
+  bool skipEnter() {
+    if (skipping()) {
+      skipNesting_++;
+      return true;
+    }
+    if (skipPending_) {
+      skipPending_ = false;
+      skipNesting_ = 1;
+      return true;
+    }
+    return false;
+  }
+  bool skipLeave() {
+    if (skipping()) {
+      skipNesting_--;
+      return true;
+    }
+    return false;
+  }
+
+ public:
+  bool shouldSimpleVariantsBeEmittedAsStrings;
+
+  SkeletonHashEmitter(OStream &os, const ATDWriterOptions opts)
+      : os_(os), shouldSimpleVariantsBeEmittedAsStrings(true) {}
+
+  void emitEOF() {
+    char hex[17];
+    for (int i = 15; i >= 0; i--) {
+      hex[i] = "0123456789abcdef"[hash_ & 0xf];
+      hash_ >>= 4;
+    }
+    hex[16] = '\n';
+    os_.write(hex, sizeof(hex));
+    os_.flush();
+  }
+  void flushOutput() {}
+
+  // every shared value goes into the hash; see the caveat above
+  bool enterSharedValue(uint64_t key) { return true; }
+
+  void emitNull() {
+    if (!skipScalar()) {
+      mixEvent('n');
+    }
+  }
+  void emitBoolean(bool val) {
+    if (!skipScalar()) {
+      mixEvent(val ? 'T' : 'F');
+    }
+  }
+  void emitInteger(int64_t val) {
+    if (!skipScalar()) {
+      char bytes[8];
+      for (int i = 0; i < 8; i++) {
+        bytes[i] = (char)(val >> (8 * i));
+      }
+      mixEvent('i', std::string_view(bytes, sizeof(bytes)));
+    }
+  }
+  void emitDouble(double val) {
+    if (!skipScalar()) {
+      char bytes[8];
+      static_assert(sizeof(bytes) == sizeof(val), "double must be 64-bit");
+      memcpy(bytes, &val, sizeof(bytes));
+      mixEvent('f', std::string_view(bytes, sizeof(bytes)));
+    }
+  }
+  void emitString(std::string_view val) {
+    if (!skipScalar()) {
+      mixEvent('s', val);
+    }
+  }
+  void emitElementBytes(std::string_view val) {
+    if (!skipScalar()) {
+      mixEvent('x', val);
+    }
+  }
+  // bulk arrays hash as the equivalent per-element events, so the
+  // fingerprint does not depend on which API the exporter used
+  void emitIntegerArray(const int64_t *values, size_t numValues) {
+    enterArray((int)numValues);
+    for (size_t i = 0; i < numValues; i++) {
+      emitInteger(values[i]);
+    }
+    leaveArray();
+  }
+  void emitStringArray(const std::string_view *values, size_t numValues) {
+    enterArray((int)numValues);
+    for (size_t i = 0; i < numValues; i++) {
+      emitString(values[i]);
+    }
+    leaveArray();
+  }
+  void emitTag(std::string_view val) {
+    if (skipping()) {
+      return;
+    }
+    if (isVolatileTag(val)) {
+      // neither the tag nor its value reaches the hash
+      skipPending_ = true;
+      return;
+    }
+    mixEvent('t', val);
+  }
+  void emitTag(const Tag &val) { emitTag(std::string_view(val.str())); }
+  void emitVariantTag(std::string_view val, bool hasArgs) {
+    if (!skipping()) {
+      mixEvent('v', val);
+    }
+  }
+  void emitVariantTag(const Tag &val, bool hasArgs) {
+    emitVariantTag(std::string_view(val.str()), hasArgs);
+  }
+
+  void enterArray() {
+    if (!skipEnter()) {
+      mixEvent('[');
+    }
+  }
+  void enterArray(int size) { enterArray(); }
+  void leaveArray() {
+    if (!skipLeave()) {
+      mixEvent(']');
+    }
+  }
+  void enterTable(int numRows) {
+    if (!skipEnter()) {
+      mixEvent('#');
+    }
+  }
+  void leaveTable() {
+    if (!skipLeave()) {
+      mixEvent('$');
+    }
+  }
+  void enterTableRow(int numElems) {
+    if (!skipEnter()) {
+      mixEvent('r');
+    }
+  }
+  void leaveTableRow() {
+    if (!skipLeave()) {
+      mixEvent('R');
+    }
+  }
+  void enterObject() {
+    if (!skipEnter()) {
+      mixEvent('{');
+    }
+  }
+  void enterObject(int size) { enterObject(); }
+  void leaveObject() {
+    if (!skipLeave()) {
+      mixEvent('}');
+    }
+  }
+  void enterTuple() {
+    if (!skipEnter()) {
+      mixEvent('(');
+    }
+  }
+  void enterTuple(int size) { enterTuple(); }
+  void leaveTuple() {
+    if (!skipLeave()) {
+      mixEvent(')');
+    }
+  }
+  void enterVariant() {
+    if (!skipEnter()) {
+      mixEvent('<');
+    }
+  }
+  void leaveVariant() {
+    if (!skipLeave()) {
+      mixEvent('>');
+    }
+  }
+};
+
+// Fans every event out to two emitters writing to separate streams, so
+// that one traversal produces two artifacts at once. The sides may
+// disagree structurally on simple variants (a plain string in one
+// format, an empty variant block in another), so enterVariant is held
+// back until the tag arrives and each side then goes its own way.
+//
+// Two caveats follow from fanning events rather than bytes: value
+// sharing (enterSharedValue) is decided by the caller once for both
+// sides, so it must be disabled wherever the sides would answer
+// differently; and pre-serialized buffers (emitElementBytes) belong to
+// a single format and cannot be teed at all.
+template <class EmitterA, class EmitterB>
+class TeeEmitter {
+  EmitterA a_;
+  EmitterB b_;
+
+  // which sides entered a variant container, per open variant
+  std::vector<std::pair<bool, bool>> openVariants_;
+  bool variantPending_ = false;
+
+ public:
+  // the string-or-variant decision is taken per side in emitVariantTag,
+  // so simple variants must not be collapsed to strings before that
+  const bool shouldSimpleVariantsBeEmittedAsStrings = false;
+
+  TeeEmitter(EmitterA a, EmitterB b) : a_(a), b_(b) {}
+
+  void emitEOF() {
+    a_.emitEOF();
+    b_.emitEOF();
+  }
+  void flushOutput() {
+    a_.flushOutput();
+    b_.flushOutput();
+  }
+  bool enterSharedValue(uint64_t key) {
+    bool needA = a_.enterSharedValue(key);
+    bool needB = b_.enterSharedValue(key);
+    // the sides must agree on whether the value gets emitted
+    assert(needA == needB);
+    return needA && needB;
+  }
+  void emitBoolean(bool val) {
+    a_.emitBoolean(val);
+    b_.emitBoolean(val);
+  }
+  void emitInteger(int64_t val) {
+    a_.emitInteger(val);
+    b_.emitInteger(val);
+  }
+  void emitDouble(double val) {
+    a_.emitDouble(val);
+    b_.emitDouble(val);
+  }
+  void emitString(std::string_view val) {
+    a_.emitString(val);
+    b_.emitString(val);
+  }
+  void emitElementBytes(std::string_view val) {
+    assert(false && "cannot splice single-format bytes into a tee");
+  }
+  void emitIntegerArray(const int64_t *values, size_t numValues) {
+    a_.emitIntegerArray(values, numValues);
+    b_.emitIntegerArray(values, numValues);
+  }
+  void emitStringArray(const std::string_view *values, size_t numValues) {
+    a_.emitStringArray(values, numValues);
+    b_.emitStringArray(values, numValues);
+  }
+  void emitTag(std::string_view val) {
+    a_.emitTag(val);
+    b_.emitTag(val);
+  }
+  void emitTag(const Tag &val) {
+    a_.emitTag(val);
+    b_.emitTag(val);
+  }
+  void emitVariantTag(std::string_view val, bool hasArg) {
+    assert(variantPending_);
+    variantPending_ = false;
+    bool openA = hasArg || !a_.shouldSimpleVariantsBeEmittedAsStrings;
+    bool openB = hasArg || !b_.shouldSimpleVariantsBeEmittedAsStrings;
+    openVariants_.emplace_back(openA, openB);
+    if (openA) {
+      a_.enterVariant();
+      a_.emitVariantTag(val, hasArg);
+    } else {
+      a_.emitString(val);
+    }
+    if (openB) {
+      b_.enterVariant();
+      b_.emitVariantTag(val, hasArg);
+    } else {
+      b_.emitString(val);
+    }
+  }
+  void emitVariantTag(const Tag &val, bool hasArg) {
+    assert(variantPending_);
+    variantPending_ = false;
+    bool openA = hasArg || !a_.shouldSimpleVariantsBeEmittedAsStrings;
+    bool openB = hasArg || !b_.shouldSimpleVariantsBeEmittedAsStrings;
+    openVariants_.emplace_back(openA, openB);
+    if (openA) {
+      a_.enterVariant();
+      a_.emitVariantTag(val, hasArg);
+    } else {
+      a_.emitString(val.str());
+    }
+    if (openB) {
+      b_.enterVariant();
+      b_.emitVariantTag(val, hasArg);
+    } else {
+      b_.emitString(val.str());
+    }
+  }
+
+  void enterArray(int size) {
+    a_.enterArray(size);
+    b_.enterArray(size);
+  }
+  void enterArray() {
+    a_.enterArray();
+    b_.enterArray();
+  }
+  void leaveArray() {
+    a_.leaveArray();
+    b_.leaveArray();
+  }
+  void enterObject(int size) {
+    a_.enterObject(size);
+    b_.enterObject(size);
+  }
+  void leaveObject() {
+    a_.leaveObject();
+    b_.leaveObject();
+  }
+  void enterTuple(int size) {
+    a_.enterTuple(size);
+    b_.enterTuple(size);
+  }
+  void leaveTuple() {
+    a_.leaveTuple();
+    b_.leaveTuple();
+  }
+  void enterTable(int numRows) {
+    a_.enterTable(numRows);
+    b_.enterTable(numRows);
+  }
+  void leaveTable() {
+    a_.leaveTable();
+    b_.leaveTable();
+  }
+  void enterTableRow(int numElems) {
+    a_.enterTableRow(numElems);
+    b_.enterTableRow(numElems);
+  }
+  void leaveTableRow() {
+    a_.leaveTableRow();
+    b_.leaveTableRow();
+  }
+  void enterVariant() {
+    // deferred to emitVariantTag, where hasArg is known
+    variantPending_ = true;
+  }
+  void leaveVariant() {
+    if (openVariants_.back().first) {
+      a_.leaveVariant();
+    }
+    if (openVariants_.back().second) {
+      b_.leaveVariant();
+    }
+    openVariants_.pop_back();
+  }
+};
+
+// Decouples traversal from rendering so the two overlap: the producer
+// side (the exporter's visitors, through GenWriter) encodes every event
+// as a compact token - one opcode byte plus varint operands - into a
+// chunk buffer, and a render thread decodes the chunks and replays the
+// events into the wrapped emitter. Tokenizing is much cheaper than
+// rendering (no formatting, no field hashing, no size buffering), so a
+// serialization-bound capture runs at the speed of the slower of the
+// two threads instead of their sum. Chunks travel through the same
+// two-buffer hand-off as AsyncOStream, with hand-offs only at token
+// boundaries so a chunk always decodes completely.
+//
+// All copies of a PipelineEmitter share one pipeline (GenWriter takes
+// its emitter by value), and the wrapped emitter runs on the render
+// thread: nothing else may touch its output stream until emitEOF has
+// returned, which drains the tokens and joins the thread. Three
+// caveats follow. flushOutput is a request, not a barrier - bytes
+// reach the stream when the render thread gets there, so anything
+// reading stream offsets synchronously cannot compose with a pipeline.
+// enterSharedValue would need the render side's answer synchronously,
+// so value sharing must be disabled in the wrapped emitter (string
+// interning stays internal to BiniouEmitter and survives). And tags
+// are replayed by name, so precomputed Tag hashes are recomputed on
+// the render side.
+template <class ATDEmitter>
+class PipelineEmitter {
+  enum Op : uint8_t {
+    OP_BOOLEAN_FALSE,
+    OP_BOOLEAN_TRUE,
+    OP_INTEGER, // zigzag varint
+    OP_DOUBLE, // f64 bits, least significant byte first
+    OP_STRING, // uvint length + bytes
+    OP_ELEMENT_BYTES, // uvint length + bytes
+    OP_TAG, // uvint length + bytes
+    OP_VARIANT_TAG, // hasArg byte + uvint length + bytes
+    OP_INTEGER_ARRAY, // uvint count + zigzag varint each
+    OP_STRING_ARRAY, // uvint count + (uvint length + bytes) each
+    OP_ENTER_ARRAY, // uvint size
+    OP_ENTER_ARRAY_UNSIZED,
+    OP_LEAVE_ARRAY,
+    OP_ENTER_OBJECT, // uvint size
+    OP_LEAVE_OBJECT,
+    OP_ENTER_TUPLE, // uvint size
+    OP_LEAVE_TUPLE,
+    OP_ENTER_TABLE, // uvint numRows
+    OP_LEAVE_TABLE,
+    OP_ENTER_TABLE_ROW, // uvint numElems
+    OP_LEAVE_TABLE_ROW,
+    OP_ENTER_VARIANT,
+    OP_LEAVE_VARIANT,
+    OP_FLUSH,
+    OP_EOF
+  };
+
+  // the pipeline shared by all copies of the emitter; the front buffer
+  // belongs to the producer, the back buffer to the render thread
+  struct State {
+    ATDEmitter emitter;
+
+    static constexpr size_t chunkSize = 1 << 20;
+    std::vector<uint8_t> front_;
+    std::vector<uint8_t> back_;
+    std::mutex mutex_;
+    std::condition_variable produced_;
+    std::condition_variable consumed_;
+    bool pending_ = false;
+    bool done_ = false;
+    std::thread render_;
+
+    // decode scratch for the bulk arrays, reused across chunks (render
+    // thread only)
+    std::vector<int64_t> scratchIntegers_;
+    std::vector<std::string_view> scratchStrings_;
+
+    explicit State(ATDEmitter e) : emitter(e) {
+      front_.reserve(chunkSize);
+      back_.reserve(chunkSize);
+      render_ = std::thread([this] { renderLoop(); });
+    }
+
+    // normal shutdown happens in emitEOF; this only covers a pipeline
+    // abandoned without one
+    ~State() {
+      if (render_.joinable()) {
+        finish();
+      }
+    }
+
+    void handOff() {
+      std::unique_lock<std::mutex> lock(mutex_);
+      consumed_.wait(lock, [this] { return !pending_; });
+      std::swap(front_, back_);
+      pending_ = true;
+      lock.unlock();
+      produced_.notify_one();
+      front_.clear();
+    }
+
+    void finish() {
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (!front_.empty()) {
+          consumed_.wait(lock, [this] { return !pending_; });
+          std::swap(front_, back_);
+          pending_ = true;
+        }
+        done_ = true;
+      }
+      produced_.notify_one();
+      render_.join();
+    }
+
+    void renderLoop() {
+      std::unique_lock<std::mutex> lock(mutex_);
+      for (;;) {
+        produced_.wait(lock, [this] { return pending_ || done_; });
+        if (pending_) {
+          std::vector<uint8_t> chunk = std::move(back_);
+          back_ = std::vector<uint8_t>();
+          back_.reserve(chunkSize);
+          pending_ = false;
+          consumed_.notify_one();
+          lock.unlock();
+          render(chunk);
+          lock.lock();
+          // re-check: more tokens may already be pending
+          continue;
+        }
+        return;
+      }
+    }
+
+    // decoding counterparts of the put* encoders below
+    static uint64_t getUvint(const std::vector<uint8_t> &chunk, size_t &pos) {
+      uint64_t x = 0;
+      int shift = 0;
+      uint8_t b;
+      do {
+        b = chunk[pos++];
+        x |= (uint64_t)(b & 0x7f) << shift;
+        shift += 7;
+      } while (b & 0x80);
+      return x;
+    }
+
+    static std::string_view getBytes(const std::vector<uint8_t> &chunk,
+                                     size_t &pos) {
+      size_t size = (size_t)getUvint(chunk, pos);
+      std::string_view bytes((const char *)chunk.data() + pos, size);
+      pos += size;
+      return bytes;
+    }
+
+    void render(const std::vector<uint8_t> &chunk) {
+      size_t pos = 0;
+      while (pos < chunk.size()) {
+        switch ((enum Op)chunk[pos++]) {
+        case OP_BOOLEAN_FALSE:
+          emitter.emitBoolean(false);
+          break;
+        case OP_BOOLEAN_TRUE:
+          emitter.emitBoolean(true);
+          break;
+        case OP_INTEGER: {
+          uint64_t x = getUvint(chunk, pos);
+          emitter.emitInteger((int64_t)(x >> 1) ^ -(int64_t)(x & 1));
+          break;
+        }
+        case OP_DOUBLE: {
+          uint64_t bits = 0;
+          for (int i = 0; i < 8; i++) {
+            bits |= (uint64_t)chunk[pos++] << (8 * i);
+          }
+          double val;
+          memcpy(&val, &bits, sizeof(val));
+          emitter.emitDouble(val);
+          break;
+        }
+        case OP_STRING:
+          emitter.emitString(getBytes(chunk, pos));
+          break;
+        case OP_ELEMENT_BYTES:
+          emitter.emitElementBytes(getBytes(chunk, pos));
+          break;
+        case OP_TAG:
+          emitter.emitTag(getBytes(chunk, pos));
+          break;
+        case OP_VARIANT_TAG: {
+          bool hasArg = chunk[pos++] != 0;
+          emitter.emitVariantTag(getBytes(chunk, pos), hasArg);
+          break;
+        }
+        case OP_INTEGER_ARRAY: {
+          size_t count = (size_t)getUvint(chunk, pos);
+          scratchIntegers_.clear();
+          for (size_t i = 0; i < count; i++) {
+            uint64_t x = getUvint(chunk, pos);
+            scratchIntegers_.push_back((int64_t)(x >> 1) ^ -(int64_t)(x & 1));
+          }
+          emitter.emitIntegerArray(scratchIntegers_.data(), count);
+          break;
+        }
+        case OP_STRING_ARRAY: {
+          size_t count = (size_t)getUvint(chunk, pos);
+          scratchStrings_.clear();
+          for (size_t i = 0; i < count; i++) {
+            scratchStrings_.push_back(getBytes(chunk, pos));
+          }
+          emitter.emitStringArray(scratchStrings_.data(), count);
+          break;
+        }
+        case OP_ENTER_ARRAY:
+          emitter.enterArray((int)getUvint(chunk, pos));
+          break;
+        case OP_ENTER_ARRAY_UNSIZED:
+          emitter.enterArray();
+          break;
+        case OP_LEAVE_ARRAY:
+          emitter.leaveArray();
+          break;
+        case OP_ENTER_OBJECT:
+          emitter.enterObject((int)getUvint(chunk, pos));
+          break;
+        case OP_LEAVE_OBJECT:
+          emitter.leaveObject();
+          break;
+        case OP_ENTER_TUPLE:
+          emitter.enterTuple((int)getUvint(chunk, pos));
+          break;
+        case OP_LEAVE_TUPLE:
+          emitter.leaveTuple();
+          break;
+        case OP_ENTER_TABLE:
+          emitter.enterTable((int)getUvint(chunk, pos));
+          break;
+        case OP_LEAVE_TABLE:
+          emitter.leaveTable();
+          break;
+        case OP_ENTER_TABLE_ROW:
+          emitter.enterTableRow((int)getUvint(chunk, pos));
+          break;
+        case OP_LEAVE_TABLE_ROW:
+          emitter.leaveTableRow();
+          break;
+        case OP_ENTER_VARIANT:
+          emitter.enterVariant();
+          break;
+        case OP_LEAVE_VARIANT:
+          emitter.leaveVariant();
+          break;
+        case OP_FLUSH:
+          emitter.flushOutput();
+          break;
+        case OP_EOF:
+          emitter.emitEOF();
+          break;
+        }
+      }
+    }
+  };
+
+  std::shared_ptr<State> s_;
+
+  void putOp(enum Op op) { s_->front_.push_back((uint8_t)op); }
+
+  void putUvint(uint64_t x) {
+    while (x >= 0x80) {
+      s_->front_.push_back((uint8_t)((x & 0x7f) | 0x80));
+      x >>= 7;
+    }
+    s_->front_.push_back((uint8_t)x);
+  }
+
+  void putBytes(std::string_view bytes) {
+    putUvint(bytes.size());
+    s_->front_.insert(s_->front_.end(), bytes.begin(), bytes.end());
+  }
+
+  // hand off only between tokens, so chunks always decode completely
+  void tokenDone() {
+    if (s_->front_.size() >= State::chunkSize) {
+      s_->handOff();
+    }
+  }
+
+ public:
+  // the decision is the wrapped emitter's; copied at construction since
+  // the emitter itself belongs to the render thread afterwards
+  const bool shouldSimpleVariantsBeEmittedAsStrings;
+
+  explicit PipelineEmitter(ATDEmitter emitter)
+      : s_(std::make_shared<State>(emitter)),
+        shouldSimpleVariantsBeEmittedAsStrings(
+            emitter.shouldSimpleVariantsBeEmittedAsStrings) {}
+
+  // drains the pipeline: every token is rendered and the render thread
+  // joined before this returns, after which the output is complete
+  void emitEOF() {
+    putOp(OP_EOF);
+    s_->finish();
+  }
+  // a request, not a barrier: rendered in order with the other tokens
+  void flushOutput() {
+    putOp(OP_FLUSH);
+    s_->handOff();
+  }
+  // answering would need the render side's state synchronously; value
+  // sharing must be disabled in the wrapped emitter instead
+  bool enterSharedValue(uint64_t key) { return true; }
+  void emitBoolean(bool val) {
+    putOp(val ? OP_BOOLEAN_TRUE : OP_BOOLEAN_FALSE);
+    tokenDone();
+  }
+  void emitInteger(int64_t val) {
+    putOp(OP_INTEGER);
+    putUvint(((uint64_t)val << 1) ^ (uint64_t)(val >> 63));
+    tokenDone();
+  }
+  void emitDouble(double val) {
+    putOp(OP_DOUBLE);
+    uint64_t bits;
+    memcpy(&bits, &val, sizeof(bits));
+    for (int i = 0; i < 8; i++) {
+      s_->front_.push_back((uint8_t)(bits >> (8 * i)));
+    }
+    tokenDone();
+  }
+  void emitString(std::string_view val) {
+    putOp(OP_STRING);
+    putBytes(val);
+    tokenDone();
+  }
+  void emitElementBytes(std::string_view val) {
+    putOp(OP_ELEMENT_BYTES);
+    putBytes(val);
+    tokenDone();
+  }
+  void emitTag(std::string_view val) {
+    putOp(OP_TAG);
+    putBytes(val);
+    tokenDone();
+  }
+  void emitTag(const Tag &val) { emitTag(std::string_view(val.str())); }
+  void emitVariantTag(std::string_view val, bool hasArg) {
+    putOp(OP_VARIANT_TAG);
+    s_->front_.push_back(hasArg ? 1 : 0);
+    putBytes(val);
+    tokenDone();
+  }
+  void emitVariantTag(const Tag &val, bool hasArg) {
+    emitVariantTag(std::string_view(val.str()), hasArg);
+  }
+  void emitIntegerArray(const int64_t *values, size_t numValues) {
+    putOp(OP_INTEGER_ARRAY);
+    putUvint(numValues);
+    for (size_t i = 0; i < numValues; i++) {
+      putUvint(((uint64_t)values[i] << 1) ^ (uint64_t)(values[i] >> 63));
+    }
+    tokenDone();
+  }
+  void emitStringArray(const std::string_view *values, size_t numValues) {
+    putOp(OP_STRING_ARRAY);
+    putUvint(numValues);
+    for (size_t i = 0; i < numValues; i++) {
+      putBytes(values[i]);
+    }
+    tokenDone();
+  }
+
+  void enterArray(int size) {
+    putOp(OP_ENTER_ARRAY);
+    putUvint((uint64_t)size);
+    tokenDone();
+  }
+  void enterArray() {
+    putOp(OP_ENTER_ARRAY_UNSIZED);
+    tokenDone();
+  }
+  void leaveArray() {
+    putOp(OP_LEAVE_ARRAY);
+    tokenDone();
+  }
+  void enterObject(int size) {
+    putOp(OP_ENTER_OBJECT);
+    putUvint((uint64_t)size);
+    tokenDone();
+  }
+  void leaveObject() {
+    putOp(OP_LEAVE_OBJECT);
+    tokenDone();
+  }
+  void enterTuple(int size) {
+    putOp(OP_ENTER_TUPLE);
+    putUvint((uint64_t)size);
+    tokenDone();
+  }
+  void leaveTuple() {
+    putOp(OP_LEAVE_TUPLE);
+    tokenDone();
+  }
+  void enterTable(int numRows) {
+    putOp(OP_ENTER_TABLE);
+    putUvint((uint64_t)numRows);
+    tokenDone();
+  }
+  void leaveTable() {
+    putOp(OP_LEAVE_TABLE);
+    tokenDone();
+  }
+  void enterTableRow(int numElems) {
+    putOp(OP_ENTER_TABLE_ROW);
+    putUvint((uint64_t)numElems);
+    tokenDone();
+  }
+  void leaveTableRow() {
+    putOp(OP_LEAVE_TABLE_ROW);
+    tokenDone();
+  }
+  void enterVariant() {
+    putOp(OP_ENTER_VARIANT);
+    tokenDone();
+  }
+  void leaveVariant() {
+    putOp(OP_LEAVE_VARIANT);
+    tokenDone();
+  }
+};
+
 // The full class for JSON and YOJSON writing
 template <class OStream = std::ostream>
 class JsonWriter : public GenWriter<JsonEmitter<OStream>> {
@@ -685,6 +2691,45 @@ class BiniouWriter : public GenWriter<BiniouEmitter<OStream>> {
   BiniouWriter(OStream &os) : GenWriter<Emitter>(Emitter(os)) {}
 
   BiniouWriter(OStream &os, const ATDWriterOptions opts)
-      : GenWriter<Emitter>(Emitter(os)) {}
+      : GenWriter<Emitter>(Emitter(os, opts)) {}
+};
+
+// The full class for flat, offset-based binary writing
+template <class OStream>
+class FlatWriter : public GenWriter<FlatEmitter<OStream>> {
+  typedef FlatEmitter<OStream> Emitter;
+
+ public:
+  FlatWriter(OStream &os, const ATDWriterOptions opts)
+      : GenWriter<Emitter>(Emitter(os, opts)) {}
+};
+
+// The full class for skeleton-hash-only writing
+template <class OStream>
+class SkeletonHashWriter : public GenWriter<SkeletonHashEmitter<OStream>> {
+  typedef SkeletonHashEmitter<OStream> Emitter;
+
+ public:
+  SkeletonHashWriter(OStream &os, const ATDWriterOptions opts)
+      : GenWriter<Emitter>(Emitter(os, opts)) {}
+};
+
+// The full class for writing two formats from one stream of events
+template <class EmitterA, class EmitterB>
+class TeeWriter : public GenWriter<TeeEmitter<EmitterA, EmitterB>> {
+  typedef TeeEmitter<EmitterA, EmitterB> Emitter;
+
+ public:
+  TeeWriter(EmitterA a, EmitterB b) : GenWriter<Emitter>(Emitter(a, b)) {}
+};
+
+// The full class for pipelined writing: events are tokenized on the
+// calling thread and rendered into the wrapped emitter on a second one
+template <class ATDEmitter>
+class PipelineWriter : public GenWriter<PipelineEmitter<ATDEmitter>> {
+  typedef PipelineEmitter<ATDEmitter> Emitter;
+
+ public:
+  PipelineWriter(ATDEmitter emitter) : GenWriter<Emitter>(Emitter(emitter)) {}
 };
 } // namespace ATDWriter
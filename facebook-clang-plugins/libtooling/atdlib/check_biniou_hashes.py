@@ -0,0 +1,106 @@
+#!/usr/bin/env python3
+
+
+# Copyright (c) Facebook, Inc. and its affiliates.
+#
+# This source code is licensed under the MIT license found in the
+# LICENSE file in the root directory of this source tree.
+
+import sys
+import re
+import argparse
+
+"""
+Check an ATD specification for biniou hash collisions.
+
+Biniou identifies record fields and variant constructors by a 31-bit
+hash of their name, so two names in the same scope that hash alike
+would corrupt the output silently. This script recomputes the hash for
+every field of every record and every constructor of every sum type
+and fails on the first scope where two distinct names collide. Run it
+over the extracted ATD spec at build time; readers and writers then
+need no runtime collision checks.
+"""
+
+type_def = re.compile(r"type\s+([a-zA-Z0-9_']+)\s*=")
+field_name = re.compile(r"[~?]?\s*([a-zA-Z_][a-zA-Z0-9_]*)\s*:")
+constructor_name = re.compile(r"^\s*([A-Z][a-zA-Z0-9_]*)")
+
+def biniou_hash(name):
+    """31-bit string hash from the biniou specification, as in
+    BiniouEmitter::biniou_hash and the constexpr ATDWriter::Tag."""
+    h = 0
+    for c in name:
+        h = (223 * h + ord(c)) & 0xffffffff
+    return h % 0x80000000
+
+def strip_noise(text):
+    # neither cpp directives, (* *) comments nor <...> annotations
+    # contribute names
+    text = "\n".join(l for l in text.splitlines() if not l.lstrip().startswith("#"))
+    text = re.sub(r"\(\*.*?\*\)", " ", text, flags=re.S)
+    text = re.sub(r"<[^<>]*>", " ", text)
+    return text
+
+def scopes(text):
+    """Yield (kind, start, content) for every { record } and [ variant
+    sum ] in the text, with the content of nested scopes attributed to
+    the innermost scope only."""
+    stack = []
+    for i, c in enumerate(text):
+        if c in "{[":
+            stack.append(["record" if c == "{" else "variant", i, []])
+        elif c in "}]":
+            if stack:
+                kind, start, chars = stack.pop()
+                yield kind, start, "".join(chars)
+        elif stack:
+            stack[-1][2].append(c)
+
+def names_of(kind, content):
+    if kind == "record":
+        return field_name.findall(content)
+    names = []
+    for alternative in content.split("|"):
+        m = constructor_name.match(alternative)
+        if m:
+            names.append(m.group(1))
+    return names
+
+def check(text):
+    text = strip_noise(text)
+    # collisions are reported against the closest preceding type definition
+    defs = [(m.start(), m.group(1)) for m in type_def.finditer(text)]
+    collisions = 0
+    counts = {"record": 0, "variant": 0}
+    for kind, start, content in scopes(text):
+        counts[kind] += 1
+        type_name = "?"
+        for def_start, name in defs:
+            if def_start > start:
+                break
+            type_name = name
+        seen = {}
+        for name in names_of(kind, content):
+            h = biniou_hash(name)
+            if h in seen and seen[h] != name:
+                print("[!] biniou hash collision in type %s: '%s' and '%s' "
+                      "both hash to %#x" % (type_name, seen[h], name, h))
+                collisions += 1
+            seen[h] = name
+    print("[*] checked %d record types and %d variant types, %d collision(s)"
+          % (counts["record"], counts["variant"], collisions))
+    return collisions
+
+def main():
+    arg_parser = argparse.ArgumentParser(description='Check the record fields and variant constructors of an ATD file for biniou hash collisions')
+    arg_parser.add_argument(metavar="FILE", nargs='?', dest="input_file", help="Input ATD file (default: stdin)")
+    args = arg_parser.parse_args()
+    if args.input_file:
+        file = open(args.input_file, "r")
+    else:
+        file = sys.stdin
+    sys.exit(1 if check(file.read()) else 0)
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,206 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// Emitter microbenchmark: drives GenWriter with synthetic event streams
+// (deep nesting, wide records, string-heavy, varint-heavy) for each
+// emitter and reports events/sec, so emitter-level changes can be
+// evaluated without building the full clang plugin.
+//
+// Usage: benchtest [scale]   (default scale 1; events grow linearly)
+//
+// Output goes to a discarding stream so the numbers are about the
+// emitter, not the sink.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "../ATDWriter.h"
+
+namespace {
+
+class NullBuffer : public std::streambuf {
+  std::streamsize xsputn(const char *, std::streamsize n) override {
+    count_ += n;
+    return n;
+  }
+  int overflow(int c) override {
+    count_++;
+    return c;
+  }
+  size_t count_ = 0;
+
+ public:
+  size_t count() const { return count_; }
+};
+
+// one event = one emitted value, tag, or scope transition
+
+template <class Writer>
+size_t emitDeep(Writer &OF, int depth) {
+  if (depth == 0) {
+    OF.emitInteger(42);
+    return 1;
+  }
+  typename Writer::ObjectScope Scope(OF, 1);
+  OF.emitTag("child");
+  return 3 + emitDeep(OF, depth - 1);
+}
+
+template <class Writer>
+size_t deepNesting(Writer &OF, int repeat) {
+  typename Writer::ArrayScope Scope(OF, repeat);
+  size_t events = 2;
+  for (int i = 0; i < repeat; i++) {
+    events += emitDeep(OF, 64);
+  }
+  return events;
+}
+
+template <class Writer>
+size_t wideRecords(Writer &OF, int repeat, const std::vector<std::string> &tags) {
+  typename Writer::ArrayScope Scope(OF, repeat);
+  size_t events = 2;
+  for (int i = 0; i < repeat; i++) {
+    typename Writer::ObjectScope Record(OF, tags.size());
+    events += 2;
+    for (size_t f = 0; f < tags.size(); f++) {
+      OF.emitTag(tags[f]);
+      switch (f % 3) {
+      case 0:
+        OF.emitInteger((int64_t)f * 12345);
+        break;
+      case 1:
+        OF.emitBoolean(f & 1);
+        break;
+      default:
+        OF.emitString("field value");
+        break;
+      }
+      events += 2;
+    }
+  }
+  return events;
+}
+
+template <class Writer>
+size_t stringHeavy(Writer &OF, int repeat) {
+  static const char *corpus[] = {
+      "x",
+      "short",
+      "an identifier_with_some_length",
+      "/very/long/path/like/string/with/many/components/file_name.h",
+      "text with \"escapes\" and \t control \n characters",
+  };
+  const int n = sizeof(corpus) / sizeof(corpus[0]);
+  typename Writer::ArrayScope Scope(OF, repeat * n);
+  size_t events = 2;
+  for (int i = 0; i < repeat; i++) {
+    for (int s = 0; s < n; s++) {
+      OF.emitString(corpus[s]);
+      events++;
+    }
+  }
+  return events;
+}
+
+template <class Writer>
+size_t varintHeavy(Writer &OF, int repeat) {
+  static const int64_t values[] = {
+      0, 1, -1, 127, 128, 300, -300, 65535, 70000, 1 << 28, -(1 << 28),
+      5000000000LL, -5000000000LL, INT64_MAX, INT64_MIN + 1};
+  const int n = sizeof(values) / sizeof(values[0]);
+  typename Writer::ArrayScope Scope(OF, repeat * n);
+  size_t events = 2;
+  for (int i = 0; i < repeat; i++) {
+    for (int v = 0; v < n; v++) {
+      OF.emitInteger(values[v]);
+      events++;
+    }
+  }
+  return events;
+}
+
+template <class Writer>
+void benchEmitter(const char *name,
+                  const ATDWriter::ATDWriterOptions &options,
+                  int scale) {
+  std::vector<std::string> tags;
+  for (int f = 0; f < 64; f++) {
+    tags.push_back("field_" + std::to_string(f));
+  }
+  struct Workload {
+    const char *name;
+    size_t (*run)(Writer &, int, const std::vector<std::string> &);
+  };
+  const Workload workloads[] = {
+      {"deep_nesting",
+       [](Writer &OF, int repeat, const std::vector<std::string> &) {
+         return deepNesting(OF, repeat);
+       }},
+      {"wide_records",
+       [](Writer &OF, int repeat, const std::vector<std::string> &tags) {
+         return wideRecords(OF, repeat, tags);
+       }},
+      {"string_heavy",
+       [](Writer &OF, int repeat, const std::vector<std::string> &) {
+         return stringHeavy(OF, repeat * 10);
+       }},
+      {"varint_heavy",
+       [](Writer &OF, int repeat, const std::vector<std::string> &) {
+         return varintHeavy(OF, repeat * 10);
+       }},
+  };
+  for (const Workload &workload : workloads) {
+    NullBuffer buffer;
+    std::ostream sink(&buffer);
+    auto start = std::chrono::steady_clock::now();
+    size_t events;
+    {
+      Writer OF(sink, options);
+      events = workload.run(OF, 2000 * scale, tags);
+    }
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    printf("%-8s %-13s %9zu events  %7.3f ms  %7.2f Mevents/s  %zu bytes\n",
+           name,
+           workload.name,
+           events,
+           elapsed.count() * 1e3,
+           events / elapsed.count() / 1e6,
+           buffer.count());
+  }
+}
+
+} // namespace
+
+typedef ATDWriter::JsonWriter<std::ostream> JsonWriter;
+typedef ATDWriter::BiniouWriter<std::ostream> BiniouWriter;
+
+int main(int argc, char **argv) {
+  int scale = argc > 1 ? atoi(argv[1]) : 1;
+  if (scale < 1) {
+    scale = 1;
+  }
+  const struct ATDWriter::ATDWriterOptions json = {
+      .useYojson = false,
+      .prettifyJson = false,
+  };
+  const struct ATDWriter::ATDWriterOptions yojson = {
+      .useYojson = true,
+      .prettifyJson = false,
+  };
+  const struct ATDWriter::ATDWriterOptions biniou = {};
+  benchEmitter<JsonWriter>("json", json, scale);
+  benchEmitter<JsonWriter>("yojson", yojson, scale);
+  benchEmitter<BiniouWriter>("biniou", biniou, scale);
+  return 0;
+}
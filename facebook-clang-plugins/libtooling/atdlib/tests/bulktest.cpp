@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+#include "../ATDWriter.h"
+
+#include <sstream>
+
+typedef ATDWriter::JsonWriter<std::ostream> JsonWriter;
+typedef ATDWriter::BiniouWriter<std::ostream> BiniouWriter;
+typedef ATDWriter::FlatWriter<std::ostream> FlatWriter;
+
+// The bulk leaf-array primitives promise byte-for-byte the output of a
+// sized enterArray with one emit per element; every writer and option
+// combination below emits the same data both ways and compares.
+namespace {
+
+const int64_t someIntegers[] = {
+    0, 1, -1, 42, -100000, 127, 128, int64_t(1) << 40, -(int64_t(1) << 40)};
+const size_t numIntegers = sizeof(someIntegers) / sizeof(someIntegers[0]);
+
+// "hello" repeats on purpose, to cover the biniou string-interning path
+const std::string_view someStrings[] = {
+    "", "a", "hello", "needs \"escaping\"\n", "hello", "a noticeably longer string"};
+const size_t numStrings = sizeof(someStrings) / sizeof(someStrings[0]);
+
+template <class Writer>
+void emitPerElement(Writer &OF) {
+  typename Writer::ObjectScope oScope(OF, 3);
+  OF.emitTag("integers");
+  {
+    typename Writer::ArrayScope aScope(OF, numIntegers);
+    for (size_t i = 0; i < numIntegers; i++) {
+      OF.emitInteger(someIntegers[i]);
+    }
+  }
+  OF.emitTag("strings");
+  {
+    typename Writer::ArrayScope aScope(OF, numStrings);
+    for (size_t i = 0; i < numStrings; i++) {
+      OF.emitString(someStrings[i]);
+    }
+  }
+  OF.emitTag("empty");
+  { typename Writer::ArrayScope aScope(OF, 0); }
+}
+
+template <class Writer>
+void emitBulk(Writer &OF) {
+  typename Writer::ObjectScope oScope(OF, 3);
+  OF.emitTag("integers");
+  OF.emitIntegerArray(someIntegers, numIntegers);
+  OF.emitTag("strings");
+  OF.emitStringArray(someStrings, numStrings);
+  OF.emitTag("empty");
+  OF.emitIntegerArray(nullptr, 0);
+}
+
+template <class Writer>
+void check(const char *name,
+           const ATDWriter::ATDWriterOptions &opts,
+           bool print) {
+  std::ostringstream perElementOs;
+  std::ostringstream bulkOs;
+  {
+    Writer OF(perElementOs, opts);
+    emitPerElement(OF);
+  }
+  {
+    Writer OF(bulkOs, opts);
+    emitBulk(OF);
+  }
+  std::cout << name << ": "
+            << (perElementOs.str() == bulkOs.str() ? "identical" : "DIFFER")
+            << " (" << bulkOs.str().size() << " bytes)" << std::endl;
+  if (print) {
+    std::cout << bulkOs.str() << std::endl;
+  }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  ATDWriter::ATDWriterOptions compactOptions = {};
+  ATDWriter::ATDWriterOptions prettyOptions = {};
+  prettyOptions.prettifyJson = true;
+  ATDWriter::ATDWriterOptions yojsonOptions = prettyOptions;
+  yojsonOptions.useYojson = true;
+  ATDWriter::ATDWriterOptions internOptions = {};
+  internOptions.biniouBackpatchSizes = true;
+  internOptions.biniouShareStrings = true;
+
+  check<JsonWriter>("json compact", compactOptions, false);
+  check<JsonWriter>("json pretty", prettyOptions, true);
+  check<JsonWriter>("yojson pretty", yojsonOptions, false);
+  check<BiniouWriter>("biniou", compactOptions, false);
+  check<BiniouWriter>("biniou interned", internOptions, false);
+  check<FlatWriter>("flat", compactOptions, false);
+  return 0;
+}
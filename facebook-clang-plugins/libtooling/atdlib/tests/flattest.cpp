@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+#include "../ATDWriter.h"
+
+#include <sstream>
+#include <stdint.h>
+
+typedef ATDWriter::FlatWriter<std::ostream> FlatWriter;
+typedef FlatWriter::ObjectScope ObjectScope;
+typedef FlatWriter::ArrayScope ArrayScope;
+typedef FlatWriter::VariantScope VariantScope;
+typedef FlatWriter::TupleScope TupleScope;
+typedef FlatWriter::TableScope TableScope;
+typedef FlatWriter::TableRowScope TableRowScope;
+
+// Minimal consumer-side navigation: walk the records region through
+// offsets alone - the way an mmap-ed capture is meant to be read - and
+// print what is found, so the output both documents the layout and
+// breaks if it drifts.
+namespace {
+
+uint32_t readLE32(const uint8_t *p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+         ((uint32_t)p[3] << 24);
+}
+
+uint64_t readLE64(const uint8_t *p) {
+  return (uint64_t)readLE32(p) | ((uint64_t)readLE32(p + 4) << 32);
+}
+
+void printValue(const uint8_t *records, const uint8_t *blob, uint32_t off) {
+  const uint8_t *rec = records + off;
+  switch (rec[0]) {
+  case 'n':
+    std::cout << "null";
+    break;
+  case 'b':
+    std::cout << (rec[1] ? "true" : "false");
+    break;
+  case 'i':
+    std::cout << (int64_t)readLE64(rec + 8);
+    break;
+  case 'f':
+    std::cout << "float64";
+    break;
+  case 's': {
+    uint32_t blobOff = readLE32(rec + 4);
+    uint32_t len = readLE32(rec + 8);
+    std::cout << '"';
+    std::cout.write((const char *)blob + blobOff, len);
+    std::cout << '"';
+    break;
+  }
+  case 'A':
+  case 'T':
+  case 't': {
+    uint32_t count = readLE32(rec + 4);
+    std::cout << (rec[0] == 'T' ? '(' : '[');
+    for (uint32_t i = 0; i < count; i++) {
+      if (i) {
+        std::cout << ",";
+      }
+      printValue(records, blob, readLE32(rec + 8 + 4 * i));
+    }
+    std::cout << (rec[0] == 'T' ? ')' : ']');
+    break;
+  }
+  case 'O':
+  case 'r': {
+    uint32_t count = readLE32(rec + 4);
+    std::cout << '{';
+    for (uint32_t i = 0; i < count; i++) {
+      if (i) {
+        std::cout << ",";
+      }
+      printValue(records, blob, readLE32(rec + 8 + 8 * i));
+      std::cout << ":";
+      printValue(records, blob, readLE32(rec + 12 + 8 * i));
+    }
+    std::cout << '}';
+    break;
+  }
+  case 'V': {
+    std::cout << '<';
+    printValue(records, blob, readLE32(rec + 4));
+    uint32_t arg = readLE32(rec + 8);
+    if (arg) {
+      std::cout << ":";
+      printValue(records, blob, arg);
+    }
+    std::cout << '>';
+    break;
+  }
+  default:
+    std::cout << "?";
+    break;
+  }
+}
+
+void decode(const std::string &bytes) {
+  const uint8_t *data = (const uint8_t *)bytes.data();
+  if (bytes.size() < 32 || bytes.compare(0, 8, "ASTFLAT1") != 0) {
+    std::cout << "bad header\n";
+    return;
+  }
+  uint32_t recordsOff = readLE32(data + 8);
+  uint32_t recordsSize = readLE32(data + 12);
+  uint32_t blobOff = readLE32(data + 16);
+  uint32_t blobSize = readLE32(data + 20);
+  uint32_t rootCount = readLE32(data + 24);
+  uint32_t rootsOff = readLE32(data + 28);
+  if (bytes.size() != (size_t)blobOff + blobSize) {
+    std::cout << "bad size\n";
+    return;
+  }
+  const uint8_t *records = data + recordsOff;
+  std::cout << "records=" << recordsSize << "B blob=" << blobSize
+            << "B roots=" << rootCount << "\n";
+  for (uint32_t i = 0; i < rootCount; i++) {
+    printValue(records, data + blobOff, readLE32(records + rootsOff + 4 * i));
+    std::cout << "\n";
+  }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  const struct ATDWriter::ATDWriterOptions flatWriterOptions = {};
+
+  std::ostringstream os;
+  {
+    FlatWriter OF(os, flatWriterOptions);
+    ObjectScope Scope(OF, 4);
+    OF.emitTag("string");
+    OF.emitString("Hello");
+    OF.emitTag("boolean");
+    OF.emitBoolean(true);
+    OF.emitTag("integer");
+    OF.emitInteger(-100000);
+    OF.emitTag("nested");
+    {
+      ArrayScope Scope(OF, 3);
+      OF.emitNull();
+      // interned: must not grow the blob a second time
+      OF.emitString("Hello");
+      {
+        VariantScope Scope(OF, "succ");
+        TupleScope Scope2(OF, 2);
+        OF.emitSimpleVariant("zero");
+        OF.emitInteger(42);
+      }
+    }
+  }
+  decode(os.str());
+
+  // a second document: trailing values become further roots
+  std::ostringstream os2;
+  {
+    FlatWriter OF(os2, flatWriterOptions);
+    {
+      TableScope Scope(OF, 2);
+      for (int i = 0; i < 2; i++) {
+        TableRowScope Row(OF, 2);
+        OF.emitTag("id");
+        OF.emitInteger(i);
+        OF.emitTag("name");
+        OF.emitString(i ? "one" : "zero");
+      }
+    }
+    OF.emitString("trailer");
+  }
+  decode(os2.str());
+
+  return 0;
+}
@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+#include "../ATDWriter.h"
+
+#include <sstream>
+
+typedef ATDWriter::JsonEmitter<std::ostream> JsonEmitter;
+typedef ATDWriter::BiniouEmitter<std::ostream> BiniouEmitter;
+typedef ATDWriter::JsonWriter<std::ostream> JsonWriter;
+typedef ATDWriter::BiniouWriter<std::ostream> BiniouWriter;
+typedef ATDWriter::PipelineWriter<JsonEmitter> PipelineJsonWriter;
+typedef ATDWriter::PipelineWriter<BiniouEmitter> PipelineBiniouWriter;
+
+// Every scenario is emitted twice, directly and through a pipeline
+// wrapping the same emitter, and the outputs must agree byte for byte:
+// the pipeline may only move rendering to another thread, never change
+// what is rendered.
+namespace {
+
+// one value of every event kind the exporters produce
+template <class Writer>
+void emitSample(Writer &OF) {
+  typename Writer::ObjectScope oScope(OF, 4);
+  OF.emitTag("scalars");
+  {
+    typename Writer::TupleScope tScope(OF, 3);
+    OF.emitInteger(-100000);
+    OF.emitBoolean(true);
+    OF.emitString("Hello\n\"quoted\"");
+  }
+  OF.emitTag("variants");
+  {
+    typename Writer::ArrayScope aScope(OF);
+    {
+      typename Writer::VariantScope vScope(OF, "DeclRefExpr");
+      OF.emitInteger(1);
+    }
+    OF.emitSimpleVariant("NullStmt");
+  }
+  OF.emitTag("table");
+  {
+    typename Writer::TableScope tScope(OF, 2);
+    for (int row = 0; row < 2; row++) {
+      typename Writer::TableRowScope rScope(OF, 2);
+      OF.emitTag("index");
+      OF.emitInteger(row);
+      OF.emitTag("name");
+      OF.emitString(row ? "snd" : "fst");
+    }
+  }
+  OF.emitTag("shared");
+  {
+    typename Writer::ArrayScope aScope(OF, 2);
+    for (int occurrence = 0; occurrence < 2; occurrence++) {
+      if (OF.enterSharedValue(42)) {
+        OF.emitString("occurrence");
+      }
+    }
+  }
+}
+
+// enough bytes to force several chunk hand-offs mid-stream
+template <class Writer>
+void emitBulk(Writer &OF) {
+  const int numStrings = 200000;
+  typename Writer::ArrayScope aScope(OF, numStrings);
+  for (int i = 0; i < numStrings; i++) {
+    typename Writer::TupleScope tScope(OF, 2);
+    OF.emitInteger(i);
+    OF.emitString("a reasonably long string pushing the pipeline across "
+                  "chunk boundaries");
+    if (i % 50000 == 0) {
+      OF.flushOutput();
+    }
+  }
+}
+
+void report(const char *name,
+            const std::string &direct,
+            const std::string &piped) {
+  std::cout << name << ": "
+            << (direct == piped ? "identical" : "DIFFER") << " ("
+            << direct.size() << " bytes)" << std::endl;
+}
+
+template <void (*Emit)(JsonWriter &), void (*PipedEmit)(PipelineJsonWriter &)>
+void checkJson(const char *name,
+               const ATDWriter::ATDWriterOptions &opts,
+               bool print) {
+  std::ostringstream directOs;
+  std::ostringstream pipedOs;
+  {
+    JsonWriter OF(directOs, opts);
+    Emit(OF);
+  }
+  {
+    PipelineJsonWriter OF(JsonEmitter(pipedOs, opts));
+    PipedEmit(OF);
+  }
+  report(name, directOs.str(), pipedOs.str());
+  if (print) {
+    std::cout << directOs.str();
+  }
+}
+
+template <void (*Emit)(BiniouWriter &),
+          void (*PipedEmit)(PipelineBiniouWriter &)>
+void checkBiniou(const char *name, const ATDWriter::ATDWriterOptions &opts) {
+  std::ostringstream directOs;
+  std::ostringstream pipedOs;
+  {
+    BiniouWriter OF(directOs, opts);
+    Emit(OF);
+  }
+  {
+    PipelineBiniouWriter OF(BiniouEmitter(pipedOs, opts));
+    PipedEmit(OF);
+  }
+  report(name, directOs.str(), pipedOs.str());
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  ATDWriter::ATDWriterOptions jsonOptions = {};
+  jsonOptions.prettifyJson = true;
+  ATDWriter::ATDWriterOptions yojsonOptions = jsonOptions;
+  yojsonOptions.useYojson = true;
+  // value sharing must stay off through a pipeline; string interning is
+  // internal to BiniouEmitter and must survive unchanged
+  ATDWriter::ATDWriterOptions biniouOptions = {};
+  ATDWriter::ATDWriterOptions internOptions = {};
+  internOptions.biniouBackpatchSizes = true;
+  internOptions.biniouShareStrings = true;
+
+  checkJson<emitSample, emitSample>("json sample", jsonOptions, true);
+  checkJson<emitSample, emitSample>("yojson sample", yojsonOptions, true);
+  checkBiniou<emitSample, emitSample>("biniou sample", biniouOptions);
+  checkBiniou<emitSample, emitSample>("biniou interned sample",
+                                      internOptions);
+  checkJson<emitBulk, emitBulk>("json bulk", jsonOptions, false);
+  checkBiniou<emitBulk, emitBulk>("biniou bulk", biniouOptions);
+  checkBiniou<emitBulk, emitBulk>("biniou interned bulk", internOptions);
+  return 0;
+}
@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+#include "../ATDReader.h"
+
+#include <cstdio>
+
+// Re-read benchmark over biniou capture files: mmap each argument and
+// walk every node with the ATDReader cursors, folding what a consumer
+// would have to touch (tags, integers, string bytes, variant hashes)
+// into a checksum so the traversal cannot be optimized away. Prints one
+// line per file; timing is the caller's job (scripts/bench_formats.sh
+// wraps this in its best-of-N measurement).
+namespace {
+
+struct WalkStats {
+  uint64_t nodes = 0;
+  uint64_t checksum = 0;
+};
+
+void walk(ATDReader::BiniouValue node, WalkStats &stats) {
+  node = node.resolveShared();
+  stats.nodes++;
+  stats.checksum += node.tag();
+  switch (node.tag()) {
+  case ATDReader::bool_tag:
+    stats.checksum += node.booleanValue();
+    break;
+  case ATDReader::svint_tag:
+  case ATDReader::uvint_tag:
+  case ATDReader::int8_tag:
+  case ATDReader::int16_tag:
+  case ATDReader::int32_tag:
+  case ATDReader::int64_tag:
+    stats.checksum += (uint64_t)node.integerValue();
+    break;
+  case ATDReader::string_tag:
+    stats.checksum += node.stringValue().size();
+    break;
+  case ATDReader::ARRAY_tag: {
+    ATDReader::BiniouArrayCursor elements = node.arrayElements();
+    ATDReader::BiniouValue element;
+    while (elements.next(element)) {
+      walk(element, stats);
+    }
+    break;
+  }
+  case ATDReader::TUPLE_tag: {
+    ATDReader::BiniouTupleCursor elements = node.tupleElements();
+    ATDReader::BiniouValue element;
+    while (elements.next(element)) {
+      walk(element, stats);
+    }
+    break;
+  }
+  case ATDReader::RECORD_tag: {
+    ATDReader::BiniouRecordCursor fields = node.recordFields();
+    ATDReader::BiniouValue value;
+    uint32_t hash;
+    while (fields.next(hash, value)) {
+      stats.checksum += hash;
+      walk(value, stats);
+    }
+    break;
+  }
+  case ATDReader::VARIANT_tag:
+    stats.checksum += node.variantHash();
+    if (node.variantHasArg()) {
+      walk(node.variantArg(), stats);
+    }
+    break;
+  case ATDReader::TABLE_tag: {
+    ATDReader::BiniouTableCursor rows = node.tableRows();
+    ATDReader::BiniouRowCursor row;
+    while (rows.next(row)) {
+      ATDReader::BiniouValue cell;
+      uint32_t hash;
+      while (row.next(hash, cell)) {
+        stats.checksum += hash;
+        walk(cell, stats);
+      }
+    }
+    break;
+  }
+  default:
+    // unit, float64 and the unproduced spec tags carry no decoded value
+    break;
+  }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s FILE...\n", argv[0]);
+    return 1;
+  }
+  for (int i = 1; i < argc; i++) {
+    ATDReader::MmapFile file;
+    if (!file.open(argv[i])) {
+      fprintf(stderr, "[!] Failed to map %s\n", argv[i]);
+      return 1;
+    }
+    WalkStats stats;
+    walk(file.root(), stats);
+    printf("%s: %llu nodes, checksum %016llx\n",
+           argv[i],
+           (unsigned long long)stats.nodes,
+           (unsigned long long)stats.checksum);
+  }
+  return 0;
+}
@@ -0,0 +1,286 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+#include "../ATDReader.h"
+#include "../ATDWriter.h"
+
+#include <fstream>
+#include <map>
+#include <sstream>
+
+typedef ATDWriter::BiniouWriter<std::ostream> BiniouWriter;
+
+// Round trip: documents encoded by BiniouWriter are walked back with
+// the ATDReader cursors and printed as an s-expression-ish dump. Field
+// and variant names come back as hashes; the test registers the names
+// it used so the dump stays readable.
+namespace {
+
+std::map<uint32_t, std::string> hashNames;
+
+void registerName(const std::string &name) {
+  hashNames[ATDReader::fieldHash(name)] = name;
+}
+
+std::string nameOf(uint32_t hash) {
+  auto it = hashNames.find(hash);
+  if (it != hashNames.end()) {
+    return it->second;
+  }
+  std::ostringstream os;
+  os << "#" << hash;
+  return os.str();
+}
+
+void dumpValue(std::ostream &os, ATDReader::BiniouValue node) {
+  node = node.resolveShared();
+  switch (node.tag()) {
+  case ATDReader::bool_tag:
+    os << (node.booleanValue() ? "true" : "false");
+    break;
+  case ATDReader::svint_tag:
+  case ATDReader::uvint_tag:
+  case ATDReader::int8_tag:
+  case ATDReader::int16_tag:
+  case ATDReader::int32_tag:
+  case ATDReader::int64_tag:
+    os << node.integerValue();
+    break;
+  case ATDReader::string_tag:
+    os << '"' << node.stringValue() << '"';
+    break;
+  case ATDReader::unit_tag:
+    os << "()";
+    break;
+  case ATDReader::ARRAY_tag: {
+    os << "[";
+    ATDReader::BiniouArrayCursor elements = node.arrayElements();
+    ATDReader::BiniouValue element;
+    bool first = true;
+    while (elements.next(element)) {
+      os << (first ? "" : " ");
+      dumpValue(os, element);
+      first = false;
+    }
+    os << "]";
+    break;
+  }
+  case ATDReader::TUPLE_tag: {
+    os << "(";
+    ATDReader::BiniouTupleCursor elements = node.tupleElements();
+    ATDReader::BiniouValue element;
+    bool first = true;
+    while (elements.next(element)) {
+      os << (first ? "" : " ");
+      dumpValue(os, element);
+      first = false;
+    }
+    os << ")";
+    break;
+  }
+  case ATDReader::RECORD_tag: {
+    os << "{";
+    ATDReader::BiniouRecordCursor fields = node.recordFields();
+    ATDReader::BiniouValue value;
+    uint32_t hash;
+    bool first = true;
+    while (fields.next(hash, value)) {
+      os << (first ? "" : " ") << nameOf(hash) << "=";
+      dumpValue(os, value);
+      first = false;
+    }
+    os << "}";
+    break;
+  }
+  case ATDReader::VARIANT_tag:
+    os << "<" << nameOf(node.variantHash());
+    if (node.variantHasArg()) {
+      os << " ";
+      dumpValue(os, node.variantArg());
+    }
+    os << ">";
+    break;
+  case ATDReader::NUM_VARIANT_tag:
+    os << "<#" << (int)node.numVariantIndex();
+    if (node.variantHasArg()) {
+      os << " ";
+      dumpValue(os, node.variantArg());
+    }
+    os << ">";
+    break;
+  case ATDReader::TABLE_tag: {
+    os << "table[";
+    ATDReader::BiniouTableCursor rows = node.tableRows();
+    ATDReader::BiniouRowCursor row;
+    bool firstRow = true;
+    while (rows.next(row)) {
+      os << (firstRow ? "" : " ") << "{";
+      ATDReader::BiniouValue cell;
+      uint32_t hash;
+      bool first = true;
+      while (row.next(hash, cell)) {
+        os << (first ? "" : " ") << nameOf(hash) << "=";
+        dumpValue(os, cell);
+        first = false;
+      }
+      os << "}";
+      firstRow = false;
+    }
+    os << "]";
+    break;
+  }
+  default:
+    os << "?" << (int)node.tag();
+    break;
+  }
+}
+
+void emitSample(BiniouWriter &OF) {
+  BiniouWriter::ObjectScope oScope(OF, 6);
+  OF.emitTag("scalars");
+  {
+    BiniouWriter::TupleScope tScope(OF, 4);
+    OF.emitBoolean(true);
+    OF.emitInteger(-123456);
+    OF.emitString("a shared string payload");
+    OF.emitString("short");
+  }
+  OF.emitTag("nested");
+  {
+    BiniouWriter::ArrayScope aScope(OF, 3);
+    for (int i = 0; i < 3; i++) {
+      BiniouWriter::ArrayScope inner(OF, 2);
+      OF.emitInteger(i);
+      OF.emitInteger(i * i);
+    }
+  }
+  OF.emitTag("variants");
+  {
+    BiniouWriter::ArrayScope aScope(OF, 2);
+    OF.emitSimpleVariant("Leaf");
+    {
+      BiniouWriter::VariantScope vScope(OF, "Node");
+      OF.emitString("payload");
+    }
+  }
+  OF.emitTag("table");
+  {
+    BiniouWriter::TableScope tScope(OF, 3);
+    for (int i = 0; i < 3; i++) {
+      BiniouWriter::TableRowScope rScope(OF, 2);
+      OF.emitTag("line");
+      OF.emitInteger(10 + i);
+      // strings of a shared column all reach the interning size, so the
+      // column keeps one value tag under BINIOU_SHARE_STRINGS
+      OF.emitTag("file");
+      OF.emitString(i == 2 ? "some/other/path.c" : "a shared string payload");
+    }
+  }
+  OF.emitTag("growing");
+  {
+    // open-ended array: element count spliced in when it closes
+    BiniouWriter::ArrayScope aScope(OF);
+    OF.emitString("a shared string payload");
+    OF.emitString("again and again");
+  }
+  OF.emitTag("empty");
+  { BiniouWriter::ArrayScope aScope(OF, 0); }
+}
+
+std::string encodeSample(const ATDWriter::ATDWriterOptions &opts) {
+  std::ostringstream os;
+  {
+    BiniouWriter OF(os, opts);
+    emitSample(OF);
+  }
+  return os.str();
+}
+
+std::string dumpDocument(const std::string &bytes) {
+  std::ostringstream os;
+  dumpValue(os, ATDReader::BiniouValue(bytes.data(), bytes.size()));
+  return os.str();
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  for (const char *name : {"scalars",
+                           "nested",
+                           "variants",
+                           "table",
+                           "growing",
+                           "empty",
+                           "line",
+                           "file",
+                           "Leaf",
+                           "Node"}) {
+    registerName(name);
+  }
+
+  ATDWriter::ATDWriterOptions plainOptions = {};
+  std::string plain = encodeSample(plainOptions);
+  std::string plainDump = dumpDocument(plain);
+  std::cout << "plain (" << plain.size() << " bytes):" << std::endl;
+  std::cout << plainDump << std::endl;
+
+  // interning rewrites repeated strings as SHARED back references;
+  // resolveShared makes the walk land on the same dump
+  ATDWriter::ATDWriterOptions internOptions = {};
+  internOptions.biniouBackpatchSizes = true;
+  internOptions.biniouShareStrings = true;
+  std::string interned = encodeSample(internOptions);
+  std::cout << "interned (" << interned.size() << " bytes): "
+            << (dumpDocument(interned) == plainDump ? "same dump"
+                                                    : "DIFFERENT DUMP")
+            << std::endl;
+
+  // num_variants: NumTag indexes on the wire instead of name hashes;
+  // the tuple cursor skips past both variant shapes (with and without
+  // an argument) to reach the trailing integer
+  ATDWriter::ATDWriterOptions numVariantOptions = {};
+  numVariantOptions.biniouNumVariants = true;
+  std::ostringstream numOs;
+  {
+    BiniouWriter OF(numOs, numVariantOptions);
+    BiniouWriter::TupleScope tScope(OF, 3);
+    OF.emitSimpleVariant(ATDWriter::NumTag("Leaf", 0));
+    {
+      BiniouWriter::VariantScope vScope(OF, ATDWriter::NumTag("Node", 1));
+      OF.emitString("payload");
+    }
+    OF.emitInteger(7);
+  }
+  std::string numVariants = numOs.str();
+  std::cout << "num_variants (" << numVariants.size()
+            << " bytes):" << std::endl;
+  std::cout << dumpDocument(numVariants) << std::endl;
+
+  // the mmap path: same bytes through a mapped file
+  const char *path = "build/readertest.bin";
+  std::ofstream(path, std::ios::binary) << plain;
+  ATDReader::MmapFile mapped;
+  if (!mapped.open(path)) {
+    std::cout << "mmap: failed to map " << path << std::endl;
+    return 1;
+  }
+  std::ostringstream mappedDump;
+  dumpValue(mappedDump, mapped.root());
+  std::cout << "mmap (" << mapped.size() << " bytes): "
+            << (mappedDump.str() == plainDump ? "same dump" : "DIFFERENT DUMP")
+            << std::endl;
+
+  // field lookup by name against the in-place record bytes
+  ATDReader::BiniouValue root(plain.data(), plain.size());
+  ATDReader::BiniouValue field;
+  std::cout << "fieldByName(table): "
+            << (root.fieldByName("table", field) ? "found" : "missing")
+            << ", rows=" << field.childCount() << std::endl;
+  std::cout << "fieldByName(absent): "
+            << (root.fieldByName("absent", field) ? "found" : "missing")
+            << std::endl;
+  return 0;
+}
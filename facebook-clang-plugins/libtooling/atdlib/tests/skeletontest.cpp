@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+#include "../ATDWriter.h"
+
+#include <iostream>
+#include <sstream>
+
+typedef ATDWriter::SkeletonHashWriter<std::ostream> SkeletonWriter;
+typedef ATDWriter::TeeWriter<ATDWriter::JsonEmitter<std::ostream>,
+                             ATDWriter::SkeletonHashEmitter<std::ostream>>
+    JsonSkeletonTeeWriter;
+
+// the same "decl", up to the volatile fields a rebuild shifts around
+template <class Writer>
+static void writeDecl(Writer &OF,
+                      const char *ptr,
+                      int line,
+                      const char *name,
+                      bool used) {
+  typename Writer::ObjectScope Scope(OF, 4);
+  OF.emitTag("pointer");
+  OF.emitString(ptr);
+  OF.emitTag("source_range");
+  {
+    typename Writer::TupleScope Scope2(OF, 2);
+    OF.emitInteger(line);
+    OF.emitInteger(line + 2);
+  }
+  OF.emitTag("name");
+  OF.emitString(name);
+  OF.emitTag("is_used");
+  OF.emitBoolean(used);
+}
+
+static std::string skeletonOf(const char *ptr,
+                              int line,
+                              const char *name,
+                              bool used) {
+  const struct ATDWriter::ATDWriterOptions options = {};
+  std::ostringstream os;
+  {
+    SkeletonWriter OF(os, options);
+    writeDecl(OF, ptr, line, name, used);
+  }
+  return os.str();
+}
+
+int main(int argc, char **argv) {
+  std::string base = skeletonOf("0xdeadbeef", 10, "foo", true);
+  std::cout << "base             " << base;
+  // volatile churn only: pointers and locations moved, nothing else
+  std::cout << "moved same? "
+            << (skeletonOf("0xcafebabe", 250, "foo", true) == base) << "\n";
+  // a semantic change must show
+  std::cout << "renamed same? "
+            << (skeletonOf("0xdeadbeef", 10, "bar", true) == base) << "\n";
+  std::cout << "flag flip same? "
+            << (skeletonOf("0xdeadbeef", 10, "foo", false) == base) << "\n";
+
+  // teed with a real emitter: one event stream, document plus hash
+  const struct ATDWriter::ATDWriterOptions options = {};
+  std::ostringstream json;
+  std::ostringstream hash;
+  {
+    JsonSkeletonTeeWriter OF(
+        ATDWriter::JsonEmitter<std::ostream>(json, options),
+        ATDWriter::SkeletonHashEmitter<std::ostream>(hash, options));
+    writeDecl(OF, "0xdeadbeef", 10, "foo", true);
+  }
+  std::cout << "teed json        " << json.str() << "\n";
+  std::cout << "teed hash same? " << (hash.str() == base) << "\n";
+
+  return 0;
+}
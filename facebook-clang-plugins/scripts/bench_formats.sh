@@ -0,0 +1,125 @@
+# Copyright (c) Facebook, Inc. and its affiliates.
+#
+# This source code is licensed under the MIT license found in the
+# LICENSE file in the root directory of this source tree.
+
+#!/bin/bash
+
+# Format comparison benchmark. For every source file given, dumps the
+# AST once per output format (and emitter variant), keeping the
+# best-of-BENCH_ITERATIONS wall time, and reports write time, raw and
+# gzipped size, and re-read time in one table per file. Re-read time is
+# measured with the C++ cursor reader (atdlib/ATDReader.h) walking the
+# whole document; the text formats have no in-tree reader, so their
+# read column stays "-". A machine-readable copy lands in
+# $OUTDIR/formats.json for diffing between commits.
+#
+# Usage: CLANG_FRONTEND="clang -fsyntax-only ... -load .../plugin" \
+#        READBENCH=atdlib/build/readbench \
+#        bench_formats.sh OUTDIR FILE...
+
+OUTDIR="$1"
+shift
+
+ITERATIONS=${BENCH_ITERATIONS:-3}
+BASELINE="$OUTDIR/formats.json"
+
+# format rows: name / plugin / extra KEY=VALUE plugin args / readable
+VARIANTS="
+json:JsonASTExporter::no
+yjson:YojsonASTExporter::no
+yjson-pipe:YojsonPipelineASTExporter::no
+biniou:BiniouASTExporter::yes
+biniou-intern:BiniouASTExporter:BINIOU_SHARE_STRINGS=1:yes
+biniou-pipe:BiniouPipelineASTExporter::yes
+flat:FlatASTExporter::no
+"
+
+# best-of-N wall time of "$@", in seconds with millisecond resolution
+measure() {
+    local best=""
+    local i
+    for i in $(seq 1 $ITERATIONS); do
+        local t
+        TIMEFORMAT='%3R'
+        t=$( { time "$@" > /dev/null 2>&1; } 2>&1 | tail -n 1 )
+        if [ -z "$best" ] || awk "BEGIN { exit !($t < $best) }"; then
+            best="$t"
+        fi
+    done
+    echo "$best"
+}
+
+mkdir -p "$OUTDIR"
+echo "[" > "$BASELINE"
+FIRST=1
+
+for SRC in "$@"; do
+    NAME=$(basename "$SRC")
+    EXTRA_FLAGS=""
+    case "$SRC" in
+    *.m )
+        if [ "$HAS_OBJC" = "no" ]; then
+            echo "[~] $NAME skipped (no Objective-C support)"
+            continue
+        fi
+        EXTRA_FLAGS="-ObjC -fblocks $IOSFLAGS"
+        ;;
+    *.cpp )
+        EXTRA_FLAGS="--std=c++14"
+        ;;
+    *.mm )
+        if [ "$HAS_OBJC" = "no" ]; then
+            echo "[~] $NAME skipped (no Objective-C support)"
+            continue
+        fi
+        EXTRA_FLAGS="--std=c++14 -ObjC++ -fblocks $IOSFLAGS"
+        ;;
+    esac
+
+    echo "== $NAME =="
+    printf '%-14s %10s %12s %12s %10s\n' \
+        "format" "write(s)" "bytes" "gz bytes" "read(s)"
+    for VARIANT in $VARIANTS; do
+        FORMAT=${VARIANT%%:*}
+        REST=${VARIANT#*:}
+        PLUGIN=${REST%%:*}
+        REST=${REST#*:}
+        ARG=${REST%%:*}
+        READABLE=${REST#*:}
+        OUT="$OUTDIR/$NAME.$FORMAT"
+        ARG_FLAGS=""
+        if [ -n "$ARG" ]; then
+            ARG_FLAGS="-Xclang -plugin-arg-$PLUGIN -Xclang $ARG"
+        fi
+        CMD="$CLANG_FRONTEND $EXTRA_FLAGS \
+             -Xclang -plugin -Xclang $PLUGIN \
+             -Xclang -plugin-arg-$PLUGIN -Xclang $OUT \
+             $ARG_FLAGS \
+             -c $SRC"
+        if ! $CMD > /dev/null 2>&1; then
+            echo "[-] $NAME failed under $FORMAT"
+            continue
+        fi
+        WRITE_SECS=$(measure $CMD)
+        BYTES=$(wc -c < "$OUT" | tr -d ' ')
+        GZ_BYTES=$(gzip -c "$OUT" | wc -c | tr -d ' ')
+        READ_SECS="-"
+        if [ "$READABLE" = "yes" ] && [ -n "$READBENCH" ]; then
+            READ_SECS=$(measure $READBENCH "$OUT")
+        fi
+        rm -f "$OUT"
+        printf '%-14s %10s %12s %12s %10s\n' \
+            "$FORMAT" "$WRITE_SECS" "$BYTES" "$GZ_BYTES" "$READ_SECS"
+        if [ $FIRST = 0 ]; then echo "," >> "$BASELINE"; fi
+        FIRST=0
+        printf '  {"file": "%s", "format": "%s", "write_seconds": %s, "bytes": %s, "gzip_bytes": %s, "read_seconds": %s}' \
+            "$NAME" "$FORMAT" "$WRITE_SECS" "$BYTES" "$GZ_BYTES" \
+            "$([ "$READ_SECS" = "-" ] && echo null || echo "$READ_SECS")" \
+            >> "$BASELINE"
+    done
+done
+
+echo "" >> "$BASELINE"
+echo "]" >> "$BASELINE"
+echo "[+] baseline written to $BASELINE"
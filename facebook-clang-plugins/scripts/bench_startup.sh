@@ -0,0 +1,186 @@
+# Copyright (c) Facebook, Inc. and its affiliates.
+#
+# This source code is licensed under the MIT license found in the
+# LICENSE file in the root directory of this source tree.
+
+#!/bin/bash
+
+# Startup-latency benchmark. Captures an empty translation unit -- so
+# that the fixed per-file cost is all there is -- along each route and
+# decomposes it into deltas between runs:
+#
+#   exec     bare "$CLANG -fsyntax-only": process exec plus an empty
+#            frontend pass, the floor every route pays
+#   dlopen   the same with "-Xclang -load" of the plugin dylib but no
+#            plugin action: dlopen, relocations, static initializers
+#   action   the full plugin capture: action setup, option parsing and
+#            the (empty) dump on top of the load
+#   tool     the static ast_exporter: exec of a binary the kernel
+#            shares from the page cache, no dlopen
+#   daemon   one round trip to a warm ast_exporter_daemon: no exec at
+#            all, the protocol and a fresh CompilerInstance remain
+#
+# Also reports the plugin image size, which is what the relocation cost
+# scales with and the number to budget against. Best of
+# BENCH_ITERATIONS runs (default 10; startup times are noisy). A
+# machine-readable baseline lands in $OUTDIR/baseline.json.
+#
+# Usage: CLANG=clang PLUGIN_DYLIB=.../FacebookClangPlugin.dylib \
+#        TOOL=build/ast_exporter DAEMON=build/ast_exporter_daemon \
+#        bench_startup.sh OUTDIR
+
+OUTDIR="$1"
+
+ITERATIONS=${BENCH_ITERATIONS:-10}
+PLUGIN=JsonASTExporter
+BASELINE="$OUTDIR/baseline.json"
+
+# best-of-N wall time of "$@", in seconds with millisecond resolution
+measure() {
+    local best=""
+    local i
+    for i in $(seq 1 $ITERATIONS); do
+        local t
+        TIMEFORMAT='%3R'
+        t=$( { time "$@" > /dev/null 2>&1; } 2>&1 | tail -n 1 )
+        if [ -z "$best" ] || awk "BEGIN { exit !($t < $best) }"; then
+            best="$t"
+        fi
+    done
+    echo "$best"
+}
+
+delta() {
+    awk "BEGIN { printf \"%.3f\", $1 - $2 }"
+}
+
+mkdir -p "$OUTDIR"
+SRC="$OUTDIR/empty.c"
+OUT="$OUTDIR/empty.out"
+: > "$SRC"
+
+echo "[" > "$BASELINE"
+FIRST=1
+record() {
+    if [ $FIRST = 0 ]; then echo "," >> "$BASELINE"; fi
+    FIRST=0
+    printf '  {"component": "%s", "seconds": %s}' "$1" "$2" >> "$BASELINE"
+}
+
+# 1. the exec floor
+if ! $CLANG -fsyntax-only "$SRC" > /dev/null 2>&1; then
+    echo "[-] $CLANG cannot compile an empty TU; aborting"
+    exit 1
+fi
+EXEC_SECS=$(measure $CLANG -fsyntax-only "$SRC")
+echo "[+] exec (bare frontend):      ${EXEC_SECS}s"
+record exec "$EXEC_SECS"
+
+# 2. load the plugin without running it
+LOAD_CMD="$CLANG -fsyntax-only -Xclang -load -Xclang $PLUGIN_DYLIB $SRC"
+if $LOAD_CMD > /dev/null 2>&1; then
+    LOAD_SECS=$(measure $LOAD_CMD)
+    echo "[+] + plugin load:           ${LOAD_SECS}s" \
+         " (dlopen/relocations: $(delta $LOAD_SECS $EXEC_SECS)s)"
+    record plugin_load "$LOAD_SECS"
+
+    # 3. the full plugin capture
+    CAPTURE_CMD="$LOAD_CMD -Xclang -plugin -Xclang $PLUGIN \
+        -Xclang -plugin-arg-$PLUGIN -Xclang $OUT"
+    CAPTURE_SECS=$(measure $CAPTURE_CMD)
+    echo "[+] + plugin capture:        ${CAPTURE_SECS}s" \
+         " (action/options/dump: $(delta $CAPTURE_SECS $LOAD_SECS)s)"
+    record plugin_capture "$CAPTURE_SECS"
+else
+    echo "[-] plugin failed to load from $PLUGIN_DYLIB"
+fi
+
+# 4. the static tool: same work as the capture, no dlopen
+if [ -x "$TOOL" ]; then
+    TOOL_CMD="$TOOL OUTPUT_FILE=$OUT FORMAT=json -- $CLANG -fsyntax-only $SRC"
+    if $TOOL_CMD > /dev/null 2>&1; then
+        TOOL_SECS=$(measure $TOOL_CMD)
+        echo "[+] static tool:             ${TOOL_SECS}s"
+        record tool "$TOOL_SECS"
+    else
+        echo "[-] $TOOL failed on the empty TU"
+    fi
+else
+    echo "[~] static tool skipped (no $TOOL; run 'make tool')"
+fi
+
+# 5. a round trip to a warm daemon: neither exec nor dlopen
+if [ -x "$DAEMON" ]; then
+    SOCKET="$OUTDIR/startup.sock"
+    rm -f "$SOCKET"
+    "$DAEMON" "$SOCKET" &
+    DAEMON_PID=$!
+    # the protocol lives in soak_daemon.py already; reuse its client
+    # shape here, timing inside python to keep the interpreter start
+    # out of the measurement
+    DAEMON_SECS=$(python3 - "$SOCKET" "$OUT" $ITERATIONS $CLANG <<'EOF'
+import socket, sys, time
+
+socket_path, out, iterations = sys.argv[1], sys.argv[2], int(sys.argv[3])
+command = sys.argv[4:] + ["-fsyntax-only", out[: -len(".out")] + ".c"]
+
+def request(option_lines, command):
+    client = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    client.connect(socket_path)
+    payload = "".join(line + "\n" for line in option_lines)
+    payload += "--\n"
+    payload += "".join(arg + "\n" for arg in command)
+    payload += "\n"
+    client.sendall(payload.encode())
+    reply = b""
+    while not reply.endswith(b"\n"):
+        chunk = client.recv(64)
+        if not chunk:
+            break
+        reply += chunk
+    return reply.strip() == b"OK"
+
+for _ in range(100):
+    try:
+        request([], [])  # malformed on purpose; probes the socket
+        break
+    except OSError:
+        time.sleep(0.1)
+
+options = ["OUTPUT_FILE=" + out, "FORMAT=json"]
+best = None
+if request(options, command):  # warm-up, not timed
+    for _ in range(iterations):
+        start = time.monotonic()
+        ok = request(options, command)
+        seconds = time.monotonic() - start
+        if ok and (best is None or seconds < best):
+            best = seconds
+if best is not None:
+    print("%.3f" % best)
+request(["QUIT"], [])
+EOF
+    )
+    wait $DAEMON_PID 2> /dev/null
+    rm -f "$SOCKET"
+    if [ -n "$DAEMON_SECS" ]; then
+        echo "[+] daemon round trip:       ${DAEMON_SECS}s"
+        record daemon "$DAEMON_SECS"
+    else
+        echo "[-] daemon requests failed"
+    fi
+else
+    echo "[~] daemon skipped (no $DAEMON; run 'make daemon')"
+fi
+
+# the relocation cost above scales with this; budget against it
+PLUGIN_BYTES=$(wc -c < "$PLUGIN_DYLIB" | tr -d ' ')
+echo "[+] plugin image size:       $PLUGIN_BYTES bytes"
+if [ $FIRST = 0 ]; then echo "," >> "$BASELINE"; fi
+printf '  {"component": "plugin_image", "bytes": %s}' "$PLUGIN_BYTES" \
+    >> "$BASELINE"
+
+rm -f "$SRC" "$OUT"
+echo "" >> "$BASELINE"
+echo "]" >> "$BASELINE"
+echo "[+] baseline written to $BASELINE"
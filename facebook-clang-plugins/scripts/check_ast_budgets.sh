@@ -0,0 +1,120 @@
+# Copyright (c) Facebook, Inc. and its affiliates.
+#
+# This source code is licensed under the MIT license found in the
+# LICENSE file in the root directory of this source tree.
+
+#!/bin/bash
+
+# Size regression gate for the exporter sample outputs. For every
+# sample that has an expected output (tests/<Plugin>/<sample>.exp), a
+# budget file next to it (<sample>.budget) caps the serialized size
+# and, for the Json plugin, the node count of the dump. 'check' fails
+# when a sample exceeds its budget by more than BUDGET_SLACK_PERCENT
+# (default 10) -- catching bloat like a newly-dumped field on every
+# Stmt before it ships. 'record' refreshes the budgets from the current
+# build; review the diff like recorded test outputs.
+#
+# Usage: CLANG_FRONTEND="clang -fsyntax-only ... -load .../plugin" \
+#        check_ast_budgets.sh record|check
+# Run from the libtooling directory.
+#
+# Nodes are counted like run_benchmark.sh does: the number of "pointer"
+# fields of the Json dump (AST_WITH_POINTERS=1), which every AST node
+# carries exactly once.
+
+MODE="$1"
+if [ "$MODE" != "record" ] && [ "$MODE" != "check" ]; then
+    echo "usage: $0 record|check" >&2
+    exit 2
+fi
+
+PLUGINS="JsonASTExporter BiniouASTExporter"
+SLACK=${BUDGET_SLACK_PERCENT:-10}
+TMPDIR_BUDGET=build/tmp_budgets
+STATUS=0
+
+mkdir -p "$TMPDIR_BUDGET"
+
+for P in $PLUGINS; do
+    for EXPFILE in tests/$P/*.exp; do
+        [ -e "$EXPFILE" ] || continue
+        TEST=${EXPFILE%.exp}
+        NAME=$(basename "$TEST")
+        SRC=tests/$NAME
+        BUDGET=$TEST.budget
+        EXTRA_FLAGS=""
+        case "$SRC" in
+        *.m )
+            if [ "$HAS_OBJC" = "no" ]; then
+                echo "[~] $P/$NAME skipped (no Objective-C support)"
+                continue
+            fi
+            EXTRA_FLAGS="-ObjC -fblocks $IOSFLAGS"
+            ;;
+        *.cpp )
+            EXTRA_FLAGS="--std=c++14"
+            ;;
+        *.mm )
+            if [ "$HAS_OBJC" = "no" ]; then
+                echo "[~] $P/$NAME skipped (no Objective-C support)"
+                continue
+            fi
+            EXTRA_FLAGS="--std=c++14 -ObjC++ -fblocks $IOSFLAGS"
+            ;;
+        esac
+
+        OUT="$TMPDIR_BUDGET/$NAME.$P.out"
+        if ! $CLANG_FRONTEND $EXTRA_FLAGS \
+            -Xclang -plugin -Xclang $P \
+            -Xclang -plugin-arg-$P -Xclang "$OUT" \
+            -Xclang -plugin-arg-$P -Xclang AST_WITH_POINTERS=1 \
+            -c "$SRC" > /dev/null 2>&1; then
+            echo "[-] $P/$NAME failed to dump"
+            STATUS=1
+            continue
+        fi
+        BYTES=$(wc -c < "$OUT" | tr -d ' ')
+        NODES=""
+        if [ "$P" = "JsonASTExporter" ]; then
+            NODES=$(grep -o '"pointer"' "$OUT" | wc -l | tr -d ' ')
+        fi
+        rm -f "$OUT"
+
+        if [ "$MODE" = "record" ]; then
+            {
+                echo "max_bytes=$BYTES"
+                [ -n "$NODES" ] && echo "max_nodes=$NODES"
+            } > "$BUDGET"
+            echo "[+] $P/$NAME budget recorded: ${BYTES}B${NODES:+ $NODES nodes}"
+            continue
+        fi
+
+        if [ ! -e "$BUDGET" ]; then
+            echo "[~] $P/$NAME has no budget (run 'make record-budgets')"
+            continue
+        fi
+        MAX_BYTES=$(sed -n 's/^max_bytes=//p' "$BUDGET")
+        MAX_NODES=$(sed -n 's/^max_nodes=//p' "$BUDGET")
+        OK=1
+        if [ -n "$MAX_BYTES" ] && \
+           [ "$BYTES" -gt $(( MAX_BYTES * (100 + SLACK) / 100 )) ]; then
+            echo "[-] $P/$NAME size over budget:" \
+                 "${BYTES}B > ${MAX_BYTES}B (+${SLACK}%)"
+            OK=0
+        fi
+        if [ -n "$NODES" ] && [ -n "$MAX_NODES" ] && \
+           [ "$NODES" -gt $(( MAX_NODES * (100 + SLACK) / 100 )) ]; then
+            echo "[-] $P/$NAME node count over budget:" \
+                 "$NODES > $MAX_NODES (+${SLACK}%)"
+            OK=0
+        fi
+        if [ $OK = 1 ]; then
+            echo "[+] $P/$NAME within budget:" \
+                 "${BYTES}B/${MAX_BYTES}B${NODES:+ $NODES/$MAX_NODES nodes}"
+        else
+            STATUS=1
+        fi
+    done
+done
+
+exit $STATUS
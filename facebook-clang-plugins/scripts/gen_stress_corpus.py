@@ -0,0 +1,124 @@
+#!/usr/bin/env python3
+
+
+# Copyright (c) Facebook, Inc. and its affiliates.
+#
+# This source code is licensed under the MIT license found in the
+# LICENSE file in the root directory of this source tree.
+
+import argparse
+import os
+
+"""
+Synthesize parameterized stress translation units for the exporter
+benchmark: N-deep template nests, M-wide ObjC interfaces, K-element
+initializer lists, each at a ladder of sizes. The hand-written samples
+in libtooling/tests never exercise scaling; feeding these files to
+run_benchmark.sh charts throughput versus input size, so superlinear
+behavior (like the template-argument printing blowup) shows up before
+production input does.
+"""
+
+
+def template_nest(depth):
+    """Nested class template specializations, depth-linear in source but
+    much larger in the AST: every level re-instantiates the next."""
+    lines = [
+        "// generated by gen_stress_corpus.py; do not edit",
+        "template <typename T> struct Wrap { T value; };",
+        "typedef int L0;",
+    ]
+    for i in range(1, depth + 1):
+        lines.append("typedef Wrap<L%d> L%d;" % (i - 1, i))
+    lines.append("L%d instance;" % depth)
+    return "\n".join(lines) + "\n"
+
+
+def objc_interface(width):
+    """One interface with width properties and width method declarations,
+    plus the implementation, to scale decl-heavy ObjC dumps."""
+    lines = [
+        "// generated by gen_stress_corpus.py; do not edit",
+        "// root class on purpose: no sdk import needed",
+        "@interface Stress",
+    ]
+    for i in range(width):
+        lines.append("@property int prop%d;" % i)
+    for i in range(width):
+        lines.append("- (int)method%d:(int)x;" % i)
+    lines.append("@end")
+    lines.append("@implementation Stress")
+    for i in range(width):
+        lines.append("- (int)method%d:(int)x { return x + %d; }" % (i, i))
+    lines.append("@end")
+    return "\n".join(lines) + "\n"
+
+
+def init_list(elems):
+    """A global array with elems literal initializers, the generated-code
+    shape MAX_INIT_LIST_ELEMS exists for."""
+    lines = [
+        "// generated by gen_stress_corpus.py; do not edit",
+        "int stress_table[%d] = {" % elems,
+    ]
+    per_line = 16
+    for start in range(0, elems, per_line):
+        row = ", ".join(str(i % 251) for i in range(start,
+                                                    min(start + per_line,
+                                                        elems)))
+        lines.append("    " + row + ",")
+    lines.append("};")
+    return "\n".join(lines) + "\n"
+
+
+def ladder(top, steps):
+    """Geometric size ladder ending at top, e.g. 1000 -> [10, 100, 1000]."""
+    sizes = []
+    size = top
+    for _ in range(steps):
+        sizes.append(size)
+        size //= 10
+        if size == 0:
+            break
+    return sorted(sizes)
+
+
+def write(outdir, name, contents):
+    path = os.path.join(outdir, name)
+    with open(path, "w") as f:
+        f.write(contents)
+    print("[+] %s (%d bytes)" % (path, len(contents)))
+
+
+def main():
+    arg_parser = argparse.ArgumentParser(
+        description='Synthesize stress translation units for the exporter '
+                    'benchmark')
+    arg_parser.add_argument('--outdir', default='build/ast_samples',
+                            help='output directory (default: '
+                                 'build/ast_samples)')
+    arg_parser.add_argument('--template-depth', type=int, default=200,
+                            help='deepest template nest (default: 200)')
+    arg_parser.add_argument('--objc-width', type=int, default=1000,
+                            help='widest ObjC interface (default: 1000)')
+    arg_parser.add_argument('--init-list-elems', type=int, default=100000,
+                            help='largest initializer list (default: 100000)')
+    arg_parser.add_argument('--steps', type=int, default=3,
+                            help='sizes per shape, spaced by 10x '
+                                 '(default: 3)')
+    args = arg_parser.parse_args()
+
+    os.makedirs(args.outdir, exist_ok=True)
+    for depth in ladder(args.template_depth, args.steps):
+        write(args.outdir, "stress_template_depth_%d.cpp" % depth,
+              template_nest(depth))
+    for width in ladder(args.objc_width, args.steps):
+        write(args.outdir, "stress_objc_width_%d.m" % width,
+              objc_interface(width))
+    for elems in ladder(args.init_list_elems, args.steps):
+        write(args.outdir, "stress_init_list_%d.c" % elems,
+              init_list(elems))
+
+
+if __name__ == '__main__':
+    main()
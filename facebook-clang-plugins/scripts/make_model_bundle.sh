@@ -0,0 +1,108 @@
+# Copyright (c) Facebook, Inc. and its affiliates.
+#
+# This source code is licensed under the MIT license found in the
+# LICENSE file in the root directory of this source tree.
+
+#!/bin/bash
+
+# Prebuilt model-AST bundle, for deployments that otherwise re-capture
+# the (rarely changing) model sources on every install. 'build'
+# captures every given source deterministically -- stable node ids
+# (AST_WITH_POINTERS=0), canonical decl order, framed decls appended to
+# one pack directory -- and records a manifest of content hashes: the
+# bundle format version, the plugin dylib, the capture options and each
+# source file. 'check' recomputes those hashes against the current tree
+# and exits nonzero on the first mismatch, so install scripts ship the
+# bundle, validate it with 'check', and fall back to source capture
+# only when something actually changed.
+#
+# Usage: CLANG_FRONTEND="clang -fsyntax-only ... -load .../plugin" \
+#        make_model_bundle.sh build BUNDLEDIR FILE...
+#        make_model_bundle.sh check BUNDLEDIR FILE...
+#
+# BUNDLE_PLUGIN selects the exporter (default BiniouASTExporter);
+# MODEL_CFLAGS adds flags to every capture (e.g. -std=c++11 for the
+# C++ models). The pack segments under BUNDLEDIR can be consolidated
+# further with ast_pack_merge.
+
+MODE="$1"
+BUNDLE="$2"
+shift 2
+if { [ "$MODE" != "build" ] && [ "$MODE" != "check" ]; } \
+    || [ -z "$BUNDLE" ] || [ $# -eq 0 ]; then
+    echo "usage: $0 build|check BUNDLEDIR FILE..." >&2
+    exit 2
+fi
+
+BUNDLE_VERSION=1
+P=${BUNDLE_PLUGIN:-BiniouASTExporter}
+CAPTURE_OPTS="AST_WITH_POINTERS=0 CANONICAL_ORDER=1 FRAME_DECLS=1"
+MANIFEST="$BUNDLE/MANIFEST"
+
+hash_file() {
+    if hash sha256sum 2>/dev/null; then
+        sha256sum "$1" | awk '{ print $1 }'
+    else
+        shasum -a 256 "$1" | awk '{ print $1 }'
+    fi
+}
+
+# the plugin dylib is part of the bundle's identity: a new infer build
+# means new serialization, even with unchanged model sources
+plugin_path() {
+    echo "$CLANG_FRONTEND" | tr ' ' '\n' | grep -e '\.dylib$' -e '\.so$' | tail -1
+}
+
+write_manifest() {
+    echo "version $BUNDLE_VERSION"
+    echo "plugin $P"
+    echo "options $CAPTURE_OPTS"
+    DYLIB=$(plugin_path)
+    if [ -n "$DYLIB" ] && [ -e "$DYLIB" ]; then
+        echo "$(hash_file "$DYLIB")  plugin-dylib"
+    fi
+    local SRC
+    for SRC in "$@"; do
+        echo "$(hash_file "$SRC")  $SRC"
+    done
+}
+
+if [ "$MODE" = "check" ]; then
+    if [ ! -f "$MANIFEST" ]; then
+        echo "[!] No bundle manifest at $MANIFEST" >&2
+        exit 1
+    fi
+    if ! write_manifest "$@" | cmp -s - "$MANIFEST"; then
+        echo "[!] Bundle at $BUNDLE does not match the current tree" >&2
+        exit 1
+    fi
+    exit 0
+fi
+
+rm -rf "$BUNDLE"
+mkdir -p "$BUNDLE"
+
+PLUGIN_ARGS="-Xclang -plugin -Xclang $P \
+    -Xclang -plugin-arg-$P -Xclang pack:$BUNDLE"
+for OPT in $CAPTURE_OPTS; do
+    PLUGIN_ARGS="$PLUGIN_ARGS -Xclang -plugin-arg-$P -Xclang $OPT"
+done
+
+STATUS=0
+for SRC in "$@"; do
+    EXTRA_FLAGS="$MODEL_CFLAGS"
+    case "$SRC" in
+    *.m )   EXTRA_FLAGS="$EXTRA_FLAGS -ObjC -fblocks $IOSFLAGS" ;;
+    *.mm )  EXTRA_FLAGS="$EXTRA_FLAGS -ObjC++ -fblocks $IOSFLAGS" ;;
+    esac
+    if ! $CLANG_FRONTEND $EXTRA_FLAGS $PLUGIN_ARGS -c "$SRC"; then
+        echo "[!] Capture failed for $SRC" >&2
+        STATUS=1
+    fi
+done
+if [ $STATUS -ne 0 ]; then
+    exit $STATUS
+fi
+
+write_manifest "$@" > "$MANIFEST"
+echo "[*] Bundle written to $BUNDLE ($# sources)"
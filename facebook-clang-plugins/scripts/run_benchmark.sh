@@ -0,0 +1,120 @@
+# Copyright (c) Facebook, Inc. and its affiliates.
+#
+# This source code is licensed under the MIT license found in the
+# LICENSE file in the root directory of this source tree.
+
+#!/bin/bash
+
+# Capture throughput benchmark. For every source file given, runs the
+# exporter plugins over it BENCH_ITERATIONS times (default 3), keeps the
+# best wall time, and reports nodes/sec, MB/sec and peak RSS. Also
+# writes a machine-readable baseline to $OUTDIR/baseline.json so runs
+# can be diffed between commits.
+#
+# Usage: CLANG_FRONTEND="clang -fsyntax-only ... -load .../plugin" \
+#        run_benchmark.sh OUTDIR FILE...
+#
+# Nodes are approximated by the number of "pointer" fields of the Json
+# dump, which every AST node carries exactly once (AST_WITH_POINTERS=1).
+
+OUTDIR="$1"
+shift
+
+ITERATIONS=${BENCH_ITERATIONS:-3}
+PLUGINS="JsonASTExporter BiniouASTExporter"
+BASELINE="$OUTDIR/baseline.json"
+
+# best-of-N wall time of "$@", in seconds with millisecond resolution
+measure() {
+    local best=""
+    local i
+    for i in $(seq 1 $ITERATIONS); do
+        local t
+        TIMEFORMAT='%3R'
+        t=$( { time "$@" > /dev/null 2>&1; } 2>&1 | tail -n 1 )
+        if [ -z "$best" ] || awk "BEGIN { exit !($t < $best) }"; then
+            best="$t"
+        fi
+    done
+    echo "$best"
+}
+
+# peak RSS in kB of "$@" (GNU and BSD time formats), empty if unknown
+peak_rss() {
+    local out
+    if out=$(/usr/bin/time -v "$@" 2>&1 > /dev/null); then
+        echo "$out" | awk '/Maximum resident set size/ { print $NF; exit }'
+    elif out=$(/usr/bin/time -l "$@" 2>&1 > /dev/null); then
+        # BSD reports bytes; convert to kB like GNU
+        echo "$out" | awk '/maximum resident set size/ { print int($1 / 1024); exit }'
+    fi
+}
+
+mkdir -p "$OUTDIR"
+echo "[" > "$BASELINE"
+FIRST=1
+
+for SRC in "$@"; do
+    NAME=$(basename "$SRC")
+    if [ "$BENCH_NAMES" = "path" ]; then
+        # corpora spanning several directories collide on basenames
+        # (every app has a main.m); key reports by the flattened path
+        NAME=${SRC##*../}
+        NAME=${NAME//\//_}
+    fi
+    EXTRA_FLAGS=""
+    case "$SRC" in
+    *.m )
+        if [ "$HAS_OBJC" = "no" ]; then
+            echo "[~] $NAME skipped (no Objective-C support)"
+            continue
+        fi
+        EXTRA_FLAGS="-ObjC -fblocks $IOSFLAGS"
+        ;;
+    *.cpp )
+        EXTRA_FLAGS="--std=c++14"
+        ;;
+    *.mm )
+        if [ "$HAS_OBJC" = "no" ]; then
+            echo "[~] $NAME skipped (no Objective-C support)"
+            continue
+        fi
+        EXTRA_FLAGS="--std=c++14 -ObjC++ -fblocks $IOSFLAGS"
+        ;;
+    esac
+
+    NODES=""
+    for PLUGIN in $PLUGINS; do
+        OUT="$OUTDIR/$NAME.$PLUGIN.out"
+        CMD="$CLANG_FRONTEND $EXTRA_FLAGS \
+             -Xclang -plugin -Xclang $PLUGIN \
+             -Xclang -plugin-arg-$PLUGIN -Xclang $OUT \
+             -Xclang -plugin-arg-$PLUGIN -Xclang AST_WITH_POINTERS=1 \
+             -c $SRC"
+        if ! $CMD > /dev/null 2>&1; then
+            echo "[-] $NAME failed under $PLUGIN"
+            continue
+        fi
+        if [ "$PLUGIN" = "JsonASTExporter" ]; then
+            # every node carries exactly one "pointer" field
+            NODES=$(grep -o '"pointer"' "$OUT" | wc -l | tr -d ' ')
+        fi
+        SECS=$(measure $CMD)
+        RSS=$(peak_rss $CMD)
+        BYTES=$(wc -c < "$OUT" | tr -d ' ')
+        rm -f "$OUT"
+        REPORT=$(awk "BEGIN {
+            printf \"%.0f nodes/s  %.2f MB/s\", $NODES / $SECS, \
+                $BYTES / $SECS / 1048576 }")
+        echo "[+] $NAME $PLUGIN: ${SECS}s  $REPORT  rss ${RSS:-?}kB"
+        if [ $FIRST = 0 ]; then echo "," >> "$BASELINE"; fi
+        FIRST=0
+        printf '  {"file": "%s", "plugin": "%s", "seconds": %s, "nodes": %s, "bytes": %s, "peak_rss_kb": %s}' \
+            "$NAME" "$PLUGIN" "$SECS" "${NODES:-0}" "$BYTES" "${RSS:-0}" \
+            >> "$BASELINE"
+    done
+done
+
+echo "" >> "$BASELINE"
+echo "]" >> "$BASELINE"
+echo "[+] baseline written to $BASELINE"
@@ -0,0 +1,160 @@
+#!/usr/bin/env python3
+
+
+# Copyright (c) Facebook, Inc. and its affiliates.
+#
+# This source code is licensed under the MIT license found in the
+# LICENSE file in the root directory of this source tree.
+
+import concurrent.futures
+import os
+import shutil
+import subprocess
+import sys
+import time
+
+"""
+Parallel twin of the serial `make test` loop: runs every
+tests/<Plugin>/<name>.exp sample across all cores and aggregates the
+results, so the full correctness suite is cheap enough to run during
+perf work (including the validating DEBUG GenWriter build, which is
+when it matters most). Same inputs and expected outputs as the serial
+target -- each job wraps the plugin invocation in the plugin's
+filter.sh and diffs against the .exp -- but diffs are collected and
+reported together at the end instead of interleaved, with per-test
+timing so the slow samples are visible.
+
+Environment: CLANG_FRONTEND (full command prefix, from the Makefile),
+IOSFLAGS, HAS_OBJC, TEST_JOBS (worker count, default all cores), LIMIT
+(max diff lines per failure, 0 = unlimited).
+"""
+
+
+def extra_flags(source):
+    if source.endswith(".m"):
+        return ["-ObjC", "-fblocks"] + os.environ.get("IOSFLAGS", "").split()
+    if source.endswith(".mm"):
+        return ["--std=c++14", "-ObjC++", "-fblocks"] + os.environ.get(
+            "IOSFLAGS", ""
+        ).split()
+    if source.endswith(".cpp"):
+        return ["--std=c++14"]
+    return []
+
+
+def run_one(plugin, expfile, tmproot):
+    """Run one sample; return (label, ok, seconds, diff_text)."""
+    test = expfile[: -len(".exp")]
+    source = os.path.join("tests", os.path.basename(test))
+    label = "%s/%s" % (plugin, os.path.basename(test))
+    # a private deduplication dir per job: the serial loop shares one
+    # per plugin, which parallel jobs would race on
+    tmpdir = os.path.join(tmproot, plugin + "_" + os.path.basename(test))
+    os.makedirs(tmpdir, exist_ok=True)
+    command = (
+        [os.path.join("tests", plugin, "filter.sh")]
+        + os.environ["CLANG_FRONTEND"].split()
+        + extra_flags(source)
+        + ["-Xclang", "-plugin", "-Xclang", plugin]
+        + ["-Xclang", "-plugin-arg-" + plugin, "-Xclang", "-"]
+        + [
+            "-Xclang",
+            "-plugin-arg-" + plugin,
+            "-Xclang",
+            "USE_TEMP_DIR_FOR_DEDUPLICATION=" + tmpdir,
+        ]
+        + ["-c", source]
+    )
+    env = dict(os.environ)
+    env["CLANG_FRONTEND_PLUGIN__AST_WITH_POINTERS"] = "0"
+    start = time.monotonic()
+    result = subprocess.run(
+        command, stdout=subprocess.PIPE, stderr=subprocess.STDOUT, env=env
+    )
+    seconds = time.monotonic() - start
+    if result.returncode != 0:
+        return (label, False, seconds, "exit status %d" % result.returncode)
+    try:
+        with open(expfile, "rb") as f:
+            expected = f.read()
+    except OSError:
+        expected = b""
+    if result.stdout == expected:
+        return (label, True, seconds, "")
+    diff = subprocess.run(
+        ["diff", expfile, "-"],
+        input=result.stdout,
+        stdout=subprocess.PIPE,
+    ).stdout.decode(errors="replace")
+    limit = int(os.environ.get("LIMIT", "0"))
+    if limit > 0:
+        diff = "\n".join(diff.splitlines()[-limit:]) + "\n"
+    return (label, False, seconds, diff)
+
+
+def main():
+    if len(sys.argv) < 3:
+        print("usage: run_tests_parallel.py TMPROOT PLUGIN...")
+        return 1
+    tmproot = sys.argv[1]
+    plugins = sys.argv[2:]
+
+    jobs = []
+    for plugin in plugins:
+        if plugin == "BiniouASTExporter" and not shutil.which("bdump"):
+            print("[~] %s skipped (no bdump)" % plugin)
+            continue
+        for entry in sorted(os.listdir(os.path.join("tests", plugin))):
+            if not entry.endswith(".exp"):
+                continue
+            source = entry[: -len(".exp")]
+            if os.environ.get("HAS_OBJC") == "no" and (
+                source.endswith(".m") or source.endswith(".mm")
+            ):
+                print("[~] %s skipped (no Objective-C support)" % source)
+                continue
+            jobs.append((plugin, os.path.join("tests", plugin, entry)))
+    if not jobs:
+        print("[-] no tests found")
+        return 1
+
+    shutil.rmtree(tmproot, ignore_errors=True)
+    workers = int(os.environ.get("TEST_JOBS", "0")) or os.cpu_count()
+    failures = []
+    timings = []
+    start = time.monotonic()
+    with concurrent.futures.ThreadPoolExecutor(workers) as pool:
+        futures = [
+            pool.submit(run_one, plugin, expfile, tmproot)
+            for plugin, expfile in jobs
+        ]
+        for future in concurrent.futures.as_completed(futures):
+            label, ok, seconds, diff = future.result()
+            timings.append((seconds, label))
+            if ok:
+                print("[+] %s succeeded (%.2fs)" % (label, seconds))
+            else:
+                print("[-] %s failed" % label)
+                failures.append((label, diff))
+    wall = time.monotonic() - start
+    shutil.rmtree(tmproot, ignore_errors=True)
+
+    timings.sort(reverse=True)
+    print(
+        "[+] %d tests in %.1fs on %d workers; slowest:"
+        % (len(jobs), wall, workers)
+    )
+    for seconds, label in timings[:5]:
+        print("      %6.2fs  %s" % (seconds, label))
+
+    if failures:
+        for label, diff in failures:
+            print("[-] %s" % label)
+            sys.stdout.write(diff)
+        print("[-] %d of %d tests failed" % (len(failures), len(jobs)))
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,222 @@
+#!/usr/bin/env python3
+
+
+# Copyright (c) Facebook, Inc. and its affiliates.
+#
+# This source code is licensed under the MIT license found in the
+# LICENSE file in the root directory of this source tree.
+
+import argparse
+import os
+import random
+import socket
+import subprocess
+import sys
+import time
+
+"""
+Long-run soak of the capture daemon: feeds ast_exporter_daemon a
+shuffled multi-thousand-request stream built by cycling the given
+sources in one process, sampling per-TU latency, RSS and the
+minor-fault rate (a cheap proxy for fresh-page demand) as it goes.
+Single-shot benchmarks miss exactly what hurts a days-long daemon --
+fragmentation, interner growth, cache pollution -- so the run fails
+when the last tenth of the run has drifted beyond thresholds from the
+first, which is the check that the bounded-memory work holds at
+production duration.
+
+Environment: CLANG (target compiler), IOSFLAGS, HAS_OBJC,
+SOAK_REQUESTS (default 2000), SOAK_MEMORY_BUDGET_MB (forwarded to the
+daemon when set), SOAK_RSS_DRIFT_PERCENT (default 25),
+SOAK_LATENCY_DRIFT_PERCENT (default 20). Samples land in
+OUTDIR/soak_samples.tsv for plotting.
+"""
+
+SAMPLE_EVERY = 25
+
+
+def read_proc_stats(pid):
+    """(rss_kb, minor_faults) from /proc, or None off Linux."""
+    try:
+        rss_kb = None
+        with open("/proc/%d/status" % pid) as f:
+            for line in f:
+                if line.startswith("VmRSS:"):
+                    rss_kb = int(line.split()[1])
+                    break
+        with open("/proc/%d/stat" % pid) as f:
+            minflt = int(f.read().split()[9])
+        if rss_kb is None:
+            return None
+        return (rss_kb, minflt)
+    except OSError:
+        return None
+
+
+def extra_flags(source):
+    if source.endswith(".m"):
+        return ["-ObjC", "-fblocks"] + os.environ.get("IOSFLAGS", "").split()
+    if source.endswith(".mm"):
+        return ["--std=c++14", "-ObjC++", "-fblocks"] + os.environ.get(
+            "IOSFLAGS", ""
+        ).split()
+    if source.endswith(".cpp"):
+        return ["--std=c++14"]
+    return []
+
+
+def one_request(socket_path, option_lines, command):
+    """Send one daemon request, return (ok, seconds)."""
+    start = time.monotonic()
+    client = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    client.connect(socket_path)
+    payload = "".join(line + "\n" for line in option_lines)
+    payload += "--\n"
+    payload += "".join(arg + "\n" for arg in command)
+    payload += "\n"
+    client.sendall(payload.encode())
+    reply = b""
+    while not reply.endswith(b"\n"):
+        chunk = client.recv(64)
+        if not chunk:
+            break
+        reply += chunk
+    client.close()
+    return (reply.strip() == b"OK", time.monotonic() - start)
+
+
+def median(values):
+    ordered = sorted(values)
+    return ordered[len(ordered) // 2]
+
+
+def main():
+    arg_parser = argparse.ArgumentParser(
+        description="Soak the capture daemon over a shuffled corpus"
+    )
+    arg_parser.add_argument("daemon", help="path to ast_exporter_daemon")
+    arg_parser.add_argument("outdir", help="output/scratch directory")
+    arg_parser.add_argument("sources", nargs="+", help="corpus source files")
+    args = arg_parser.parse_args()
+
+    clang = os.environ.get("CLANG", "clang")
+    requests = int(os.environ.get("SOAK_REQUESTS", "2000"))
+    budget_mb = os.environ.get("SOAK_MEMORY_BUDGET_MB", "")
+    rss_drift_limit = float(os.environ.get("SOAK_RSS_DRIFT_PERCENT", "25"))
+    latency_drift_limit = float(
+        os.environ.get("SOAK_LATENCY_DRIFT_PERCENT", "20")
+    )
+
+    sources = [
+        s
+        for s in args.sources
+        if not (
+            os.environ.get("HAS_OBJC") == "no"
+            and (s.endswith(".m") or s.endswith(".mm"))
+        )
+    ]
+    if not sources:
+        print("[-] no usable sources")
+        return 1
+
+    os.makedirs(args.outdir, exist_ok=True)
+    socket_path = os.path.join(args.outdir, "soak.sock")
+    daemon = subprocess.Popen([args.daemon, socket_path])
+    for _ in range(100):
+        if os.path.exists(socket_path):
+            break
+        time.sleep(0.1)
+
+    # shuffled but reproducible: every run sees the same interleaving
+    rng = random.Random(0x50AC)
+    stream = []
+    while len(stream) < requests:
+        cycle = sources[:]
+        rng.shuffle(cycle)
+        stream.extend(cycle)
+    stream = stream[:requests]
+
+    option_lines_base = ["FORMAT=biniou"]
+    if budget_mb:
+        option_lines_base.append("MEMORY_BUDGET_MB=" + budget_mb)
+
+    latencies = []
+    samples = []  # (request index, rss_kb, minflt, window median latency)
+    failures = 0
+    try:
+        for i, source in enumerate(stream):
+            out = os.path.join(args.outdir, "soak.out")
+            options = ["OUTPUT_FILE=" + out] + option_lines_base
+            command = [clang, "-fsyntax-only"] + extra_flags(source) + [source]
+            ok, seconds = one_request(socket_path, options, command)
+            if not ok:
+                failures += 1
+            latencies.append(seconds)
+            if (i + 1) % SAMPLE_EVERY == 0:
+                stats = read_proc_stats(daemon.pid)
+                window = median(latencies[-SAMPLE_EVERY:])
+                if stats:
+                    samples.append((i + 1, stats[0], stats[1], window))
+                else:
+                    samples.append((i + 1, 0, 0, window))
+    finally:
+        try:
+            one_request(socket_path, ["QUIT"], [])
+        except OSError:
+            daemon.terminate()
+        daemon.wait()
+
+    with open(os.path.join(args.outdir, "soak_samples.tsv"), "w") as f:
+        f.write("request\trss_kb\tminor_faults\twindow_median_s\n")
+        for row in samples:
+            f.write("%d\t%d\t%d\t%.4f\n" % row)
+
+    if failures:
+        print("[-] %d of %d requests failed" % (failures, len(stream)))
+        return 1
+    if len(samples) < 10:
+        print("[~] run too short for drift detection; no verdict")
+        return 0
+
+    # first tenth is warmup and reference, last tenth the verdict
+    tenth = max(1, len(samples) // 10)
+    head, tail = samples[:tenth], samples[-tenth:]
+    verdict = 0
+
+    head_lat = median([s[3] for s in head])
+    tail_lat = median([s[3] for s in tail])
+    lat_drift = 100.0 * (tail_lat - head_lat) / head_lat
+    print(
+        "[+] latency: %.4fs -> %.4fs (%+.1f%%)"
+        % (head_lat, tail_lat, lat_drift)
+    )
+    if lat_drift > latency_drift_limit:
+        print("[-] latency drift beyond %.0f%%" % latency_drift_limit)
+        verdict = 1
+
+    if any(s[1] for s in samples):
+        head_rss = median([s[1] for s in head])
+        tail_rss = median([s[1] for s in tail])
+        rss_drift = 100.0 * (tail_rss - head_rss) / head_rss
+        # fault rate over the steady state: growth means the daemon
+        # keeps demanding fresh pages instead of reusing its own
+        fault_rate = (tail[-1][2] - head[-1][2]) / max(
+            1, tail[-1][0] - head[-1][0]
+        )
+        print(
+            "[+] rss: %dkB -> %dkB (%+.1f%%), %.0f minor faults/request"
+            % (head_rss, tail_rss, rss_drift, fault_rate)
+        )
+        if rss_drift > rss_drift_limit:
+            print("[-] rss drift beyond %.0f%%" % rss_drift_limit)
+            verdict = 1
+    else:
+        print("[~] no /proc on this platform; rss drift not checked")
+
+    if verdict == 0:
+        print("[+] soak stable over %d requests" % len(stream))
+    return verdict
+
+
+if __name__ == "__main__":
+    sys.exit(main())
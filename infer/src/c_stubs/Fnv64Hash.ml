@@ -6,3 +6,6 @@
  *)
 
 external fnv64_hash : string -> string = "fnv64_hash"
+
+(** XXH64 with seed 0, matching what the clang plugin emits when USE_XXHASH is on *)
+external xxh64_hash : string -> string = "xxh64_hash"
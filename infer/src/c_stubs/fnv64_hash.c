@@ -29,3 +29,103 @@ CAMLprim value fnv64_hash(value c) {
   snprintf(str, 21, "%" PRIu64, hashed);
   return caml_copy_string(str);
 }
+
+// 64 bits xxHash (XXH64, seed 0). Must stay in sync with llvm::xxHash64,
+// which the clang plugin uses when USE_XXHASH is on; reads are
+// little-endian regardless of the host.
+#define XXH64_P1 11400714785074694791ULL
+#define XXH64_P2 14029467366897019727ULL
+#define XXH64_P3 1609587929392839161ULL
+#define XXH64_P4 9650029242287828579ULL
+#define XXH64_P5 2870177450012600261ULL
+
+static uint64_t xxh64_rotl(uint64_t x, int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t xxh64_round(uint64_t acc, uint64_t input) {
+  acc += input * XXH64_P2;
+  acc = xxh64_rotl(acc, 31);
+  acc *= XXH64_P1;
+  return acc;
+}
+
+static uint64_t xxh64_read64(const unsigned char* p) {
+  uint64_t v = 0;
+  int i;
+  for (i = 7; i >= 0; i--) {
+    v = (v << 8) | p[i];
+  }
+  return v;
+}
+
+static uint32_t xxh64_read32(const unsigned char* p) {
+  uint32_t v = 0;
+  int i;
+  for (i = 3; i >= 0; i--) {
+    v = (v << 8) | p[i];
+  }
+  return v;
+}
+
+uint64_t xxh64_hash_impl(const char* s, size_t len) {
+  const unsigned char* p = (const unsigned char*)s;
+  const unsigned char* end = p + len;
+  uint64_t h;
+  if (len >= 32) {
+    const unsigned char* limit = end - 32;
+    uint64_t v1 = XXH64_P1 + XXH64_P2;
+    uint64_t v2 = XXH64_P2;
+    uint64_t v3 = 0;
+    uint64_t v4 = 0 - XXH64_P1;
+    do {
+      v1 = xxh64_round(v1, xxh64_read64(p));
+      v2 = xxh64_round(v2, xxh64_read64(p + 8));
+      v3 = xxh64_round(v3, xxh64_read64(p + 16));
+      v4 = xxh64_round(v4, xxh64_read64(p + 24));
+      p += 32;
+    } while (p <= limit);
+    h = xxh64_rotl(v1, 1) + xxh64_rotl(v2, 7) + xxh64_rotl(v3, 12) +
+        xxh64_rotl(v4, 18);
+    h ^= xxh64_round(0, v1);
+    h = h * XXH64_P1 + XXH64_P4;
+    h ^= xxh64_round(0, v2);
+    h = h * XXH64_P1 + XXH64_P4;
+    h ^= xxh64_round(0, v3);
+    h = h * XXH64_P1 + XXH64_P4;
+    h ^= xxh64_round(0, v4);
+    h = h * XXH64_P1 + XXH64_P4;
+  } else {
+    h = /* seed */ 0 + XXH64_P5;
+  }
+  h += len;
+  while (p + 8 <= end) {
+    h ^= xxh64_round(0, xxh64_read64(p));
+    h = xxh64_rotl(h, 27) * XXH64_P1 + XXH64_P4;
+    p += 8;
+  }
+  if (p + 4 <= end) {
+    h ^= (uint64_t)xxh64_read32(p) * XXH64_P1;
+    h = xxh64_rotl(h, 23) * XXH64_P2 + XXH64_P3;
+    p += 4;
+  }
+  while (p < end) {
+    h ^= *p * XXH64_P5;
+    h = xxh64_rotl(h, 11) * XXH64_P1;
+    p++;
+  }
+  h ^= h >> 33;
+  h *= XXH64_P2;
+  h ^= h >> 29;
+  h *= XXH64_P3;
+  h ^= h >> 32;
+  return h;
+}
+
+CAMLprim value xxh64_hash(value c) {
+  const char* c_string = String_val(c);
+  uint64_t hashed = xxh64_hash_impl(c_string, caml_string_length(c));
+  char str[21];
+  snprintf(str, 21, "%" PRIu64, hashed);
+  return caml_copy_string(str);
+}
@@ -23,4 +23,17 @@ let test_fnv64_hash_function =
          name >:: create_test test_input expected_output )
 
 
-let tests = "fnv64_hash_function_suite" >::: test_fnv64_hash_function
+let test_xxh64_hash_function =
+  let create_test (input : string) (hashed_input : string) _ =
+    let actual_hashed_value = Fnv64Hash.xxh64_hash input in
+    let cmp s1 s2 = String.equal s1 s2 in
+    assert_equal ~pp_diff:pp_diff_of_hashed_value ~cmp hashed_input actual_hashed_value
+  in
+  (* expected value computed with llvm::xxHash64 *)
+  [("test_correct_xxh64_hash", "_Z4testv", "3598600716422365222")]
+  |> List.map ~f:(fun (name, test_input, expected_output) ->
+         name >:: create_test test_input expected_output )
+
+
+let tests =
+  "fnv64_hash_function_suite" >::: test_fnv64_hash_function @ test_xxh64_hash_function